@@ -18,6 +18,13 @@ const std::uint32_t info_compression_mode = 4;
 const std::uint32_t info_compression_transfer = 8;
 const std::uint32_t info_compression_update = 16;
 
+// compression modes: the images are compressed when imported, in the
+// background at any time, or in the background between the start and stop
+// hours:
+const std::int32_t compression_mode_import = 0;
+const std::int32_t compression_mode_background = 1;
+const std::int32_t compression_mode_scheduled = 2;
+
 struct compression {
   static void create(json& compression, std::uint32_t flags) {
     if (!compression.isObject()) {
@@ -11,6 +11,8 @@ using json = Json::Value;
 #define DI_TYPE_KEY "type"
 #define DI_RESCNT_KEY "rescnt"
 #define DI_RESULT_KEY "result"
+#define DI_PACK_OFFSET_KEY "packoffset"
+#define DI_PACK_SIZE_KEY "packsize"
 
 namespace onis::database {
 
@@ -28,6 +30,9 @@ struct download_image {
     output[DI_TYPE_KEY] = -1;
     output[DI_RESCNT_KEY] = 1;
     output[DI_RESULT_KEY] = EOS_NONE;
+    // range of the file in a series container, -1 for a whole file:
+    output[DI_PACK_OFFSET_KEY] = static_cast<Json::Int64>(-1);
+    output[DI_PACK_SIZE_KEY] = static_cast<Json::Int64>(-1);
   }
 
   static void verify(const json& input, bool with_seq) {
@@ -54,6 +59,11 @@ struct download_image {
     output[DI_TYPE_KEY] = input[DI_TYPE_KEY].asInt();
     output[DI_RESCNT_KEY] = input[DI_RESCNT_KEY].asInt();
     output[DI_RESULT_KEY] = input[DI_RESULT_KEY].asInt();
+    if (input.isMember(DI_PACK_OFFSET_KEY) &&
+        input.isMember(DI_PACK_SIZE_KEY)) {
+      output[DI_PACK_OFFSET_KEY] = input[DI_PACK_OFFSET_KEY].asInt64();
+      output[DI_PACK_SIZE_KEY] = input[DI_PACK_SIZE_KEY].asInt64();
+    }
   }
 };
 }  // namespace onis::database
@@ -34,6 +34,12 @@ using json = Json::Value;
 #define IM_ORIGIN_ID_KEY "oid"
 #define IM_ORIGIN_NAME_KEY "oname"
 #define IM_ORIGIN_IP_KEY "oip"
+#define IM_PIXEL_OFFSET_KEY "pxoffset"
+#define IM_FRAME_COUNT_KEY "frmcnt"
+#define IM_FRAME_TABLE_KEY "frmtable"
+#define IM_PACK_OFFSET_KEY "packoffset"
+#define IM_PACK_SIZE_KEY "packsize"
+#define IM_PIXEL_STATS_KEY "pxstats"
 
 namespace onis::database {
 
@@ -52,6 +58,13 @@ const std::uint32_t info_image_creation = 2048;
 const std::uint32_t info_image_status = 4096;
 const std::uint32_t info_image_stream = 8192;
 // const s32 info_image_stream_detail = 16384;
+const std::uint32_t info_image_pixel_statistics = 32768;
+
+// compression status of the images (cstatus), the version (updatecnt) of the
+// compression rule applied being their cupd:
+const std::int32_t image_compression_failed = -1;
+const std::int32_t image_compression_none = 0;
+const std::int32_t image_compression_done = 1;
 
 struct image {
   static void create(json& image, std::uint32_t flags, bool for_client) {
@@ -120,6 +133,8 @@ struct image {
       image[IM_COMP_STATUS_KEY] = 0;
       image[IM_COMP_UPDATE_KEY] = 0;
     }
+    if (flags & info_image_pixel_statistics)
+      image[IM_PIXEL_STATS_KEY] = Json::Value(Json::nullValue);
   }
 
   static void verify(const json& input, bool with_seq, bool for_client) {
@@ -318,6 +333,13 @@ struct image {
         output[IM_STREAM_PATH_KEY] = input[IM_STREAM_PATH_KEY].asString();
       }
     }
+
+    if (flags & info_image_pixel_statistics) {
+      if ((input_flags & info_image_pixel_statistics) == 0)
+        throw onis::exception(EOS_PARAM,
+                              "Failed to copy the image json object.");
+      output[IM_PIXEL_STATS_KEY] = input[IM_PIXEL_STATS_KEY];
+    }
   }
 };
 
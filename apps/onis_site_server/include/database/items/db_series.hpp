@@ -32,6 +32,7 @@ using json = Json::Value;
 #define SR_PROP_MEDIA_KEY "propmedia"
 #define SR_PROP_PATH_KEY "proppath"
 #define SR_PROP_KEY "properties"
+#define SR_PIXEL_STATS_KEY "pxstats"
 
 namespace onis::database {
 
@@ -51,6 +52,7 @@ const std::uint32_t info_series_status = 8192;
 const std::uint32_t info_series_modality = 16384;
 const std::uint32_t info_series_station = 32768;
 const std::uint32_t info_series_comment = 65536;
+const std::uint32_t info_series_pixel_statistics = 131072;
 
 struct series {
   static void create(json& series, std::uint32_t flags, bool for_client) {
@@ -116,6 +118,9 @@ struct series {
     if (flags & info_series_comment) {
       series[SR_COMMENT_KEY] = "";
     }
+    if (flags & info_series_pixel_statistics) {
+      series[SR_PIXEL_STATS_KEY] = Json::Value(Json::nullValue);
+    }
   }
 
   static void verify(const json& input, bool with_seq, bool for_client) {
@@ -264,6 +269,13 @@ struct series {
       output[SR_IMCNT_KEY] = input[SR_IMCNT_KEY].asInt();
     }
 
+    if (flags & info_series_pixel_statistics) {
+      if ((input_flags & info_series_pixel_statistics) == 0)
+        throw onis::exception(EOS_PARAM,
+                              "Failed to copy the series json object.");
+      output[SR_PIXEL_STATS_KEY] = input[SR_PIXEL_STATS_KEY];
+    }
+
     if (flags & info_series_creation) {
       if ((input_flags & info_series_creation) == 0)
         throw onis::exception(EOS_PARAM,
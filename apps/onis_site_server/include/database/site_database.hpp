@@ -148,6 +148,7 @@ public:
                              std::uint32_t flags, std::string* site_id,
                              json& output);
   void modify_partition(const Json::Value& partition, std::uint32_t flags);
+  void get_partition_seqs(std::vector<std::string>& output);
 
   /*void create_partition_item(onis::odb_record &rec, std::uint32_t flags,
   onis::astring *site_seq, Json::Value &output, onis::aresult &res); void
@@ -260,8 +261,20 @@ public:
   void get_partition_compressions(const std::string& partition_seq,
                                   std::uint32_t flags, lock_mode mode,
                                   Json::Value& output);
-  /*void get_first_hundred_images_to_compress(onis::astring_list& images,
-                                            onis::aresult& res);*/
+  std::string get_images_to_compress(std::int32_t hour,
+                                     const std::string& after_seq,
+                                     std::int32_t limit,
+                                     std::vector<std::string>& seqs);
+  bool find_compression_image_source(const std::string& seq,
+                                     Json::Value& output);
+  bool set_image_compressed(const std::string& seq, std::int32_t media,
+                            const std::string& path,
+                            const std::string& new_path,
+                            const Json::Value& pixel_data,
+                            std::int32_t update);
+  bool set_image_compression_status(const std::string& seq, std::int32_t media,
+                                    const std::string& path,
+                                    std::int32_t status, std::int32_t update);
 
   // patients:
   static std::string get_patient_columns(std::uint32_t flags,
@@ -845,6 +858,10 @@ onis::astring& origin_ip, Json::Value& patient, onis::aresult& res);*/
   void find_image_by_seq(const std::string& seq, std::uint32_t flags,
                          bool for_client, onis::database::lock_mode lock_mode,
                          Json::Value& output, std::string* series_seq);
+  void find_image_location(const std::string& seq, std::uint32_t flags,
+                           onis::database::lock_mode lock_mode,
+                           Json::Value& output, std::string* series_seq,
+                           std::string& partition_seq);
   /*onis::aresult& res); b32 find_image_series(const onis::astring& image_seq,
   u32 series_flags, b32 for_client, s32 lock_mode, Json::Value& output,
                         onis::aresult& res);
@@ -853,21 +870,57 @@ onis::astring& origin_ip, Json::Value& patient, onis::aresult& res);*/
   onis::aresult& res);*/
   bool check_if_sop_already_exist_under_online_or_conflicted_study(
       const std::string& sop, const Json::Value& studies);
+  void find_image_frames(const std::string& seq,
+                         onis::database::lock_mode lock_mode,
+                         Json::Value& output, std::string& partition_seq);
+  void find_series_image_files(const std::string& series_seq,
+                               Json::Value& output);
+  void find_export_images(const std::string& study_seq, Json::Value& output);
+  std::string get_partition_sops(const std::string& partition_seq,
+                                 const std::string& after_seq,
+                                 std::int32_t limit,
+                                 std::vector<std::string>& sops);
   void create_image(
       std::int32_t compression_status, std::int32_t compression_update,
       const std::string& series_seq, const onis::core::date_time& dt,
       const onis::dicom_base_ptr& dataset, std::int32_t image_media,
-      const std::string& image_path, bool create_stream, bool create_icon,
-      const std::string& origin_id, const std::string& origin_name,
-      const std::string& origin_ip, Json::Value& image);
+      const std::string& image_path, const Json::Value& pixel_data,
+      bool create_stream, bool create_icon, const std::string& origin_id,
+      const std::string& origin_name, const std::string& origin_ip,
+      Json::Value& image);
+  void create_images(
+      const std::vector<std::int32_t>& compression_status,
+      std::int32_t compression_update,
+      const std::string& series_seq, const onis::core::date_time& dt,
+      const std::vector<onis::dicom_base_ptr>& datasets,
+      std::int32_t image_media, const std::vector<std::string>& image_paths,
+      const std::vector<Json::Value>& pixel_data, bool create_stream,
+      bool create_icon, const std::string& origin_id,
+      const std::string& origin_name, const std::string& origin_ip,
+      std::vector<Json::Value>& images);
   std::unique_ptr<onis_kit::database::database_query>
   create_image_insertion_query(
       std::int32_t compression_status, std::int32_t compression_update,
       const std::string& series_seq, const onis::core::date_time& dt,
       const onis::dicom_base_ptr& dataset, std::int32_t image_media,
-      const std::string& image_path, bool create_stream, bool create_icon,
+      const std::string& image_path, const Json::Value& pixel_data,
+      bool create_stream, bool create_icon, const std::string& origin_id,
+      const std::string& origin_name, const std::string& origin_ip,
+      Json::Value& image);
+  static std::string get_image_insertion_values();
+  void bind_image_insertion_parameters(
+      std::unique_ptr<onis_kit::database::database_query>& query,
+      std::int32_t& index, std::int32_t compression_status,
+      std::int32_t compression_update, const std::string& series_seq,
+      const onis::core::date_time& dt, const onis::dicom_base_ptr& dataset,
+      std::int32_t image_media, const std::string& image_path,
+      const Json::Value& pixel_data, bool create_stream, bool create_icon,
       const std::string& origin_id, const std::string& origin_name,
       const std::string& origin_ip, Json::Value& image);
+  void set_image_frames(const std::string& seq, const Json::Value& pixel_data);
+  void bind_pixel_data_parameters(
+      std::unique_ptr<onis_kit::database::database_query>& query,
+      std::int32_t& index, const Json::Value& pixel_data);
   /*void modify_image(const Json::Value& image, u32 flags, onis::aresult& res);
   void modify_image_uid(const onis::astring& seq, const onis::astring& uid,
                         onis::aresult& res);
@@ -920,17 +973,130 @@ onis::astring& origin_ip, Json::Value& patient, onis::aresult& res);*/
   void create_download_image_item(const onis_kit::database::database_row& rec,
                                   Json::Value& output);
   std::unique_ptr<onis_kit::database::database_query>
-  create_download_image_insertion_query(const std::string& series_seq,
-                                        std::int32_t num,
-                                        const std::string& path,
-                                        std::int32_t type, std::int32_t rescnt,
-                                        std::int32_t error,
-                                        Json::Value& output);
+  create_download_image_insertion_query(
+      const std::string& series_seq, std::int32_t num, const std::string& path,
+      std::int32_t type, std::int32_t rescnt, std::int32_t error,
+      std::int64_t pack_offset, std::int64_t pack_size, Json::Value& output);
   void create_download_image(const std::string& series_seq, std::int32_t num,
                              const std::string& path, std::int32_t type,
                              std::int32_t rescnt, std::int32_t error,
+                             std::int64_t pack_offset, std::int64_t pack_size,
                              Json::Value& output);
 
+  // counter deltas (the patient, study and series counters changed by the
+  // imports, applied later):
+  void create_counter_delta(const std::string& patient_seq,
+                            const std::string& study_seq,
+                            const std::string& series_seq,
+                            std::int32_t patient_studies,
+                            std::int32_t patient_series,
+                            std::int32_t patient_images, std::int32_t series,
+                            std::int32_t images, bool update_study_summary);
+  std::size_t apply_counter_deltas(std::int32_t limit);
+  // adds the deltas not applied yet to the counters of a find_studies result:
+  void add_pending_counter_deltas(Json::Value& studies);
+
+  // derived objects (the stream files, icons and pixel statistics created
+  // after the imports):
+  std::string get_pending_derived_images(const std::string& after_seq,
+                                         std::int32_t limit,
+                                         bool pixel_statistics,
+                                         std::vector<std::string>& seqs);
+  bool find_derived_image_source(const std::string& seq, Json::Value& output);
+  bool set_image_stream(const std::string& seq, std::int32_t media,
+                        const std::string& path);
+  bool set_image_icon(const std::string& seq, std::int32_t media,
+                      const std::string& path);
+  bool set_series_icon(const std::string& seq, std::int32_t media,
+                       const std::string& path);
+  bool set_image_pixel_statistics(const std::string& seq,
+                                  const std::string& statistics);
+  void get_series_pixel_statistics(const std::string& seq,
+                                   onis::database::lock_mode lock,
+                                   Json::Value& output);
+  void set_series_pixel_statistics(const std::string& seq,
+                                   const std::string& statistics);
+
+  // contents (the files stored once, when the deduplication is enabled):
+  bool acquire_content(const std::string& partition_seq, std::int32_t media,
+                       const std::string& hash, std::int64_t size,
+                       const std::string& path,
+                       const onis::core::date_time& dt, Json::Value& output);
+  void set_images_content(const std::vector<std::string>& image_seqs,
+                          const std::vector<std::string>& content_seqs);
+  bool release_image_content(const std::string& image_seq);
+  static std::string get_unshared_file_clause();
+  std::size_t collect_contents(std::int32_t limit,
+                               std::vector<Json::Value>& contents);
+  void get_content_statistics(Json::Value& output);
+
+  // file releases (the replaced files, deleted after a delay):
+  void add_file_release(const std::string& volume_seq, std::int32_t media,
+                        const std::string& path, std::int32_t delay);
+  void get_due_file_releases(std::int32_t limit,
+                             std::vector<Json::Value>& releases);
+  void cancel_file_release(const std::string& volume_seq, std::int32_t media,
+                           const std::string& path);
+  void delete_file_releases(const std::vector<std::string>& seqs);
+
+  // tiering (the series moved between the media of their volume):
+  void set_series_access(const std::string& series_seq);
+  std::string get_series_to_migrate(const std::string& partition_seq,
+                                    std::int32_t media,
+                                    std::int32_t min_age_days,
+                                    std::int32_t min_idle_days,
+                                    const std::string& after_seq,
+                                    std::int32_t limit,
+                                    std::vector<std::string>& seqs);
+  bool find_migration_files(const std::string& series_seq,
+                            Json::Value& output);
+  bool set_image_file_media(const std::string& seq, std::int32_t kind,
+                            std::int32_t from_media, std::int32_t to_media,
+                            const std::string& path);
+  void redirect_series_downloads(const std::string& series_seq,
+                                 const std::string& path,
+                                 const std::string& new_path);
+  bool is_image_file_used(const std::string& series_seq, std::int32_t kind,
+                          std::int32_t media, const std::string& path);
+
+  // packing (the completed series stored in a container):
+  std::string get_series_to_pack(std::int32_t min_idle_hours,
+                                 std::int32_t min_instances,
+                                 const std::string& after_seq,
+                                 std::int32_t limit,
+                                 std::vector<std::string>& seqs);
+  bool find_packing_images(const std::string& series_seq, Json::Value& output);
+  std::string find_series_container(const std::string& series_seq,
+                                    std::int32_t media);
+  bool lock_series_container(const std::string& series_seq,
+                             std::int32_t media, const std::string& path);
+  bool set_image_packed(const std::string& seq, std::int32_t media,
+                        const std::string& path,
+                        const std::string& container_path,
+                        std::uint64_t offset, std::uint64_t size);
+  void redirect_packed_downloads(const std::string& series_seq,
+                                 const std::string& path,
+                                 const std::string& container_path,
+                                 std::uint64_t offset, std::uint64_t size);
+
+  // consistency checks (the media folders compared with the database):
+  std::string get_check_images(const std::string& partition_seq,
+                               const std::string& after_seq,
+                               std::int32_t limit, Json::Value& output);
+  std::string get_check_series_icons(const std::string& partition_seq,
+                                     const std::string& after_seq,
+                                     std::int32_t limit, Json::Value& output);
+  std::string get_check_contents(const std::string& volume_seq,
+                                 const std::string& after_seq,
+                                 std::int32_t limit, Json::Value& output);
+  bool reset_derived_object(const std::string& seq, std::int32_t kind,
+                            std::int32_t media, const std::string& path);
+  std::string get_counter_mismatches(const std::string& level,
+                                     const std::string& partition_seq,
+                                     const std::string& after_seq,
+                                     std::int32_t limit, Json::Value& output);
+  bool fix_counters(const std::string& level, const std::string& seq);
+
   // Utilities:
   std::unique_ptr<onis_kit::database::database_query> create_and_prepare_query(
       const std::string& columns, const std::string& from,
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <drogon/HttpController.h>
+#include "../../../include/services/config/config_service.hpp"
 #include "../../../include/services/requests/request_service.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -14,8 +15,10 @@ class http_drogon_controller
     : public drogon::HttpController<http_drogon_controller, false> {
 public:
   // constructors:
-  static http_drogon_controller_ptr create(const request_service_ptr& srv);
-  http_drogon_controller(const request_service_ptr& srv);
+  static http_drogon_controller_ptr create(const request_service_ptr& srv,
+                                           const config_service_ptr& config);
+  http_drogon_controller(const request_service_ptr& srv,
+                         const config_service_ptr& config);
 
   // cleanup:
   ~http_drogon_controller();
@@ -31,10 +34,30 @@ public:
                 drogon::Post);
   ADD_METHOD_TO(http_drogon_controller::dicom_import, "/dicom/import",
                 drogon::Post);
+  ADD_METHOD_TO(http_drogon_controller::get_import_job, "/dicom/import/{1}",
+                drogon::Get);
   ADD_METHOD_TO(http_drogon_controller::init_series_download,
                 "/series/download", drogon::Post);
   ADD_METHOD_TO(http_drogon_controller::download_images, "/images/download",
                 drogon::Post);
+  ADD_METHOD_TO(http_drogon_controller::get_image_file, "/images/{1}/file",
+                drogon::Get, drogon::Head);
+  ADD_METHOD_TO(http_drogon_controller::get_image_frames,
+                "/images/{1}/frames", drogon::Get);
+  ADD_METHOD_TO(http_drogon_controller::get_image_frame_data,
+                "/images/{1}/frames/{2}", drogon::Get, drogon::Head);
+  ADD_METHOD_TO(http_drogon_controller::get_image_preview,
+                "/images/{1}/preview", drogon::Get);
+  ADD_METHOD_TO(http_drogon_controller::get_series_metadata,
+                "/series/{1}/metadata", drogon::Get);
+  ADD_METHOD_TO(http_drogon_controller::get_statistics, "/server/statistics",
+                drogon::Post);
+  ADD_METHOD_TO(http_drogon_controller::check_archive, "/archive/check",
+                drogon::Post);
+  ADD_METHOD_TO(http_drogon_controller::get_archive_check,
+                "/archive/check/{1}", drogon::Get);
+  ADD_METHOD_TO(http_drogon_controller::export_studies, "/studies/export",
+                drogon::Post);
   METHOD_LIST_END
 
   // Accounts
@@ -55,6 +78,11 @@ public:
       const drogon::HttpRequestPtr& req,
       std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
 
+  void get_import_job(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+      const std::string& id) const;
+
   // Download:
   void init_series_download(
       const drogon::HttpRequestPtr& req,
@@ -64,11 +92,78 @@ public:
       const drogon::HttpRequestPtr& req,
       std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
 
+  void get_image_file(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+      const std::string& seq) const;
+
+  void get_image_frames(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+      const std::string& seq) const;
+
+  void get_image_frame_data(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+      const std::string& seq, const std::string& frames) const;
+
+  void get_image_preview(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+      const std::string& seq) const;
+
+  void get_series_metadata(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+      const std::string& seq) const;
+
+  // Statistics:
+  void get_statistics(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
+
+  // Consistency checks:
+  void check_archive(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
+
+  void get_archive_check(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+      const std::string& id) const;
+
+  // Exports:
+  void export_studies(
+      const drogon::HttpRequestPtr& req,
+      std::function<void(const drogon::HttpResponsePtr&)>&& callback) const;
+
 private:
   request_service_ptr rqsrv_;
+  config_service_ptr config_;
 
   void treat_post_request(
       const drogon::HttpRequestPtr& req,
       std::function<void(const drogon::HttpResponsePtr&)>& callback,
       [[maybe_unused]] request_type type) const;
+
+  // JSON response, compressed according to the client Accept-Encoding:
+  drogon::HttpResponsePtr create_json_response(
+      const drogon::HttpRequestPtr& req, const Json::Value& output) const;
+
+  // Body compressed according to the client Accept-Encoding, when it is
+  // large enough:
+  void set_compressed_body(const drogon::HttpRequestPtr& req,
+                           const drogon::HttpResponsePtr& resp,
+                           std::string body) const;
+
+  // Immutable file response (ETag, conditional and range requests), the
+  // served content is the part [offset, offset + size) of the file:
+  drogon::HttpResponsePtr create_file_response(
+      const drogon::HttpRequestPtr& req, const std::string& path,
+      std::uint64_t offset, std::uint64_t size, const std::string& etag,
+      const std::string& content_type,
+      const hot_file_cache::buffer_ptr& content = nullptr) const;
+
+  // HTTP status matching a request error code:
+  static drogon::HttpStatusCode get_error_status(std::int32_t code);
 };
\ No newline at end of file
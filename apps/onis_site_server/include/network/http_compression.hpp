@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+// http_encoding enum
+////////////////////////////////////////////////////////////////////////////////
+
+enum class http_encoding {
+  kIdentity,
+  kGzip,
+  kZstd,
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// http_compression class
+////////////////////////////////////////////////////////////////////////////////
+
+class http_compression {
+public:
+  // negotiation:
+  static bool is_zstd_supported();
+  static http_encoding negotiate(const std::string& accept_encoding);
+  static const char* get_encoding_name(http_encoding encoding);
+
+  // compression (returns false if the body could not be compressed):
+  static bool compress(http_encoding encoding, const std::string& input,
+                       int level, std::string& output);
+
+private:
+  static bool compress_gzip(const std::string& input, int level,
+                            std::string& output);
+  static bool compress_zstd(const std::string& input, int level,
+                            std::string& output);
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// derived_file_cache class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Two levels LRU of the files derived from the images on demand (rendered
+// previews, transcoded files): a byte budgeted one in memory, backed by a
+// byte budgeted one in "folder" that survives the restarts (its files are
+// indexed by "start", from the most recently used). Either level is disabled
+// by a budget of 0. The keys are those of request_coalescer::make_key: they
+// hold everything the file depends on, including the version of its image
+// file, so an entry is never stale and is only removed by the LRU.
+
+class derived_file_cache;
+typedef std::shared_ptr<derived_file_cache> derived_file_cache_ptr;
+
+class derived_file_cache {
+public:
+  using buffer_ptr = std::shared_ptr<const std::vector<char>>;
+
+  // static constructor:
+  static derived_file_cache_ptr create(const std::string& folder,
+                                       std::size_t memory_budget,
+                                       std::size_t disk_budget);
+
+  // constructor:
+  derived_file_cache(const std::string& folder, std::size_t memory_budget,
+                     std::size_t disk_budget);
+
+  // destructor:
+  ~derived_file_cache();
+
+  // prevent copy and move
+  derived_file_cache(const derived_file_cache&) = delete;
+  derived_file_cache& operator=(const derived_file_cache&) = delete;
+  derived_file_cache(derived_file_cache&&) = delete;
+  derived_file_cache& operator=(derived_file_cache&&) = delete;
+
+  // lifecycle (indexes the files left in the folder by the previous runs):
+  void start();
+
+  // access to the content (find returns nullptr when the file must be
+  // created):
+  buffer_ptr find(const std::string& key);
+  void insert(const std::string& key, const buffer_ptr& data);
+
+  // access to the files of the disk level, for the files served as they are
+  // (find_file returns an empty string when the file must be created). A
+  // new file is written to a temporary path, and moved to the cache by
+  // insert_file, which returns its path or an empty string when the file
+  // was not stored (it is then left in place).
+  std::string find_file(const std::string& key);
+  std::string insert_file(const std::string& key, const std::string& path);
+  std::string create_temp_path() const;
+
+  // invalidation:
+  void clear();
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  struct memory_entry {
+    std::string name;
+    buffer_ptr data;
+  };
+  struct disk_entry {
+    std::string name;
+    std::uintmax_t size{0};
+  };
+  typedef std::list<memory_entry> memory_list;
+  typedef std::list<disk_entry> disk_list;
+
+  static std::string get_file_name(const std::string& key);
+  std::string get_file_path(const std::string& name) const;
+  void insert_memory(const std::string& name, const buffer_ptr& data);
+  bool insert_disk(const std::string& name, std::uintmax_t size,
+                   std::vector<std::string>& removed);
+  void erase_disk(disk_list::iterator it);
+  void delete_files(const std::vector<std::string>& names) const;
+
+  std::string folder_;
+  std::size_t memory_budget_;
+  std::size_t disk_budget_;
+
+  mutable std::mutex mutex_;
+  memory_list memory_lru_;  // most recently used first
+  std::unordered_map<std::string, memory_list::iterator> memory_index_;
+  std::size_t memory_bytes_{0};
+  disk_list disk_lru_;  // most recently used first
+  std::unordered_map<std::string, disk_list::iterator> disk_index_;
+  std::uintmax_t disk_bytes_{0};
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> disk_hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+  std::atomic<std::uint64_t> disk_evictions_{0};
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// directory_cache class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Set of the storage directories known to exist, so that the images of a
+// series do not check (and create) their directory again, one metadata call
+// per level, which is a round trip on the network file systems. A directory
+// whose parent is known is created with a single call. An entry is removed
+// when a file cannot be written in its directory, and the whole set is
+// cleared when the media change or when it holds too many directories.
+
+class directory_cache;
+typedef std::shared_ptr<directory_cache> directory_cache_ptr;
+
+class directory_cache {
+public:
+  // static constructor:
+  static directory_cache_ptr create(std::size_t max_entries);
+
+  // constructor:
+  explicit directory_cache(std::size_t max_entries);
+
+  // destructor:
+  ~directory_cache();
+
+  // prevent copy and move
+  directory_cache(const directory_cache&) = delete;
+  directory_cache& operator=(const directory_cache&) = delete;
+  directory_cache(directory_cache&&) = delete;
+  directory_cache& operator=(directory_cache&&) = delete;
+
+  // directories (create_directories returns false if "dir" cannot be
+  // created):
+  bool create_directories(const std::string& dir);
+  void invalidate(const std::string& dir);
+  void clear();
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  bool contains(const std::string& dir) const;
+  void insert(const std::vector<std::string>& dirs);
+
+  std::size_t max_entries_;
+
+  mutable std::shared_mutex mutex_;
+  std::unordered_set<std::string> directories_;
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> created_{0};
+  std::atomic<std::uint64_t> invalidations_{0};
+  std::atomic<std::uint64_t> clears_{0};
+};
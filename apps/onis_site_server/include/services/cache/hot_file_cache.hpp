@@ -0,0 +1,88 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// hot_file_cache class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Byte budgeted LRU of the files recently served by the download stream.
+// A file is only admitted once it was requested "admission_hits" times, so a
+// single pass over a large series does not flush the popular files out of the
+// cache. Cached entries are revalidated against the file size and modification
+// time, so rewritten files (transcoding, migration) are never served stale.
+
+class hot_file_cache;
+typedef std::shared_ptr<hot_file_cache> hot_file_cache_ptr;
+
+class hot_file_cache {
+public:
+  using buffer_ptr = std::shared_ptr<const std::vector<char>>;
+
+  // static constructor:
+  static hot_file_cache_ptr create(std::size_t budget,
+                                   std::size_t max_file_size,
+                                   std::uint32_t admission_hits);
+
+  // constructor:
+  hot_file_cache(std::size_t budget, std::size_t max_file_size,
+                 std::uint32_t admission_hits);
+
+  // destructor:
+  ~hot_file_cache();
+
+  // prevent copy and move
+  hot_file_cache(const hot_file_cache&) = delete;
+  hot_file_cache& operator=(const hot_file_cache&) = delete;
+  hot_file_cache(hot_file_cache&&) = delete;
+  hot_file_cache& operator=(hot_file_cache&&) = delete;
+
+  // access (returns nullptr when the file must be read from disk):
+  buffer_ptr find(const std::string& path);
+  buffer_ptr load(const std::string& path);
+
+  // invalidation:
+  void invalidate(const std::string& path);
+  void clear();
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  struct entry {
+    std::string path;
+    buffer_ptr data;
+    std::uintmax_t file_size{0};
+    std::filesystem::file_time_type write_time;
+  };
+  typedef std::list<entry> entry_list;
+
+  bool is_valid(const entry& item) const;
+  bool should_admit(const std::string& path, std::uintmax_t file_size);
+  void insert(entry&& item);
+  void erase(entry_list::iterator it);
+
+  std::size_t budget_;
+  std::size_t max_file_size_;
+  std::uint32_t admission_hits_;
+
+  mutable std::mutex mutex_;
+  entry_list lru_;  // most recently used first
+  std::unordered_map<std::string, entry_list::iterator> index_;
+  std::unordered_map<std::string, std::uint32_t> frequency_;
+  std::size_t bytes_{0};
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> admissions_{0};
+  std::atomic<std::uint64_t> evictions_{0};
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+////////////////////////////////////////////////////////////////////////////////
+// import_lookup_cache class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Short-lived cache of the patient, study and series where the images of a
+// series were imported, per partition. A modality sends the images of a
+// series one after the other, the following images are then attached to the
+// series without searching the studies and patients matching their uids.
+// Only the locations committed by an import are stored, and only for the
+// studies not in conflict. The rows are still read again and locked by seq,
+// so a stale entry is detected and the import falls back to the full lookup.
+// Each invalidation increases the generation of the partition: a location
+// resolved before it is not stored.
+
+class import_lookup_cache;
+typedef std::shared_ptr<import_lookup_cache> import_lookup_cache_ptr;
+
+class import_lookup_cache {
+public:
+  // location of the images of a series:
+  struct location {
+    std::string patient_seq;
+    std::string study_seq;
+    std::string series_seq;
+    std::string identity;  // patient and study attributes of the images
+    Json::Value studies;   // online and conflicted studies with the study uid
+  };
+
+  // static constructor:
+  static import_lookup_cache_ptr create(std::chrono::seconds ttl,
+                                        std::size_t max_series);
+
+  // constructor:
+  import_lookup_cache(std::chrono::seconds ttl, std::size_t max_series);
+
+  // destructor:
+  ~import_lookup_cache();
+
+  // prevent copy and move
+  import_lookup_cache(const import_lookup_cache&) = delete;
+  import_lookup_cache& operator=(const import_lookup_cache&) = delete;
+  import_lookup_cache(import_lookup_cache&&) = delete;
+  import_lookup_cache& operator=(import_lookup_cache&&) = delete;
+
+  // series:
+  std::uint64_t get_generation(const std::string& partition_seq);
+  bool find(const std::string& partition_seq, const std::string& study_uid,
+            const std::string& series_uid, location& output);
+  void store(const std::string& partition_seq, const std::string& study_uid,
+             const std::string& series_uid, const location& item,
+             std::uint64_t generation);
+
+  // compressions of the partitions:
+  bool find_compressions(const std::string& partition_seq,
+                         Json::Value& output);
+  void store_compressions(const std::string& partition_seq,
+                          const Json::Value& compressions);
+
+  // invalidation:
+  void invalidate_study(const std::string& partition_seq,
+                        const std::string& study_uid);
+  void invalidate_partition(const std::string& partition_seq);
+  void clear();
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  struct series_entry {
+    location item;
+    clock::time_point expiration;
+  };
+
+  struct partition_entry {
+    std::uint64_t generation{0};
+    std::unordered_map<std::string, series_entry> series;
+    bool has_compressions{false};
+    Json::Value compressions;
+    clock::time_point compressions_expiration;
+  };
+
+  bool is_enabled() const;
+  static std::string make_key(const std::string& study_uid,
+                              const std::string& series_uid);
+  void prune(clock::time_point now);
+
+  std::chrono::seconds ttl_;
+  std::size_t max_series_;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, partition_entry> partitions_;
+  std::size_t series_count_{0};
+
+  std::atomic<std::uint64_t> hits_{0};
+  std::atomic<std::uint64_t> misses_{0};
+  std::atomic<std::uint64_t> invalidations_{0};
+};
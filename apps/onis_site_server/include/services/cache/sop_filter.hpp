@@ -0,0 +1,122 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// sop_filter class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Bloom filter of the SOP Instance UIDs stored in each partition, so that the
+// database is only searched for a duplicate when the filter reports a
+// possible hit. The filters are built in the background from the database,
+// and the imported sops are added as they are inserted (before the commit:
+// a rolled back insert only leaves a false positive). The sops inserted by
+// the transactions still running are kept until they are released, and
+// added to a filter when its build starts, as its reads may not see them.
+// A filter has no false negative, so a partition whose filter is not built
+// yet always reports a possible hit. The deleted sops cannot be removed, the
+// partition is then invalidated and its filter built again. A filter that
+// holds more sops than it was sized for is rebuilt twice as large.
+
+class sop_filter;
+typedef std::shared_ptr<sop_filter> sop_filter_ptr;
+
+class sop_filter {
+public:
+  // reads the sops of a partition, stops when "add" returns false:
+  using add_fn = std::function<bool(const std::string& sop)>;
+  using loader_fn =
+      std::function<void(const std::string& partition_seq, const add_fn& add)>;
+  using partitions_fn = std::function<void(std::vector<std::string>& seqs)>;
+
+  // static constructor:
+  static sop_filter_ptr create(std::uint32_t bits_per_sop,
+                               std::size_t min_capacity);
+
+  // constructor:
+  sop_filter(std::uint32_t bits_per_sop, std::size_t min_capacity);
+
+  // destructor:
+  ~sop_filter();
+
+  // prevent copy and move
+  sop_filter(const sop_filter&) = delete;
+  sop_filter& operator=(const sop_filter&) = delete;
+  sop_filter(sop_filter&&) = delete;
+  sop_filter& operator=(sop_filter&&) = delete;
+
+  // lifecycle (start builds the filters of all the partitions):
+  bool is_enabled() const;
+  void start(const partitions_fn& partitions, const loader_fn& loader);
+  void stop();
+
+  // access:
+  bool may_contain(const std::string& partition_seq, const std::string& sop);
+  void insert(const std::string& partition_seq, const std::string& sop);
+  void release(const std::string& partition_seq,
+               const std::vector<std::string>& sops);
+
+  // invalidation (after sops were deleted from the partition):
+  void invalidate_partition(const std::string& partition_seq);
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  struct bloom {
+    std::vector<std::uint64_t> bits;
+    std::uint64_t bit_count{0};
+    std::uint32_t hash_count{0};
+    std::size_t capacity{0};
+    std::size_t count{0};
+
+    bloom(std::size_t capacity, std::uint32_t bits_per_sop);
+    void add(const std::string& sop);
+    bool test(const std::string& sop) const;
+  };
+  typedef std::shared_ptr<bloom> bloom_ptr;
+
+  struct partition_entry {
+    bloom_ptr current;  // built filter
+    bloom_ptr next;     // filter being built, receives the inserts too
+    std::unordered_multiset<std::string> in_flight;
+    bool queued{false};
+    std::chrono::steady_clock::time_point retry_at;
+  };
+
+  void worker();
+  void build(const std::string& partition_seq);
+  void schedule(const std::string& partition_seq, partition_entry& entry);
+
+  std::uint32_t bits_per_sop_;
+  std::size_t min_capacity_;
+
+  partitions_fn partitions_;
+  loader_fn loader_;
+  std::thread worker_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::unordered_map<std::string, partition_entry> entries_;
+  std::deque<std::string> pending_;
+  bool running_{false};
+  bool stopping_{false};
+
+  std::atomic<std::uint64_t> checks_{0};
+  std::atomic<std::uint64_t> negatives_{0};
+  std::atomic<std::uint64_t> unknown_{0};
+  std::atomic<std::uint64_t> builds_{0};
+};
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <json/json.h>
+#include <cstddef>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
@@ -41,6 +44,102 @@ public:
   std::string get_ssl_certificate_file() const;
   std::string get_ssl_private_key_file() const;
 
+  // HTTP compression configuration
+  bool is_compression_enabled() const;
+  std::size_t get_compression_min_size() const;
+  int get_compression_gzip_level() const;
+  int get_compression_zstd_level() const;
+
+  // cache configuration
+  std::size_t get_hot_file_cache_budget() const;
+  std::size_t get_hot_file_cache_max_file_size() const;
+  std::uint32_t get_hot_file_cache_admission_hits() const;
+  std::uint32_t get_import_lookup_cache_ttl() const;
+  std::size_t get_import_lookup_cache_max_series() const;
+  std::uint32_t get_sop_filter_bits_per_sop() const;
+  std::size_t get_sop_filter_min_capacity() const;
+  std::size_t get_directory_cache_max_entries() const;
+  std::string get_preview_cache_folder() const;
+  std::size_t get_preview_cache_memory_budget() const;
+  std::size_t get_preview_cache_disk_budget() const;
+  std::uint32_t get_preview_max_size() const;
+  std::uint32_t get_preview_default_size() const;
+  std::string get_transcoded_cache_folder() const;
+  std::size_t get_transcoded_cache_budget() const;
+  std::string get_metadata_cache_folder() const;
+  std::size_t get_metadata_cache_memory_budget() const;
+  std::size_t get_metadata_cache_disk_budget() const;
+
+  // import configuration
+  std::string get_import_spool_folder() const;
+  std::uint32_t get_import_workers() const;
+  std::size_t get_import_max_pending() const;
+  std::uint32_t get_import_max_attempts() const;
+  std::uint32_t get_import_retention_hours() const;
+  std::size_t get_import_batch_size() const;
+  std::uint32_t get_import_aggregate_interval() const;
+  std::size_t get_import_aggregate_batch_size() const;
+  std::size_t get_import_lock_stripes() const;
+
+  // derived objects configuration (J2K stream files, icons and pixel
+  // statistics)
+  std::uint32_t get_derived_workers() const;
+  std::uint32_t get_derived_stream_resolutions() const;
+  std::uint32_t get_derived_stream_layers() const;
+  std::uint32_t get_derived_icon_size() const;
+  std::size_t get_derived_max_queued() const;
+  std::size_t get_derived_scan_batch_size() const;
+  std::uint32_t get_derived_backlog_delay() const;
+  std::uint32_t get_derived_rescan_interval() const;
+  bool is_pixel_statistics_enabled() const;
+  std::uint32_t get_pixel_histogram_bins() const;
+
+  // image compression configuration (pacs_compressions rules)
+  std::uint32_t get_image_compression_workers() const;
+  std::size_t get_image_compression_scan_batch_size() const;
+  std::uint32_t get_image_compression_rescan_interval() const;
+  std::uint32_t get_image_compression_release_delay() const;
+
+  // transcoding configuration (images retrieved in another transfer syntax)
+  std::uint32_t get_transcoding_workers() const;
+  std::size_t get_transcoding_max_pending() const;
+
+  // deduplication configuration (files stored once per content)
+  bool is_deduplication_enabled() const;
+  std::uint32_t get_deduplication_gc_interval() const;
+  std::size_t get_deduplication_gc_batch_size() const;
+
+  // file release configuration (replaced files deleted after a delay)
+  std::uint32_t get_file_release_interval() const;
+  std::size_t get_file_release_batch_size() const;
+
+  // tiering configuration (series moved between the media of a volume)
+  const Json::Value& get_tiering_rules() const;
+  std::uint32_t get_tiering_interval() const;
+  std::size_t get_tiering_batch_size() const;
+  std::uint64_t get_tiering_max_bytes_per_second() const;
+  std::uint32_t get_tiering_release_delay() const;
+
+  // packing configuration (completed series stored in a single container)
+  bool is_packing_enabled() const;
+  std::uint32_t get_packing_interval() const;
+  std::size_t get_packing_batch_size() const;
+  std::uint32_t get_packing_min_idle_hours() const;
+  std::uint32_t get_packing_min_instances() const;
+  std::uint32_t get_packing_release_delay() const;
+
+  // archive check configuration (media folders compared with the database)
+  std::uint32_t get_archive_check_threads() const;
+  std::size_t get_archive_check_max_pending() const;
+  std::uint32_t get_archive_check_retention_hours() const;
+  std::uint32_t get_archive_check_min_file_age() const;
+  std::uint32_t get_archive_check_max_reported() const;
+
+  // export configuration (studies streamed as ZIP archives)
+  std::uint32_t get_export_readers() const;
+  std::size_t get_export_max_buffered() const;
+  std::uint32_t get_export_max_concurrent() const;
+
   // configuration validation
   bool is_valid() const;
   std::string get_last_error() const;
@@ -69,8 +168,127 @@ private:
     std::string ssl_private_key_file;
   };
 
+  struct compression_config {
+    bool enabled;
+    std::size_t min_size;
+    int gzip_level;
+    int zstd_level;
+  };
+
+  struct cache_config {
+    std::size_t hot_file_budget_mb;
+    std::size_t hot_file_max_file_mb;
+    std::uint32_t hot_file_admission_hits;
+    std::uint32_t import_lookup_ttl_seconds;
+    std::size_t import_lookup_max_series;
+    std::uint32_t sop_filter_bits_per_sop;
+    std::size_t sop_filter_min_capacity;
+    std::size_t directories_max_entries;
+    std::string previews_folder;
+    std::size_t previews_memory_mb;
+    std::size_t previews_disk_mb;
+    std::uint32_t previews_max_size;
+    std::uint32_t previews_default_size;
+    std::string transcoded_folder;
+    std::size_t transcoded_disk_mb;
+    std::string metadata_folder;
+    std::size_t metadata_memory_mb;
+    std::size_t metadata_disk_mb;
+  };
+
+  struct import_config {
+    std::string spool_folder;
+    std::uint32_t workers;
+    std::size_t max_pending;
+    std::uint32_t max_attempts;
+    std::uint32_t retention_hours;
+    std::size_t batch_size;
+    std::uint32_t aggregate_interval_ms;
+    std::size_t aggregate_batch_size;
+    std::size_t lock_stripes;
+  };
+
+  struct derived_config {
+    std::uint32_t workers;
+    std::uint32_t stream_resolutions;
+    std::uint32_t stream_layers;
+    std::uint32_t icon_size;
+    std::size_t max_queued;
+    std::size_t scan_batch_size;
+    std::uint32_t backlog_delay_ms;
+    std::uint32_t rescan_interval_seconds;
+    bool pixel_statistics;
+    std::uint32_t histogram_bins;
+  };
+
+  struct image_compression_config {
+    std::uint32_t workers;
+    std::size_t scan_batch_size;
+    std::uint32_t rescan_interval_seconds;
+    std::uint32_t release_delay_seconds;
+  };
+
+  struct transcoding_config {
+    std::uint32_t workers;
+    std::size_t max_pending;
+  };
+
+  struct deduplication_config {
+    bool enabled;
+    std::uint32_t gc_interval_seconds;
+    std::size_t gc_batch_size;
+  };
+
+  struct file_release_config {
+    std::uint32_t interval_seconds;
+    std::size_t batch_size;
+  };
+
+  struct tiering_config {
+    Json::Value rules;
+    std::uint32_t interval_seconds;
+    std::size_t batch_size;
+    std::uint64_t max_bytes_per_second;
+    std::uint32_t release_delay_seconds;
+  };
+
+  struct packing_config {
+    bool enabled;
+    std::uint32_t interval_seconds;
+    std::size_t batch_size;
+    std::uint32_t min_idle_hours;
+    std::uint32_t min_instances;
+    std::uint32_t release_delay_seconds;
+  };
+
+  struct archive_check_config {
+    std::uint32_t threads;
+    std::size_t max_pending;
+    std::uint32_t retention_hours;
+    std::uint32_t min_file_age_seconds;
+    std::uint32_t max_reported;
+  };
+
+  struct export_config {
+    std::uint32_t readers;
+    std::size_t max_buffered_mb;
+    std::uint32_t max_concurrent;
+  };
+
   database_config db_config_;
   http_config http_config_;
+  compression_config compression_config_;
+  cache_config cache_config_;
+  import_config import_config_;
+  derived_config derived_config_;
+  image_compression_config image_compression_config_;
+  transcoding_config transcoding_config_;
+  deduplication_config deduplication_config_;
+  file_release_config file_release_config_;
+  tiering_config tiering_config_;
+  packing_config packing_config_;
+  archive_check_config archive_check_config_;
+  export_config export_config_;
   bool is_valid_;
   std::string last_error_;
 };
\ No newline at end of file
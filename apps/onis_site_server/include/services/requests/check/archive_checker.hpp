@@ -0,0 +1,101 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+////////////////////////////////////////////////////////////////////////////////
+// archive_checker class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Runs the consistency checks of the partitions (their media folders compared
+// with the database), one at a time in the background as they read whole
+// media. The jobs are only kept in memory, for "retention_hours" once
+// finished: a check interrupted by a shutdown is failed, it can be submitted
+// again. The checks are run with "threads" scanning threads.
+
+class archive_checker;
+typedef std::shared_ptr<archive_checker> archive_checker_ptr;
+
+class archive_checker {
+public:
+  // job states:
+  static const char* const kQueued;
+  static const char* const kRunning;
+  static const char* const kCompleted;
+  static const char* const kFailed;
+
+  // records the progress of a check, returns false once the checker is
+  // stopping (the check must be interrupted):
+  using progress_fn = std::function<bool(const Json::Value& progress)>;
+  // checks a partition, throws on failure:
+  using handler_fn =
+      std::function<void(const Json::Value& job, const progress_fn& progress,
+                         Json::Value& result)>;
+
+  // static constructor:
+  static archive_checker_ptr create(std::uint32_t threads,
+                                    std::size_t max_pending,
+                                    std::uint32_t retention_hours);
+
+  // constructor:
+  archive_checker(std::uint32_t threads, std::size_t max_pending,
+                  std::uint32_t retention_hours);
+
+  // destructor:
+  ~archive_checker();
+
+  // prevent copy and move
+  archive_checker(const archive_checker&) = delete;
+  archive_checker& operator=(const archive_checker&) = delete;
+  archive_checker(archive_checker&&) = delete;
+  archive_checker& operator=(archive_checker&&) = delete;
+
+  // lifecycle:
+  bool is_enabled() const;
+  void start(const handler_fn& handler);
+  void stop();
+
+  // scanning threads of a check:
+  std::uint32_t get_threads() const;
+
+  // jobs (the input holds the options of the check):
+  void submit(const std::string& source, const Json::Value& input,
+              Json::Value& job);
+  bool find_job(const std::string& id, Json::Value& job) const;
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  void run_job(const std::string& id);
+  bool set_progress(const std::string& id, const Json::Value& progress);
+  void purge_expired_jobs();
+
+  std::uint32_t threads_;
+  std::size_t max_pending_;
+  std::int64_t retention_;  // seconds
+
+  handler_fn handler_;
+  std::thread worker_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> pending_;
+  std::unordered_map<std::string, Json::Value> jobs_;
+  bool running_{false};
+  bool stopping_{false};
+
+  std::atomic<std::uint64_t> accepted_{0};
+  std::atomic<std::uint64_t> completed_{0};
+  std::atomic<std::uint64_t> failed_{0};
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////
+// directory_scanner class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Parallel walk of a folder tree: the folders found are shared by a pool of
+// threads, each one listing a folder at a time. The type of the entries is
+// read from the folders themselves, the files are not opened (nor stat'ed on
+// most file systems). The symbolic links are not followed.
+
+class directory_scanner {
+public:
+  // receives the path of a file, relative to the root, from the scanning
+  // thread "worker" (called concurrently by the threads):
+  using file_fn =
+      std::function<void(std::size_t worker, const std::string& path)>;
+  // returns true to interrupt the scan:
+  using cancel_fn = std::function<bool()>;
+
+  struct statistics {
+    std::uint64_t folders{0};
+    std::uint64_t files{0};
+    std::uint64_t errors{0};
+  };
+
+  // Walk the tree of "folder" (relative to "root") with "threads" threads.
+  // Returns false if the scan was interrupted.
+  static bool scan(const std::string& root, const std::string& folder,
+                   std::size_t threads, const file_fn& visit,
+                   const cancel_fn& cancelled, statistics& stats);
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// compression_worker class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Pool of workers transcoding the stored images to the transfer syntax of the
+// compression rule (pacs_compressions) of their partition. The images to
+// compress are read from the database page by page: those of the rules
+// compressing in the background at any time, and those of the scheduled rules
+// while their time window is open. Once all of them were read, they are read
+// again after an interval. An image stays to compress until its new file is
+// recorded, so nothing is lost when the server stops. The previous files are
+// deleted later by the file_releaser, so that the downloads in progress can
+// complete.
+
+class compression_worker;
+typedef std::shared_ptr<compression_worker> compression_worker_ptr;
+
+class compression_worker {
+public:
+  // outcome of the compression of an image:
+  enum class result { compressed, unchanged, failed, skipped };
+
+  // reads up to "limit" images to compress after "after_seq", returns the seq
+  // of the last one read, or an empty string once they were all read:
+  using scan_fn = std::function<std::string(
+      const std::string& after_seq, std::int32_t limit,
+      std::vector<std::string>& seqs)>;
+  // compresses an image, "saved" receives the number of bytes saved:
+  using compress_fn =
+      std::function<result(const std::string& seq, std::int64_t& saved)>;
+
+  // static constructor:
+  static compression_worker_ptr create(std::uint32_t workers,
+                                       std::size_t batch_size,
+                                       std::chrono::seconds rescan_interval);
+
+  // constructor:
+  compression_worker(std::uint32_t workers, std::size_t batch_size,
+                     std::chrono::seconds rescan_interval);
+
+  // destructor:
+  ~compression_worker();
+
+  // prevent copy and move
+  compression_worker(const compression_worker&) = delete;
+  compression_worker& operator=(const compression_worker&) = delete;
+  compression_worker(compression_worker&&) = delete;
+  compression_worker& operator=(compression_worker&&) = delete;
+
+  // lifecycle:
+  void start(const scan_fn& scan, const compress_fn& compress);
+  void stop();
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  bool next(std::string& seq, std::unique_lock<std::mutex>& lock);
+  void scan(std::unique_lock<std::mutex>& lock);
+
+  std::uint32_t workers_count_;
+  std::int32_t batch_size_;
+  std::chrono::seconds rescan_interval_;
+
+  scan_fn scan_;
+  compress_fn compress_;
+  std::vector<std::thread> workers_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+  std::deque<std::string> pending_;
+  std::unordered_set<std::string> running_;
+  std::string cursor_;
+  bool scanning_{false};
+  std::chrono::steady_clock::time_point next_scan_;
+
+  std::atomic<std::uint64_t> compressed_{0};
+  std::atomic<std::uint64_t> unchanged_{0};
+  std::atomic<std::uint64_t> failed_{0};
+  std::atomic<std::uint64_t> skipped_{0};
+  std::atomic<std::uint64_t> errors_{0};
+  std::atomic<std::int64_t> saved_bytes_{0};
+};
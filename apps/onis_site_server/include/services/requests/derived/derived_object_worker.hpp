@@ -0,0 +1,104 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// derived_object_worker class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Pool of workers creating the objects derived from the stored images (the
+// J2K stream files, the icons and the pixel statistics) that the imports
+// leave to be generated. The images committed by the imports are queued and
+// generated first. The other ones (left by a previous run, or dropped when
+// the queue was full) are read from the database page by page, and generated
+// one at a time with a pause between them, only while nothing is queued. The
+// database remains the reference: an image is pending until its objects are
+// recorded, so nothing is lost when the server stops.
+
+class derived_object_worker;
+typedef std::shared_ptr<derived_object_worker> derived_object_worker_ptr;
+
+class derived_object_worker {
+public:
+  // reads up to "limit" pending images after "after_seq", returns the seq of
+  // the last one read, or an empty string once they were all read:
+  using scan_fn = std::function<std::string(
+      const std::string& after_seq, std::int32_t limit,
+      std::vector<std::string>& seqs)>;
+  // generates the pending objects of an image, returns the number created:
+  using generate_fn = std::function<std::size_t(const std::string& seq)>;
+
+  // static constructor:
+  static derived_object_worker_ptr create(
+      std::uint32_t workers, std::size_t max_queued, std::size_t batch_size,
+      std::chrono::milliseconds backlog_delay,
+      std::chrono::seconds rescan_interval);
+
+  // constructor:
+  derived_object_worker(std::uint32_t workers, std::size_t max_queued,
+                        std::size_t batch_size,
+                        std::chrono::milliseconds backlog_delay,
+                        std::chrono::seconds rescan_interval);
+
+  // destructor:
+  ~derived_object_worker();
+
+  // prevent copy and move
+  derived_object_worker(const derived_object_worker&) = delete;
+  derived_object_worker& operator=(const derived_object_worker&) = delete;
+  derived_object_worker(derived_object_worker&&) = delete;
+  derived_object_worker& operator=(derived_object_worker&&) = delete;
+
+  // lifecycle:
+  void start(const scan_fn& scan, const generate_fn& generate);
+  void stop();
+
+  // images committed by the imports:
+  void add(const std::vector<std::string>& seqs);
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  bool next(std::string& seq, bool& backlog,
+            std::unique_lock<std::mutex>& lock);
+  void scan(std::unique_lock<std::mutex>& lock);
+
+  std::uint32_t workers_count_;
+  std::size_t max_queued_;
+  std::int32_t batch_size_;
+  std::chrono::milliseconds backlog_delay_;
+  std::chrono::seconds rescan_interval_;
+
+  scan_fn scan_;
+  generate_fn generate_;
+  std::vector<std::thread> workers_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+  std::deque<std::string> queued_;
+  std::deque<std::string> backlog_;
+  std::unordered_set<std::string> running_;
+  std::string backlog_cursor_;
+  bool scanning_{false};
+  std::chrono::steady_clock::time_point next_scan_;
+
+  std::atomic<std::uint64_t> generated_{0};
+  std::atomic<std::uint64_t> objects_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<std::uint64_t> failures_{0};
+};
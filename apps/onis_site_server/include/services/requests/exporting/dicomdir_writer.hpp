@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// dicomdir_writer class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Encoder of the DICOMDIR of an exported file-set (PS3.10 and PS3.3 F),
+// from the values stored in the database: the records are written in
+// explicit VR little endian, a PATIENT record for each patient, followed
+// by its STUDY, SERIES and IMAGE records, and are linked by their offsets
+// in the file. The values are expected in UTF-8, the records holding non
+// ASCII characters are marked as ISO_IR 192.
+
+class dicomdir_writer {
+public:
+  struct image_record {
+    std::string file_id;  // components separated by '\'
+    std::string sop_class_uid;
+    std::string sop_instance_uid;
+    std::string transfer_syntax;
+    std::string number;
+  };
+  struct series_record {
+    std::string uid;
+    std::string modality;
+    std::string number;
+    std::vector<image_record> images;
+  };
+  struct study_record {
+    std::string uid;
+    std::string date;
+    std::string time;
+    std::string accession_number;
+    std::string id;
+    std::string description;
+    std::vector<series_record> series;
+  };
+  struct patient_record {
+    std::string id;
+    std::string name;
+    std::string birth_date;
+    std::string sex;
+    std::vector<study_record> studies;
+  };
+
+  // encoding:
+  static void encode(const std::vector<patient_record>& patients,
+                     std::string& output);
+
+  // Read the transfer syntax from the file meta information at the start of
+  // a DICOM file, returns an empty string when it cannot be found:
+  static std::string read_transfer_syntax(const char* data, std::size_t size);
+
+  // Create a UID from a random UUID, under the 2.25 root:
+  static std::string create_uid();
+};
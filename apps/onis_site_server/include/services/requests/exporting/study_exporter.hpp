@@ -0,0 +1,122 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "./dicomdir_writer.hpp"
+#include "./zip_stream_writer.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// study_exporter class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Export of the images of studies as a ZIP archive produced while it is
+// sent: "readers" threads read the files ahead of the writer, in parallel,
+// into at most "max_buffered" bytes of chunks, and read fills the response
+// with the archive, entry after entry, from these chunks. The archive is
+// never written to disk: only a transcoded or de-identified image is saved
+// to a temporary file, deleted once it is read. The DICOMDIR (when asked)
+// and the list of the images that could not be exported are added at the
+// end. The entries are in the order of the image records of "directory".
+
+class study_exporter;
+typedef std::shared_ptr<study_exporter> study_exporter_ptr;
+
+class study_exporter {
+public:
+  struct entry {
+    std::string name;  // in the archive
+    std::string path;  // file, or container of a packed image
+    std::uint64_t offset{0};
+    std::uint64_t size{0};
+    bool packed{false};
+    std::size_t patient{0};  // index of the patient record
+  };
+  struct options {
+    bool dicomdir{false};
+    std::string transfer_syntax;  // empty to export the files as they are
+    bool deidentify{false};
+    std::uint32_t readers{4};
+    std::size_t max_buffered{32 * 1024 * 1024};
+  };
+
+  // static constructor:
+  static study_exporter_ptr create(
+      const options& opts, const onis::dicom_manager_ptr& manager,
+      std::vector<dicomdir_writer::patient_record> directory,
+      std::vector<entry> entries);
+
+  // constructor:
+  study_exporter(const options& opts, const onis::dicom_manager_ptr& manager,
+                 std::vector<dicomdir_writer::patient_record> directory,
+                 std::vector<entry> entries);
+
+  // destructor:
+  ~study_exporter();
+
+  // prevent copy and move
+  study_exporter(const study_exporter&) = delete;
+  study_exporter& operator=(const study_exporter&) = delete;
+  study_exporter(study_exporter&&) = delete;
+  study_exporter& operator=(study_exporter&&) = delete;
+
+  // lifecycle:
+  void start();
+  void stop();
+
+  // Write the next bytes of the archive to "buffer", waiting for them when
+  // they are not read yet. Returns 0 once the archive is complete, or when
+  // the export is stopped ("buffer" is nullptr when the client is gone).
+  std::size_t read(char* buffer, std::size_t size);
+
+private:
+  enum class stage { kEntries, kDicomdir, kErrors, kDirectory, kDone };
+  struct slot {
+    std::deque<std::string> chunks;
+    bool done{false};
+    std::string error;
+    std::string transfer_syntax;
+  };
+
+  void run_reader();
+  void read_entry(std::size_t index);
+  void read_file(std::size_t index, const std::string& path,
+                 std::uint64_t offset, std::uint64_t size);
+  std::string process_entry(const entry& item) const;
+  void deidentify(const onis::dicom_file_ptr& dcm,
+                  const dicomdir_writer::patient_record& patient) const;
+  bool next_output();
+  void write_entry(const std::string& name, const std::string& data);
+  void write_dicomdir();
+
+  options options_;
+  onis::dicom_manager_ptr manager_;
+  std::vector<dicomdir_writer::patient_record> directory_;
+  std::vector<entry> entries_;
+
+  // read ahead:
+  std::mutex mutex_;
+  std::condition_variable data_cv_;
+  std::condition_variable space_cv_;
+  std::vector<slot> slots_;
+  std::size_t next_entry_{0};
+  std::size_t write_entry_{0};
+  std::size_t buffered_{0};
+  bool stopping_{false};
+  std::vector<std::thread> readers_;
+
+  // writer:
+  zip_stream_writer zip_;
+  stage stage_{stage::kEntries};
+  std::deque<std::string> pending_;
+  std::size_t pending_position_{0};
+  std::vector<bool> exported_;
+  std::vector<std::string> transfer_syntaxes_;
+  std::vector<std::string> errors_;
+};
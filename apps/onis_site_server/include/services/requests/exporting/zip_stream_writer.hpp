@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// zip_stream_writer class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Encoder of a ZIP archive written front to back, without seeking: the
+// entries are stored (the DICOM files barely compress, and their size must
+// not delay the first bytes), their CRC and sizes follow their data in a
+// data descriptor, and the central directory is written at the end. The
+// writer produces the headers only, the data of the entries is written by
+// the caller and accounted for by add_data. The archive switches to ZIP64
+// when it passes 4 GB or 65535 entries, an entry cannot exceed 4 GB.
+
+class zip_stream_writer {
+public:
+  // largest entry:
+  static const std::uint64_t max_entry_size = 0xFFFFFFFFULL;
+
+  // constructor:
+  zip_stream_writer();
+
+  // entries (the headers are appended to "output"):
+  void begin_entry(const std::string& name, std::string& output);
+  void add_data(const char* data, std::size_t size);
+  void end_entry(std::string& output);
+
+  // central directory and end records:
+  void finish(std::string& output);
+
+  // properties:
+  std::uint64_t get_offset() const { return offset_; }
+  std::size_t get_entry_count() const { return entries_.size(); }
+  bool has_open_entry() const { return open_; }
+
+private:
+  struct entry {
+    std::string name;
+    std::uint32_t crc{0};
+    std::uint64_t size{0};
+    std::uint64_t offset{0};
+  };
+
+  std::vector<entry> entries_;
+  std::uint64_t offset_{0};
+  bool open_{false};
+  std::uint16_t dos_time_{0};
+  std::uint16_t dos_date_{0};
+};
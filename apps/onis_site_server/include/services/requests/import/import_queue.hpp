@@ -0,0 +1,111 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// import_queue class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Durable queue of the DICOM files waiting to be imported. The uploaded file
+// is spooled before the job is accepted, and each job is journaled as a JSON
+// file in the spool folder (replaced atomically on every state change, and
+// flushed to the disk), so the queued and interrupted jobs are resumed when
+// the server restarts.
+// A pool of workers drains the queue through the import handler.
+
+class import_queue;
+typedef std::shared_ptr<import_queue> import_queue_ptr;
+
+class import_queue {
+public:
+  // job states:
+  static const char* const kQueued;
+  static const char* const kRunning;
+  static const char* const kCompleted;
+  static const char* const kFailed;
+
+  // imports the files of a job, throws on failure. The progress is journaled
+  // with the job, the handler resumes an interrupted job from it:
+  using progress_fn = std::function<void(const Json::Value& progress)>;
+  using handler_fn =
+      std::function<void(const Json::Value& job, const progress_fn& progress,
+                         Json::Value& result)>;
+
+  // static constructor:
+  static import_queue_ptr create(const std::string& folder,
+                                 std::uint32_t workers,
+                                 std::size_t max_pending,
+                                 std::uint32_t max_attempts,
+                                 std::uint32_t retention_hours);
+
+  // constructor:
+  import_queue(const std::string& folder, std::uint32_t workers,
+               std::size_t max_pending, std::uint32_t max_attempts,
+               std::uint32_t retention_hours);
+
+  // destructor:
+  ~import_queue();
+
+  // prevent copy and move
+  import_queue(const import_queue&) = delete;
+  import_queue& operator=(const import_queue&) = delete;
+  import_queue(import_queue&&) = delete;
+  import_queue& operator=(import_queue&&) = delete;
+
+  // lifecycle (start replays the journal):
+  bool is_enabled() const;
+  void start(const handler_fn& handler);
+  void stop();
+
+  // jobs (the input holds either the spooled "files", [{path, name}] deleted
+  // once imported, or a "folder" of the server):
+  void submit(const std::string& source, const Json::Value& input,
+              Json::Value& job);
+  bool find_job(const std::string& id, Json::Value& job) const;
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void replay();
+  void worker();
+  void run_job(const std::string& id);
+  void set_progress(const std::string& id, const Json::Value& progress);
+  static void delete_spooled_files(const Json::Value& job);
+  void purge_expired_jobs();
+  bool write_journal(const Json::Value& job) const;
+  void delete_journal(const std::string& id) const;
+  std::string get_journal_path(const std::string& id) const;
+
+  std::string folder_;
+  std::uint32_t worker_count_;
+  std::size_t max_pending_;
+  std::uint32_t max_attempts_;
+  std::int64_t retention_;  // seconds
+
+  handler_fn handler_;
+  std::vector<std::thread> workers_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> pending_;
+  std::unordered_map<std::string, Json::Value> jobs_;
+  std::size_t running_{0};
+  bool stopping_{false};
+
+  std::atomic<std::uint64_t> accepted_{0};
+  std::atomic<std::uint64_t> completed_{0};
+  std::atomic<std::uint64_t> failed_{0};
+  std::atomic<std::uint64_t> retried_{0};
+};
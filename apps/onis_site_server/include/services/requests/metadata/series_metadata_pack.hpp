@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "onis_kit/include/dicom/dicom.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// series_metadata_pack class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Binary encoding of the headers of all the images of a series, so that a
+// series is opened with a single request instead of a conversion per file.
+// The elements having the same value in every image are stored once, each
+// image only storing its other elements:
+//
+//   "ONISMD02"
+//   image count, common element count, common elements
+//   for each image: seq length, seq, element count, elements, region count,
+//   regions
+//
+// An element is its tag (u32 little endian, group in the high 16 bits), its
+// VR (2 characters), its VM, the length of its value and the value, as the
+// string given by the dicom file (UTF-8, the multiple values separated by
+// backslashes). The other counts and lengths are unsigned LEB128 varints.
+// The elements of each list are in the order of their tags. The bulk data
+// (pixel data, binary values) is not stored: it is read from the files.
+//
+// The regions are the calibrations of the image (its pixel spacing, or its
+// ultrasound regions), as given by the dicom file: the spatial format, the
+// data type, the area (x0, x1, y0, y1) and the units in x and y (i32 little
+// endian), then the spacing in x and y (f64 little endian).
+
+class series_metadata_pack {
+public:
+  struct element {
+    std::uint32_t tag{0};
+    std::string vr;
+    std::uint32_t vm{0};
+    std::string value;
+  };
+  struct region {
+    std::int32_t spatial_format{0};
+    std::int32_t data_type{0};
+    std::int32_t area[4]{0, 0, 0, 0};
+    std::int32_t units[2]{0, 0};
+    double spacing[2]{1.0, 1.0};
+  };
+  struct instance {
+    std::string seq;
+    std::vector<element> elements;
+    std::vector<region> regions;
+  };
+
+  // version of the encoding, the one of the magic:
+  static const std::int32_t version = 2;
+
+  // Read the elements of the file meta information and of the dataset of a
+  // loaded file, in the order of their tags:
+  static void read_elements(const onis::dicom_file_ptr& dcm,
+                            std::vector<element>& output);
+
+  // Read the calibrations of a loaded file:
+  static void read_regions(const onis::dicom_file_ptr& dcm,
+                           std::vector<region>& output);
+
+  // Encode the headers of the images of a series:
+  static void encode(const std::vector<instance>& instances,
+                     std::vector<char>& output);
+};
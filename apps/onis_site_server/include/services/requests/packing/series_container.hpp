@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// series_container class
+////////////////////////////////////////////////////////////////////////////////
+//
+// File storing the DICOM files of the images of a series one after the other,
+// so that a completed series is no longer stored as thousands of small files.
+// A container is only appended to: the files it stores never move, and the
+// images keep being read from their range (packoffset and packsize) while
+// other files are added. Each append ends with the index of the files it
+// added, followed by a trailer:
+//
+//   "ONISPK01"
+//   files                      first append
+//   index, trailer
+//   files                      next append
+//   index, trailer
+//
+// An index entry is the length of the image seq (u16), the seq, the offset
+// and the size (u64) of the file. The trailer is the offset of the index
+// (u64), its count (u32), the size of the container before the append (u64)
+// and "ONISPKIX". The integers are little endian. The database remains the
+// reference for the location of the images, the indexes allow to check a
+// container and to recover its files without it.
+
+class series_container {
+public:
+  // a file stored in a container:
+  struct entry {
+    std::string seq;     // image
+    std::string source;  // file to store (when appending)
+    std::uint64_t offset{0};
+    std::uint64_t size{0};
+  };
+
+  // name of a new container:
+  static std::string create_name();
+
+  // Append the files of "entries" to the container "path" (created if it does
+  // not exist) and set their offset and size. "previous_size" receives the
+  // size of the container before the append, 0 if it was created. Returns
+  // false if the container is not valid or if the files could not be stored,
+  // the container being left as it was.
+  static bool append(const std::string& path, std::vector<entry>& entries,
+                     std::uint64_t& previous_size);
+
+  // Restore a container to its size before an append whose files were not
+  // recorded (the container is deleted if the append created it):
+  static void discard(const std::string& path, std::uint64_t previous_size);
+
+  // A container can only be appended to if its last append was completed:
+  static bool is_valid(const std::string& path);
+
+  // Read the files stored in a container, from all its indexes:
+  static bool read_index(const std::string& path, std::vector<entry>& entries);
+
+  // Copy the file stored at [offset, offset + size) of a container to
+  // "destination" (for the readers that need a file of their own):
+  static bool extract(const std::string& path, std::uint64_t offset,
+                      std::uint64_t size, const std::string& destination);
+};
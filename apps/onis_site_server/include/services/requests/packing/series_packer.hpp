@@ -0,0 +1,92 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// series_packer class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Stores the completed series in containers (see series_container): when it
+// is enabled, the series that received no image for a number of hours are
+// read periodically, page by page, and the files of their images are
+// appended to a container of their media. The previous files are deleted
+// later by the file_releaser, so that the downloads in progress can complete.
+
+class series_packer;
+typedef std::shared_ptr<series_packer> series_packer_ptr;
+
+class series_packer {
+public:
+  // outcome of the packing of a series:
+  enum class result { packed, skipped, failed };
+
+  // reads up to "limit" series to pack after "after_seq", returns the seq of
+  // the last one read, or an empty string once they were all read:
+  using scan_fn = std::function<std::string(const std::string& after_seq,
+                                            std::int32_t limit,
+                                            std::vector<std::string>& seqs)>;
+  // packs a series, "files" and "bytes" receive what was packed:
+  using pack_fn = std::function<result(const std::string& seq,
+                                       std::int64_t& files,
+                                       std::int64_t& bytes)>;
+
+  // static constructor:
+  static series_packer_ptr create(bool enabled, std::chrono::seconds interval,
+                                  std::size_t batch_size);
+
+  // constructor:
+  series_packer(bool enabled, std::chrono::seconds interval,
+                std::size_t batch_size);
+
+  // destructor:
+  ~series_packer();
+
+  // prevent copy and move
+  series_packer(const series_packer&) = delete;
+  series_packer& operator=(const series_packer&) = delete;
+  series_packer(series_packer&&) = delete;
+  series_packer& operator=(series_packer&&) = delete;
+
+  // lifecycle:
+  void start(const scan_fn& scan, const pack_fn& pack);
+  void stop();
+
+  // packing:
+  bool is_enabled() const;
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  void pack_all();
+
+  bool enabled_;
+  std::chrono::seconds interval_;
+  std::int32_t batch_size_;
+
+  scan_fn scan_;
+  pack_fn pack_;
+  std::thread worker_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+
+  std::atomic<std::uint64_t> packed_{0};
+  std::atomic<std::uint64_t> skipped_{0};
+  std::atomic<std::uint64_t> failed_{0};
+  std::atomic<std::uint64_t> errors_{0};
+  std::atomic<std::int64_t> files_{0};
+  std::atomic<std::int64_t> bytes_{0};
+};
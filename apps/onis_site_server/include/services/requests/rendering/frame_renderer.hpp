@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include "onis_kit/include/core/bitmap.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// frame_renderer class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Renders reduced images of the frames (icons, previews) with their current
+// window level. The reduction is a box filter: each pixel of the reduced
+// image is the average of the pixels it covers, which is fast and does not
+// alias the thin structures of the downsampled medical images.
+
+class frame_renderer {
+public:
+  // Render the frame reduced to fit in a square of "size" pixels (never
+  // enlarged), as a 24 bits bitmap. Returns nullptr on failure.
+  static onis::core::bitmap_ptr render(const onis::dicom_frame_ptr& frame,
+                                       std::uint32_t size);
+
+  // Reduce a 24 bits bitmap to "width" x "height":
+  static onis::core::bitmap_ptr reduce(const onis::core::bitmap_ptr& image,
+                                       std::size_t width, std::size_t height);
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+////////////////////////////////////////////////////////////////////////////////
+// request_coalescer class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Single flight execution of idempotent reads: the first caller for a given
+// key (the leader) runs the work, concurrent callers with the same key (the
+// followers) wait for the leader and share its result. A completed result is
+// kept for a short time so that near-simultaneous arrivals are also served
+// from it. Failures are propagated to the waiting followers but never kept.
+
+class request_coalescer;
+typedef std::shared_ptr<request_coalescer> request_coalescer_ptr;
+
+class request_coalescer {
+public:
+  using value_ptr = std::shared_ptr<const Json::Value>;
+
+  // static constructor:
+  static request_coalescer_ptr create(std::chrono::milliseconds ttl);
+
+  // constructor:
+  request_coalescer(std::chrono::milliseconds ttl);
+
+  // destructor:
+  ~request_coalescer();
+
+  // prevent copy and move
+  request_coalescer(const request_coalescer&) = delete;
+  request_coalescer& operator=(const request_coalescer&) = delete;
+  request_coalescer(request_coalescer&&) = delete;
+  request_coalescer& operator=(request_coalescer&&) = delete;
+
+  // canonical request key (sha-256 of the operation and its parameters):
+  static std::string make_key(const std::string& operation,
+                              const Json::Value& params);
+
+  // execution:
+  template <typename Func>
+  value_ptr run(const std::string& key, Func&& func) {
+    std::shared_ptr<flight> current;
+    bool leader = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto now = std::chrono::steady_clock::now();
+      purge_expired(now);
+      auto it = flights_.find(key);
+      if (it != flights_.end()) {
+        current = it->second;
+      } else {
+        current = std::make_shared<flight>();
+        current->future = current->promise.get_future().share();
+        flights_[key] = current;
+        leader = true;
+      }
+    }
+
+    if (!leader) {
+      shared_count_++;
+      return current->future.get();
+    }
+
+    leader_count_++;
+    try {
+      Json::Value result;
+      func(result);
+      value_ptr value = std::make_shared<const Json::Value>(std::move(result));
+      current->promise.set_value(value);
+      std::lock_guard<std::mutex> lock(mutex_);
+      current->done = true;
+      current->expires = std::chrono::steady_clock::now() + ttl_;
+      return value;
+    } catch (...) {
+      current->promise.set_exception(std::current_exception());
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto it = flights_.find(key);
+      if (it != flights_.end() && it->second == current)
+        flights_.erase(it);
+      throw;
+    }
+  }
+
+  // invalidation:
+  void invalidate(const std::string& key);
+  void clear();
+
+  // statistics:
+  std::uint64_t get_leader_count() const;
+  std::uint64_t get_shared_count() const;
+
+private:
+  struct flight {
+    std::promise<value_ptr> promise;
+    std::shared_future<value_ptr> future;
+    bool done{false};
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  void purge_expired(std::chrono::steady_clock::time_point now);
+
+  std::chrono::milliseconds ttl_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<flight>> flights_;
+  std::atomic<std::uint64_t> leader_count_{0};
+  std::atomic<std::uint64_t> shared_count_{0};
+};
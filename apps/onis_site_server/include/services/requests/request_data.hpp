@@ -5,7 +5,9 @@
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 #include "./sessions/request_session.hpp"
 
@@ -20,8 +22,17 @@ enum class request_type {
   kLogout,
   kFindStudies,
   kImportDicom,
+  kGetImportJob,
   kInitSeriesDownload,
   kDownloadImages,
+  kGetImageFile,
+  kGetImageFrames,
+  kGetImagePreview,
+  kGetSeriesMetadata,
+  kGetStatistics,
+  kCheckArchive,
+  kGetArchiveCheck,
+  kExportStudies,
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -34,6 +45,12 @@ typedef std::shared_ptr<request_data> request_data_ptr;
 class request_data {
 public:
   using stream_reader_fn = std::function<std::size_t(char*, std::size_t)>;
+  using file_writer_fn = std::function<bool(const std::string&)>;
+
+  struct uploaded_file {
+    std::string name;
+    file_writer_fn write;
+  };
 
   // static constructor
   static request_data_ptr create(request_type type);
@@ -87,6 +104,9 @@ public:
 
   request_session_ptr session;
 
+  // uploaded files, written by the service where they will be stored:
+  std::vector<uploaded_file> input_files;
+
 private:
   request_type type_;
   json output_json_;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <map>
@@ -8,11 +9,30 @@
 #include <set>
 #include <unordered_map>
 #include "../../database/site_database_pool.hpp"
+#include "../cache/derived_file_cache.hpp"
+#include "../cache/directory_cache.hpp"
+#include "../cache/hot_file_cache.hpp"
+#include "../cache/import_lookup_cache.hpp"
+#include "../cache/sop_filter.hpp"
+#include "../config/config_service.hpp"
 
+#include "./request_coalescer.hpp"
 #include "./request_data.hpp"
 #include "./request_database.hpp"
 #include "./request_exceptions.hpp"
 
+#include "./check/archive_checker.hpp"
+#include "./compression/compression_worker.hpp"
+#include "./derived/derived_object_worker.hpp"
+#include "./import/import_queue.hpp"
+#include "./packing/series_packer.hpp"
+#include "./store/aggregate_updater.hpp"
+#include "./store/content_store.hpp"
+#include "./store/file_releaser.hpp"
+#include "./store/import_lock_manager.hpp"
+#include "./tiering/media_migration_worker.hpp"
+#include "./transcoding/transcode_pool.hpp"
+
 #include "./sessions/request_session.hpp"
 
 // #include "./sessions/request_session_access.hpp"
@@ -50,18 +70,69 @@ public:
 class request_service : public std::enable_shared_from_this<request_service> {
 public:
   // static constructor:
-  static request_service_ptr create();
+  static request_service_ptr create(const config_service_ptr& config);
 
   // constructor:
-  request_service();
+  request_service(const config_service_ptr& config);
 
   // destructor:
   ~request_service();
 
+  // stop the background workers:
+  void stop();
+
   // database pool access
   std::shared_ptr<site_database> get_database_connection();
   void return_database_connection(std::shared_ptr<site_database> connection);
 
+  // request coalescing (idempotent reads):
+  request_coalescer_ptr get_read_coalescer() const;
+
+  // caches:
+  hot_file_cache_ptr get_hot_file_cache() const;
+  import_lookup_cache_ptr get_import_lookup_cache() const;
+  sop_filter_ptr get_sop_filter() const;
+  directory_cache_ptr get_directory_cache() const;
+  derived_file_cache_ptr get_preview_cache() const;
+  derived_file_cache_ptr get_transcode_cache() const;
+  derived_file_cache_ptr get_metadata_cache() const;
+
+  // asynchronous imports:
+  import_queue_ptr get_import_queue() const;
+  import_lock_manager_ptr get_import_lock_manager() const;
+
+  // counters of the patients, studies and series:
+  aggregate_updater_ptr get_aggregate_updater() const;
+
+  // stream files, icons and pixel statistics created after the imports:
+  derived_object_worker_ptr get_derived_object_worker() const;
+  bool is_pixel_statistics_enabled() const;
+
+  // compression of the stored images (the rule of a partition is found when
+  // it has a single one):
+  compression_worker_ptr get_compression_worker() const;
+  bool find_partition_compression(const std::string& partition_seq,
+                                  const request_database& db,
+                                  Json::Value& output);
+
+  // images retrieved in another transfer syntax:
+  transcode_pool_ptr get_transcode_pool() const;
+
+  // deduplication of the stored files:
+  content_store_ptr get_content_store() const;
+
+  // files replaced by another one, deleted after a delay:
+  file_releaser_ptr get_file_releaser() const;
+
+  // series moved between the media of their volume:
+  media_migration_worker_ptr get_migration_worker() const;
+
+  // completed series stored in a container:
+  series_packer_ptr get_series_packer() const;
+
+  // consistency checks of the partitions:
+  archive_checker_ptr get_archive_checker() const;
+
   // prevent copy and move
   request_service(const request_service&) = delete;
   request_service& operator=(const request_service&) = delete;
@@ -81,14 +152,26 @@ public:
   void process_authenticate_request(const request_data_ptr& req);
   void process_find_studies_request(const request_data_ptr& req);
   void process_import_dicom_file_request(const request_data_ptr& req);
+  void process_get_import_job_request(const request_data_ptr& req);
   void process_init_series_download_request(const request_data_ptr& req);
   void process_download_images_request(const request_data_ptr& req);
+  void process_get_image_file_request(const request_data_ptr& req);
+  void process_get_image_frames_request(const request_data_ptr& req);
+  void process_get_image_preview_request(const request_data_ptr& req);
+  void process_get_series_metadata_request(const request_data_ptr& req);
+  void process_get_statistics_request(const request_data_ptr& req);
+  void process_check_archive_request(const request_data_ptr& req);
+  void process_get_archive_check_request(const request_data_ptr& req);
+  void process_export_studies_request(const request_data_ptr& req);
 
   // utilities:
   static std::string convert_dicom_file_to_json(
       const onis::dicom_file_ptr& dcm);
 
 private:
+  // configuration
+  config_service_ptr config_;
+
   // database pool
   std::unique_ptr<site_database_pool> database_pool_;
 
@@ -97,6 +180,54 @@ private:
   mutable std::mutex sessions_mutex_;
   std::chrono::seconds session_timeout_;
 
+  // request coalescing
+  request_coalescer_ptr read_coalescer_;
+
+  // caches
+  hot_file_cache_ptr hot_file_cache_;
+  import_lookup_cache_ptr import_lookup_cache_;
+  sop_filter_ptr sop_filter_;
+  directory_cache_ptr directory_cache_;
+  derived_file_cache_ptr preview_cache_;
+  derived_file_cache_ptr transcode_cache_;
+  derived_file_cache_ptr metadata_cache_;
+
+  // asynchronous imports
+  import_queue_ptr import_queue_;
+  import_lock_manager_ptr import_lock_manager_;
+
+  // deferred counter updates
+  aggregate_updater_ptr aggregate_updater_;
+
+  // derived objects
+  derived_object_worker_ptr derived_object_worker_;
+
+  // image compression
+  compression_worker_ptr compression_worker_;
+
+  // transcoding on retrieval
+  transcode_pool_ptr transcode_pool_;
+
+  // deduplication
+  content_store_ptr content_store_;
+
+  // replaced files
+  file_releaser_ptr file_releaser_;
+
+  // tiering
+  media_migration_worker_ptr migration_worker_;
+
+  // packing
+  series_packer_ptr series_packer_;
+
+  // consistency checks
+  archive_checker_ptr archive_checker_;
+
+  // exports
+  std::atomic<std::uint32_t> running_exports_{0};
+  std::atomic<std::uint64_t> exports_{0};
+  std::atomic<std::uint64_t> rejected_exports_{0};
+
   // Authentication:
   void get_user_configuration(const request_database& db,
                               const request_session_ptr& session,
@@ -113,6 +244,94 @@ private:
       const std::unordered_map<std::string, const Json::Value&>& roles,
       std::set<std::string>& circular_loop, const request_database& db) const;
 
+  // import:
+  void process_import_job(const Json::Value& job,
+                          const import_queue::progress_fn& progress,
+                          Json::Value& output);
+  void import_dicom_file(const request_database& db,
+                         const std::string& source_id,
+                         const Json::Value& partition, std::int32_t media,
+                         const std::string& folder,
+                         const std::string& dicom_file_path, bool staged,
+                         Json::Value& output);
+  void import_dicom_files(const request_database& db,
+                          const std::string& source_id,
+                          const Json::Value& partition, std::int32_t media,
+                          const std::string& folder,
+                          const std::vector<std::string>& dicom_file_paths,
+                          bool staged,
+                          const import_queue::progress_fn& progress,
+                          Json::Value& results);
+  void import_dicom_folder(const request_database& db,
+                           const std::string& source_id,
+                           const Json::Value& partition, std::int32_t media,
+                           const std::string& folder,
+                           const std::string& dicom_folder_path,
+                           const import_queue::progress_fn& progress,
+                           Json::Value& summary);
+  std::size_t apply_counter_deltas(std::int32_t limit);
+
+  // derived objects:
+  std::string get_pending_derived_images(const std::string& after_seq,
+                                         std::int32_t limit,
+                                         std::vector<std::string>& seqs);
+  std::size_t generate_derived_objects(const std::string& seq);
+
+  // image compression:
+  std::string get_images_to_compress(const std::string& after_seq,
+                                     std::int32_t limit,
+                                     std::vector<std::string>& seqs);
+  compression_worker::result compress_image(const std::string& seq,
+                                            std::int64_t& saved);
+
+  // deduplication:
+  std::size_t collect_contents(std::int32_t limit);
+  void measure_contents(Json::Value& output);
+
+  // replaced files:
+  std::size_t release_files(std::int32_t limit);
+
+  // tiering:
+  std::string get_series_to_migrate(const Json::Value& rule,
+                                    const std::string& after_seq,
+                                    std::int32_t limit,
+                                    std::vector<std::string>& seqs);
+  media_migration_worker::result migrate_series(
+      const Json::Value& rule, const std::string& seq, std::int64_t& files,
+      std::int64_t& bytes);
+
+  // packing:
+  std::string get_series_to_pack(const std::string& after_seq,
+                                 std::int32_t limit,
+                                 std::vector<std::string>& seqs);
+  series_packer::result pack_series(const std::string& seq,
+                                    std::int64_t& files, std::int64_t& bytes);
+
+  // image files (the location of the file served for an image, its access
+  // being verified for the session of the request):
+  request_coalescer::value_ptr find_image_file(const request_data_ptr& req,
+                                               const std::string& seq,
+                                               bool dicom_only);
+  void write_transcoded_image_file(const request_data_ptr& req,
+                                   const Json::Value& location,
+                                   const std::string& version,
+                                   const std::string& transfer);
+
+  // series metadata packs (the headers of the images of a series, prepared
+  // once the series is completed):
+  void prepare_series_metadata(const std::string& seq,
+                               const request_database& db);
+  derived_file_cache::buffer_ptr load_series_metadata(
+      const std::string& key, const Json::Value& files,
+      const request_database& db);
+  derived_file_cache::buffer_ptr build_series_metadata(
+      const Json::Value& files, const request_database& db);
+
+  // consistency checks:
+  void check_archive(const Json::Value& job,
+                     const archive_checker::progress_fn& progress,
+                     Json::Value& output);
+
   // permissions:
   void verify_partition_access_permission(const request_database& db,
                                           const request_session_ptr& session,
@@ -134,6 +353,8 @@ private:
   std::string get_media_folder(std::int32_t target,
                                const std::string& volume_seq,
                                std::int32_t media, const request_database& db);
+  request_coalescer::value_ptr load_volume_media_list(
+      const std::string& volume_seq, const request_database& db);
 
   /*void get_session_permissions(bool only_privileges,
                                search_access_result& result,
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////
+// aggregate_updater class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Applies the counter deltas logged by the imports to the patients, studies
+// and series. The deltas are left to accumulate for an interval (or until a
+// batch worth of them is pending), so the images of a series cost a single
+// update of each row. A search that returns the counters adds the deltas
+// still pending to the rows it found instead of waiting for them. The deltas
+// left by a previous run are applied at startup.
+
+class aggregate_updater;
+typedef std::shared_ptr<aggregate_updater> aggregate_updater_ptr;
+
+class aggregate_updater {
+public:
+  // applies up to "limit" deltas in its own transaction, returns their count:
+  using apply_fn = std::function<std::size_t(std::int32_t limit)>;
+
+  // static constructor:
+  static aggregate_updater_ptr create(std::chrono::milliseconds interval,
+                                      std::size_t batch_size);
+
+  // constructor:
+  aggregate_updater(std::chrono::milliseconds interval, std::size_t batch_size);
+
+  // destructor:
+  ~aggregate_updater();
+
+  // prevent copy and move
+  aggregate_updater(const aggregate_updater&) = delete;
+  aggregate_updater& operator=(const aggregate_updater&) = delete;
+  aggregate_updater(aggregate_updater&&) = delete;
+  aggregate_updater& operator=(aggregate_updater&&) = delete;
+
+  // lifecycle:
+  void start(const apply_fn& apply);
+  void stop();
+
+  // deltas (add_pending is called once they are committed):
+  void add_pending(std::size_t count);
+
+  // incremented when a round starts and when it ends (odd while it runs): a
+  // search that reads the counters and then the pending deltas is consistent
+  // if the generation did not change in between and was even:
+  std::uint64_t get_generation() const;
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  bool drain();
+
+  std::chrono::milliseconds interval_;
+  std::int32_t batch_size_;
+
+  apply_fn apply_;
+  std::thread worker_;
+  std::mutex apply_mutex_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+
+  std::atomic<std::size_t> pending_{0};
+  std::atomic<bool> recovered_{false};
+  std::atomic<std::uint64_t> applied_{0};
+  std::atomic<std::uint64_t> rounds_{0};
+  std::atomic<std::uint64_t> generation_{0};
+  std::atomic<std::uint64_t> failures_{0};
+};
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////
+// content_store class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Deduplication of the stored files. When it is enabled, the imports hash the
+// file of each image (BLAKE2b-512), and a file whose content is already stored
+// on the media is not kept: the image refers to the stored one. The contents
+// (pacs_contents) count their images, the count being decreased by the
+// database when an image is deleted. The contents no longer referenced are
+// removed with their file in the background, where the deduplication figures
+// of the partitions are also measured.
+
+class content_store;
+typedef std::shared_ptr<content_store> content_store_ptr;
+
+class content_store {
+public:
+  // removes up to "limit" contents no longer referenced, returns their count:
+  using collect_fn = std::function<std::size_t(std::int32_t limit)>;
+  // reads the deduplication figures of the partitions:
+  using measure_fn = std::function<void(Json::Value& output)>;
+
+  // static constructor:
+  static content_store_ptr create(bool enabled, std::chrono::seconds interval,
+                                  std::size_t batch_size);
+
+  // constructor:
+  content_store(bool enabled, std::chrono::seconds interval,
+                std::size_t batch_size);
+
+  // destructor:
+  ~content_store();
+
+  // prevent copy and move
+  content_store(const content_store&) = delete;
+  content_store& operator=(const content_store&) = delete;
+  content_store(content_store&&) = delete;
+  content_store& operator=(content_store&&) = delete;
+
+  // lifecycle:
+  void start(const collect_fn& collect, const measure_fn& measure);
+  void stop();
+
+  // contents:
+  bool is_enabled() const;
+  static bool hash_file(const std::string& path, std::string& hash,
+                        std::int64_t& size);
+
+  // contents stored and shared by the imports (once they are committed):
+  void add_imported(std::size_t stored, std::size_t shared,
+                    std::int64_t saved_bytes);
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  void collect();
+
+  bool enabled_;
+  std::chrono::seconds interval_;
+  std::int32_t batch_size_;
+
+  collect_fn collect_;
+  measure_fn measure_;
+  std::thread worker_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+  Json::Value figures_;
+
+  std::atomic<std::uint64_t> stored_{0};
+  std::atomic<std::uint64_t> shared_{0};
+  std::atomic<std::int64_t> saved_bytes_{0};
+  std::atomic<std::uint64_t> collected_{0};
+  std::atomic<std::uint64_t> failures_{0};
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////
+// file_releaser class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Deletion of the files replaced by another one. The workers replacing a file
+// (compression, tiering, packing) record it in the database with the date
+// from which it can be deleted, the downloads in progress being completed
+// meanwhile (pacs_file_releases). The files whose date is passed are deleted
+// in the background, at start and then periodically: those replaced before a
+// restart are deleted too.
+
+class file_releaser;
+typedef std::shared_ptr<file_releaser> file_releaser_ptr;
+
+class file_releaser {
+public:
+  // deletes up to "limit" files whose date is passed, returns their count:
+  using release_fn = std::function<std::size_t(std::int32_t limit)>;
+
+  // static constructor:
+  static file_releaser_ptr create(std::chrono::seconds interval,
+                                  std::size_t batch_size);
+
+  // constructor:
+  file_releaser(std::chrono::seconds interval, std::size_t batch_size);
+
+  // destructor:
+  ~file_releaser();
+
+  // prevent copy and move
+  file_releaser(const file_releaser&) = delete;
+  file_releaser& operator=(const file_releaser&) = delete;
+  file_releaser(file_releaser&&) = delete;
+  file_releaser& operator=(file_releaser&&) = delete;
+
+  // lifecycle:
+  void start(const release_fn& release);
+  void stop();
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  void release();
+
+  std::chrono::seconds interval_;
+  std::int32_t batch_size_;
+
+  release_fn release_;
+  std::thread worker_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+
+  std::atomic<std::uint64_t> released_{0};
+  std::atomic<std::uint64_t> failures_{0};
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// import_lock_manager class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Striped table of in-process locks taken by the imports before their
+// transaction reads the partition, keyed by the hash of the partition and of
+// each study uid and patient id of the imported files. The imports of the
+// same study, or of the same patient, are then run one after the other and
+// no longer wait for each other inside the database, while the imports of
+// other studies run in parallel. All the stripes of an import are taken at
+// once in increasing order, and released once the transaction is over, so
+// the imports cannot deadlock on them.
+
+class import_lock_manager;
+typedef std::shared_ptr<import_lock_manager> import_lock_manager_ptr;
+
+class import_lock_manager {
+public:
+  // stripes held by an import, released by the destructor:
+  class guard {
+  public:
+    guard() = default;
+    guard(import_lock_manager* manager, std::vector<std::size_t>&& stripes);
+    ~guard();
+    guard(guard&& other) noexcept;
+    guard& operator=(guard&& other) noexcept;
+    guard(const guard&) = delete;
+    guard& operator=(const guard&) = delete;
+    void release();
+
+  private:
+    import_lock_manager* manager_{nullptr};
+    std::vector<std::size_t> stripes_;
+  };
+
+  // static constructor:
+  static import_lock_manager_ptr create(std::size_t stripes);
+
+  // constructor:
+  explicit import_lock_manager(std::size_t stripes);
+
+  // destructor:
+  ~import_lock_manager();
+
+  // prevent copy and move
+  import_lock_manager(const import_lock_manager&) = delete;
+  import_lock_manager& operator=(const import_lock_manager&) = delete;
+  import_lock_manager(import_lock_manager&&) = delete;
+  import_lock_manager& operator=(import_lock_manager&&) = delete;
+
+  // locks:
+  guard lock(const std::string& partition_seq,
+             const std::set<std::string>& study_uids,
+             const std::set<std::string>& patient_ids);
+
+  // transactions run again after a deadlock or a serialization failure:
+  void add_retry();
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  std::size_t get_stripe(const std::string& partition_seq, char type,
+                         const std::string& value) const;
+  void unlock(const std::vector<std::size_t>& stripes);
+
+  std::size_t stripe_count_;
+  std::unique_ptr<std::mutex[]> stripes_;
+
+  std::atomic<std::uint64_t> acquisitions_{0};
+  std::atomic<std::uint64_t> waits_{0};
+  std::atomic<std::uint64_t> wait_us_{0};
+  std::atomic<std::uint64_t> retries_{0};
+};
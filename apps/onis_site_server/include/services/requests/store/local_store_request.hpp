@@ -2,9 +2,14 @@
 
 #include <cstdint>
 #include <memory>
+#include <set>
 #include <string>
+#include <utility>
 #include <vector>
+#include "../../cache/directory_cache.hpp"
+#include "../../cache/import_lookup_cache.hpp"
 #include "../request_database.hpp"
+#include "./import_lock_manager.hpp"
 #include "onis_kit/include/dicom/dicom.hpp"
 
 class request_service;
@@ -31,6 +36,7 @@ public:
   // operations:
   void set_origin(const std::string& id, const std::string& name,
                   const std::string& ip);
+  void set_move_source_file(bool move);
 
   void import_file_to_partition(
       const request_database& db, std::string& partition_seq,
@@ -38,26 +44,106 @@ public:
       const std::string& media_folder, const std::string& dicom_file_path,
       bool do_commit, Json::Value* output, std::uint32_t* output_flags);
 
-  // Dicom file saving:
+  // Import a file in its own transaction (begun and committed here), run
+  // again when it failed on a deadlock or a serialization failure:
+  void import_file_in_transaction(
+      const request_database& db, std::string& partition_seq,
+      const std::string& partition_parameters, std::int32_t media,
+      const std::string& media_folder, const std::string& dicom_file_path,
+      bool move, Json::Value* output, std::uint32_t* output_flags);
+
+  // Batch import: the files are grouped by study and series, and committed
+  // in a single transaction (begun by the caller). If the batch fails, each
+  // file is imported again in its own transaction. One result is appended to
+  // "output" for each file, in the order of the input paths.
+  void import_files_to_partition(
+      const request_database& db, std::string& partition_seq,
+      const std::string& partition_parameters, std::int32_t media,
+      const std::string& media_folder,
+      const std::vector<std::string>& dicom_file_paths, Json::Value& output);
+
+  // Dicom file saving (the directories already created are skipped when a
+  // directory cache is given):
   static void save_dicom_file(const onis::dicom_file_ptr& dcm,
                               const std::string& folder,
                               const std::string& partition_id,
                               std::string study_date, std::string modality,
                               std::string series_uid, std::string sop,
                               std::string* file_path,
-                              std::string* relative_path);
+                              std::string* relative_path,
+                              const directory_cache_ptr& directories = nullptr,
+                              const std::string& transfer_syntax = "");
 
   static std::string get_dicom_file_path_saving_directory(
       const onis::dicom_file_ptr& dcm, const std::string& folder,
       const std::string& partition_id, std::string study_date,
-      std::string modality, std::string series_uid, std::string sop);
+      std::string modality, std::string series_uid, std::string sop,
+      const directory_cache_ptr& directories = nullptr);
+
+  // Pixel data offsets (position of each frame in a stored file):
+  static bool read_pixel_data_offsets(const std::string& path,
+                                      Json::Value& output);
+  static bool get_pixel_data_offsets(const onis::dicom_file_ptr& dcm,
+                                     Json::Value& output);
 
 private:
+  // file of a batch:
+  struct batch_instance {
+    Json::Value::ArrayIndex result;
+    std::string path;
+    onis::dicom_file_ptr dcm;
+    std::string study_uid;
+    std::string series_uid;
+    std::string patient_id;
+  };
+
+  // series of a batch, whose patient, study and series are resolved by its
+  // first image. The following images are inserted together, and a single
+  // counter delta is logged for them:
+  struct batch_group {
+    bool resolved{false};
+    std::string study_uid;
+    std::string series_uid;
+    std::string identity;
+    Json::Value studies;
+    Json::Value patient;
+    Json::Value study;
+    Json::Value series;
+    std::vector<Json::Value::ArrayIndex> results;
+    std::vector<onis::dicom_base_ptr> datasets;
+    std::vector<std::string> paths;
+    std::vector<Json::Value> pixel_data;
+    std::vector<std::int32_t> compression_status;
+    std::int32_t compression_update{0};
+    std::vector<std::string> contents;
+  };
+
+  // series location stored in the lookup cache once the import is committed:
+  struct pending_location {
+    std::string study_uid;
+    std::string series_uid;
+    import_lookup_cache::location item;
+    std::uint64_t generation;
+  };
+
   request_service_ptr service_;
   onis::dicom_file_ptr dcm_{nullptr};
   std::int32_t media_{0};
   std::string media_folder_;
   std::vector<std::string> created_files_;
+  std::string source_path_;
+  std::string target_path_;
+  bool move_source_file_{false};
+  bool defer_source_moves_{false};
+  std::vector<std::pair<std::string, std::string>> source_moves_;
+  std::set<std::string> batch_sops_;
+  std::vector<pending_location> pending_locations_;
+  std::vector<std::string> inserted_sops_;
+  std::size_t counter_deltas_{0};
+  std::vector<std::string> derived_images_;
+  std::size_t stored_contents_{0};
+  std::size_t shared_contents_{0};
+  std::int64_t shared_bytes_{0};
 
   std::string origin_id_;
   std::string origin_name_;
@@ -97,19 +183,67 @@ private:
 
   // utilities:
   static void check_study_date_format(std::string& study_date);
+  static bool has_file_meta_information(const std::string& path);
   Json::Value* find_matching_patient(Json::Value& patients);
   static Json::Value* find_online_study(Json::Value& items, bool allow_none);
   Json::Value* find_conflict_study(Json::Value& items);
   bool study_is_in_conflict(const Json::Value* item);
+  bool sop_exists(const request_database& db, const Json::Value& studies);
+  void add_sop_to_filter();
+  void check_existing_sop() const;
 
   // process:
   void init(const std::string& parameters, const std::string& path,
             std::int32_t media, const std::string& media_folder);
+  void read_partition_parameters(const std::string& parameters);
+  void load_dicom_file(const std::string& path);
+  void read_dicom_file_information();
+  std::string get_patient_and_study_identity() const;
   void import_file(const request_database& db, const std::string& partition_seq,
-                   Json::Value* output, std::uint32_t* output_flags);
+                   Json::Value* output, std::uint32_t* output_flags,
+                   batch_group* group = nullptr);
+  bool import_file_to_cached_location(
+      const request_database& db, const import_lookup_cache::location& cached,
+      std::uint64_t generation, Json::Value* output,
+      std::uint32_t* output_flags, batch_group* group);
+  void complete_import(const Json::Value& studies, Json::Value* final_items[4],
+                       bool cacheable, std::uint64_t generation,
+                       Json::Value* output, std::uint32_t* output_flags,
+                       batch_group* group);
+  void publish_locations();
+  void publish_counter_deltas();
+  void publish_derived_images();
+  void publish_contents();
+  void wait_before_retry(std::int32_t attempt);
   void add_new_image_to_partition(const request_database& db,
                                   const Json::Value* conflict_study,
                                   Json::Value* existing_items[4],
                                   Json::Value* created_items);
+  void increase_counters(Json::Value* existing_items[4],
+                         Json::Value* final_items[4]);
+  void log_counter_delta(const request_database& db,
+                         Json::Value* final_items[4], std::int32_t images,
+                         bool new_study, bool new_series);
+
+  // batch:
+  void import_batch(const request_database& db,
+                    std::vector<batch_instance>& instances,
+                    Json::Value& output);
+  void add_image_to_group(const request_database& db, batch_group& group,
+                          Json::Value::ArrayIndex result);
+  void flush_group(const request_database& db, batch_group& group,
+                   Json::Value& output);
+  void apply_source_moves();
+  void revert_source_moves();
+  std::string get_import_compression(const request_database& db,
+                                     std::int32_t& update);
+  std::int32_t store_dicom_file(std::string* file_path,
+                                std::string* relative_path,
+                                Json::Value& pixel_data,
+                                const std::string& transfer_syntax);
+  std::string store_content(const request_database& db,
+                            std::string* file_path,
+                            std::string* relative_path);
+  void move_source_file();
   void cleanup();
 };
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// media_migration_worker class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Moves the series between the media of their volume, following the tiering
+// rules of the configuration: the series of a partition (or of all of them)
+// stored on a medium, created and last downloaded before a number of days,
+// are moved to another medium (for example from a fast disk to a bulk one).
+// The rules are applied periodically, the series being read page by page.
+// The files are copied at a limited rate, and the previous ones are deleted
+// later by the file_releaser, so that the downloads in progress can complete.
+
+class media_migration_worker;
+typedef std::shared_ptr<media_migration_worker> media_migration_worker_ptr;
+
+class media_migration_worker {
+public:
+  // outcome of the migration of a series:
+  enum class result { migrated, skipped, failed };
+
+  // reads up to "limit" series to migrate with "rule" after "after_seq",
+  // returns the seq of the last one read, or an empty string once they were
+  // all read:
+  using scan_fn = std::function<std::string(
+      const Json::Value& rule, const std::string& after_seq,
+      std::int32_t limit, std::vector<std::string>& seqs)>;
+  // migrates a series, "files" and "bytes" receive what was moved:
+  using migrate_fn = std::function<result(
+      const Json::Value& rule, const std::string& seq, std::int64_t& files,
+      std::int64_t& bytes)>;
+
+  // static constructor:
+  static media_migration_worker_ptr create(const Json::Value& rules,
+                                           std::chrono::seconds interval,
+                                           std::size_t batch_size,
+                                           std::uint64_t max_bytes_per_second);
+
+  // constructor:
+  media_migration_worker(const Json::Value& rules,
+                         std::chrono::seconds interval, std::size_t batch_size,
+                         std::uint64_t max_bytes_per_second);
+
+  // destructor:
+  ~media_migration_worker();
+
+  // prevent copy and move
+  media_migration_worker(const media_migration_worker&) = delete;
+  media_migration_worker& operator=(const media_migration_worker&) = delete;
+  media_migration_worker(media_migration_worker&&) = delete;
+  media_migration_worker& operator=(media_migration_worker&&) = delete;
+
+  // lifecycle:
+  void start(const scan_fn& scan, const migrate_fn& migrate);
+  void stop();
+
+  // rate limit of the copies, waits until "bytes" can be read and written.
+  // Returns false if the worker is stopping:
+  bool throttle(std::uint64_t bytes);
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  void worker();
+  void apply_rule(const Json::Value& rule);
+
+  Json::Value rules_;
+  std::chrono::seconds interval_;
+  std::int32_t batch_size_;
+  std::uint64_t max_bytes_per_second_;
+
+  scan_fn scan_;
+  migrate_fn migrate_;
+  std::thread worker_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+  std::chrono::steady_clock::time_point next_io_;
+
+  std::atomic<std::uint64_t> migrated_{0};
+  std::atomic<std::uint64_t> skipped_{0};
+  std::atomic<std::uint64_t> failed_{0};
+  std::atomic<std::uint64_t> errors_{0};
+  std::atomic<std::int64_t> files_{0};
+  std::atomic<std::int64_t> bytes_{0};
+  std::atomic<std::uint64_t> throttled_ms_{0};
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// transcode_pool class
+////////////////////////////////////////////////////////////////////////////////
+//
+// Pool of workers transcoding the images requested in another transfer
+// syntax. The requests wait for their transcoding, which runs on one of the
+// "workers" threads so that concurrent retrievals are transcoded in parallel
+// without exhausting the request threads. At most "max_pending" transcodings
+// wait for a worker, the other requests are rejected as busy.
+
+class transcode_pool;
+typedef std::shared_ptr<transcode_pool> transcode_pool_ptr;
+
+class transcode_pool {
+public:
+  using task_fn = std::function<void()>;
+
+  // static constructor:
+  static transcode_pool_ptr create(std::uint32_t workers,
+                                   std::size_t max_pending);
+
+  // constructor:
+  transcode_pool(std::uint32_t workers, std::size_t max_pending);
+
+  // destructor:
+  ~transcode_pool();
+
+  // prevent copy and move
+  transcode_pool(const transcode_pool&) = delete;
+  transcode_pool& operator=(const transcode_pool&) = delete;
+  transcode_pool(transcode_pool&&) = delete;
+  transcode_pool& operator=(transcode_pool&&) = delete;
+
+  // lifecycle:
+  bool is_enabled() const;
+  void start();
+  void stop();
+
+  // Run "task" on a worker and wait for its end, returns the time it took.
+  // Throws when the pool is stopped or busy, and rethrows the exception of
+  // the task.
+  std::chrono::microseconds run(const task_fn& task);
+
+  // statistics:
+  void get_statistics(Json::Value& output) const;
+
+private:
+  struct job {
+    task_fn task;
+    std::promise<void> done;
+    std::chrono::steady_clock::time_point queued;
+    std::chrono::microseconds duration{0};
+  };
+
+  void worker();
+  void record(std::chrono::microseconds wait,
+              std::chrono::microseconds duration);
+
+  std::uint32_t workers_count_;
+  std::size_t max_pending_;
+  std::vector<std::thread> workers_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_{false};
+  std::deque<std::shared_ptr<job>> pending_;
+  std::size_t running_{0};
+  std::int64_t max_us_{0};
+
+  std::atomic<std::uint64_t> completed_{0};
+  std::atomic<std::uint64_t> failed_{0};
+  std::atomic<std::uint64_t> rejected_{0};
+  std::atomic<std::int64_t> total_us_{0};
+  std::atomic<std::int64_t> wait_us_{0};
+};
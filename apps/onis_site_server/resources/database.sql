@@ -49,6 +49,44 @@ CREATE TABLE public.pacs_compressions (
 
 ALTER TABLE public.pacs_compressions OWNER TO dgc;
 
+--
+-- Name: pacs_contents; Type: TABLE; Schema: public; Owner: dgc
+--
+
+CREATE TABLE public.pacs_contents (
+    id uuid NOT NULL,
+    volume_id uuid NOT NULL,
+    media integer NOT NULL,
+    hash character varying(128) NOT NULL,
+    size bigint NOT NULL,
+    path text NOT NULL,
+    refcnt integer NOT NULL,
+    crdate timestamp(0) without time zone NOT NULL
+);
+
+
+ALTER TABLE public.pacs_contents OWNER TO dgc;
+
+--
+-- Name: pacs_counter_deltas; Type: TABLE; Schema: public; Owner: dgc
+--
+
+CREATE TABLE public.pacs_counter_deltas (
+    id uuid NOT NULL,
+    patient_id uuid NOT NULL,
+    study_id uuid NOT NULL,
+    series_id uuid NOT NULL,
+    pstcnt integer NOT NULL,
+    psrcnt integer NOT NULL,
+    pimcnt integer NOT NULL,
+    srcnt integer NOT NULL,
+    imcnt integer NOT NULL,
+    summary integer NOT NULL
+);
+
+
+ALTER TABLE public.pacs_counter_deltas OWNER TO dgc;
+
 --
 -- TOC entry 227 (class 1259 OID 141601)
 -- Name: pacs_dicom_access; Type: TABLE; Schema: public; Owner: dgc
@@ -139,7 +177,9 @@ CREATE TABLE public.pacs_download_images (
     path text NOT NULL,
     type integer NOT NULL,
     rescnt integer NOT NULL,
-    result integer NOT NULL
+    result integer NOT NULL,
+    packoffset bigint,
+    packsize bigint
 );
 
 
@@ -163,6 +203,21 @@ CREATE TABLE public.pacs_download_series (
 
 ALTER TABLE public.pacs_download_series OWNER TO dgc;
 
+--
+-- Name: pacs_file_releases; Type: TABLE; Schema: public; Owner: dgc
+--
+
+CREATE TABLE public.pacs_file_releases (
+    id uuid NOT NULL,
+    volume_id uuid NOT NULL,
+    media integer NOT NULL,
+    path text NOT NULL,
+    duedate timestamp(0) without time zone NOT NULL
+);
+
+
+ALTER TABLE public.pacs_file_releases OWNER TO dgc;
+
 --
 -- TOC entry 233 (class 1259 OID 141698)
 -- Name: pacs_image_links; Type: TABLE; Schema: public; Owner: dgc
@@ -205,7 +260,14 @@ CREATE TABLE public.pacs_images (
     crdate timestamp(0) without time zone NOT NULL,
     oid character varying(255),
     oname character varying(255),
-    oip character varying(255)
+    oip character varying(255),
+    pxoffset bigint,
+    frmcnt integer,
+    frmtable text,
+    content_id uuid,
+    packoffset bigint,
+    packsize bigint,
+    pxstats text
 );
 
 
@@ -613,7 +675,9 @@ CREATE TABLE public.pacs_series (
     crdate timestamp(0) without time zone NOT NULL,
     oid character varying(255),
     oname character varying(255),
-    oip character varying(255)
+    oip character varying(255),
+    accdate timestamp(0) without time zone,
+    pxstats text
 );
 
 
@@ -897,6 +961,25 @@ ALTER TABLE ONLY public.pacs_compressions
     ADD CONSTRAINT pacs_compressions_pkey PRIMARY KEY (id);
 
 
+--
+-- Name: pacs_contents pacs_contents_pkey; Type: CONSTRAINT; Schema: public; Owner: dgc
+--
+
+ALTER TABLE ONLY public.pacs_contents
+    ADD CONSTRAINT pacs_contents_pkey PRIMARY KEY (id);
+
+
+--
+-- Name: pacs_counter_deltas pacs_counter_deltas_pkey; Type: CONSTRAINT; Schema: public; Owner: dgc
+--
+
+ALTER TABLE ONLY public.pacs_counter_deltas
+    ADD CONSTRAINT pacs_counter_deltas_pkey PRIMARY KEY (id);
+
+CREATE INDEX pacs_counter_deltas_patient_id_index ON public.pacs_counter_deltas USING btree (patient_id);
+CREATE INDEX pacs_counter_deltas_study_id_index ON public.pacs_counter_deltas USING btree (study_id);
+
+
 --
 -- TOC entry 3273 (class 2606 OID 141622)
 -- Name: pacs_dicom_access_items pacs_dicom_access_items_pkey; Type: CONSTRAINT; Schema: public; Owner: dgc
@@ -951,6 +1034,17 @@ ALTER TABLE ONLY public.pacs_download_series
     ADD CONSTRAINT pacs_download_series_pkey PRIMARY KEY (id);
 
 CREATE INDEX pacs_download_series_date_index ON public.pacs_download_series USING btree (date);
+CREATE INDEX pacs_download_series_series_id_index ON public.pacs_download_series USING btree (series_id);
+
+--
+-- Name: pacs_file_releases pacs_file_releases_pkey; Type: CONSTRAINT; Schema: public; Owner: dgc
+--
+
+ALTER TABLE ONLY public.pacs_file_releases
+    ADD CONSTRAINT pacs_file_releases_pkey PRIMARY KEY (id);
+
+CREATE INDEX pacs_file_releases_duedate_index ON public.pacs_file_releases USING btree (duedate);
+CREATE INDEX pacs_file_releases_path_index ON public.pacs_file_releases USING btree (volume_id, media, path);
 
 --
 -- TOC entry 3286 (class 2606 OID 141702)
@@ -1365,6 +1459,35 @@ CREATE UNIQUE INDEX pacs_images_series_id_uid_status_index ON public.pacs_images
 CREATE INDEX pacs_images_series_id_index ON public.pacs_images USING btree (series_id);
 CREATE INDEX pacs_images_uid_index ON public.pacs_images USING btree (uid);
 CREATE INDEX pacs_images_status_index ON public.pacs_images USING btree (status);
+CREATE INDEX pacs_images_pending_derived_index ON public.pacs_images USING btree (id) WHERE ((streammedia = '-2'::integer) OR (iconmedia = '-2'::integer) OR (pxstats IS NULL));
+CREATE INDEX pacs_images_content_id_index ON public.pacs_images USING btree (content_id) WHERE (content_id IS NOT NULL);
+
+CREATE UNIQUE INDEX pacs_contents_volume_id_media_hash_size_index ON public.pacs_contents USING btree (volume_id, media, hash, size);
+CREATE INDEX pacs_contents_unreferenced_index ON public.pacs_contents USING btree (id) WHERE (refcnt <= 0);
+
+--
+-- Name: pacs_images_release_content; Type: FUNCTION; Schema: public; Owner: dgc
+--
+-- The file of a deduplicated image is released when the image is deleted or
+-- no longer refers to it. The contents no longer referenced are removed with
+-- their file by the site server.
+--
+
+CREATE FUNCTION public.pacs_images_release_content() RETURNS trigger
+    LANGUAGE plpgsql
+    AS $$
+BEGIN
+    IF OLD.content_id IS NOT NULL AND (TG_OP = 'DELETE' OR NEW.content_id IS DISTINCT FROM OLD.content_id) THEN
+        UPDATE public.pacs_contents SET refcnt = refcnt - 1 WHERE id = OLD.content_id;
+    END IF;
+    RETURN NULL;
+END;
+$$;
+
+
+ALTER FUNCTION public.pacs_images_release_content() OWNER TO dgc;
+
+CREATE TRIGGER pacs_images_release_content_trigger AFTER DELETE OR UPDATE OF content_id ON public.pacs_images FOR EACH ROW EXECUTE PROCEDURE public.pacs_images_release_content();
 
 --
 -- TOC entry 3199 (class 1259 OID 141193)
@@ -0,0 +1,339 @@
+#include <string>
+#include <vector>
+#include "../../include/database/items/db_image.hpp"
+#include "../../include/database/site_database.hpp"
+#include "onis_kit/include/core/exception.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// Consistency check operations
+////////////////////////////////////////////////////////////////////////////////
+//
+// The files found in the media folders of a partition are compared with the
+// files its rows refer to (images, stream files, icons and contents), and the
+// counters of its patients, studies and series with the rows they count. The
+// counter deltas not applied yet are taken into account.
+
+// columns of the files of an image, by kind of file (see
+// set_image_file_media):
+static const char* const kFileMediaColumns[] = {"STREAMMEDIA", "ICONMEDIA"};
+static const char* const kFilePathColumns[] = {"STREAMPATH", "ICONPATH"};
+
+// a counter, and how the rows it counts are counted:
+struct counter_definition {
+  const char* name;
+  const char* column;
+  const char* count;
+  const char* delta;
+};
+
+// the counters of a level:
+struct counter_level {
+  const char* name;
+  const char* table;
+  const char* from;
+  const char* partition;
+  const char* delta_key;
+  std::vector<counter_definition> counters;
+};
+
+static const std::vector<counter_level> kCounterLevels = {
+    {"patient",
+     "pacs_patients",
+     "pacs_patients",
+     "pacs_patients.partition_id",
+     "patient_id",
+     {{"studies", "stcnt",
+       "SELECT COUNT(*) FROM pacs_studies WHERE pacs_studies.patient_id="
+       "pacs_patients.id",
+       "pstcnt"},
+      {"series", "srcnt",
+       "SELECT COUNT(*) FROM pacs_series INNER JOIN pacs_studies ON "
+       "pacs_studies.id=pacs_series.study_id WHERE pacs_studies.patient_id="
+       "pacs_patients.id",
+       "psrcnt"},
+      {"images", "imcnt",
+       "SELECT COUNT(*) FROM pacs_images INNER JOIN pacs_series ON "
+       "pacs_series.id=pacs_images.series_id INNER JOIN pacs_studies ON "
+       "pacs_studies.id=pacs_series.study_id WHERE pacs_studies.patient_id="
+       "pacs_patients.id",
+       "pimcnt"}}},
+    {"study",
+     "pacs_studies",
+     "pacs_studies",
+     "pacs_studies.partition_id",
+     "study_id",
+     {{"series", "srcnt",
+       "SELECT COUNT(*) FROM pacs_series WHERE pacs_series.study_id="
+       "pacs_studies.id",
+       "srcnt"},
+      {"images", "imcnt",
+       "SELECT COUNT(*) FROM pacs_images INNER JOIN pacs_series ON "
+       "pacs_series.id=pacs_images.series_id WHERE pacs_series.study_id="
+       "pacs_studies.id",
+       "imcnt"}}},
+    {"series",
+     "pacs_series",
+     "pacs_series inner join pacs_studies on pacs_studies.id = "
+     "pacs_series.study_id",
+     "pacs_studies.partition_id",
+     "series_id",
+     {{"images", "imcnt",
+       "SELECT COUNT(*) FROM pacs_images WHERE pacs_images.series_id="
+       "pacs_series.id",
+       "imcnt"}}}};
+
+static const counter_level& find_counter_level(const std::string& name) {
+  for (const auto& level : kCounterLevels) {
+    if (name == level.name)
+      return level;
+  }
+  throw onis::exception(EOS_PARAM, "Invalid counter level");
+}
+
+// The rows counted by a counter, and the deltas not applied yet:
+static std::string get_counted_rows(const counter_definition& counter) {
+  return std::string("CAST((") + counter.count + ") AS INTEGER)";
+}
+
+static std::string get_pending_delta(const counter_level& level,
+                                     const counter_definition& counter) {
+  return std::string("CAST((SELECT COALESCE(SUM(pacs_counter_deltas.") +
+         counter.delta + "),0) FROM pacs_counter_deltas WHERE "
+         "pacs_counter_deltas." + level.delta_key + "=" + level.table +
+         ".id) AS INTEGER)";
+}
+
+//------------------------------------------------------------------------------
+// Files
+//------------------------------------------------------------------------------
+
+// Read the files of the images of a partition, page by page in the order of
+// their seqs. Returns the seq of the last image read, or an empty string once
+// all the images were read.
+std::string site_database::get_check_images(const std::string& partition_seq,
+                                            const std::string& after_seq,
+                                            std::int32_t limit,
+                                            Json::Value& output) {
+  const auto columns =
+      "pacs_images.id, pacs_images.uid, pacs_images.imgmedia, "
+      "pacs_images.imgpath, pacs_images.streammedia, pacs_images.streampath, "
+      "pacs_images.iconmedia, pacs_images.iconpath";
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id";
+  std::string clause = "pacs_studies.partition_id=?";
+  if (!after_seq.empty())
+    clause += " AND pacs_images.id>?";
+  std::string sql = sql_builder_->build_select_query(
+      columns, from, clause, "pacs_images.id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_check_images");
+
+  int index = 1;
+  bind_parameter(query, index, partition_seq, "partition_id");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& image = output.append(Json::objectValue);
+      last_seq = row->get_uuid(row_index, false, false);
+      image[BASE_SEQ_KEY] = last_seq;
+      image[IM_UID_KEY] = row->get_string(row_index, false, false);
+      image[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, false);
+      image[IM_IMAGE_PATH_KEY] = row->get_string(row_index, true, true);
+      image[IM_STREAM_MEDIA_KEY] = row->get_int(row_index, false);
+      image[IM_STREAM_PATH_KEY] = row->get_string(row_index, true, true);
+      image[IM_ICON_MEDIA_KEY] = row->get_int(row_index, false);
+      image[IM_ICON_PATH_KEY] = row->get_string(row_index, true, true);
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Read the icons of the series of a partition (see get_check_images), as
+// {seq, media, path} items.
+std::string site_database::get_check_series_icons(
+    const std::string& partition_seq, const std::string& after_seq,
+    std::int32_t limit, Json::Value& output) {
+  const auto columns =
+      "pacs_series.id, COALESCE(pacs_series.iconmedia, -1), "
+      "pacs_series.iconpath";
+  const std::string from =
+      "pacs_series inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id";
+  std::string clause = "pacs_studies.partition_id=?";
+  if (!after_seq.empty())
+    clause += " AND pacs_series.id>?";
+  std::string sql = sql_builder_->build_select_query(
+      columns, from, clause, "pacs_series.id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_check_series_icons");
+
+  int index = 1;
+  bind_parameter(query, index, partition_seq, "partition_id");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& icon = output.append(Json::objectValue);
+      last_seq = row->get_uuid(row_index, false, false);
+      icon[BASE_SEQ_KEY] = last_seq;
+      icon["media"] = row->get_int(row_index, false);
+      icon["path"] = row->get_string(row_index, true, true);
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Read the contents stored on the media of a volume, the ones no longer
+// referenced included (see get_check_images), as {seq, media, path} items.
+std::string site_database::get_check_contents(const std::string& volume_seq,
+                                              const std::string& after_seq,
+                                              std::int32_t limit,
+                                              Json::Value& output) {
+  std::string clause = "volume_id=?";
+  if (!after_seq.empty())
+    clause += " AND id>?";
+  std::string sql = sql_builder_->build_select_query(
+      "id, media, path", "pacs_contents", clause, "id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_check_contents");
+
+  int index = 1;
+  bind_parameter(query, index, volume_seq, "volume_id");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& content = output.append(Json::objectValue);
+      last_seq = row->get_uuid(row_index, false, false);
+      content[BASE_SEQ_KEY] = last_seq;
+      content["media"] = row->get_int(row_index, false);
+      content["path"] = row->get_string(row_index, false, false);
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Set the stream file ("kind" 1) or the icon ("kind" 2) of an image pending
+// again, when its file is missing: it is created again by the derived object
+// worker. Returns false if the file of the image was changed meanwhile.
+bool site_database::reset_derived_object(const std::string& seq,
+                                         std::int32_t kind,
+                                         std::int32_t media,
+                                         const std::string& path) {
+  if (kind < 1 || kind > 2)
+    throw onis::exception(EOS_PARAM, "Invalid kind of file");
+  std::string media_column = kFileMediaColumns[kind - 1];
+  std::string path_column = kFilePathColumns[kind - 1];
+  auto query = prepare_query("UPDATE PACS_IMAGES SET " + media_column +
+                                 "=-2, " + path_column + "=NULL WHERE ID=? "
+                                 "AND " + media_column + "=? AND " +
+                                 path_column + "=?",
+                             "reset_derived_object");
+  int index = 1;
+  bind_parameter(query, index, seq, "id");
+  bind_parameter(query, index, media, "media");
+  bind_parameter(query, index, path, "path");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+//------------------------------------------------------------------------------
+// Counters
+//------------------------------------------------------------------------------
+
+// Read the patients, studies or series ("level") of a partition whose
+// counters differ from the rows they count, page by page in the order of
+// their seqs. Each item receives, by counter, the "stored" value, the
+// "actual" count and the "pending" deltas. Returns the seq of the last item
+// read, or an empty string once all the items were read.
+std::string site_database::get_counter_mismatches(
+    const std::string& level_name, const std::string& partition_seq,
+    const std::string& after_seq, std::int32_t limit, Json::Value& output) {
+  const counter_level& level = find_counter_level(level_name);
+  std::string columns = std::string(level.table) + ".id";
+  std::string mismatch;
+  for (const auto& counter : level.counters) {
+    std::string stored = std::string(level.table) + "." + counter.column;
+    std::string counted = get_counted_rows(counter);
+    std::string pending = get_pending_delta(level, counter);
+    columns += ", " + stored + ", " + counted + ", " + pending;
+    if (!mismatch.empty())
+      mismatch += " OR ";
+    mismatch += stored + "+" + pending + "<>" + counted;
+  }
+  std::string clause =
+      std::string(level.partition) + "=? AND (" + mismatch + ")";
+  if (!after_seq.empty())
+    clause += std::string(" AND ") + level.table + ".id>?";
+  std::string sql = sql_builder_->build_select_query(
+      columns, level.from, clause, std::string(level.table) + ".id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_counter_mismatches");
+
+  int index = 1;
+  bind_parameter(query, index, partition_seq, "partition_id");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& item = output.append(Json::objectValue);
+      last_seq = row->get_uuid(row_index, false, false);
+      item[BASE_SEQ_KEY] = last_seq;
+      item["level"] = level.name;
+      for (const auto& counter : level.counters) {
+        Json::Value& value = item["counters"][counter.name];
+        value["stored"] = row->get_int(row_index, false);
+        value["actual"] = row->get_int(row_index, false);
+        value["pending"] = row->get_int(row_index, false);
+      }
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Set the counters of a patient, study or series to the rows they count (the
+// deltas not applied yet excluded). Returns false if the item no longer
+// exists.
+bool site_database::fix_counters(const std::string& level_name,
+                                 const std::string& seq) {
+  const counter_level& level = find_counter_level(level_name);
+  std::string values;
+  for (const auto& counter : level.counters) {
+    if (!values.empty())
+      values += ", ";
+    values += std::string(counter.column) + "=" + get_counted_rows(counter) +
+              "-" + get_pending_delta(level, counter);
+  }
+  auto query = prepare_query(
+      std::string("UPDATE ") + level.table + " SET " + values + " WHERE id=?",
+      "fix_counters");
+  int index = 1;
+  bind_parameter(query, index, seq, "id");
+  return execute_query(query)->get_affected_rows() > 0;
+}
@@ -2,6 +2,8 @@
 #include <list>
 #include <sstream>
 #include "../../include/database/items/db_compression.hpp"
+#include "../../include/database/items/db_image.hpp"
+#include "../../include/database/items/db_partition.hpp"
 #include "../../include/database/site_database.hpp"
 #include "onis_kit/include/core/exception.hpp"
 #include "onis_kit/include/utilities/uuid.hpp"
@@ -99,5 +101,151 @@ void site_database::get_partition_compressions(const std::string& partition_seq,
     }
   }
 }
-/*void get_first_hundred_images_to_compress(onis::astring_list& images,
-                                          onis::aresult& res);*/
+
+//------------------------------------------------------------------------------
+// Images to compress
+//------------------------------------------------------------------------------
+//
+// An image is to compress while the active rule of its partition was not
+// applied to it: it was stored as received, or compressed (or found not
+// compressible) with a previous version of the rule. The scheduled rules only
+// apply during their window, from the start hour to the stop hour (excluded,
+// possibly past midnight, the whole day when they are equal). The files
+// shared by several images (deduplicated contents) and the packed images are
+// left as stored, the content of a single image is released on compression.
+
+// Read the images to compress at "hour", page by page in the order of their
+// seqs. Returns the seq of the last image read, or an empty string once all
+// the images were read.
+std::string site_database::get_images_to_compress(
+    std::int32_t hour, const std::string& after_seq, std::int32_t limit,
+    std::vector<std::string>& seqs) {
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id inner join pacs_compressions on "
+      "pacs_compressions.partition_id = pacs_studies.partition_id";
+  std::string clause =
+      get_unshared_file_clause() +
+      " AND pacs_images.packoffset IS NULL AND pacs_compressions.active=1 "
+      "AND (COALESCE(pacs_images.cstatus, 0)=0 OR "
+      "COALESCE(pacs_images.cupd, 0)<>pacs_compressions.updatecnt) AND "
+      "(pacs_compressions.mode<>? OR COALESCE(pacs_compressions.start, 0)="
+      "COALESCE(pacs_compressions.stop, 0) OR (pacs_compressions.start<"
+      "pacs_compressions.stop AND ?>=pacs_compressions.start AND ?<"
+      "pacs_compressions.stop) OR (pacs_compressions.start>"
+      "pacs_compressions.stop AND (?>=pacs_compressions.start OR ?<"
+      "pacs_compressions.stop)))";
+  if (!after_seq.empty())
+    clause += " AND pacs_images.id>?";
+  std::string sql = sql_builder_->build_select_query(
+      "pacs_images.id", from, clause, "pacs_images.id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_images_to_compress");
+
+  int index = 1;
+  bind_parameter(query, index, onis::database::compression_mode_scheduled,
+                 "mode");
+  for (std::int32_t i = 0; i < 4; i++)
+    bind_parameter(query, index, hour, "hour");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      last_seq = row->get_uuid(row_index, false, false);
+      seqs.push_back(last_seq);
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Read what the compression of an image needs: its file, its compression
+// status, its series, its partition and the volume of its partition. Returns
+// false if the image no longer exists, or if its file is shared with other
+// images or is a packed image.
+bool site_database::find_compression_image_source(const std::string& seq,
+                                                  Json::Value& output) {
+  const auto columns =
+      "pacs_images.imgmedia, pacs_images.imgpath, pacs_images.cstatus, "
+      "pacs_images.cupd, pacs_images.series_id, pacs_partitions.id, "
+      "pacs_partitions.volume_id";
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id inner join pacs_partitions on pacs_partitions.id "
+      "= pacs_studies.partition_id";
+  const std::string clause = "pacs_images.id=? AND " +
+                             get_unshared_file_clause() +
+                             " AND pacs_images.packoffset IS NULL";
+  auto query = create_and_prepare_query(columns, from, clause,
+                                        onis::database::lock_mode::NO_LOCK);
+
+  int index = 1;
+  bind_parameter(query, index, seq, "id");
+
+  auto result = execute_query(query);
+  if (!result->has_rows())
+    return false;
+  auto row = result->get_next_row();
+  if (!row)
+    return false;
+  std::int32_t row_index = 0;
+  output[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, false);
+  output[IM_IMAGE_PATH_KEY] = row->get_string(row_index, true, true);
+  output[IM_COMP_STATUS_KEY] = row->get_int(row_index, true);
+  output[IM_COMP_UPDATE_KEY] = row->get_int(row_index, true);
+  output["series"] = row->get_uuid(row_index, false, false);
+  output["partition"] = row->get_uuid(row_index, false, false);
+  output[PT_VOLUME_KEY] = row->get_uuid(row_index, true, true);
+  return true;
+}
+
+// Record the compressed file of an image, with the position of its frames.
+// Returns false if the file of the image was changed meanwhile.
+bool site_database::set_image_compressed(const std::string& seq,
+                                         std::int32_t media,
+                                         const std::string& path,
+                                         const std::string& new_path,
+                                         const Json::Value& pixel_data,
+                                         std::int32_t update) {
+  auto query = prepare_query(
+      "UPDATE PACS_IMAGES SET IMGPATH=?, CSTATUS=?, CUPD=?, PXOFFSET=?, "
+      "FRMCNT=?, FRMTABLE=? WHERE ID=? AND IMGMEDIA=? AND IMGPATH=?",
+      "set_image_compressed");
+  int index = 1;
+  bind_parameter(query, index, new_path, "imgpath");
+  bind_parameter(query, index, onis::database::image_compression_done,
+                 "cstatus");
+  bind_parameter(query, index, update, "cupd");
+  bind_pixel_data_parameters(query, index, pixel_data);
+  bind_parameter(query, index, seq, "id");
+  bind_parameter(query, index, media, "imgmedia");
+  bind_parameter(query, index, path, "old_imgpath");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+// Record that an image was left as is (already in the transfer syntax, or
+// not compressible). Returns false if its file was changed meanwhile.
+bool site_database::set_image_compression_status(const std::string& seq,
+                                                 std::int32_t media,
+                                                 const std::string& path,
+                                                 std::int32_t status,
+                                                 std::int32_t update) {
+  auto query = prepare_query(
+      "UPDATE PACS_IMAGES SET CSTATUS=?, CUPD=? WHERE ID=? AND IMGMEDIA=? AND "
+      "IMGPATH=?",
+      "set_image_compression_status");
+  int index = 1;
+  bind_parameter(query, index, status, "cstatus");
+  bind_parameter(query, index, update, "cupd");
+  bind_parameter(query, index, seq, "id");
+  bind_parameter(query, index, media, "imgmedia");
+  bind_parameter(query, index, path, "imgpath");
+  return execute_query(query)->get_affected_rows() > 0;
+}
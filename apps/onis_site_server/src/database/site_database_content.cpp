@@ -0,0 +1,256 @@
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../../include/database/items/db_partition.hpp"
+#include "../../include/database/site_database.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// Content operations
+////////////////////////////////////////////////////////////////////////////////
+//
+// The files of the images are stored once per content (hash and size) and per
+// media of a volume. A content counts the images referring to it (refcnt),
+// the count is decreased by the database when an image is deleted or no
+// longer refers to it (see pacs_images_release_content). The contents whose
+// count dropped to 0 are removed with their file by the site server. The
+// file of a content referred to by a single image can be compressed, moved or
+// packed with it: the image is first detached from its content.
+
+//------------------------------------------------------------------------------
+// Utilities
+//------------------------------------------------------------------------------
+
+// Condition on pacs_images selecting the images whose file is not shared with
+// other images: without content, or the only one to refer to their content.
+std::string site_database::get_unshared_file_clause() {
+  return "NOT EXISTS (SELECT 1 FROM pacs_contents WHERE pacs_contents.id="
+         "pacs_images.content_id AND pacs_contents.refcnt>1)";
+}
+
+//------------------------------------------------------------------------------
+// Create operations
+//------------------------------------------------------------------------------
+
+// Reference the content of a stored file, recorded with "path" if it was not
+// stored yet on the media. "output" receives the seq and the path of the
+// content. Returns true if the content was created (its file is the one at
+// "path"), false if it was already stored (the file at "path" is not needed).
+bool site_database::acquire_content(const std::string& partition_seq,
+                                    std::int32_t media,
+                                    const std::string& hash, std::int64_t size,
+                                    const std::string& path,
+                                    const onis::core::date_time& dt,
+                                    Json::Value& output) {
+  std::ostringstream crdate_oss;
+  crdate_oss << std::setfill('0') << std::setw(4) << dt.year() << std::setw(2)
+             << dt.month() << std::setw(2) << dt.day() << " " << std::setw(2)
+             << dt.hour() << std::setw(2) << dt.minute() << std::setw(2)
+             << dt.second();
+
+  // a content no longer referenced but not removed yet is referenced again,
+  // its file is still there:
+  std::string sql =
+      "INSERT INTO PACS_CONTENTS (ID, VOLUME_ID, MEDIA, HASH, SIZE, PATH, "
+      "REFCNT, CRDATE) SELECT ?, VOLUME_ID, ?, ?, ?, ?, 1, ? FROM "
+      "PACS_PARTITIONS WHERE ID=? ON CONFLICT (VOLUME_ID, MEDIA, HASH, SIZE) "
+      "DO UPDATE SET REFCNT=PACS_CONTENTS.REFCNT+1 RETURNING ID, PATH";
+  auto query = prepare_query(sql, "acquire_content");
+
+  int index = 1;
+  bind_parameter(query, index, onis::util::uuid::generate_random_uuid(), "id");
+  bind_parameter(query, index, media, "media");
+  bind_parameter(query, index, hash, "hash");
+  bind_parameter(query, index, std::to_string(size), "size");
+  bind_parameter(query, index, path, "path");
+  bind_parameter(query, index, crdate_oss.str(), "crdate");
+  bind_parameter(query, index, partition_seq, "partition_id");
+
+  auto result = execute_query(query);
+  auto row = result->has_rows() ? result->get_next_row() : nullptr;
+  if (!row)
+    throw onis::exception(EOS_DB_QUERY, "Failed to reference the content");
+  std::int32_t row_index = 0;
+  output[BASE_SEQ_KEY] = row->get_uuid(row_index, false, false);
+  output["path"] = row->get_string(row_index, false, false);
+  return output["path"].asString() == path;
+}
+
+//------------------------------------------------------------------------------
+// Modify operations
+//------------------------------------------------------------------------------
+
+// Record the contents of images, the images without content are skipped:
+void site_database::set_images_content(
+    const std::vector<std::string>& image_seqs,
+    const std::vector<std::string>& content_seqs) {
+  // the images are updated by chunks, the number of parameters of a statement
+  // is limited:
+  const std::size_t chunk_size = 1000;
+  std::size_t start = 0;
+  while (start < image_seqs.size()) {
+    std::string values;
+    std::vector<std::size_t> items;
+    for (; start < image_seqs.size() && items.size() < chunk_size; start++) {
+      if (content_seqs[start].empty())
+        continue;
+      if (!items.empty())
+        values += ", ";
+      values += "(CAST(? AS UUID), CAST(? AS UUID))";
+      items.push_back(start);
+    }
+    if (items.empty())
+      continue;
+
+    std::string sql =
+        "UPDATE PACS_IMAGES SET CONTENT_ID=V.CONTENT_ID FROM (VALUES " +
+        values + ") AS V(ID, CONTENT_ID) WHERE PACS_IMAGES.ID=V.ID";
+    auto query = prepare_query(sql, "set_images_content");
+    int index = 1;
+    for (std::size_t i : items) {
+      bind_parameter(query, index, image_seqs[i], "id");
+      bind_parameter(query, index, content_seqs[i], "content_id");
+    }
+    if (execute_query(query)->get_affected_rows() !=
+        static_cast<int>(items.size()))
+      throw onis::exception(EOS_DB_QUERY, "Failed to set the image contents");
+  }
+}
+
+// Detach an image from its content before its file is rewritten, moved or
+// packed: the content is removed without its file, which stays the file of
+// the image alone. Returns false if the content is shared with other images
+// (its file must be left as is), true if the image has no content or was the
+// only one to refer to it.
+bool site_database::release_image_content(const std::string& image_seq) {
+  auto query = create_and_prepare_query("content_id", "pacs_images", "id=?",
+                                        onis::database::lock_mode::NO_LOCK);
+  int index = 1;
+  bind_parameter(query, index, image_seq, "id");
+  auto result = execute_query(query);
+  auto row = result->has_rows() ? result->get_next_row() : nullptr;
+  if (!row)
+    return true;
+  std::int32_t row_index = 0;
+  std::string content_seq = row->get_uuid(row_index, true, true);
+  if (content_seq.empty())
+    return true;
+
+  // an import referencing the content meanwhile waits for the removal, and
+  // then creates a new content:
+  auto delete_query = prepare_query(
+      "DELETE FROM PACS_CONTENTS WHERE ID=? AND REFCNT<=1",
+      "release_image_content");
+  index = 1;
+  bind_parameter(delete_query, index, content_seq, "id");
+  if (execute_query(delete_query)->get_affected_rows() == 0)
+    return false;
+
+  auto update_query = prepare_query(
+      "UPDATE PACS_IMAGES SET CONTENT_ID=NULL WHERE ID=? AND CONTENT_ID=?",
+      "detach_image_content");
+  index = 1;
+  bind_parameter(update_query, index, image_seq, "id");
+  bind_parameter(update_query, index, content_seq, "content_id");
+  execute_query(update_query);
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Delete operations
+//------------------------------------------------------------------------------
+
+// Remove up to "limit" contents no longer referenced, "contents" receives
+// their volume, media and path so that their files can be deleted once the
+// transaction is committed. Returns the number of contents removed.
+std::size_t site_database::collect_contents(
+    std::int32_t limit, std::vector<Json::Value>& contents) {
+  std::string sql = sql_builder_->build_select_query(
+      "id, volume_id, media, path", "pacs_contents", "refcnt<=0", "", limit,
+      onis::database::lock_mode::EXCLUSIVE_LOCK);
+  auto query = prepare_query(sql, "collect_contents");
+
+  std::vector<std::string> ids;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      ids.push_back(row->get_uuid(row_index, false, false));
+      Json::Value& content = contents.emplace_back(Json::objectValue);
+      content[PT_VOLUME_KEY] = row->get_uuid(row_index, false, false);
+      content["media"] = row->get_int(row_index, false);
+      content["path"] = row->get_string(row_index, false, false);
+    }
+  }
+  if (ids.empty())
+    return 0;
+
+  std::string clause;
+  for (std::size_t i = 0; i < ids.size(); i++)
+    clause += i == 0 ? "?" : ", ?";
+  auto delete_query = prepare_query(
+      "DELETE FROM PACS_CONTENTS WHERE ID IN (" + clause + ")",
+      "delete_contents");
+  int index = 1;
+  for (const auto& id : ids)
+    bind_parameter(delete_query, index, id, "id");
+  execute_query(delete_query);
+  return ids.size();
+}
+
+//------------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------------
+
+// Read the deduplication figures: those of all the stored contents, and per
+// partition, the images stored as contents and the contents they refer to
+// (their ratio is the number of images per stored file).
+void site_database::get_content_statistics(Json::Value& output) {
+  auto query = prepare_query(
+      "SELECT COUNT(*), COALESCE(SUM(REFCNT), 0), COALESCE(SUM(SIZE), 0), "
+      "COALESCE(SUM(SIZE*REFCNT), 0) FROM PACS_CONTENTS WHERE REFCNT>0",
+      "get_content_statistics");
+  auto result = execute_query(query);
+  auto row = result->has_rows() ? result->get_next_row() : nullptr;
+  if (row) {
+    std::int32_t row_index = 0;
+    output["contents"] = static_cast<Json::Int64>(
+        std::stoll(row->get_string(row_index, false, false)));
+    output["references"] = static_cast<Json::Int64>(
+        std::stoll(row->get_string(row_index, false, false)));
+    output["stored_bytes"] = static_cast<Json::Int64>(
+        std::stoll(row->get_string(row_index, false, false)));
+    output["referenced_bytes"] = static_cast<Json::Int64>(
+        std::stoll(row->get_string(row_index, false, false)));
+  }
+
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id";
+  auto partitions_query = prepare_query(
+      "SELECT pacs_studies.partition_id, COUNT(*), COUNT(DISTINCT "
+      "pacs_images.content_id) FROM " +
+          from +
+          " WHERE pacs_images.content_id IS NOT NULL GROUP BY "
+          "pacs_studies.partition_id",
+      "get_partition_content_statistics");
+  Json::Value& partitions = output["partitions"];
+  partitions = Json::Value(Json::objectValue);
+  auto partitions_result = execute_query(partitions_query);
+  if (partitions_result->has_rows()) {
+    while (auto partition = partitions_result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& item =
+          partitions[partition->get_uuid(row_index, false, false)];
+      std::int32_t images = partition->get_int(row_index, false);
+      std::int32_t contents = partition->get_int(row_index, false);
+      item["images"] = images;
+      item["contents"] = contents;
+      item["ratio"] = contents > 0 ? static_cast<double>(images) / contents
+                                   : 1.0;
+    }
+  }
+}
@@ -0,0 +1,269 @@
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+#include "../../include/database/items/db_patient.hpp"
+#include "../../include/database/items/db_series.hpp"
+#include "../../include/database/items/db_study.hpp"
+#include "../../include/database/site_database.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// number of applied deltas deleted by one query:
+static const std::size_t kDeleteChunkSize = 100;
+
+// number of items whose pending deltas are read by one query:
+static const std::size_t kReadChunkSize = 100;
+
+////////////////////////////////////////////////////////////////////////////////
+// Counter delta operations
+////////////////////////////////////////////////////////////////////////////////
+//
+// An import no longer rewrites the counters of its patient, study and series:
+// it inserts a delta row instead, so the concurrent imports of a patient or a
+// study no longer hold write locks on the same rows until they commit. The
+// deltas are summed and applied later as relative updates, in a transaction
+// that also deletes them.
+
+//------------------------------------------------------------------------------
+// Create operations
+//------------------------------------------------------------------------------
+
+void site_database::create_counter_delta(
+    const std::string& patient_seq, const std::string& study_seq,
+    const std::string& series_seq, std::int32_t patient_studies,
+    std::int32_t patient_series, std::int32_t patient_images,
+    std::int32_t series, std::int32_t images, bool update_study_summary) {
+  std::string sql =
+      "INSERT INTO PACS_COUNTER_DELTAS (ID, PATIENT_ID, STUDY_ID, SERIES_ID, "
+      "PSTCNT, PSRCNT, PIMCNT, SRCNT, IMCNT, SUMMARY) VALUES (?, ?, ?, ?, ?, "
+      "?, ?, ?, ?, ?)";
+  auto query = prepare_query(sql, "create_counter_delta");
+
+  int index = 1;
+  bind_parameter(query, index, onis::util::uuid::generate_random_uuid(), "id");
+  bind_parameter(query, index, patient_seq, "patient_id");
+  bind_parameter(query, index, study_seq, "study_id");
+  bind_parameter(query, index, series_seq, "series_id");
+  bind_parameter(query, index, patient_studies, "pstcnt");
+  bind_parameter(query, index, patient_series, "psrcnt");
+  bind_parameter(query, index, patient_images, "pimcnt");
+  bind_parameter(query, index, series, "srcnt");
+  bind_parameter(query, index, images, "imcnt");
+  bind_parameter(query, index, update_study_summary ? 1 : 0, "summary");
+  execute_and_check_affected(query, "Failed to create the counter delta");
+}
+
+//------------------------------------------------------------------------------
+// Apply operations
+//------------------------------------------------------------------------------
+
+std::size_t site_database::apply_counter_deltas(std::int32_t limit) {
+  struct counters {
+    std::int32_t studies{0};
+    std::int32_t series{0};
+    std::int32_t images{0};
+  };
+
+  // read and lock the oldest deltas:
+  std::string sql = sql_builder_->build_select_query(
+      "id, patient_id, study_id, series_id, pstcnt, psrcnt, pimcnt, srcnt, "
+      "imcnt, summary",
+      "pacs_counter_deltas", "", "", limit,
+      onis::database::lock_mode::EXCLUSIVE_LOCK);
+  auto query = prepare_query(sql, "apply_counter_deltas");
+
+  // sum them per item, the maps keep the rows sorted by seq so that all the
+  // rounds lock them in the same order:
+  std::vector<std::string> ids;
+  std::map<std::string, counters> patients;
+  std::map<std::string, counters> studies;
+  std::map<std::string, std::int32_t> series;
+  std::set<std::string> summaries;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t index = 0;
+      ids.push_back(row->get_uuid(index, false, false));
+      std::string patient_seq = row->get_uuid(index, false, false);
+      std::string study_seq = row->get_uuid(index, false, false);
+      std::string series_seq = row->get_uuid(index, false, false);
+      counters& patient = patients[patient_seq];
+      patient.studies += row->get_int(index, false);
+      patient.series += row->get_int(index, false);
+      patient.images += row->get_int(index, false);
+      counters& study = studies[study_seq];
+      study.series += row->get_int(index, false);
+      std::int32_t images = row->get_int(index, false);
+      study.images += images;
+      series[series_seq] += images;
+      if (row->get_int(index, false) != 0)
+        summaries.insert(study_seq);
+    }
+  }
+  if (ids.empty())
+    return 0;
+
+  // the items deleted since the import are skipped. Studies first, as by the
+  // imports:
+  for (const auto& item : studies) {
+    query = prepare_query(
+        "UPDATE PACS_STUDIES SET SRCNT=SRCNT+?, IMCNT=IMCNT+? WHERE ID=?",
+        "apply_study_counter_delta");
+    int index = 1;
+    bind_parameter(query, index, item.second.series, "series_count");
+    bind_parameter(query, index, item.second.images, "image_count");
+    bind_parameter(query, index, item.first, "id");
+    execute_query(query);
+  }
+  for (const auto& item : patients) {
+    if (item.second.studies == 0 && item.second.series == 0 &&
+        item.second.images == 0)
+      continue;
+    query = prepare_query(
+        "UPDATE PACS_PATIENTS SET STCNT=STCNT+?, SRCNT=SRCNT+?, "
+        "IMCNT=IMCNT+? WHERE ID=?",
+        "apply_patient_counter_delta");
+    int index = 1;
+    bind_parameter(query, index, item.second.studies, "study_count");
+    bind_parameter(query, index, item.second.series, "series_count");
+    bind_parameter(query, index, item.second.images, "image_count");
+    bind_parameter(query, index, item.first, "id");
+    execute_query(query);
+  }
+  for (const auto& item : series) {
+    query = prepare_query("UPDATE PACS_SERIES SET IMCNT=IMCNT+? WHERE ID=?",
+                          "apply_series_counter_delta");
+    int index = 1;
+    bind_parameter(query, index, item.second, "image_count");
+    bind_parameter(query, index, item.first, "id");
+    execute_query(query);
+  }
+
+  // the modalities, body parts and station names only change with a new
+  // series:
+  for (const auto& study_seq : summaries) {
+    Json::Value study(Json::objectValue);
+    find_study_by_seq(study_seq, onis::database::info_all, false,
+                      onis::database::lock_mode::NO_LOCK, study, nullptr);
+    if (study.empty())
+      continue;
+    if (update_study_modalities_bodyparts_and_station_names(study, ""))
+      modify_study(study, onis::database::info_study_body_parts |
+                              onis::database::info_study_modalities |
+                              onis::database::info_study_stations);
+  }
+
+  // delete the applied deltas:
+  for (std::size_t start = 0; start < ids.size(); start += kDeleteChunkSize) {
+    std::size_t end = std::min(ids.size(), start + kDeleteChunkSize);
+    sql = "DELETE FROM pacs_counter_deltas WHERE id IN (?";
+    for (std::size_t i = start + 1; i < end; i++)
+      sql += ", ?";
+    sql += ")";
+    query = prepare_query(sql, "delete_counter_deltas");
+    int index = 1;
+    for (std::size_t i = start; i < end; i++)
+      bind_parameter(query, index, ids[i], "id");
+    execute_query(query);
+  }
+  return ids.size();
+}
+
+//------------------------------------------------------------------------------
+// Read operations
+//------------------------------------------------------------------------------
+
+static void add_to_counter(Json::Value& item, const char* key,
+                           std::int32_t delta) {
+  if (delta != 0 && item.isMember(key))
+    item[key] = item[key].asInt() + delta;
+}
+
+void site_database::add_pending_counter_deltas(Json::Value& studies) {
+  // index the items of the result by seq (a patient may own several of the
+  // studies found):
+  std::map<std::string, std::vector<Json::Value*>> patients;
+  std::map<std::string, Json::Value*> study_items;
+  std::map<std::string, Json::Value*> series_items;
+  for (auto& item : studies) {
+    Json::Value& patient = item["patient"];
+    Json::Value& study = item["study"];
+    if (patient.isMember(BASE_SEQ_KEY))
+      patients[patient[BASE_SEQ_KEY].asString()].push_back(&patient);
+    if (study.isMember(BASE_SEQ_KEY))
+      study_items[study[BASE_SEQ_KEY].asString()] = &study;
+    if (item.isMember("series")) {
+      for (auto& series : item["series"]) {
+        if (series.isMember(BASE_SEQ_KEY))
+          series_items[series[BASE_SEQ_KEY].asString()] = &series;
+      }
+    }
+  }
+
+  // the sums are read for the items found only, by chunks:
+  auto read_chunks = [this](const auto& items, const std::string& sql_start,
+                            const std::string& sql_end, const char* name,
+                            const auto& add) {
+    auto it = items.begin();
+    while (it != items.end()) {
+      std::vector<std::string> seqs;
+      for (; it != items.end() && seqs.size() < kReadChunkSize; ++it)
+        seqs.push_back(it->first);
+      std::string sql = sql_start + "?";
+      for (std::size_t i = 1; i < seqs.size(); i++)
+        sql += ", ?";
+      sql += sql_end;
+      auto query = prepare_query(sql, name);
+      int index = 1;
+      for (const auto& seq : seqs)
+        bind_parameter(query, index, seq, "id");
+      auto result = execute_query(query);
+      if (result->has_rows()) {
+        while (auto row = result->get_next_row())
+          add(*row);
+      }
+    }
+  };
+
+  read_chunks(
+      patients,
+      "SELECT patient_id, CAST(SUM(pstcnt) AS INTEGER), CAST(SUM(psrcnt) AS "
+      "INTEGER), CAST(SUM(pimcnt) AS INTEGER) FROM pacs_counter_deltas WHERE "
+      "patient_id IN (",
+      ") GROUP BY patient_id", "find_patient_counter_deltas",
+      [&](auto& row) {
+        std::int32_t index = 0;
+        auto it = patients.find(row.get_uuid(index, false, false));
+        std::int32_t studies_delta = row.get_int(index, false);
+        std::int32_t series_delta = row.get_int(index, false);
+        std::int32_t images_delta = row.get_int(index, false);
+        if (it == patients.end())
+          return;
+        for (Json::Value* patient : it->second) {
+          add_to_counter(*patient, PA_STCNT_KEY, studies_delta);
+          add_to_counter(*patient, PA_SRCNT_KEY, series_delta);
+          add_to_counter(*patient, PA_IMCNT_KEY, images_delta);
+        }
+      });
+
+  read_chunks(
+      study_items,
+      "SELECT study_id, series_id, CAST(SUM(srcnt) AS INTEGER), "
+      "CAST(SUM(imcnt) AS INTEGER) FROM pacs_counter_deltas WHERE study_id IN "
+      "(",
+      ") GROUP BY study_id, series_id", "find_study_counter_deltas",
+      [&](auto& row) {
+        std::int32_t index = 0;
+        auto study = study_items.find(row.get_uuid(index, false, false));
+        auto series = series_items.find(row.get_uuid(index, false, false));
+        std::int32_t series_delta = row.get_int(index, false);
+        std::int32_t images_delta = row.get_int(index, false);
+        if (study != study_items.end()) {
+          add_to_counter(*study->second, ST_SRCNT_KEY, series_delta);
+          add_to_counter(*study->second, ST_IMCNT_KEY, images_delta);
+        }
+        if (series != series_items.end())
+          add_to_counter(*series->second, SR_IMCNT_KEY, images_delta);
+      });
+}
@@ -0,0 +1,208 @@
+#include "../../include/database/items/db_image.hpp"
+#include "../../include/database/items/db_partition.hpp"
+#include "../../include/database/items/db_series.hpp"
+#include "../../include/database/site_database.hpp"
+#include "onis_kit/include/core/exception.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// Derived object operations
+////////////////////////////////////////////////////////////////////////////////
+//
+// The stream file and the icon of an image are created after the import when
+// its streammedia or iconmedia is -2. They are recorded with the media they
+// were written to, or with -1 when they cannot be created. The pixel
+// statistics of an image (pxstats) are computed while it is NULL, and
+// recorded empty when they cannot be; those of its series merge them.
+
+//------------------------------------------------------------------------------
+// Find operations
+//------------------------------------------------------------------------------
+
+// Read the images whose stream file or icon (or pixel statistics) are still
+// to be created, page by page in the order of their seqs. Returns the seq of
+// the last image read, or an empty string once all the images were read.
+std::string site_database::get_pending_derived_images(
+    const std::string& after_seq, std::int32_t limit, bool pixel_statistics,
+    std::vector<std::string>& seqs) {
+  std::string clause = pixel_statistics
+                           ? "(streammedia=-2 OR iconmedia=-2 OR pxstats IS "
+                             "NULL)"
+                           : "(streammedia=-2 OR iconmedia=-2)";
+  if (!after_seq.empty())
+    clause += " AND id>?";
+  std::string sql = sql_builder_->build_select_query(
+      "id", "pacs_images", clause, "id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_pending_derived_images");
+
+  int index = 1;
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      last_seq = row->get_uuid(row_index, false, false);
+      seqs.push_back(last_seq);
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Read what the creation of the derived objects of an image needs: its file
+// (a range of its series container once packed), the state of its objects,
+// its series and the volume of its partition. Returns false if the image no
+// longer exists.
+bool site_database::find_derived_image_source(const std::string& seq,
+                                              Json::Value& output) {
+  const auto columns =
+      "pacs_images.imgmedia, pacs_images.imgpath, pacs_images.streammedia, "
+      "pacs_images.iconmedia, pacs_series.id, pacs_series.iconmedia, "
+      "pacs_partitions.volume_id, pacs_images.packoffset, "
+      "pacs_images.packsize, CASE WHEN pacs_images.pxstats IS NULL THEN 1 "
+      "ELSE 0 END";
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id inner join pacs_partitions on pacs_partitions.id "
+      "= pacs_studies.partition_id";
+  const auto clause = "pacs_images.id=?";
+  auto query = create_and_prepare_query(columns, from, clause,
+                                        onis::database::lock_mode::NO_LOCK);
+
+  int index = 1;
+  bind_parameter(query, index, seq, "id");
+
+  auto result = execute_query(query);
+  if (!result->has_rows())
+    return false;
+  auto row = result->get_next_row();
+  if (!row)
+    return false;
+  std::int32_t row_index = 0;
+  output[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, false);
+  output[IM_IMAGE_PATH_KEY] = row->get_string(row_index, true, true);
+  output[IM_STREAM_MEDIA_KEY] = row->get_int(row_index, false);
+  output[IM_ICON_MEDIA_KEY] = row->get_int(row_index, false);
+  Json::Value& series = output["series"];
+  series[BASE_SEQ_KEY] = row->get_uuid(row_index, false, false);
+  series[SR_ICON_MEDIA_KEY] = row->get_int(row_index, false);
+  output[PT_VOLUME_KEY] = row->get_uuid(row_index, true, true);
+  if (row->is_null(row_index)) {
+    row_index += 2;
+  } else {
+    output[IM_PACK_OFFSET_KEY] = static_cast<Json::Int64>(
+        std::stoll(row->get_string(row_index, false, false)));
+    output[IM_PACK_SIZE_KEY] = static_cast<Json::Int64>(
+        std::stoll(row->get_string(row_index, false, false)));
+  }
+  output["pending_statistics"] = row->get_int(row_index, false) != 0;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// Modify operations
+//------------------------------------------------------------------------------
+
+// Record the stream file of an image (media -1 and an empty path when it
+// could not be created). Returns false if it was already recorded.
+bool site_database::set_image_stream(const std::string& seq,
+                                     std::int32_t media,
+                                     const std::string& path) {
+  auto query = prepare_query(
+      "UPDATE PACS_IMAGES SET STREAMMEDIA=?, STREAMPATH=? WHERE ID=? AND "
+      "STREAMMEDIA=-2",
+      "set_image_stream");
+  int index = 1;
+  bind_parameter(query, index, media, "streammedia");
+  if (path.empty())
+    bind_parameter(query, index, nullptr, "streampath");
+  else
+    bind_parameter(query, index, path, "streampath");
+  bind_parameter(query, index, seq, "id");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+// Record the icon of an image, see set_image_stream.
+bool site_database::set_image_icon(const std::string& seq, std::int32_t media,
+                                   const std::string& path) {
+  auto query = prepare_query(
+      "UPDATE PACS_IMAGES SET ICONMEDIA=?, ICONPATH=? WHERE ID=? AND "
+      "ICONMEDIA=-2",
+      "set_image_icon");
+  int index = 1;
+  bind_parameter(query, index, media, "iconmedia");
+  if (path.empty())
+    bind_parameter(query, index, nullptr, "iconpath");
+  else
+    bind_parameter(query, index, path, "iconpath");
+  bind_parameter(query, index, seq, "id");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+// The icon of a series is the first icon created for one of its images.
+bool site_database::set_series_icon(const std::string& seq,
+                                    std::int32_t media,
+                                    const std::string& path) {
+  auto query = prepare_query(
+      "UPDATE PACS_SERIES SET ICONMEDIA=?, ICONPATH=? WHERE ID=? AND "
+      "ICONMEDIA=-2",
+      "set_series_icon");
+  int index = 1;
+  bind_parameter(query, index, media, "iconmedia");
+  bind_parameter(query, index, path, "iconpath");
+  bind_parameter(query, index, seq, "id");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+// Record the pixel statistics of an image (empty when they cannot be
+// computed). Returns false if they were already recorded.
+bool site_database::set_image_pixel_statistics(const std::string& seq,
+                                               const std::string& statistics) {
+  auto query = prepare_query(
+      "UPDATE PACS_IMAGES SET PXSTATS=? WHERE ID=? AND PXSTATS IS NULL",
+      "set_image_pixel_statistics");
+  int index = 1;
+  bind_parameter(query, index, statistics, "pxstats");
+  bind_parameter(query, index, seq, "id");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+// Read the pixel statistics of a series, a null value if it has none yet.
+// The series is locked with "lock" while its statistics are merged with those
+// of one of its images.
+void site_database::get_series_pixel_statistics(
+    const std::string& seq, onis::database::lock_mode lock,
+    Json::Value& output) {
+  auto query =
+      create_and_prepare_query("pxstats", "pacs_series", "id=?", lock);
+  int index = 1;
+  bind_parameter(query, index, seq, "id");
+
+  output = Json::Value(Json::nullValue);
+  auto result = execute_query(query);
+  if (!result->has_rows())
+    return;
+  auto row = result->get_next_row();
+  if (!row)
+    return;
+  std::int32_t row_index = 0;
+  std::string value = row->get_string(row_index, true, true);
+  Json::Reader reader;
+  if (!value.empty() && !reader.parse(value, output))
+    output = Json::Value(Json::nullValue);
+}
+
+void site_database::set_series_pixel_statistics(
+    const std::string& seq, const std::string& statistics) {
+  auto query = prepare_query("UPDATE PACS_SERIES SET PXSTATS=? WHERE ID=?",
+                             "set_series_pixel_statistics");
+  int index = 1;
+  bind_parameter(query, index, statistics, "pxstats");
+  bind_parameter(query, index, seq, "id");
+  execute_query(query);
+}
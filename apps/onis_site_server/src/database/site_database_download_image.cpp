@@ -11,7 +11,8 @@
 std::string site_database::get_download_image_columns(bool add_table_name) {
   std::string prefix = add_table_name ? "pacs_download_image." : "";
   return prefix + "id, " + prefix + "series_id, " + prefix + "num, " + prefix +
-         "path, " + prefix + "type, " + prefix + "rescnt, " + prefix + "result";
+         "path, " + prefix + "type, " + prefix + "rescnt, " + prefix +
+         "result, " + prefix + "packoffset, " + prefix + "packsize";
 }
 
 void site_database::create_download_image_item(
@@ -25,6 +26,12 @@ void site_database::create_download_image_item(
   output[DI_TYPE_KEY] = rec.get_int(local_index, false);
   output[DI_RESCNT_KEY] = rec.get_int(local_index, false);
   output[DI_RESULT_KEY] = rec.get_int(local_index, false);
+  if (!rec.is_null(local_index)) {
+    output[DI_PACK_OFFSET_KEY] = static_cast<Json::Int64>(
+        std::stoll(rec.get_string(local_index, false, false)));
+    output[DI_PACK_SIZE_KEY] = static_cast<Json::Int64>(
+        std::stoll(rec.get_string(local_index, false, false)));
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -61,11 +68,11 @@ std::unique_ptr<onis_kit::database::database_query>
 site_database::create_download_image_insertion_query(
     const std::string& series_seq, std::int32_t num, const std::string& path,
     std::int32_t type, std::int32_t rescnt, std::int32_t error,
-    Json::Value& output) {
+    std::int64_t pack_offset, std::int64_t pack_size, Json::Value& output) {
   std::string sql =
       "INSERT INTO pacs_download_images (id, series_id, num, path, type, "
       "rescnt, "
-      "result) VALUES (?, ?, ?, ?, ?, ?, ?)";
+      "result, packoffset, packsize) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
   auto query = prepare_query(sql, "create_download_image_insertion_query");
   std::int32_t index = 1;
   std::string seq = onis::util::uuid::generate_random_uuid();
@@ -76,6 +83,13 @@ site_database::create_download_image_insertion_query(
   bind_parameter(query, index, type, "type");
   bind_parameter(query, index, rescnt, "rescnt");
   bind_parameter(query, index, error, "result");
+  if (pack_size >= 0) {
+    bind_parameter(query, index, std::to_string(pack_offset), "packoffset");
+    bind_parameter(query, index, std::to_string(pack_size), "packsize");
+  } else {
+    bind_parameter(query, index, nullptr, "packoffset");
+    bind_parameter(query, index, nullptr, "packsize");
+  }
 
   onis::database::download_image::create(output);
   output[BASE_SEQ_KEY] = seq;
@@ -84,6 +98,10 @@ site_database::create_download_image_insertion_query(
   output[DI_PATH_KEY] = path;
   output[DI_RESCNT_KEY] = rescnt;
   output[DI_RESULT_KEY] = error;
+  if (pack_size >= 0) {
+    output[DI_PACK_OFFSET_KEY] = static_cast<Json::Int64>(pack_offset);
+    output[DI_PACK_SIZE_KEY] = static_cast<Json::Int64>(pack_size);
+  }
 
   return query;
 }
@@ -91,8 +109,9 @@ site_database::create_download_image_insertion_query(
 void site_database::create_download_image(
     const std::string& series_seq, std::int32_t num, const std::string& path,
     std::int32_t type, std::int32_t rescnt, std::int32_t error,
-    Json::Value& output) {
+    std::int64_t pack_offset, std::int64_t pack_size, Json::Value& output) {
   auto query = create_download_image_insertion_query(
-      series_seq, num, path, type, rescnt, error, output);
+      series_seq, num, path, type, rescnt, error, pack_offset, pack_size,
+      output);
   execute_and_check_affected(query, "Failed to create download image");
 }
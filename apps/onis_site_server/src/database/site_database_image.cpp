@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
 #include <list>
 #include <sstream>
 #include "../../include/database/items/db_image.hpp"
+#include "../../include/database/items/db_partition.hpp"
 #include "../../include/database/items/db_patient.hpp"
+#include "../../include/database/items/db_series.hpp"
 #include "../../include/database/items/db_study.hpp"
 #include "../../include/database/site_database.hpp"
 #include "onis_kit/include/core/exception.hpp"
@@ -27,11 +30,13 @@ std::string site_database::get_image_columns(std::uint32_t flags,
     return prefix + "id, " + prefix + "series_id, " + prefix + "uid, " +
            prefix + "charset, " + prefix + "instnum, " + prefix + "sopclass, " +
            prefix + "acqnum, " + prefix + "imgmedia, " + prefix + "imgpath, " +
-           prefix + "streammedia, " + prefix + "streampath, " + prefix +
+           prefix + "packoffset, " + prefix + "packsize, " + prefix +
+           "streammedia, " + prefix + "streampath, " + prefix +
            "iconmedia, " + prefix + "iconpath, " + prefix + "width, " + prefix +
            "height, " + prefix + "depth, " + prefix + "cstatus, " + prefix +
            "cupd, " + prefix + "status, " + prefix + "crdate, " + prefix +
-           "oid, " + prefix + "oname, " + prefix + "oip";
+           "oid, " + prefix + "oname, " + prefix + "oip, " + prefix +
+           "pxstats";
   }
 
   std::string columns =
@@ -49,7 +54,8 @@ std::string site_database::get_image_columns(std::uint32_t flags,
     columns += ", " + prefix + "acqnum";
   }
   if (flags & onis::database::info_image_path) {
-    columns += ", " + prefix + "imgmedia, " + prefix + "imgpath";
+    columns += ", " + prefix + "imgmedia, " + prefix + "imgpath, " + prefix +
+               "packoffset, " + prefix + "packsize";
   }
   if (flags & onis::database::info_image_stream) {
     columns += ", " + prefix + "streammedia, " + prefix + "streampath";
@@ -73,6 +79,9 @@ std::string site_database::get_image_columns(std::uint32_t flags,
     columns += ", " + prefix + "crdate, " + prefix + "oid, " + prefix +
                "oname, " + prefix + "oip";
   }
+  if (flags & onis::database::info_image_pixel_statistics) {
+    columns += ", " + prefix + "pxstats";
+  }
   return columns;
 }
 
@@ -113,9 +122,19 @@ void site_database::create_image_item(onis_kit::database::database_row& rec,
       (*target_index)++;
       std::string path = rec.get_string(*target_index, true, true);
       image[IM_IMAGE_KEY] = path.empty() ? 0 : 1;
+      *target_index += 2;
     } else {
       image[IM_IMAGE_MEDIA_KEY] = rec.get_int(*target_index, false);
       image[IM_IMAGE_PATH_KEY] = rec.get_string(*target_index, true, true);
+      // the file of a packed image is a range of its series container:
+      if (rec.is_null(*target_index)) {
+        *target_index += 2;
+      } else {
+        image[IM_PACK_OFFSET_KEY] = static_cast<Json::Int64>(
+            std::stoll(rec.get_string(*target_index, false, false)));
+        image[IM_PACK_SIZE_KEY] = static_cast<Json::Int64>(
+            std::stoll(rec.get_string(*target_index, false, false)));
+      }
     }
   }
 
@@ -173,6 +192,34 @@ void site_database::create_image_item(onis_kit::database::database_row& rec,
     image[IM_ORIGIN_NAME_KEY] = rec.get_string(*target_index, true, true);
     image[IM_ORIGIN_IP_KEY] = rec.get_string(*target_index, true, true);
   }
+
+  // the statistics are recorded as json text, empty when they could not be
+  // computed:
+  if (flags & onis::database::info_image_pixel_statistics) {
+    std::string value = rec.get_string(*target_index, true, true);
+    Json::Reader reader;
+    if (!value.empty() && !reader.parse(value, image[IM_PIXEL_STATS_KEY]))
+      image[IM_PIXEL_STATS_KEY] = Json::Value(Json::nullValue);
+  }
+}
+
+void site_database::bind_pixel_data_parameters(
+    std::unique_ptr<onis_kit::database::database_query>& query,
+    std::int32_t& index, const Json::Value& pixel_data) {
+  // the offsets are 64 bits values, they are bound as text:
+  if (pixel_data.isObject() && pixel_data.isMember(IM_FRAME_TABLE_KEY)) {
+    bind_parameter(query, index,
+                   std::to_string(pixel_data[IM_PIXEL_OFFSET_KEY].asUInt64()),
+                   "pxoffset");
+    bind_parameter(query, index, pixel_data[IM_FRAME_COUNT_KEY].asInt(),
+                   "frmcnt");
+    bind_parameter(query, index, pixel_data[IM_FRAME_TABLE_KEY].asString(),
+                   "frmtable");
+  } else {
+    bind_parameter(query, index, nullptr, "pxoffset");
+    bind_parameter(query, index, nullptr, "frmcnt");
+    bind_parameter(query, index, nullptr, "frmtable");
+  }
 }
 
 bool site_database::check_if_sop_already_exist_under_online_or_conflicted_study(
@@ -223,12 +270,43 @@ bool site_database::check_if_sop_already_exist_under_online_or_conflicted_study(
 // Create operations
 //------------------------------------------------------------------------------
 
+std::string site_database::get_image_insertion_values() {
+  return "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, "
+         "?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+}
+
 std::unique_ptr<onis_kit::database::database_query>
 site_database::create_image_insertion_query(
     std::int32_t compression_status, std::int32_t compression_update,
     const std::string& series_seq, const onis::core::date_time& dt,
     const onis::dicom_base_ptr& dataset, std::int32_t image_media,
-    const std::string& image_path, bool create_stream, bool create_icon,
+    const std::string& image_path, const Json::Value& pixel_data,
+    bool create_stream, bool create_icon, const std::string& origin_id,
+    const std::string& origin_name, const std::string& origin_ip,
+    Json::Value& image) {
+  std::string sql =
+      "INSERT INTO PACS_IMAGES (ID, SERIES_ID, UID, CHARSET, INSTNUM, "
+      "SOPCLASS, ACQNUM, IMGMEDIA, IMGPATH, STREAMMEDIA, ICONMEDIA, WIDTH, "
+      "HEIGHT, DEPTH, CSTATUS, CUPD, STATUS, CRDATE, OID, ONAME, OIP, "
+      "PXOFFSET, FRMCNT, FRMTABLE) VALUES " +
+      get_image_insertion_values();
+
+  auto query = prepare_query(sql, "create_image_insertion_query");
+  int index = 1;
+  bind_image_insertion_parameters(
+      query, index, compression_status, compression_update, series_seq, dt,
+      dataset, image_media, image_path, pixel_data, create_stream,
+      create_icon, origin_id, origin_name, origin_ip, image);
+  return query;
+}
+
+void site_database::bind_image_insertion_parameters(
+    std::unique_ptr<onis_kit::database::database_query>& query,
+    std::int32_t& index, std::int32_t compression_status,
+    std::int32_t compression_update, const std::string& series_seq,
+    const onis::core::date_time& dt, const onis::dicom_base_ptr& dataset,
+    std::int32_t image_media, const std::string& image_path,
+    const Json::Value& pixel_data, bool create_stream, bool create_icon,
     const std::string& origin_id, const std::string& origin_name,
     const std::string& origin_ip, Json::Value& image) {
   std::string charset, sop, instance_num, sop_class, acqnum, width, height,
@@ -252,18 +330,9 @@ site_database::create_image_insertion_query(
              << dt.second();
   std::string crdate = crdate_oss.str();
 
-  std::string sql =
-      "INSERT INTO PACS_IMAGES (ID, SERIES_ID, UID, CHARSET, INSTNUM, "
-      "SOPCLASS, ACQNUM, IMGMEDIA, IMGPATH, STREAMMEDIA, ICONMEDIA, WIDTH, "
-      "HEIGHT, DEPTH, CSTATUS, CUPD, STATUS, CRDATE, OID, ONAME, OIP) VALUES "
-      "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
-
   std::string seq = onis::util::uuid::generate_random_uuid();
   std::string online_status = ONLINE_STATUS;
 
-  auto query = prepare_query(sql, "create_image_insertion_query");
-
-  int index = 1;
   bind_parameter(query, index, seq, "id");
   bind_parameter(query, index, series_seq, "series_id");
   bind_parameter(query, index, sop, "uid");
@@ -285,6 +354,7 @@ site_database::create_image_insertion_query(
   bind_parameter(query, index, origin_id, "oid");
   bind_parameter(query, index, origin_name, "oname");
   bind_parameter(query, index, origin_ip, "oip");
+  bind_pixel_data_parameters(query, index, pixel_data);
 
   onis::database::image::create(image, onis::database::info_all, false);
   image[IM_SEQ_KEY] = seq;
@@ -315,24 +385,78 @@ site_database::create_image_insertion_query(
   image[IM_ICON_PATH_KEY] = "";
   image[IM_COMP_STATUS_KEY] = compression_status;
   image[IM_COMP_UPDATE_KEY] = compression_update;
-
-  return query;
 }
 
 void site_database::create_image(
     std::int32_t compression_status, std::int32_t compression_update,
     const std::string& series_seq, const onis::core::date_time& dt,
     const onis::dicom_base_ptr& dataset, std::int32_t image_media,
-    const std::string& image_path, bool create_stream, bool create_icon,
-    const std::string& origin_id, const std::string& origin_name,
-    const std::string& origin_ip, Json::Value& image) {
+    const std::string& image_path, const Json::Value& pixel_data,
+    bool create_stream, bool create_icon, const std::string& origin_id,
+    const std::string& origin_name, const std::string& origin_ip,
+    Json::Value& image) {
   auto query = create_image_insertion_query(
       compression_status, compression_update, series_seq, dt, dataset,
-      image_media, image_path, create_stream, create_icon, origin_id,
-      origin_name, origin_ip, image);
+      image_media, image_path, pixel_data, create_stream, create_icon,
+      origin_id, origin_name, origin_ip, image);
   execute_and_check_affected(query, "Failed to create image");
 }
 
+void site_database::create_images(
+    const std::vector<std::int32_t>& compression_status,
+    std::int32_t compression_update,
+    const std::string& series_seq, const onis::core::date_time& dt,
+    const std::vector<onis::dicom_base_ptr>& datasets,
+    std::int32_t image_media, const std::vector<std::string>& image_paths,
+    const std::vector<Json::Value>& pixel_data, bool create_stream,
+    bool create_icon, const std::string& origin_id,
+    const std::string& origin_name, const std::string& origin_ip,
+    std::vector<Json::Value>& images) {
+  // the rows are inserted by chunks, the number of parameters of a statement
+  // is limited:
+  const std::size_t chunk_size = 1000;
+  images.assign(datasets.size(), Json::Value(Json::objectValue));
+  for (std::size_t start = 0; start < datasets.size(); start += chunk_size) {
+    std::size_t end = std::min(datasets.size(), start + chunk_size);
+    std::string sql =
+        "INSERT INTO PACS_IMAGES (ID, SERIES_ID, UID, CHARSET, INSTNUM, "
+        "SOPCLASS, ACQNUM, IMGMEDIA, IMGPATH, STREAMMEDIA, ICONMEDIA, WIDTH, "
+        "HEIGHT, DEPTH, CSTATUS, CUPD, STATUS, CRDATE, OID, ONAME, OIP, "
+        "PXOFFSET, FRMCNT, FRMTABLE) VALUES ";
+    for (std::size_t i = start; i < end; i++) {
+      if (i != start)
+        sql += ", ";
+      sql += get_image_insertion_values();
+    }
+
+    auto query = prepare_query(sql, "create_images");
+    int index = 1;
+    for (std::size_t i = start; i < end; i++) {
+      bind_image_insertion_parameters(
+          query, index, compression_status[i], compression_update,
+          series_seq, dt, datasets[i], image_media, image_paths[i],
+          pixel_data[i], create_stream, create_icon, origin_id, origin_name,
+          origin_ip, images[i]);
+    }
+    execute_and_check_affected(query, "Failed to create images");
+  }
+}
+
+//------------------------------------------------------------------------------
+// Modify operations
+//------------------------------------------------------------------------------
+
+void site_database::set_image_frames(const std::string& seq,
+                                     const Json::Value& pixel_data) {
+  std::string sql =
+      "UPDATE PACS_IMAGES SET PXOFFSET=?, FRMCNT=?, FRMTABLE=? WHERE ID=?";
+  auto query = prepare_query(sql, "set_image_frames");
+  int index = 1;
+  bind_pixel_data_parameters(query, index, pixel_data);
+  bind_parameter(query, index, seq, "id");
+  execute_and_check_affected(query, "Failed to set the image frames");
+}
+
 //------------------------------------------------------------------------------
 // Find operations
 //------------------------------------------------------------------------------
@@ -359,6 +483,257 @@ void site_database::find_image_by_seq(const std::string& seq,
   }
 }
 
+void site_database::find_image_location(const std::string& seq,
+                                        std::uint32_t flags,
+                                        onis::database::lock_mode lock_mode,
+                                        Json::Value& output,
+                                        std::string* series_seq,
+                                        std::string& partition_seq) {
+  const auto columns =
+      get_image_columns(flags, true) + ", pacs_studies.partition_id";
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id";
+  const auto clause = "pacs_images.id=?";
+  auto query = create_and_prepare_query(columns, from, clause, lock_mode);
+
+  int index = 1;
+  bind_parameter(query, index, seq, "id");
+
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    auto row = result->get_next_row();
+    std::int32_t row_index = 0;
+    create_image_item(*row, flags, false, &row_index, series_seq, output);
+    partition_seq = row->get_uuid(row_index, false, false);
+  } else {
+    throw onis::exception(EOS_NOT_FOUND, "Image not found");
+  }
+}
+
+void site_database::find_image_frames(const std::string& seq,
+                                      onis::database::lock_mode lock_mode,
+                                      Json::Value& output,
+                                      std::string& partition_seq) {
+  const auto columns =
+      "pacs_images.imgmedia, pacs_images.imgpath, pacs_images.packoffset, "
+      "pacs_images.packsize, pacs_images.pxoffset, pacs_images.frmcnt, "
+      "pacs_images.frmtable, pacs_studies.partition_id";
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id";
+  const auto clause = "pacs_images.id=?";
+  auto query = create_and_prepare_query(columns, from, clause, lock_mode);
+
+  int index = 1;
+  bind_parameter(query, index, seq, "id");
+
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    auto row = result->get_next_row();
+    std::int32_t row_index = 0;
+    output[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, false);
+    output[IM_IMAGE_PATH_KEY] = row->get_string(row_index, true, true);
+    if (row->is_null(row_index)) {
+      row_index += 2;
+    } else {
+      output[IM_PACK_OFFSET_KEY] = static_cast<Json::Int64>(
+          std::stoll(row->get_string(row_index, false, false)));
+      output[IM_PACK_SIZE_KEY] = static_cast<Json::Int64>(
+          std::stoll(row->get_string(row_index, false, false)));
+    }
+    // images stored before the offsets were recorded have no frame table:
+    if (row->is_null(row_index)) {
+      row_index += 3;
+    } else {
+      output[IM_PIXEL_OFFSET_KEY] = static_cast<Json::UInt64>(
+          std::stoull(row->get_string(row_index, false, false)));
+      output[IM_FRAME_COUNT_KEY] = row->get_int(row_index, false);
+      output[IM_FRAME_TABLE_KEY] = row->get_string(row_index, false, false);
+    }
+    partition_seq = row->get_uuid(row_index, false, false);
+  } else {
+    throw onis::exception(EOS_NOT_FOUND, "Image not found");
+  }
+}
+
+// Read the files of the images of a series (in the order of their seqs),
+// with the partition and the volume of the series. Throws if the series does
+// not exist.
+void site_database::find_series_image_files(const std::string& series_seq,
+                                            Json::Value& output) {
+  const auto columns =
+      "pacs_studies.partition_id, pacs_partitions.volume_id, pacs_images.id, "
+      "pacs_images.instnum, pacs_images.imgmedia, pacs_images.imgpath, "
+      "pacs_images.packoffset, pacs_images.packsize";
+  const std::string from =
+      "pacs_series inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id inner join pacs_partitions on pacs_partitions.id "
+      "= pacs_studies.partition_id left join pacs_images on "
+      "pacs_images.series_id = pacs_series.id and pacs_images.imgpath<>''";
+  std::string sql = sql_builder_->build_select_query(
+      columns, from, "pacs_series.id=?", "pacs_images.id", 0,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "find_series_image_files");
+
+  int index = 1;
+  bind_parameter(query, index, series_seq, "id");
+
+  bool found = false;
+  Json::Value& images = output["images"];
+  images = Json::Value(Json::arrayValue);
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      output["partition"] = row->get_uuid(row_index, false, false);
+      output[PT_VOLUME_KEY] = row->get_uuid(row_index, true, true);
+      found = true;
+      // the series has no image:
+      if (row->is_null(row_index))
+        continue;
+      Json::Value& image = images.append(Json::objectValue);
+      image[BASE_SEQ_KEY] = row->get_uuid(row_index, false, false);
+      image[IM_INSTNUM_KEY] = row->get_string(row_index, true, true);
+      image[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, false);
+      image[IM_IMAGE_PATH_KEY] = row->get_string(row_index, false, false);
+      if (!row->is_null(row_index)) {
+        image[IM_PACK_OFFSET_KEY] = static_cast<Json::Int64>(
+            std::stoll(row->get_string(row_index, false, false)));
+        image[IM_PACK_SIZE_KEY] = static_cast<Json::Int64>(
+            std::stoll(row->get_string(row_index, false, false)));
+      }
+    }
+  }
+  if (!found)
+    throw onis::exception(EOS_NOT_FOUND, "Series not found");
+}
+
+// Find the files of the images of a study to export, with the values of the
+// DICOMDIR records of the patient, the study, its series and their images.
+void site_database::find_export_images(const std::string& study_seq,
+                                       Json::Value& output) {
+  const auto columns =
+      "pacs_studies.partition_id, pacs_partitions.volume_id, "
+      "pacs_patients.pid, pacs_patients.name, pacs_patients.birthdate, "
+      "pacs_patients.sex, pacs_studies.uid, pacs_studies.studydate, "
+      "pacs_studies.studytime, pacs_studies.accnum, pacs_studies.studyid, "
+      "pacs_studies.description, pacs_series.id, pacs_series.uid, "
+      "pacs_series.modality, pacs_series.srnum, pacs_images.id, "
+      "pacs_images.uid, pacs_images.sopclass, pacs_images.instnum, "
+      "pacs_images.imgmedia, pacs_images.imgpath, pacs_images.packoffset, "
+      "pacs_images.packsize";
+  const std::string from =
+      "pacs_studies inner join pacs_patients on pacs_patients.id = "
+      "pacs_studies.patient_id inner join pacs_partitions on "
+      "pacs_partitions.id = pacs_studies.partition_id inner join pacs_series "
+      "on pacs_series.study_id = pacs_studies.id inner join pacs_images on "
+      "pacs_images.series_id = pacs_series.id and pacs_images.imgpath<>''";
+  std::string sql = sql_builder_->build_select_query(
+      columns, from, "pacs_studies.id=?", "pacs_series.id, pacs_images.id", 0,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "find_export_images");
+
+  int index = 1;
+  bind_parameter(query, index, study_seq, "id");
+
+  Json::Value& series = output["series"];
+  series = Json::Value(Json::arrayValue);
+  Json::Value* current_series = nullptr;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      output["partition"] = row->get_uuid(row_index, false, false);
+      output[PT_VOLUME_KEY] = row->get_uuid(row_index, true, true);
+      Json::Value& patient = output["patient"];
+      patient[PA_UID_KEY] = row->get_string(row_index, true, true);
+      patient[PA_NAME_KEY] = row->get_string(row_index, true, true);
+      patient[PA_BDATE_KEY] = row->get_string(row_index, true, true);
+      patient[PA_SEX_KEY] = row->get_string(row_index, true, true);
+      Json::Value& study = output["study"];
+      study[ST_UID_KEY] = row->get_string(row_index, false, false);
+      study[ST_DATE_KEY] = row->get_string(row_index, true, true);
+      study[ST_TIME_KEY] = row->get_string(row_index, true, true);
+      study[ST_ACCNUM_KEY] = row->get_string(row_index, true, true);
+      study[ST_STUDYID_KEY] = row->get_string(row_index, true, true);
+      study[ST_DESC_KEY] = row->get_string(row_index, true, true);
+
+      // the rows of a series are consecutive:
+      std::string series_seq = row->get_uuid(row_index, false, false);
+      if (current_series == nullptr ||
+          (*current_series)[BASE_SEQ_KEY].asString() != series_seq) {
+        current_series = &series.append(Json::objectValue);
+        (*current_series)[BASE_SEQ_KEY] = series_seq;
+        (*current_series)[SR_UID_KEY] =
+            row->get_string(row_index, false, false);
+        (*current_series)[SR_MODALITY_KEY] =
+            row->get_string(row_index, true, true);
+        (*current_series)[SR_NUM_KEY] = row->get_string(row_index, true, true);
+        (*current_series)["images"] = Json::Value(Json::arrayValue);
+      } else {
+        row_index += 3;
+      }
+      Json::Value& image =
+          (*current_series)["images"].append(Json::objectValue);
+      image[BASE_SEQ_KEY] = row->get_uuid(row_index, false, false);
+      image[IM_UID_KEY] = row->get_string(row_index, false, false);
+      image[IM_SOPCLASS_KEY] = row->get_string(row_index, true, true);
+      image[IM_INSTNUM_KEY] = row->get_string(row_index, true, true);
+      image[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, false);
+      image[IM_IMAGE_PATH_KEY] = row->get_string(row_index, false, false);
+      if (!row->is_null(row_index)) {
+        image[IM_PACK_OFFSET_KEY] = static_cast<Json::Int64>(
+            std::stoll(row->get_string(row_index, false, false)));
+        image[IM_PACK_SIZE_KEY] = static_cast<Json::Int64>(
+            std::stoll(row->get_string(row_index, false, false)));
+      }
+    }
+  }
+  if (series.empty())
+    throw onis::exception(EOS_NOT_FOUND, "Study not found or empty");
+}
+
+// Read the sops of the images of a partition, page by page in the order of
+// the image seqs. Returns the seq of the last image read, or an empty string
+// once all the images were read.
+std::string site_database::get_partition_sops(const std::string& partition_seq,
+                                              const std::string& after_seq,
+                                              std::int32_t limit,
+                                              std::vector<std::string>& sops) {
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id";
+  std::string clause = "pacs_studies.partition_id=?";
+  if (!after_seq.empty())
+    clause += " AND pacs_images.id>?";
+  std::string sql = sql_builder_->build_select_query(
+      "pacs_images.id, pacs_images.uid", from, clause, "pacs_images.id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_partition_sops");
+
+  int index = 1;
+  bind_parameter(query, index, partition_seq, "partition_id");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      last_seq = row->get_uuid(row_index, false, false);
+      sops.push_back(row->get_string(row_index, false, false));
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
 void site_database::find_images(const std::string& series_seq,
                                 std::uint32_t flags, bool for_client,
                                 onis::database::lock_mode lock_mode,
@@ -0,0 +1,201 @@
+#include <string>
+#include <vector>
+#include "../../include/database/items/db_image.hpp"
+#include "../../include/database/items/db_partition.hpp"
+#include "../../include/database/site_database.hpp"
+#include "onis_kit/include/core/exception.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// Packing operations
+////////////////////////////////////////////////////////////////////////////////
+//
+// The files of the images of a completed series are appended to a container
+// of their media (see series_container), the images recording their range in
+// it (packoffset and packsize, NULL for the images stored in their own file).
+// The files shared by several images (deduplicated contents) are not packed,
+// neither are the stream files and the icons. The content of a single image
+// is released when its file is packed.
+
+//------------------------------------------------------------------------------
+// Series to pack
+//------------------------------------------------------------------------------
+
+// Read the series that received no image for "min_idle_hours", whose stream
+// files and icons were created, and with at least "min_instances" images to
+// pack (or a container already), page by page in the order of their seqs.
+// Returns the seq of the last series read, or an empty string once all the
+// series were read.
+std::string site_database::get_series_to_pack(std::int32_t min_idle_hours,
+                                              std::int32_t min_instances,
+                                              const std::string& after_seq,
+                                              std::int32_t limit,
+                                              std::vector<std::string>& seqs) {
+  const std::string unpacked =
+      "pacs_images.series_id=pacs_series.id AND " +
+      get_unshared_file_clause() +
+      " AND pacs_images.packoffset IS NULL AND pacs_images.imgpath<>''";
+  std::string clause =
+      "NOT EXISTS (SELECT 1 FROM pacs_images WHERE pacs_images.series_id="
+      "pacs_series.id AND (pacs_images.crdate>LOCALTIMESTAMP-CAST(? AS "
+      "INTEGER)*INTERVAL '1 hour' OR pacs_images.streammedia=-2 OR "
+      "pacs_images.iconmedia=-2)) AND EXISTS (SELECT 1 FROM pacs_images "
+      "WHERE " +
+      unpacked + ") AND ((SELECT COUNT(*) FROM pacs_images WHERE " +
+      unpacked +
+      ")>=CAST(? AS INTEGER) OR EXISTS (SELECT 1 FROM pacs_images WHERE "
+      "pacs_images.series_id=pacs_series.id AND pacs_images.packoffset IS "
+      "NOT NULL))";
+  if (!after_seq.empty())
+    clause += " AND pacs_series.id>?";
+  std::string sql = sql_builder_->build_select_query(
+      "pacs_series.id", "pacs_series", clause, "pacs_series.id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_series_to_pack");
+
+  int index = 1;
+  bind_parameter(query, index, min_idle_hours, "min_idle_hours");
+  bind_parameter(query, index, min_instances, "min_instances");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      last_seq = row->get_uuid(row_index, false, false);
+      seqs.push_back(last_seq);
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Read the images of a series to pack, with the volume of its partition
+// ("frames" is false for the images whose frame table is not recorded yet).
+// Returns false if the series has no such image.
+bool site_database::find_packing_images(const std::string& series_seq,
+                                        Json::Value& output) {
+  const auto columns =
+      "pacs_images.id, pacs_images.imgmedia, pacs_images.imgpath, "
+      "pacs_images.pxoffset, pacs_partitions.volume_id";
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id inner join pacs_partitions on pacs_partitions.id "
+      "= pacs_studies.partition_id";
+  const std::string clause =
+      "pacs_images.series_id=? AND " + get_unshared_file_clause() +
+      " AND pacs_images.packoffset IS NULL AND pacs_images.imgpath<>''";
+  auto query = create_and_prepare_query(columns, from, clause,
+                                        onis::database::lock_mode::NO_LOCK);
+
+  int index = 1;
+  bind_parameter(query, index, series_seq, "series_id");
+
+  Json::Value& images = output["images"];
+  images = Json::Value(Json::arrayValue);
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& image = images.append(Json::objectValue);
+      image[BASE_SEQ_KEY] = row->get_uuid(row_index, false, false);
+      image[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, false);
+      image[IM_IMAGE_PATH_KEY] = row->get_string(row_index, false, false);
+      image["frames"] = !row->is_null(row_index++);
+      output[PT_VOLUME_KEY] = row->get_uuid(row_index, true, true);
+    }
+  }
+  return !images.empty();
+}
+
+// Read the container of a series on a media, if it has one:
+std::string site_database::find_series_container(const std::string& series_seq,
+                                                 std::int32_t media) {
+  std::string sql = sql_builder_->build_select_query(
+      "imgpath", "pacs_images",
+      "series_id=? AND imgmedia=? AND packoffset IS NOT NULL", "imgpath", 1,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "find_series_container");
+
+  int index = 1;
+  bind_parameter(query, index, series_seq, "series_id");
+  bind_parameter(query, index, media, "imgmedia");
+
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    if (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      return row->get_string(row_index, false, false);
+    }
+  }
+  return "";
+}
+
+//------------------------------------------------------------------------------
+// Packing
+//------------------------------------------------------------------------------
+
+// Lock the images stored in a container before recording the files appended
+// to it, so that a migration cannot move the container meanwhile. Returns
+// false if the container is no longer used (it was moved, the files appended
+// must not be recorded).
+bool site_database::lock_series_container(const std::string& series_seq,
+                                          std::int32_t media,
+                                          const std::string& path) {
+  auto query = create_and_prepare_query(
+      "id", "pacs_images",
+      "series_id=? AND imgmedia=? AND imgpath=? AND packoffset IS NOT NULL",
+      onis::database::lock_mode::EXCLUSIVE_LOCK);
+  int index = 1;
+  bind_parameter(query, index, series_seq, "series_id");
+  bind_parameter(query, index, media, "imgmedia");
+  bind_parameter(query, index, path, "imgpath");
+  return execute_query(query)->has_rows();
+}
+
+// Record that the file of an image is stored in a container. Returns false if
+// the file of the image was changed meanwhile.
+bool site_database::set_image_packed(const std::string& seq,
+                                     std::int32_t media,
+                                     const std::string& path,
+                                     const std::string& container_path,
+                                     std::uint64_t offset,
+                                     std::uint64_t size) {
+  auto query = prepare_query(
+      "UPDATE PACS_IMAGES SET IMGPATH=?, PACKOFFSET=?, PACKSIZE=? WHERE ID=? "
+      "AND IMGMEDIA=? AND IMGPATH=? AND PACKOFFSET IS NULL AND CONTENT_ID IS "
+      "NULL",
+      "set_image_packed");
+  int index = 1;
+  bind_parameter(query, index, container_path, "container_path");
+  bind_parameter(query, index, std::to_string(offset), "packoffset");
+  bind_parameter(query, index, std::to_string(size), "packsize");
+  bind_parameter(query, index, seq, "id");
+  bind_parameter(query, index, media, "imgmedia");
+  bind_parameter(query, index, path, "imgpath");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+// The downloads of a series in progress read the packed files from the
+// container:
+void site_database::redirect_packed_downloads(const std::string& series_seq,
+                                              const std::string& path,
+                                              const std::string& container_path,
+                                              std::uint64_t offset,
+                                              std::uint64_t size) {
+  auto query = prepare_query(
+      "UPDATE PACS_DOWNLOAD_IMAGES SET PATH=?, PACKOFFSET=?, PACKSIZE=? WHERE "
+      "PATH=? AND TYPE=1 AND SERIES_ID IN (SELECT ID FROM "
+      "PACS_DOWNLOAD_SERIES WHERE SERIES_ID=?)",
+      "redirect_packed_downloads");
+  int index = 1;
+  bind_parameter(query, index, container_path, "container_path");
+  bind_parameter(query, index, std::to_string(offset), "packoffset");
+  bind_parameter(query, index, std::to_string(size), "packsize");
+  bind_parameter(query, index, path, "path");
+  bind_parameter(query, index, series_seq, "series_id");
+  execute_query(query);
+}
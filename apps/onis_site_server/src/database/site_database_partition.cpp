@@ -178,6 +178,18 @@ void site_database::find_partition_by_seq(
   }
 }
 
+void site_database::get_partition_seqs(std::vector<std::string>& output) {
+  auto query = create_and_prepare_query("id", "pacs_partitions", "",
+                                        onis::database::lock_mode::NO_LOCK);
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t index = 0;
+      output.push_back(row->get_uuid(index, false, false));
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 // Modify operations
 //------------------------------------------------------------------------------
@@ -0,0 +1,101 @@
+#include <string>
+#include <vector>
+#include "../../include/database/items/db_partition.hpp"
+#include "../../include/database/site_database.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// File release operations
+////////////////////////////////////////////////////////////////////////////////
+//
+// The files replaced by another one (compressed, moved to another media or
+// packed) may still be downloaded for a while. They are recorded in
+// pacs_file_releases in the transaction replacing them, with the date from
+// which they can be deleted, and deleted by the site server once this date is
+// passed, even after a restart.
+
+//------------------------------------------------------------------------------
+// Create operations
+//------------------------------------------------------------------------------
+
+// Record the file at "path" (relative to the media folder) to delete in
+// "delay" seconds.
+void site_database::add_file_release(const std::string& volume_seq,
+                                     std::int32_t media,
+                                     const std::string& path,
+                                     std::int32_t delay) {
+  auto query = prepare_query(
+      "INSERT INTO PACS_FILE_RELEASES (ID, VOLUME_ID, MEDIA, PATH, DUEDATE) "
+      "VALUES (?, ?, ?, ?, LOCALTIMESTAMP(0)+CAST(? AS INTEGER)*INTERVAL "
+      "'1 second')",
+      "add_file_release");
+  int index = 1;
+  bind_parameter(query, index, onis::util::uuid::generate_random_uuid(), "id");
+  bind_parameter(query, index, volume_seq, "volume_id");
+  bind_parameter(query, index, media, "media");
+  bind_parameter(query, index, path, "path");
+  bind_parameter(query, index, delay < 0 ? 0 : delay, "delay");
+  execute_query(query);
+}
+
+//------------------------------------------------------------------------------
+// Find operations
+//------------------------------------------------------------------------------
+
+// Read up to "limit" files whose date is passed, "releases" receives their
+// seq, volume, media and path.
+void site_database::get_due_file_releases(std::int32_t limit,
+                                          std::vector<Json::Value>& releases) {
+  std::string sql = sql_builder_->build_select_query(
+      "id, volume_id, media, path", "pacs_file_releases",
+      "duedate<=LOCALTIMESTAMP", "duedate", limit);
+  auto query = prepare_query(sql, "get_due_file_releases");
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& release = releases.emplace_back(Json::objectValue);
+      release[BASE_SEQ_KEY] = row->get_uuid(row_index, false, false);
+      release[PT_VOLUME_KEY] = row->get_uuid(row_index, false, false);
+      release["media"] = row->get_int(row_index, false);
+      release["path"] = row->get_string(row_index, false, false);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Delete operations
+//------------------------------------------------------------------------------
+
+// Keep the file at "path" if it was recorded to delete: it is referenced
+// again (moved back to its media before it was deleted).
+void site_database::cancel_file_release(const std::string& volume_seq,
+                                        std::int32_t media,
+                                        const std::string& path) {
+  auto query = prepare_query(
+      "DELETE FROM PACS_FILE_RELEASES WHERE VOLUME_ID=? AND MEDIA=? AND "
+      "PATH=?",
+      "cancel_file_release");
+  int index = 1;
+  bind_parameter(query, index, volume_seq, "volume_id");
+  bind_parameter(query, index, media, "media");
+  bind_parameter(query, index, path, "path");
+  execute_query(query);
+}
+
+// Remove the records of the files deleted.
+void site_database::delete_file_releases(const std::vector<std::string>& seqs) {
+  if (seqs.empty())
+    return;
+  std::string clause;
+  for (std::size_t i = 0; i < seqs.size(); i++)
+    clause += i == 0 ? "?" : ", ?";
+  auto query = prepare_query(
+      "DELETE FROM PACS_FILE_RELEASES WHERE ID IN (" + clause + ")",
+      "delete_file_releases");
+  int index = 1;
+  for (const auto& seq : seqs)
+    bind_parameter(query, index, seq, "id");
+  execute_query(query);
+}
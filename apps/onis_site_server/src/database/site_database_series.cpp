@@ -28,7 +28,7 @@ std::string site_database::get_series_columns(std::uint32_t flags,
            "station, " + prefix + "iconmedia, " + prefix + "iconpath, " +
            prefix + "propmedia, " + prefix + "proppath, " + prefix + "imcnt, " +
            prefix + "status, " + prefix + "crdate, " + prefix + "oid, " +
-           prefix + "oname, " + prefix + "oip";
+           prefix + "oname, " + prefix + "oip, " + prefix + "pxstats";
   }
   std::string columns =
       prefix + "id, " + prefix + "study_id, " + prefix + "uid";
@@ -72,6 +72,9 @@ std::string site_database::get_series_columns(std::uint32_t flags,
     columns += ", " + prefix + "crdate, " + prefix + "oid, " + prefix +
                "oname, " + prefix + "oip";
   }
+  if (flags & onis::database::info_series_pixel_statistics) {
+    columns += ", " + prefix + "pxstats";
+  }
   return columns;
 }
 
@@ -156,6 +159,12 @@ void site_database::create_series_item(onis_kit::database::database_row& rec,
     series[SR_ORIGIN_NAME_KEY] = rec.get_string(*target_index, true, true);
     series[SR_ORIGIN_IP_KEY] = rec.get_string(*target_index, true, true);
   }
+  if (flags & onis::database::info_series_pixel_statistics) {
+    std::string value = rec.get_string(*target_index, true, true);
+    Json::Reader reader;
+    if (!value.empty() && !reader.parse(value, series[SR_PIXEL_STATS_KEY]))
+      series[SR_PIXEL_STATS_KEY] = Json::Value(Json::nullValue);
+  }
 }
 
 //------------------------------------------------------------------------------
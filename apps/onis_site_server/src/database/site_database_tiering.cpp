@@ -0,0 +1,200 @@
+#include <string>
+#include <vector>
+#include "../../include/database/items/db_image.hpp"
+#include "../../include/database/items/db_partition.hpp"
+#include "../../include/database/site_database.hpp"
+#include "onis_kit/include/core/exception.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// Tiering operations
+////////////////////////////////////////////////////////////////////////////////
+//
+// The series are moved between the media of their volume by the tiering
+// rules, depending on their age and on their last download (accdate). Only
+// the files of the images are moved (files, stream files and icons), the
+// files shared by several images (deduplicated contents) stay where they are
+// (the content of a single image is released when its file is moved).
+// A series container is moved once, with all the images it stores.
+
+// columns of the files of an image, by kind of file:
+static const char* const kFileMediaColumns[] = {"IMGMEDIA", "STREAMMEDIA",
+                                                "ICONMEDIA"};
+static const char* const kFilePathColumns[] = {"IMGPATH", "STREAMPATH",
+                                               "ICONPATH"};
+
+//------------------------------------------------------------------------------
+// Series access
+//------------------------------------------------------------------------------
+
+// Record that a series was downloaded. The date is only updated once an hour,
+// the downloads of the same series do not update it again:
+void site_database::set_series_access(const std::string& series_seq) {
+  auto query = prepare_query(
+      "UPDATE PACS_SERIES SET ACCDATE=LOCALTIMESTAMP(0) WHERE ID=? AND "
+      "(ACCDATE IS NULL OR ACCDATE<LOCALTIMESTAMP-INTERVAL '1 hour')",
+      "set_series_access");
+  int index = 1;
+  bind_parameter(query, index, series_seq, "id");
+  execute_query(query);
+}
+
+//------------------------------------------------------------------------------
+// Series to migrate
+//------------------------------------------------------------------------------
+
+// Read the series created and last downloaded more than "min_age_days" and
+// "min_idle_days" ago, having files on "media" (of the partition if
+// "partition_seq" is not empty), page by page in the order of their seqs.
+// Returns the seq of the last series read, or an empty string once all the
+// series were read.
+std::string site_database::get_series_to_migrate(
+    const std::string& partition_seq, std::int32_t media,
+    std::int32_t min_age_days, std::int32_t min_idle_days,
+    const std::string& after_seq, std::int32_t limit,
+    std::vector<std::string>& seqs) {
+  const std::string from =
+      "pacs_series inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id";
+  std::string clause =
+      "pacs_series.crdate<LOCALTIMESTAMP-CAST(? AS INTEGER)*INTERVAL '1 day' "
+      "AND COALESCE(pacs_series.accdate, pacs_series.crdate)<LOCALTIMESTAMP-"
+      "CAST(? AS INTEGER)*INTERVAL '1 day' AND EXISTS (SELECT 1 FROM "
+      "pacs_images WHERE pacs_images.series_id=pacs_series.id AND " +
+      get_unshared_file_clause() +
+      " AND (pacs_images.imgmedia=? OR pacs_images.streammedia=? OR "
+      "pacs_images.iconmedia=?))";
+  if (!partition_seq.empty())
+    clause += " AND pacs_studies.partition_id=?";
+  if (!after_seq.empty())
+    clause += " AND pacs_series.id>?";
+  std::string sql = sql_builder_->build_select_query(
+      "pacs_series.id", from, clause, "pacs_series.id", limit,
+      onis::database::lock_mode::NO_LOCK);
+  auto query = prepare_query(sql, "get_series_to_migrate");
+
+  int index = 1;
+  bind_parameter(query, index, min_age_days, "min_age_days");
+  bind_parameter(query, index, min_idle_days, "min_idle_days");
+  for (std::int32_t i = 0; i < 3; i++)
+    bind_parameter(query, index, media, "media");
+  if (!partition_seq.empty())
+    bind_parameter(query, index, partition_seq, "partition_id");
+  if (!after_seq.empty())
+    bind_parameter(query, index, after_seq, "id");
+
+  std::string last_seq;
+  std::int32_t count = 0;
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      last_seq = row->get_uuid(row_index, false, false);
+      seqs.push_back(last_seq);
+      count++;
+    }
+  }
+  return count < limit ? "" : last_seq;
+}
+
+// Read the files of the images of a series that can be moved, with the volume
+// of its partition. Returns false if the series has no such image.
+bool site_database::find_migration_files(const std::string& series_seq,
+                                         Json::Value& output) {
+  const auto columns =
+      "pacs_images.id, pacs_images.imgmedia, pacs_images.imgpath, "
+      "pacs_images.streammedia, pacs_images.streampath, "
+      "pacs_images.iconmedia, pacs_images.iconpath, pacs_partitions.volume_id";
+  const std::string from =
+      "pacs_images inner join pacs_series on pacs_series.id = "
+      "pacs_images.series_id inner join pacs_studies on pacs_studies.id = "
+      "pacs_series.study_id inner join pacs_partitions on pacs_partitions.id "
+      "= pacs_studies.partition_id";
+  const std::string clause =
+      "pacs_images.series_id=? AND " + get_unshared_file_clause();
+  auto query = create_and_prepare_query(columns, from, clause,
+                                        onis::database::lock_mode::NO_LOCK);
+
+  int index = 1;
+  bind_parameter(query, index, series_seq, "series_id");
+
+  Json::Value& images = output["images"];
+  images = Json::Value(Json::arrayValue);
+  auto result = execute_query(query);
+  if (result->has_rows()) {
+    while (auto row = result->get_next_row()) {
+      std::int32_t row_index = 0;
+      Json::Value& image = images.append(Json::objectValue);
+      image[BASE_SEQ_KEY] = row->get_uuid(row_index, false, false);
+      image[IM_IMAGE_MEDIA_KEY] = row->get_int(row_index, true);
+      image[IM_IMAGE_PATH_KEY] = row->get_string(row_index, true, true);
+      image[IM_STREAM_MEDIA_KEY] = row->get_int(row_index, true);
+      image[IM_STREAM_PATH_KEY] = row->get_string(row_index, true, true);
+      image[IM_ICON_MEDIA_KEY] = row->get_int(row_index, true);
+      image[IM_ICON_PATH_KEY] = row->get_string(row_index, true, true);
+      output[PT_VOLUME_KEY] = row->get_uuid(row_index, true, true);
+    }
+  }
+  return !images.empty();
+}
+
+//------------------------------------------------------------------------------
+// Migration
+//------------------------------------------------------------------------------
+
+// Record that a file of an image ("kind": 0 for its file, 1 for its stream
+// file, 2 for its icon) was moved to another media. Returns false if the file
+// of the image was changed meanwhile.
+bool site_database::set_image_file_media(const std::string& seq,
+                                         std::int32_t kind,
+                                         std::int32_t from_media,
+                                         std::int32_t to_media,
+                                         const std::string& path) {
+  if (kind < 0 || kind > 2)
+    throw onis::exception(EOS_PARAM, "Invalid kind of file");
+  std::string media_column = kFileMediaColumns[kind];
+  std::string path_column = kFilePathColumns[kind];
+  auto query = prepare_query("UPDATE PACS_IMAGES SET " + media_column +
+                                 "=? WHERE ID=? AND " + media_column +
+                                 "=? AND " + path_column + "=?",
+                             "set_image_file_media");
+  int index = 1;
+  bind_parameter(query, index, to_media, "to_media");
+  bind_parameter(query, index, seq, "id");
+  bind_parameter(query, index, from_media, "from_media");
+  bind_parameter(query, index, path, "path");
+  return execute_query(query)->get_affected_rows() > 0;
+}
+
+// The downloads of a series in progress read its files from their new path:
+void site_database::redirect_series_downloads(const std::string& series_seq,
+                                              const std::string& path,
+                                              const std::string& new_path) {
+  auto query = prepare_query(
+      "UPDATE PACS_DOWNLOAD_IMAGES SET PATH=? WHERE PATH=? AND SERIES_ID IN "
+      "(SELECT ID FROM PACS_DOWNLOAD_SERIES WHERE SERIES_ID=?)",
+      "redirect_series_downloads");
+  int index = 1;
+  bind_parameter(query, index, new_path, "new_path");
+  bind_parameter(query, index, path, "path");
+  bind_parameter(query, index, series_seq, "series_id");
+  execute_query(query);
+}
+
+// Check whether images of a series still use a file of a media, as the
+// series containers shared by the images packed after a migration started:
+bool site_database::is_image_file_used(const std::string& series_seq,
+                                       std::int32_t kind, std::int32_t media,
+                                       const std::string& path) {
+  if (kind < 0 || kind > 2)
+    throw onis::exception(EOS_PARAM, "Invalid kind of file");
+  std::string clause = std::string("series_id=? AND ") +
+                       kFileMediaColumns[kind] + "=? AND " +
+                       kFilePathColumns[kind] + "=?";
+  auto query = create_and_prepare_query("id", "pacs_images", clause,
+                                        onis::database::lock_mode::NO_LOCK, 1);
+  int index = 1;
+  bind_parameter(query, index, series_seq, "series_id");
+  bind_parameter(query, index, media, "media");
+  bind_parameter(query, index, path, "path");
+  return execute_query(query)->has_rows();
+}
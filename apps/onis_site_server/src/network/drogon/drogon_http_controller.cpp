@@ -1,10 +1,111 @@
 #include "../../../include/network/drogon/drogon_http_controller.hpp"
+#include "../../../include/network/http_compression.hpp"
 #include <json/json.h>
-#include <cstdlib>
-#include <ctime>
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include "onis_kit/include/core/result.hpp"
+
+namespace {
+
+// Parse a single "bytes=first-last" range (RFC 9110 14.1.2). Returns false if
+// the whole file has to be sent (no range, or a multi-range request), and
+// sets "satisfiable" to false if the range lies outside of the file.
+bool parse_byte_range(const std::string& header, std::uint64_t size,
+                      std::uint64_t& offset, std::uint64_t& length,
+                      bool& satisfiable) {
+  satisfiable = true;
+  const std::string unit = "bytes=";
+  if (header.compare(0, unit.size(), unit) != 0 ||
+      header.find(',') != std::string::npos)
+    return false;
+  std::string spec = header.substr(unit.size());
+  std::size_t dash = spec.find('-');
+  if (dash == std::string::npos)
+    return false;
+  std::string first = spec.substr(0, dash);
+  std::string last = spec.substr(dash + 1);
+  try {
+    if (first.empty()) {
+      // suffix range: the last N bytes
+      std::uint64_t suffix = std::stoull(last);
+      if (suffix == 0 || size == 0) {
+        satisfiable = false;
+        return true;
+      }
+      length = std::min(suffix, size);
+      offset = size - length;
+      return true;
+    }
+    offset = std::stoull(first);
+    std::uint64_t end = last.empty() ? size - 1 : std::stoull(last);
+    if (offset >= size || end < offset) {
+      satisfiable = false;
+      return true;
+    }
+    end = std::min(end, size - 1);
+    length = end - offset + 1;
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+std::string trim(const std::string& value) {
+  std::size_t first = value.find_first_not_of(" \t");
+  if (first == std::string::npos)
+    return "";
+  std::size_t last = value.find_last_not_of(" \t");
+  return value.substr(first, last - first + 1);
+}
+
+// Read the transfer syntaxes accepted for a DICOM file: the comma separated
+// "transfer_syntax" parameter, or the "transfer-syntax" parameters of the
+// application/dicom media ranges of the Accept header (DICOM PS3.18 8.7.3).
+// Returns false when the client did not ask for any.
+bool parse_transfer_syntaxes(const drogon::HttpRequestPtr& req,
+                             Json::Value& output, bool& from_accept) {
+  output = Json::Value(Json::arrayValue);
+  from_accept = false;
+  std::string item;
+  std::istringstream parameter(req->getParameter("transfer_syntax"));
+  while (std::getline(parameter, item, ',')) {
+    item = trim(item);
+    if (!item.empty())
+      output.append(item);
+  }
+  if (!output.empty())
+    return true;
+
+  std::istringstream accept(req->getHeader("Accept"));
+  std::string range;
+  while (std::getline(accept, range, ',')) {
+    std::istringstream parts(range);
+    std::string media_type;
+    std::getline(parts, media_type, ';');
+    media_type = trim(media_type);
+    std::transform(media_type.begin(), media_type.end(), media_type.begin(),
+                   ::tolower);
+    if (media_type != "application/dicom")
+      continue;
+    while (std::getline(parts, item, ';')) {
+      std::size_t equal = item.find('=');
+      if (equal == std::string::npos ||
+          trim(item.substr(0, equal)) != "transfer-syntax")
+        continue;
+      std::string value = trim(item.substr(equal + 1));
+      if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+        value = value.substr(1, value.size() - 2);
+      if (!value.empty())
+        output.append(value);
+    }
+  }
+  from_accept = !output.empty();
+  return from_accept;
+}
+
+}  // namespace
 
 ////////////////////////////////////////////////////////////////////////////////
 // drogon_http_controller
@@ -15,12 +116,14 @@
 //------------------------------------------------------------------------------
 
 http_drogon_controller_ptr http_drogon_controller::create(
-    const request_service_ptr& srv) {
-  return std::make_shared<http_drogon_controller>(srv);
+    const request_service_ptr& srv, const config_service_ptr& config) {
+  return std::make_shared<http_drogon_controller>(srv, config);
 }
 
-http_drogon_controller::http_drogon_controller(const request_service_ptr& srv) {
+http_drogon_controller::http_drogon_controller(
+    const request_service_ptr& srv, const config_service_ptr& config) {
   rqsrv_ = srv;
+  config_ = config;
 }
 
 //------------------------------------------------------------------------------
@@ -75,72 +178,67 @@ void http_drogon_controller::dicom_import(
     std::string content_type = req->getHeader("Content-Type");
     bool is_multi_part =
         content_type.find("multipart/form-data") != std::string::npos;
-    if (!is_multi_part) {
-      auto resp = drogon::HttpResponse::newHttpResponse();
-      resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
-      return callback(resp);
-    }
-
     drogon::MultiPartParser parser;
-    int parse_result = parser.parse(req);
-    if (parse_result != 0) {
-      auto resp = drogon::HttpResponse::newHttpResponse();
-      resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
-      return callback(resp);
-    }
-
-    const auto& files = parser.getFiles();
-    if (files.empty()) {
-      auto resp = drogon::HttpResponse::newHttpResponse();
-      resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
-      return callback(resp);
-    }
+    if (!is_multi_part) {
+      // files or folders already on the server (dicom_file_path or
+      // dicom_folder_path):
+      auto& json_obj = req->getJsonObject();
+      if (json_obj == nullptr) {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
+        return callback(resp);
+      }
+      data->input_json = *json_obj;
+    } else {
+      int parse_result = parser.parse(req);
+      if (parse_result != 0) {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
+        return callback(resp);
+      }
 
-    // Form fields - convert parameters to Json::Value object
-    const auto& parameters = parser.getParameters();
-    Json::Reader reader;
-    for (const auto& param : parameters) {
-      data->input_json[param.first] = param.second;
-    }
+      const auto& files = parser.getFiles();
+      if (files.empty()) {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
+        return callback(resp);
+      }
 
-    // Pick file
-    const drogon::HttpFile* upload_file = nullptr;
-    std::string field_name;
-    for (const auto& file : files) {
-      std::string item_name = file.getItemName();
-      if (item_name == "file" || upload_file == nullptr) {
-        upload_file = &file;
-        field_name = item_name;
-        if (item_name == "file")
-          break;
+      // Form fields - convert parameters to Json::Value object
+      const auto& parameters = parser.getParameters();
+      for (const auto& param : parameters) {
+        data->input_json[param.first] = param.second;
       }
-    }
 
-    if (!upload_file) {
-      auto resp = drogon::HttpResponse::newHttpResponse();
-      resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
-      return callback(resp);
+      // The uploaded contents are written by the service, on the media
+      // volume where the images will be stored. All the files of the set are
+      // imported together:
+      for (const auto& file : files) {
+        const drogon::HttpFile* upload_file = &file;
+        data->input_files.push_back(
+            {file.getFileName(), [upload_file](const std::string& path) {
+               return upload_file->saveAs(path) == 0;
+             }});
+      }
     }
 
-    // Destination temp file
-    std::filesystem::path tmp_dir = std::filesystem::temp_directory_path();
-    std::string tmp_file_name = "onis_dicom_upload_" +
-                                std::to_string(std::time(nullptr)) + "_" +
-                                std::to_string(std::rand()) + ".dcm";
-    std::filesystem::path tmp_file_path = tmp_dir / tmp_file_name;
-
-    // Save uploaded content
-    upload_file->saveAs(tmp_file_path.string());
-    data->input_json["dicom_file_path"] = tmp_file_path.string();
-
     // Handle request:
     drogon::HttpResponsePtr resp;
     rqsrv_->process_request(data);
     data->read_output([&](const Json::Value& output,
                           const std::vector<std::uint8_t>& binary_output) {
-      resp = drogon::HttpResponse::newHttpJsonResponse(output);
+      resp = create_json_response(req, output);
+      if (output["status"].asInt() != EOS_NONE) {
+        resp->setStatusCode(get_error_status(output["status"].asInt()));
+      } else if (output.isMember("job")) {
+        // spooled, the import runs in the background:
+        resp->setStatusCode(drogon::HttpStatusCode::k202Accepted);
+        resp->addHeader("Location",
+                        "/dicom/import/" + output["job"]["id"].asString());
+      } else {
+        resp->setStatusCode(drogon::HttpStatusCode::k200OK);
+      }
     });
-    resp->setStatusCode(drogon::HttpStatusCode::k200OK);
     callback(resp);
   } catch (const std::exception& e) {
     auto resp = drogon::HttpResponse::newHttpResponse();
@@ -149,6 +247,24 @@ void http_drogon_controller::dicom_import(
   }
 }
 
+void http_drogon_controller::get_import_job(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+    const std::string& id) const {
+  request_data_ptr data = request_data::create(request_type::kGetImportJob);
+  data->input_json["id"] = id;
+  rqsrv_->process_request(data);
+
+  drogon::HttpResponsePtr resp;
+  data->read_output([&](const Json::Value& output,
+                        const std::vector<std::uint8_t>& binary_output) {
+    resp = create_json_response(req, output);
+    if (output["status"].asInt() != EOS_NONE)
+      resp->setStatusCode(get_error_status(output["status"].asInt()));
+  });
+  callback(resp);
+}
+
 //------------------------------------------------------------------------------
 // Download
 //------------------------------------------------------------------------------
@@ -165,6 +281,327 @@ void http_drogon_controller::download_images(
   treat_post_request(req, callback, request_type::kDownloadImages);
 }
 
+void http_drogon_controller::get_image_file(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+    const std::string& seq) const {
+  request_data_ptr data = request_data::create(request_type::kGetImageFile);
+  data->input_json["seq"] = seq;
+  const std::string& format = req->getParameter("format");
+  if (!format.empty())
+    data->input_json["format"] = format;
+  Json::Value syntaxes;
+  bool from_accept = false;
+  if (parse_transfer_syntaxes(req, syntaxes, from_accept)) {
+    data->input_json["transfer_syntaxes"] = syntaxes;
+    const std::string& if_none_match = req->getHeader("If-None-Match");
+    if (!if_none_match.empty())
+      data->input_json["if_none_match"] = if_none_match;
+  }
+  rqsrv_->process_request(data);
+
+  Json::Value output;
+  hot_file_cache::buffer_ptr content;
+  request_data::stream_reader_fn reader;
+  data->read_output([&](const Json::Value& result,
+                        const std::vector<std::uint8_t>& binary_output,
+                        const request_data::stream_reader_fn& stream_reader) {
+    output = result;
+    if (!binary_output.empty())
+      content = std::make_shared<const std::vector<char>>(
+          binary_output.begin(), binary_output.end());
+    reader = stream_reader;
+  });
+  if (output["status"].asInt() != EOS_NONE) {
+    auto resp = create_json_response(req, output);
+    resp->setStatusCode(get_error_status(output["status"].asInt()));
+    return callback(resp);
+  }
+
+  std::string content_type = output["type"].asInt() == 1
+                                 ? "application/dicom"
+                                 : "application/octet-stream";
+  drogon::HttpResponsePtr resp;
+  if (output["not_modified"].asBool() || reader) {
+    // a transcoded file, already held by the client or too large to be sent
+    // from memory (it was opened by the request):
+    if (reader) {
+      resp = drogon::HttpResponse::newStreamResponse(reader);
+      resp->setStatusCode(drogon::HttpStatusCode::k200OK);
+      resp->setContentTypeString(content_type);
+    } else {
+      resp = drogon::HttpResponse::newHttpResponse();
+      resp->setStatusCode(drogon::HttpStatusCode::k304NotModified);
+    }
+    // like the stored file it is produced from, it is revalidated:
+    resp->addHeader("ETag", output["etag"].asString());
+    resp->addHeader("Cache-Control", "private, no-cache");
+  } else if (content != nullptr) {
+    // a transcoded file read by the request:
+    resp = create_file_response(req, "", 0, content->size(),
+                                output["etag"].asString(), content_type,
+                                content);
+  } else {
+    resp = create_file_response(req, output["path"].asString(),
+                                output["offset"].asUInt64(),
+                                output["size"].asUInt64(),
+                                output["etag"].asString(), content_type);
+  }
+  if (from_accept)
+    resp->addHeader("Vary", "Accept");
+  if (output.isMember("transcode_ms")) {
+    std::ostringstream timing;
+    timing << "transcode;dur=" << output["transcode_ms"].asDouble()
+           << ";desc=\"" << output["transcode_cache"].asString() << '"';
+    resp->addHeader("Server-Timing", timing.str());
+  }
+  callback(resp);
+}
+
+void http_drogon_controller::get_image_frames(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+    const std::string& seq) const {
+  request_data_ptr data = request_data::create(request_type::kGetImageFrames);
+  data->input_json["seq"] = seq;
+  const std::string& frames = req->getParameter("frames");
+  if (!frames.empty())
+    data->input_json["frames"] = frames;
+  rqsrv_->process_request(data);
+
+  Json::Value output;
+  data->read_output([&](const Json::Value& result,
+                        const std::vector<std::uint8_t>& binary_output) {
+    output = result;
+  });
+  output.removeMember("path");
+  output.removeMember("file_offset");
+  auto resp = create_json_response(req, output);
+  if (output["status"].asInt() != EOS_NONE) {
+    resp->setStatusCode(get_error_status(output["status"].asInt()));
+  } else {
+    // the byte ranges change when the frames are re-encoded, they are
+    // revalidated with the entity tag of the file:
+    resp->addHeader("ETag", output["etag"].asString());
+    resp->addHeader("Cache-Control", "private, no-cache");
+  }
+  callback(resp);
+}
+
+void http_drogon_controller::get_image_frame_data(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+    const std::string& seq, const std::string& frames) const {
+  request_data_ptr data = request_data::create(request_type::kGetImageFrames);
+  data->input_json["seq"] = seq;
+  data->input_json["frames"] = frames;
+  rqsrv_->process_request(data);
+
+  Json::Value output;
+  data->read_output([&](const Json::Value& result,
+                        const std::vector<std::uint8_t>& binary_output) {
+    output = result;
+  });
+  if (output["status"].asInt() != EOS_NONE) {
+    output.removeMember("path");
+    auto resp = create_json_response(req, output);
+    resp->setStatusCode(get_error_status(output["status"].asInt()));
+    return callback(resp);
+  }
+
+  // the frames have their own entity tag, derived from the file one, so
+  // that the frames re-encoded by a compression are not served from the
+  // cache of the client:
+  std::string etag = output["etag"].asString();
+  etag.insert(etag.size() - 1, "-f" + frames);
+  callback(create_file_response(req, output["path"].asString(),
+                                output["file_offset"].asUInt64() +
+                                    output["offset"].asUInt64(),
+                                output["length"].asUInt64(), etag,
+                                "application/octet-stream"));
+}
+
+void http_drogon_controller::get_image_preview(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+    const std::string& seq) const {
+  request_data_ptr data = request_data::create(request_type::kGetImagePreview);
+  data->input_json["seq"] = seq;
+  for (const char* name : {"frame", "size", "format", "center", "width"}) {
+    const std::string& value = req->getParameter(name);
+    if (!value.empty())
+      data->input_json[name] = value;
+  }
+  const std::string& if_none_match = req->getHeader("If-None-Match");
+  if (!if_none_match.empty())
+    data->input_json["if_none_match"] = if_none_match;
+  rqsrv_->process_request(data);
+
+  drogon::HttpResponsePtr resp;
+  data->read_output([&](const Json::Value& output,
+                        const std::vector<std::uint8_t>& binary_output) {
+    if (output["status"].asInt() != EOS_NONE) {
+      resp = create_json_response(req, output);
+      resp->setStatusCode(get_error_status(output["status"].asInt()));
+      return;
+    }
+    resp = drogon::HttpResponse::newHttpResponse();
+    if (output["not_modified"].asBool()) {
+      resp->setStatusCode(drogon::HttpStatusCode::k304NotModified);
+    } else {
+      resp->setStatusCode(drogon::HttpStatusCode::k200OK);
+      resp->setBody(std::string(binary_output.begin(), binary_output.end()));
+      resp->setContentTypeString(output["content_type"].asString());
+    }
+    // the entity tag holds the version of the file, a rewritten file gets
+    // a new preview on revalidation:
+    resp->addHeader("ETag", output["etag"].asString());
+    resp->addHeader("Cache-Control", "private, no-cache");
+  });
+  callback(resp);
+}
+
+void http_drogon_controller::get_series_metadata(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+    const std::string& seq) const {
+  request_data_ptr data =
+      request_data::create(request_type::kGetSeriesMetadata);
+  data->input_json["seq"] = seq;
+  const std::string& if_none_match = req->getHeader("If-None-Match");
+  if (!if_none_match.empty())
+    data->input_json["if_none_match"] = if_none_match;
+  rqsrv_->process_request(data);
+
+  drogon::HttpResponsePtr resp;
+  data->read_output([&](const Json::Value& output,
+                        const std::vector<std::uint8_t>& binary_output) {
+    if (output["status"].asInt() != EOS_NONE) {
+      resp = create_json_response(req, output);
+      resp->setStatusCode(get_error_status(output["status"].asInt()));
+      return;
+    }
+    resp = drogon::HttpResponse::newHttpResponse();
+    if (output["not_modified"].asBool()) {
+      resp->setStatusCode(drogon::HttpStatusCode::k304NotModified);
+    } else {
+      resp->setStatusCode(drogon::HttpStatusCode::k200OK);
+      resp->setContentTypeString("application/vnd.onis.series-metadata");
+      std::string body(binary_output.begin(), binary_output.end());
+      if (config_ && config_->is_compression_enabled())
+        set_compressed_body(req, resp, std::move(body));
+      else
+        resp->setBody(std::move(body));
+      resp->addHeader("X-Instance-Count",
+                      std::to_string(output["instances"].asUInt()));
+    }
+    // the pack changes with the files of the series, it is revalidated:
+    resp->addHeader("ETag", output["etag"].asString());
+    resp->addHeader("Cache-Control", "private, no-cache");
+  });
+  callback(resp);
+}
+
+//------------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------------
+
+void http_drogon_controller::get_statistics(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback) const {
+  treat_post_request(req, callback, request_type::kGetStatistics);
+}
+
+//------------------------------------------------------------------------------
+// Consistency checks
+//------------------------------------------------------------------------------
+
+void http_drogon_controller::check_archive(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback) const {
+  auto& json_obj = req->getJsonObject();
+  if (json_obj == nullptr) {
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
+    return callback(resp);
+  }
+  request_data_ptr data = request_data::create(request_type::kCheckArchive);
+  data->input_json = *json_obj;
+  rqsrv_->process_request(data);
+
+  // the check runs in the background:
+  drogon::HttpResponsePtr resp;
+  data->read_output([&](const Json::Value& output,
+                        const std::vector<std::uint8_t>& binary_output) {
+    resp = create_json_response(req, output);
+    if (output["status"].asInt() != EOS_NONE) {
+      resp->setStatusCode(get_error_status(output["status"].asInt()));
+      return;
+    }
+    resp->setStatusCode(drogon::HttpStatusCode::k202Accepted);
+    resp->addHeader("Location",
+                    "/archive/check/" + output["job"]["id"].asString());
+  });
+  callback(resp);
+}
+
+void http_drogon_controller::get_archive_check(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback,
+    const std::string& id) const {
+  request_data_ptr data =
+      request_data::create(request_type::kGetArchiveCheck);
+  data->input_json["id"] = id;
+  rqsrv_->process_request(data);
+
+  drogon::HttpResponsePtr resp;
+  data->read_output([&](const Json::Value& output,
+                        const std::vector<std::uint8_t>& binary_output) {
+    resp = create_json_response(req, output);
+    if (output["status"].asInt() != EOS_NONE)
+      resp->setStatusCode(get_error_status(output["status"].asInt()));
+  });
+  callback(resp);
+}
+
+//------------------------------------------------------------------------------
+// Exports
+//------------------------------------------------------------------------------
+
+void http_drogon_controller::export_studies(
+    const drogon::HttpRequestPtr& req,
+    std::function<void(const drogon::HttpResponsePtr&)>&& callback) const {
+  auto& json_obj = req->getJsonObject();
+  if (json_obj == nullptr) {
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::HttpStatusCode::k400BadRequest);
+    return callback(resp);
+  }
+  request_data_ptr data = request_data::create(request_type::kExportStudies);
+  data->input_json = *json_obj;
+  rqsrv_->process_request(data);
+
+  // the archive is sent (chunked) while it is produced:
+  drogon::HttpResponsePtr resp;
+  data->read_output([&](const Json::Value& output,
+                        const std::vector<std::uint8_t>& binary_output,
+                        const request_data::stream_reader_fn& stream_reader) {
+    if (output["status"].asInt() != EOS_NONE || !stream_reader) {
+      resp = create_json_response(req, output);
+      resp->setStatusCode(get_error_status(output["status"].asInt()));
+      return;
+    }
+    resp = drogon::HttpResponse::newStreamResponse(stream_reader);
+    resp->setStatusCode(drogon::HttpStatusCode::k200OK);
+    resp->setContentTypeString("application/zip");
+    resp->addHeader("Content-Disposition",
+                    "attachment; filename=\"" +
+                        output["filename"].asString() + "\"");
+    resp->addHeader("Cache-Control", "no-store");
+  });
+  callback(resp);
+}
+
 //------------------------------------------------------------------------------
 // Treat Post Request
 //------------------------------------------------------------------------------
@@ -197,7 +634,7 @@ void http_drogon_controller::treat_post_request(
         // Choose proper MIME type for your payload
         resp->setContentTypeCode(drogon::CT_APPLICATION_OCTET_STREAM);
       } else {
-        resp = drogon::HttpResponse::newHttpJsonResponse(output);
+        resp = create_json_response(req, output);
         resp->setStatusCode(drogon::HttpStatusCode::k200OK);
       }
     });
@@ -208,3 +645,145 @@ void http_drogon_controller::treat_post_request(
   }
   return callback(resp);
 }
+
+//------------------------------------------------------------------------------
+// Json Response
+//------------------------------------------------------------------------------
+
+drogon::HttpResponsePtr http_drogon_controller::create_json_response(
+    const drogon::HttpRequestPtr& req, const Json::Value& output) const {
+  // Only JSON bodies and metadata packs are compressed: raw DICOM and J2K
+  // payloads are already compressed (or close to incompressible) and go out
+  // as octet-stream.
+  if (!config_ || !config_->is_compression_enabled())
+    return drogon::HttpResponse::newHttpJsonResponse(output);
+
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  auto resp = drogon::HttpResponse::newHttpResponse();
+  resp->setContentTypeCode(drogon::CT_APPLICATION_JSON);
+  set_compressed_body(req, resp, Json::writeString(builder, output));
+  return resp;
+}
+
+void http_drogon_controller::set_compressed_body(
+    const drogon::HttpRequestPtr& req, const drogon::HttpResponsePtr& resp,
+    std::string body) const {
+  http_encoding encoding = http_encoding::kIdentity;
+  std::string compressed;
+  if (body.size() >= config_->get_compression_min_size()) {
+    encoding = http_compression::negotiate(req->getHeader("Accept-Encoding"));
+    int level = encoding == http_encoding::kZstd
+                    ? config_->get_compression_zstd_level()
+                    : config_->get_compression_gzip_level();
+    if (encoding != http_encoding::kIdentity &&
+        (!http_compression::compress(encoding, body, level, compressed) ||
+         compressed.size() >= body.size()))
+      encoding = http_encoding::kIdentity;
+  }
+
+  resp->addHeader("Vary", "Accept-Encoding");
+  if (encoding != http_encoding::kIdentity) {
+    resp->addHeader("Content-Encoding",
+                    http_compression::get_encoding_name(encoding));
+    resp->setBody(std::move(compressed));
+  } else {
+    resp->setBody(std::move(body));
+  }
+}
+
+//------------------------------------------------------------------------------
+// File Response
+//------------------------------------------------------------------------------
+
+drogon::HttpResponsePtr http_drogon_controller::create_file_response(
+    const drogon::HttpRequestPtr& req, const std::string& path,
+    std::uint64_t offset, std::uint64_t size, const std::string& etag,
+    const std::string& content_type,
+    const hot_file_cache::buffer_ptr& content) const {
+  // the file behind an URL can be replaced (stream file, compression,
+  // migration, packing) and holds patient data: the clients keep it for
+  // themselves and revalidate it with its entity tag:
+  auto add_cache_headers = [&](const drogon::HttpResponsePtr& resp) {
+    resp->addHeader("ETag", etag);
+    resp->addHeader("Cache-Control", "private, no-cache");
+    resp->addHeader("Accept-Ranges", "bytes");
+  };
+
+  // conditional request:
+  const std::string& if_none_match = req->getHeader("If-None-Match");
+  if (!if_none_match.empty() &&
+      (if_none_match == "*" ||
+       if_none_match.find(etag) != std::string::npos)) {
+    auto resp = drogon::HttpResponse::newHttpResponse();
+    resp->setStatusCode(drogon::HttpStatusCode::k304NotModified);
+    add_cache_headers(resp);
+    return resp;
+  }
+
+  // range request (ignored if If-Range does not match the current file):
+  std::uint64_t start = 0;
+  std::uint64_t length = size;
+  bool partial = false;
+  const std::string& range = req->getHeader("Range");
+  const std::string& if_range = req->getHeader("If-Range");
+  if (!range.empty() && (if_range.empty() || if_range == etag)) {
+    bool satisfiable = true;
+    partial = parse_byte_range(range, size, start, length, satisfiable);
+    if (!satisfiable) {
+      auto resp = drogon::HttpResponse::newHttpResponse();
+      resp->setStatusCode(
+          drogon::HttpStatusCode::k416RequestedRangeNotSatisfiable);
+      resp->addHeader("Content-Range", "bytes */" + std::to_string(size));
+      add_cache_headers(resp);
+      return resp;
+    }
+  }
+
+  // popular files are served from memory, as the content already read:
+  drogon::HttpResponsePtr resp;
+  hot_file_cache::buffer_ptr buffer =
+      content != nullptr ? content : rqsrv_->get_hot_file_cache()->load(path);
+  if (buffer && offset + size <= buffer->size()) {
+    resp = drogon::HttpResponse::newHttpResponse();
+    resp->setBody(std::string(buffer->data() + offset + start, length));
+    resp->setContentTypeString(content_type);
+  } else {
+    resp = drogon::HttpResponse::newFileResponse(path, offset + start, length,
+                                                 false, "", drogon::CT_NONE,
+                                                 content_type);
+  }
+  add_cache_headers(resp);
+  if (partial) {
+    resp->setStatusCode(drogon::HttpStatusCode::k206PartialContent);
+    resp->addHeader("Content-Range",
+                    "bytes " + std::to_string(start) + "-" +
+                        std::to_string(start + length - 1) + "/" +
+                        std::to_string(size));
+  } else {
+    resp->setStatusCode(drogon::HttpStatusCode::k200OK);
+  }
+  return resp;
+}
+
+drogon::HttpStatusCode http_drogon_controller::get_error_status(
+    std::int32_t code) {
+  switch (code) {
+    case EOS_PARAM:
+      return drogon::HttpStatusCode::k400BadRequest;
+    case EOS_PERMISSION:
+      return drogon::HttpStatusCode::k403Forbidden;
+    case EOS_CHANGE_TRANSFER:
+      return drogon::HttpStatusCode::k406NotAcceptable;
+    case EOS_NOT_FOUND:
+    case EOS_NO_FILE:
+    case EOS_FILE_MISSING:
+      return drogon::HttpStatusCode::k404NotFound;
+    case EOS_NOT_AVAILABLE:
+    case EOS_MEDIA:
+    case EOS_BUSY:
+      return drogon::HttpStatusCode::k503ServiceUnavailable;
+    default:
+      return drogon::HttpStatusCode::k500InternalServerError;
+  }
+}
@@ -47,7 +47,7 @@ void drogon_http_server::init_instance() {
   onis::thread::init_instance();
   std::cout << "drogon_http_server: init_instance" << std::endl;
 
-  controller_ = http_drogon_controller::create(rqsrv_);
+  controller_ = http_drogon_controller::create(rqsrv_, config_service_);
   th_ = std::thread(worker_thread, this, controller_);
 }
 
@@ -0,0 +1,140 @@
+#include "../../include/network/http_compression.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+#ifdef ONIS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// http_compression class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// negotiation
+//------------------------------------------------------------------------------
+
+bool http_compression::is_zstd_supported() {
+#ifdef ONIS_HAVE_ZSTD
+  return true;
+#else
+  return false;
+#endif
+}
+
+http_encoding http_compression::negotiate(const std::string& accept_encoding) {
+  // Parse the Accept-Encoding header (RFC 9110 12.5.3) and keep the quality
+  // value of the codings we know. A missing q means 1, q=0 means "refused".
+  double gzip_q = -1.0;
+  double zstd_q = -1.0;
+  double any_q = -1.0;
+  std::stringstream ss(accept_encoding);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    std::string name = item.substr(0, item.find(';'));
+    name.erase(std::remove_if(name.begin(), name.end(),
+                              [](unsigned char c) { return std::isspace(c); }),
+               name.end());
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    double q = 1.0;
+    std::size_t pos = item.find("q=");
+    if (pos != std::string::npos)
+      q = std::atof(item.c_str() + pos + 2);
+    if (name == "gzip" || name == "x-gzip")
+      gzip_q = q;
+    else if (name == "zstd")
+      zstd_q = q;
+    else if (name == "*")
+      any_q = q;
+  }
+
+  if (gzip_q < 0.0)
+    gzip_q = any_q;
+  if (zstd_q < 0.0)
+    zstd_q = any_q;
+  if (!is_zstd_supported())
+    zstd_q = -1.0;
+
+  // zstd wins ties: it is both faster and smaller than gzip on JSON.
+  if (zstd_q > 0.0 && zstd_q >= gzip_q)
+    return http_encoding::kZstd;
+  if (gzip_q > 0.0)
+    return http_encoding::kGzip;
+  return http_encoding::kIdentity;
+}
+
+const char* http_compression::get_encoding_name(http_encoding encoding) {
+  switch (encoding) {
+    case http_encoding::kGzip:
+      return "gzip";
+    case http_encoding::kZstd:
+      return "zstd";
+    default:
+      return "identity";
+  }
+}
+
+//------------------------------------------------------------------------------
+// compression
+//------------------------------------------------------------------------------
+
+bool http_compression::compress(http_encoding encoding,
+                                const std::string& input, int level,
+                                std::string& output) {
+  switch (encoding) {
+    case http_encoding::kGzip:
+      return compress_gzip(input, level, output);
+    case http_encoding::kZstd:
+      return compress_zstd(input, level, output);
+    default:
+      return false;
+  }
+}
+
+bool http_compression::compress_gzip(const std::string& input, int level,
+                                     std::string& output) {
+  z_stream zs{};
+  level = std::clamp(level, Z_BEST_SPEED, Z_BEST_COMPRESSION);
+  // 15 window bits + 16 to get a gzip wrapper instead of a zlib one:
+  if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+      Z_OK)
+    return false;
+
+  output.resize(deflateBound(&zs, static_cast<uLong>(input.size())) + 18);
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  zs.avail_in = static_cast<uInt>(input.size());
+  zs.next_out = reinterpret_cast<Bytef*>(output.data());
+  zs.avail_out = static_cast<uInt>(output.size());
+  int ret = deflate(&zs, Z_FINISH);
+  std::size_t written = zs.total_out;
+  deflateEnd(&zs);
+  if (ret != Z_STREAM_END) {
+    output.clear();
+    return false;
+  }
+  output.resize(written);
+  return true;
+}
+
+bool http_compression::compress_zstd([[maybe_unused]] const std::string& input,
+                                     [[maybe_unused]] int level,
+                                     std::string& output) {
+#ifdef ONIS_HAVE_ZSTD
+  output.resize(ZSTD_compressBound(input.size()));
+  level = std::clamp(level, 1, ZSTD_maxCLevel());
+  std::size_t written = ZSTD_compress(output.data(), output.size(),
+                                      input.data(), input.size(), level);
+  if (ZSTD_isError(written)) {
+    output.clear();
+    return false;
+  }
+  output.resize(written);
+  return true;
+#else
+  output.clear();
+  return false;
+#endif
+}
@@ -0,0 +1,352 @@
+#include "../../../include/services/cache/derived_file_cache.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// derived_file_cache class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+derived_file_cache_ptr derived_file_cache::create(const std::string& folder,
+                                                  std::size_t memory_budget,
+                                                  std::size_t disk_budget) {
+  return std::make_shared<derived_file_cache>(folder, memory_budget,
+                                              disk_budget);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+derived_file_cache::derived_file_cache(const std::string& folder,
+                                       std::size_t memory_budget,
+                                       std::size_t disk_budget)
+    : folder_(folder),
+      memory_budget_(memory_budget),
+      disk_budget_(folder.empty() ? 0 : disk_budget) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+derived_file_cache::~derived_file_cache() {}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void derived_file_cache::start() {
+  if (disk_budget_ == 0)
+    return;
+  std::error_code ec;
+  std::filesystem::create_directories(folder_, ec);
+
+  struct file {
+    std::string name;
+    std::uintmax_t size;
+    std::filesystem::file_time_type write_time;
+  };
+  std::vector<file> files;
+  std::vector<std::string> removed;
+  std::filesystem::recursive_directory_iterator it(folder_, ec);
+  for (; !ec && it != std::filesystem::recursive_directory_iterator();
+       it.increment(ec)) {
+    if (!it->is_regular_file(ec))
+      continue;
+    std::string path = it->path().string();
+    // files whose writing was interrupted:
+    if (onis::util::filesystem::has_tmp_extension(path)) {
+      onis::util::filesystem::delete_file(path);
+      continue;
+    }
+    file item;
+    item.name = it->path().filename().string();
+    item.size = it->file_size(ec);
+    item.write_time = it->last_write_time(ec);
+    if (!ec)
+      files.push_back(std::move(item));
+    ec.clear();
+  }
+  std::sort(files.begin(), files.end(), [](const file& a, const file& b) {
+    return a.write_time > b.write_time;
+  });
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& item : files) {
+      if (disk_index_.count(item.name) ||
+          disk_bytes_ + item.size > disk_budget_) {
+        removed.push_back(item.name);
+        continue;
+      }
+      disk_lru_.push_back({item.name, item.size});
+      disk_index_[item.name] = std::prev(disk_lru_.end());
+      disk_bytes_ += item.size;
+    }
+  }
+  delete_files(removed);
+}
+
+//------------------------------------------------------------------------------
+// access
+//------------------------------------------------------------------------------
+
+derived_file_cache::buffer_ptr derived_file_cache::find(
+    const std::string& key) {
+  std::string name = get_file_name(key);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto disk = disk_index_.find(name);
+    if (disk != disk_index_.end())
+      disk_lru_.splice(disk_lru_.begin(), disk_lru_, disk->second);
+    auto it = memory_index_.find(name);
+    if (it != memory_index_.end()) {
+      memory_lru_.splice(memory_lru_.begin(), memory_lru_, it->second);
+      hits_++;
+      return it->second->data;
+    }
+    if (disk == disk_index_.end()) {
+      misses_++;
+      return nullptr;
+    }
+  }
+
+  // the file may have been evicted meanwhile:
+  std::string path = get_file_path(name);
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  std::streamsize size = file.is_open() ? std::streamsize(file.tellg()) : -1;
+  auto buffer = std::make_shared<std::vector<char>>(
+      static_cast<std::size_t>(std::max<std::streamsize>(size, 0)));
+  if (size <= 0 || !file.seekg(0) || !file.read(buffer->data(), size)) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = disk_index_.find(name);
+    if (it != disk_index_.end())
+      erase_disk(it->second);
+    misses_++;
+    return nullptr;
+  }
+  file.close();
+
+  // the order of the files is kept across the restarts:
+  std::error_code ec;
+  std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now(), ec);
+  std::lock_guard<std::mutex> lock(mutex_);
+  insert_memory(name, buffer);
+  disk_hits_++;
+  return buffer;
+}
+
+void derived_file_cache::insert(const std::string& key,
+                                const buffer_ptr& data) {
+  if (data == nullptr || data->empty())
+    return;
+  std::string name = get_file_name(key);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert_memory(name, data);
+    if (data->size() > disk_budget_ || disk_index_.count(name))
+      return;
+  }
+
+  std::string tmp_path = create_temp_path();
+  bool written = false;
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    written =
+        file.write(data->data(), static_cast<std::streamsize>(data->size())) &&
+        file.flush();
+  }
+  if (!written || insert_file(key, tmp_path).empty())
+    onis::util::filesystem::delete_file(tmp_path);
+}
+
+std::string derived_file_cache::find_file(const std::string& key) {
+  if (disk_budget_ == 0)
+    return "";
+  std::string name = get_file_name(key);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = disk_index_.find(name);
+    if (it == disk_index_.end()) {
+      misses_++;
+      return "";
+    }
+    disk_lru_.splice(disk_lru_.begin(), disk_lru_, it->second);
+  }
+
+  // the order of the files is kept across the restarts (the file may have
+  // been evicted meanwhile):
+  std::string path = get_file_path(name);
+  std::error_code ec;
+  std::filesystem::last_write_time(
+      path, std::filesystem::file_time_type::clock::now(), ec);
+  if (ec) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = disk_index_.find(name);
+    if (it != disk_index_.end())
+      erase_disk(it->second);
+    misses_++;
+    return "";
+  }
+  disk_hits_++;
+  return path;
+}
+
+// A file is written under a temporary name, so that it is never read
+// partially, then renamed:
+std::string derived_file_cache::insert_file(const std::string& key,
+                                            const std::string& path) {
+  std::error_code ec;
+  std::uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec || size == 0 || size > disk_budget_)
+    return "";
+  std::string name = get_file_name(key);
+  std::string file_path = get_file_path(name);
+  if (!onis::util::filesystem::move_file(path, file_path))
+    return "";
+
+  std::vector<std::string> removed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    insert_disk(name, size, removed);
+  }
+  delete_files(removed);
+  return file_path;
+}
+
+// In the folder when the files are kept on disk (the temporary files left
+// by a crash are deleted by start), so that they are moved by a rename:
+std::string derived_file_cache::create_temp_path() const {
+  std::string name = onis::util::uuid::generate_random_uuid() + ".tmp";
+  if (disk_budget_ == 0)
+    return (std::filesystem::temp_directory_path() / name).string();
+  std::string path = folder_;
+  onis::util::filesystem::concat(path, name);
+  return path;
+}
+
+//------------------------------------------------------------------------------
+// invalidation
+//------------------------------------------------------------------------------
+
+void derived_file_cache::clear() {
+  std::vector<std::string> removed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_lru_.clear();
+    memory_index_.clear();
+    memory_bytes_ = 0;
+    for (const auto& item : disk_lru_)
+      removed.push_back(item.name);
+    disk_lru_.clear();
+    disk_index_.clear();
+    disk_bytes_ = 0;
+  }
+  delete_files(removed);
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void derived_file_cache::get_statistics(Json::Value& output) const {
+  std::uint64_t hits = hits_;
+  std::uint64_t disk_hits = disk_hits_;
+  std::uint64_t misses = misses_;
+  std::uint64_t total = hits + disk_hits + misses;
+  output["hits"] = static_cast<Json::UInt64>(hits);
+  output["disk_hits"] = static_cast<Json::UInt64>(disk_hits);
+  output["misses"] = static_cast<Json::UInt64>(misses);
+  output["hit_ratio"] =
+      total > 0 ? static_cast<double>(hits + disk_hits) / total : 0.0;
+  output["evictions"] = static_cast<Json::UInt64>(evictions_);
+  output["disk_evictions"] = static_cast<Json::UInt64>(disk_evictions_);
+  output["budget"] = static_cast<Json::UInt64>(memory_budget_);
+  output["disk_budget"] = static_cast<Json::UInt64>(disk_budget_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  output["bytes"] = static_cast<Json::UInt64>(memory_bytes_);
+  output["files"] = static_cast<Json::UInt64>(memory_lru_.size());
+  output["disk_bytes"] = static_cast<Json::UInt64>(disk_bytes_);
+  output["disk_files"] = static_cast<Json::UInt64>(disk_lru_.size());
+}
+
+//------------------------------------------------------------------------------
+// utilities
+//------------------------------------------------------------------------------
+
+// The file of a key is named after its digest:
+std::string derived_file_cache::get_file_name(const std::string& key) {
+  std::string name = key.substr(key.rfind(':') + 1);
+  for (auto& c : name)
+    if (!std::isalnum(static_cast<unsigned char>(c)))
+      c = '_';
+  return name;
+}
+
+// The files are spread over sub-folders named after their first characters:
+std::string derived_file_cache::get_file_path(const std::string& name) const {
+  std::string path = folder_;
+  onis::util::filesystem::concat(path, name.substr(0, 2));
+  onis::util::filesystem::concat(path, name);
+  return path;
+}
+
+void derived_file_cache::insert_memory(const std::string& name,
+                                       const buffer_ptr& data) {
+  if (data->size() > memory_budget_)
+    return;
+  auto it = memory_index_.find(name);
+  if (it != memory_index_.end()) {
+    memory_bytes_ -= it->second->data->size();
+    memory_lru_.erase(it->second);
+    memory_index_.erase(it);
+  }
+  while (!memory_lru_.empty() &&
+         memory_bytes_ + data->size() > memory_budget_) {
+    auto last = std::prev(memory_lru_.end());
+    memory_bytes_ -= last->data->size();
+    memory_index_.erase(last->name);
+    memory_lru_.erase(last);
+    evictions_++;
+  }
+  memory_bytes_ += data->size();
+  memory_lru_.push_front({name, data});
+  memory_index_[name] = memory_lru_.begin();
+}
+
+bool derived_file_cache::insert_disk(const std::string& name,
+                                     std::uintmax_t size,
+                                     std::vector<std::string>& removed) {
+  if (disk_index_.count(name))
+    return false;
+  while (!disk_lru_.empty() && disk_bytes_ + size > disk_budget_) {
+    auto last = std::prev(disk_lru_.end());
+    removed.push_back(last->name);
+    erase_disk(last);
+    disk_evictions_++;
+  }
+  disk_bytes_ += size;
+  disk_lru_.push_front({name, size});
+  disk_index_[name] = disk_lru_.begin();
+  return true;
+}
+
+void derived_file_cache::erase_disk(disk_list::iterator it) {
+  disk_bytes_ -= it->size;
+  disk_index_.erase(it->name);
+  disk_lru_.erase(it);
+}
+
+void derived_file_cache::delete_files(
+    const std::vector<std::string>& names) const {
+  for (const auto& name : names)
+    onis::util::filesystem::delete_file(get_file_path(name));
+}
@@ -0,0 +1,129 @@
+#include "../../../include/services/cache/directory_cache.hpp"
+#include <filesystem>
+#include <mutex>
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// directory_cache class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+directory_cache_ptr directory_cache::create(std::size_t max_entries) {
+  return std::make_shared<directory_cache>(max_entries);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+directory_cache::directory_cache(std::size_t max_entries)
+    : max_entries_(max_entries) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+directory_cache::~directory_cache() {}
+
+//------------------------------------------------------------------------------
+// directories
+//------------------------------------------------------------------------------
+
+bool directory_cache::create_directories(const std::string& dir) {
+  if (dir.empty())
+    return false;
+  if (max_entries_ == 0)
+    return onis::util::filesystem::create_multi_directories(dir);
+  if (contains(dir)) {
+    hits_++;
+    return true;
+  }
+  misses_++;
+
+  // the levels below the deepest directory known to exist:
+  std::vector<std::string> missing;
+  std::string known;
+  for (std::filesystem::path path(dir); path.has_relative_path();
+       path = path.parent_path()) {
+    std::string item = path.string();
+    if (contains(item)) {
+      known = item;
+      break;
+    }
+    missing.push_back(item);
+  }
+
+  // they are created one by one from the top, otherwise (or if the known
+  // directory was removed meanwhile) all the levels are checked:
+  bool created = !known.empty();
+  for (auto it = missing.rbegin(); created && it != missing.rend(); ++it) {
+    std::error_code ec;
+    std::filesystem::create_directory(*it, ec);
+    if (ec)
+      created = false;
+  }
+  if (!created) {
+    if (!known.empty())
+      invalidate(known);
+    if (!onis::util::filesystem::create_multi_directories(dir))
+      return false;
+  }
+  created_++;
+  insert(missing);
+  return true;
+}
+
+void directory_cache::invalidate(const std::string& dir) {
+  // the parents are forgotten too, one of them may be the removed directory:
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  for (std::filesystem::path path(dir); path.has_relative_path();
+       path = path.parent_path())
+    directories_.erase(path.string());
+  invalidations_++;
+}
+
+void directory_cache::clear() {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  directories_.clear();
+  clears_++;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void directory_cache::get_statistics(Json::Value& output) const {
+  std::uint64_t hits = hits_;
+  std::uint64_t misses = misses_;
+  output["hits"] = static_cast<Json::UInt64>(hits);
+  output["misses"] = static_cast<Json::UInt64>(misses);
+  output["hit_ratio"] =
+      hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+  output["created"] = static_cast<Json::UInt64>(created_);
+  output["invalidations"] = static_cast<Json::UInt64>(invalidations_);
+  output["clears"] = static_cast<Json::UInt64>(clears_);
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  output["directories"] = static_cast<Json::UInt64>(directories_.size());
+}
+
+//------------------------------------------------------------------------------
+// utilities
+//------------------------------------------------------------------------------
+
+bool directory_cache::contains(const std::string& dir) const {
+  std::shared_lock<std::shared_mutex> lock(mutex_);
+  return directories_.find(dir) != directories_.end();
+}
+
+void directory_cache::insert(const std::vector<std::string>& dirs) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  // the set is rebuilt from the directories used after it was full:
+  if (directories_.size() + dirs.size() > max_entries_) {
+    directories_.clear();
+    clears_++;
+  }
+  directories_.insert(dirs.begin(), dirs.end());
+}
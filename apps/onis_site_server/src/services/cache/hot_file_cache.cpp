@@ -0,0 +1,197 @@
+#include "../../../include/services/cache/hot_file_cache.hpp"
+#include <fstream>
+
+// number of distinct files whose access count is tracked before aging:
+static const std::size_t kMaxTrackedFiles = 65536;
+
+////////////////////////////////////////////////////////////////////////////////
+// hot_file_cache class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+hot_file_cache_ptr hot_file_cache::create(std::size_t budget,
+                                          std::size_t max_file_size,
+                                          std::uint32_t admission_hits) {
+  return std::make_shared<hot_file_cache>(budget, max_file_size,
+                                          admission_hits);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+hot_file_cache::hot_file_cache(std::size_t budget, std::size_t max_file_size,
+                               std::uint32_t admission_hits)
+    : budget_(budget),
+      max_file_size_(max_file_size),
+      admission_hits_(admission_hits) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+hot_file_cache::~hot_file_cache() {}
+
+//------------------------------------------------------------------------------
+// access
+//------------------------------------------------------------------------------
+
+hot_file_cache::buffer_ptr hot_file_cache::find(const std::string& path) {
+  if (budget_ == 0)
+    return nullptr;
+
+  entry item;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it == index_.end())
+      return nullptr;
+    item = *it->second;
+  }
+
+  // the file may have been rewritten since it was cached:
+  if (!is_valid(item)) {
+    invalidate(path);
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(path);
+  if (it == index_.end() || it->second->data != item.data)
+    return nullptr;
+  lru_.splice(lru_.begin(), lru_, it->second);
+  hits_++;
+  return item.data;
+}
+
+hot_file_cache::buffer_ptr hot_file_cache::load(const std::string& path) {
+  if (budget_ == 0)
+    return nullptr;
+
+  buffer_ptr data = find(path);
+  if (data)
+    return data;
+  misses_++;
+
+  std::error_code ec;
+  entry item;
+  item.path = path;
+  item.file_size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return nullptr;
+  item.write_time = std::filesystem::last_write_time(path, ec);
+  if (ec || !should_admit(path, item.file_size))
+    return nullptr;
+
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return nullptr;
+  auto buffer = std::make_shared<std::vector<char>>(item.file_size);
+  file.read(buffer->data(), static_cast<std::streamsize>(buffer->size()));
+  if (static_cast<std::uintmax_t>(file.gcount()) != item.file_size)
+    return nullptr;
+
+  item.data = buffer;
+  insert(std::move(item));
+  admissions_++;
+  return buffer;
+}
+
+//------------------------------------------------------------------------------
+// invalidation
+//------------------------------------------------------------------------------
+
+void hot_file_cache::invalidate(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(path);
+  if (it != index_.end())
+    erase(it->second);
+}
+
+void hot_file_cache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  lru_.clear();
+  index_.clear();
+  frequency_.clear();
+  bytes_ = 0;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void hot_file_cache::get_statistics(Json::Value& output) const {
+  std::uint64_t hits = hits_;
+  std::uint64_t misses = misses_;
+  output["hits"] = static_cast<Json::UInt64>(hits);
+  output["misses"] = static_cast<Json::UInt64>(misses);
+  output["hit_ratio"] =
+      hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+  output["admissions"] = static_cast<Json::UInt64>(admissions_);
+  output["evictions"] = static_cast<Json::UInt64>(evictions_);
+  output["budget"] = static_cast<Json::UInt64>(budget_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  output["bytes"] = static_cast<Json::UInt64>(bytes_);
+  output["files"] = static_cast<Json::UInt64>(lru_.size());
+}
+
+//------------------------------------------------------------------------------
+// utilities
+//------------------------------------------------------------------------------
+
+bool hot_file_cache::is_valid(const entry& item) const {
+  std::error_code ec;
+  if (std::filesystem::file_size(item.path, ec) != item.file_size || ec)
+    return false;
+  return std::filesystem::last_write_time(item.path, ec) == item.write_time &&
+         !ec;
+}
+
+bool hot_file_cache::should_admit(const std::string& path,
+                                  std::uintmax_t file_size) {
+  if (file_size == 0 || file_size > max_file_size_ || file_size > budget_)
+    return false;
+  if (admission_hits_ <= 1)
+    return true;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // age the access counts so that old popularity fades away:
+  if (frequency_.size() >= kMaxTrackedFiles) {
+    auto it = frequency_.begin();
+    while (it != frequency_.end()) {
+      it->second /= 2;
+      if (it->second == 0)
+        it = frequency_.erase(it);
+      else
+        ++it;
+    }
+  }
+  std::uint32_t& count = frequency_[path];
+  if (++count < admission_hits_)
+    return false;
+  frequency_.erase(path);
+  return true;
+}
+
+void hot_file_cache::insert(entry&& item) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(item.path);
+  if (it != index_.end())
+    erase(it->second);
+  while (!lru_.empty() && bytes_ + item.data->size() > budget_) {
+    erase(std::prev(lru_.end()));
+    evictions_++;
+  }
+  bytes_ += item.data->size();
+  lru_.push_front(std::move(item));
+  index_[lru_.front().path] = lru_.begin();
+}
+
+void hot_file_cache::erase(entry_list::iterator it) {
+  bytes_ -= it->data->size();
+  index_.erase(it->path);
+  lru_.erase(it);
+}
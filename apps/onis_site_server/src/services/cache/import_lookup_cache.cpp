@@ -0,0 +1,217 @@
+#include "../../../include/services/cache/import_lookup_cache.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// import_lookup_cache class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+import_lookup_cache_ptr import_lookup_cache::create(std::chrono::seconds ttl,
+                                                    std::size_t max_series) {
+  return std::make_shared<import_lookup_cache>(ttl, max_series);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+import_lookup_cache::import_lookup_cache(std::chrono::seconds ttl,
+                                         std::size_t max_series)
+    : ttl_(ttl), max_series_(max_series) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+import_lookup_cache::~import_lookup_cache() {}
+
+//------------------------------------------------------------------------------
+// series
+//------------------------------------------------------------------------------
+
+std::uint64_t import_lookup_cache::get_generation(
+    const std::string& partition_seq) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = partitions_.find(partition_seq);
+  return it == partitions_.end() ? 0 : it->second.generation;
+}
+
+bool import_lookup_cache::find(const std::string& partition_seq,
+                               const std::string& study_uid,
+                               const std::string& series_uid,
+                               location& output) {
+  if (!is_enabled())
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto partition = partitions_.find(partition_seq);
+  if (partition != partitions_.end()) {
+    auto it = partition->second.series.find(make_key(study_uid, series_uid));
+    if (it != partition->second.series.end()) {
+      if (it->second.expiration > clock::now()) {
+        output = it->second.item;
+        hits_++;
+        return true;
+      }
+      partition->second.series.erase(it);
+      series_count_--;
+    }
+  }
+  misses_++;
+  return false;
+}
+
+void import_lookup_cache::store(const std::string& partition_seq,
+                                const std::string& study_uid,
+                                const std::string& series_uid,
+                                const location& item,
+                                std::uint64_t generation) {
+  if (!is_enabled())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& partition = partitions_[partition_seq];
+  // invalidated since the location was resolved:
+  if (partition.generation != generation)
+    return;
+
+  clock::time_point now = clock::now();
+  std::string key = make_key(study_uid, series_uid);
+  auto it = partition.series.find(key);
+  if (it == partition.series.end()) {
+    if (series_count_ >= max_series_)
+      prune(now);
+    series_count_++;
+  }
+  partition.series[key] = series_entry{item, now + ttl_};
+}
+
+//------------------------------------------------------------------------------
+// compressions of the partitions
+//------------------------------------------------------------------------------
+
+bool import_lookup_cache::find_compressions(const std::string& partition_seq,
+                                            Json::Value& output) {
+  if (!is_enabled())
+    return false;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = partitions_.find(partition_seq);
+  if (it == partitions_.end() || !it->second.has_compressions ||
+      it->second.compressions_expiration <= clock::now())
+    return false;
+  output = it->second.compressions;
+  return true;
+}
+
+void import_lookup_cache::store_compressions(const std::string& partition_seq,
+                                             const Json::Value& compressions) {
+  if (!is_enabled())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& partition = partitions_[partition_seq];
+  partition.has_compressions = true;
+  partition.compressions = compressions;
+  partition.compressions_expiration = clock::now() + ttl_;
+}
+
+//------------------------------------------------------------------------------
+// invalidation
+//------------------------------------------------------------------------------
+
+void import_lookup_cache::invalidate_study(const std::string& partition_seq,
+                                           const std::string& study_uid) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& partition = partitions_[partition_seq];
+  partition.generation++;
+  std::string prefix = make_key(study_uid, "");
+  auto it = partition.series.begin();
+  while (it != partition.series.end()) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+      it = partition.series.erase(it);
+      series_count_--;
+    } else {
+      ++it;
+    }
+  }
+  invalidations_++;
+}
+
+void import_lookup_cache::invalidate_partition(
+    const std::string& partition_seq) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& partition = partitions_[partition_seq];
+  partition.generation++;
+  series_count_ -= partition.series.size();
+  partition.series.clear();
+  partition.has_compressions = false;
+  partition.compressions = Json::Value();
+  invalidations_++;
+}
+
+void import_lookup_cache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& partition : partitions_) {
+    partition.second.generation++;
+    partition.second.series.clear();
+    partition.second.has_compressions = false;
+    partition.second.compressions = Json::Value();
+  }
+  series_count_ = 0;
+  invalidations_++;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void import_lookup_cache::get_statistics(Json::Value& output) const {
+  std::uint64_t hits = hits_;
+  std::uint64_t misses = misses_;
+  output["hits"] = static_cast<Json::UInt64>(hits);
+  output["misses"] = static_cast<Json::UInt64>(misses);
+  output["hit_ratio"] =
+      hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0;
+  output["invalidations"] = static_cast<Json::UInt64>(invalidations_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  output["series"] = static_cast<Json::UInt64>(series_count_);
+  output["partitions"] = static_cast<Json::UInt64>(partitions_.size());
+}
+
+//------------------------------------------------------------------------------
+// utilities
+//------------------------------------------------------------------------------
+
+bool import_lookup_cache::is_enabled() const {
+  return ttl_.count() > 0 && max_series_ > 0;
+}
+
+std::string import_lookup_cache::make_key(const std::string& study_uid,
+                                          const std::string& series_uid) {
+  // the uids cannot contain a backslash:
+  return study_uid + "\\" + series_uid;
+}
+
+void import_lookup_cache::prune(clock::time_point now) {
+  for (auto& partition : partitions_) {
+    auto it = partition.second.series.begin();
+    while (it != partition.second.series.end()) {
+      if (it->second.expiration <= now) {
+        it = partition.second.series.erase(it);
+        series_count_--;
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // the series arrive in bursts, the oldest ones are rarely needed again:
+  if (series_count_ >= max_series_) {
+    for (auto& partition : partitions_)
+      partition.second.series.clear();
+    series_count_ = 0;
+  }
+}
@@ -0,0 +1,300 @@
+#include "../../../include/services/cache/sop_filter.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+// delay before a failed build is tried again:
+static const std::chrono::seconds kRetryDelay(60);
+
+// second hash of the double hashing (finalizer of splitmix64):
+static std::uint64_t mix_hash(std::uint64_t value) {
+  value ^= value >> 30;
+  value *= 0xbf58476d1ce4e5b9ULL;
+  value ^= value >> 27;
+  value *= 0x94d049bb133111ebULL;
+  value ^= value >> 31;
+  return value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// sop_filter class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+sop_filter_ptr sop_filter::create(std::uint32_t bits_per_sop,
+                                  std::size_t min_capacity) {
+  return std::make_shared<sop_filter>(bits_per_sop, min_capacity);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+sop_filter::sop_filter(std::uint32_t bits_per_sop, std::size_t min_capacity)
+    : bits_per_sop_(bits_per_sop),
+      min_capacity_(std::max<std::size_t>(min_capacity, 1024)) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+sop_filter::~sop_filter() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+bool sop_filter::is_enabled() const {
+  return bits_per_sop_ > 0;
+}
+
+void sop_filter::start(const partitions_fn& partitions,
+                       const loader_fn& loader) {
+  if (!is_enabled())
+    return;
+  partitions_ = partitions;
+  loader_ = loader;
+  std::lock_guard<std::mutex> lock(mutex_);
+  running_ = true;
+  stopping_ = false;
+  worker_ = std::thread(&sop_filter::worker, this);
+}
+
+void sop_filter::stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    running_ = false;
+    worker.swap(worker_);
+  }
+  cv_.notify_all();
+  if (worker.get_id() == std::this_thread::get_id())
+    worker.detach();
+  else if (worker.joinable())
+    worker.join();
+}
+
+//------------------------------------------------------------------------------
+// access
+//------------------------------------------------------------------------------
+
+bool sop_filter::may_contain(const std::string& partition_seq,
+                             const std::string& sop) {
+  if (!is_enabled())
+    return true;
+  checks_++;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& entry = entries_[partition_seq];
+  if (!entry.current) {
+    // the partition was created since the start, or its build failed:
+    if (running_ && std::chrono::steady_clock::now() >= entry.retry_at)
+      schedule(partition_seq, entry);
+    unknown_++;
+    return true;
+  }
+  if (entry.current->test(sop))
+    return true;
+  negatives_++;
+  return false;
+}
+
+void sop_filter::insert(const std::string& partition_seq,
+                        const std::string& sop) {
+  if (!is_enabled())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& entry = entries_[partition_seq];
+  entry.in_flight.insert(sop);
+  if (entry.current)
+    entry.current->add(sop);
+  if (entry.next)
+    entry.next->add(sop);
+  // the filter is too full to stay accurate:
+  if (running_ && entry.current &&
+      entry.current->count > entry.current->capacity)
+    schedule(partition_seq, entry);
+}
+
+void sop_filter::release(const std::string& partition_seq,
+                         const std::vector<std::string>& sops) {
+  if (!is_enabled() || sops.empty())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(partition_seq);
+  if (it == entries_.end())
+    return;
+  for (const auto& sop : sops) {
+    auto pos = it->second.in_flight.find(sop);
+    if (pos != it->second.in_flight.end())
+      it->second.in_flight.erase(pos);
+  }
+}
+
+//------------------------------------------------------------------------------
+// invalidation
+//------------------------------------------------------------------------------
+
+void sop_filter::invalidate_partition(const std::string& partition_seq) {
+  if (!is_enabled())
+    return;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& entry = entries_[partition_seq];
+  entry.current.reset();
+  entry.next.reset();
+  if (running_)
+    schedule(partition_seq, entry);
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void sop_filter::get_statistics(Json::Value& output) const {
+  output["enabled"] = is_enabled();
+  output["checks"] = static_cast<Json::UInt64>(checks_);
+  output["skipped_lookups"] = static_cast<Json::UInt64>(negatives_);
+  output["unknown"] = static_cast<Json::UInt64>(unknown_);
+  output["builds"] = static_cast<Json::UInt64>(builds_);
+
+  std::uint64_t partitions = 0, sops = 0, bytes = 0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& item : entries_) {
+    if (!item.second.current)
+      continue;
+    partitions++;
+    sops += item.second.current->count;
+    bytes += item.second.current->bits.size() * sizeof(std::uint64_t);
+  }
+  output["partitions"] = static_cast<Json::UInt64>(partitions);
+  output["sops"] = static_cast<Json::UInt64>(sops);
+  output["bytes"] = static_cast<Json::UInt64>(bytes);
+  output["pending"] = static_cast<Json::UInt64>(pending_.size());
+}
+
+//------------------------------------------------------------------------------
+// builds
+//------------------------------------------------------------------------------
+
+void sop_filter::worker() {
+  std::vector<std::string> seqs;
+  try {
+    partitions_(seqs);
+  } catch (const std::exception& e) {
+    std::cerr << "sop_filter: Failed to list the partitions: " << e.what()
+              << std::endl;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (const auto& seq : seqs)
+    schedule(seq, entries_[seq]);
+  while (!stopping_) {
+    if (pending_.empty()) {
+      cv_.wait(lock);
+      continue;
+    }
+    std::string seq = pending_.front();
+    pending_.pop_front();
+    lock.unlock();
+    build(seq);
+    lock.lock();
+  }
+}
+
+void sop_filter::build(const std::string& partition_seq) {
+  bloom_ptr next;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    partition_entry& entry = entries_[partition_seq];
+    entry.queued = false;
+    std::size_t count = entry.current ? entry.current->count : 0;
+    next = std::make_shared<bloom>(std::max(min_capacity_, count * 2),
+                                   bits_per_sop_);
+    // the reads of the build may not see the sops of the running imports:
+    for (const auto& sop : entry.in_flight)
+      next->add(sop);
+    entry.next = next;
+  }
+
+  bool failed = false;
+  try {
+    loader_(partition_seq, [&](const std::string& sop) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_)
+        return false;
+      next->add(sop);
+      return true;
+    });
+  } catch (const std::exception& e) {
+    std::cerr << "sop_filter: Failed to build the filter of the partition "
+              << partition_seq << ": " << e.what() << std::endl;
+    failed = true;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  partition_entry& entry = entries_[partition_seq];
+  // invalidated during the build:
+  if (entry.next != next)
+    return;
+  entry.next.reset();
+  if (failed || stopping_) {
+    entry.retry_at = std::chrono::steady_clock::now() + kRetryDelay;
+    return;
+  }
+  entry.current = next;
+  builds_++;
+  if (next->count > next->capacity)
+    schedule(partition_seq, entry);
+}
+
+void sop_filter::schedule(const std::string& partition_seq,
+                          partition_entry& entry) {
+  if (entry.queued || entry.next)
+    return;
+  entry.queued = true;
+  pending_.push_back(partition_seq);
+  cv_.notify_one();
+}
+
+//------------------------------------------------------------------------------
+// bloom filter
+//------------------------------------------------------------------------------
+
+sop_filter::bloom::bloom(std::size_t capacity, std::uint32_t bits_per_sop)
+    : capacity(capacity) {
+  bits.resize((capacity * bits_per_sop + 63) / 64, 0);
+  bit_count = bits.size() * 64;
+  // the false positive rate is minimal with ln(2) hashes per bit of a sop:
+  hash_count = std::max<std::uint32_t>(
+      1, static_cast<std::uint32_t>(bits_per_sop * 0.693 + 0.5));
+}
+
+void sop_filter::bloom::add(const std::string& sop) {
+  std::uint64_t h1 = std::hash<std::string>()(sop);
+  std::uint64_t h2 = mix_hash(h1) | 1;
+  for (std::uint32_t i = 0; i < hash_count; i++) {
+    std::uint64_t bit = (h1 + i * h2) % bit_count;
+    bits[bit / 64] |= 1ULL << (bit % 64);
+  }
+  count++;
+}
+
+bool sop_filter::bloom::test(const std::string& sop) const {
+  std::uint64_t h1 = std::hash<std::string>()(sop);
+  std::uint64_t h2 = mix_hash(h1) | 1;
+  for (std::uint32_t i = 0; i < hash_count; i++) {
+    std::uint64_t bit = (h1 + i * h2) % bit_count;
+    if ((bits[bit / 64] & (1ULL << (bit % 64))) == 0)
+      return false;
+  }
+  return true;
+}
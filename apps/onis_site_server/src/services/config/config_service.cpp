@@ -35,6 +35,89 @@ config_service::config_service() : is_valid_(false), last_error_("") {
   http_config_.ssl_enabled = true;
   http_config_.ssl_certificate_file = "certificates/certificate.crt";
   http_config_.ssl_private_key_file = "certificates/private.key";
+
+  compression_config_.enabled = true;
+  compression_config_.min_size = 1024;
+  compression_config_.gzip_level = 6;
+  compression_config_.zstd_level = 3;
+
+  cache_config_.hot_file_budget_mb = 512;
+  cache_config_.hot_file_max_file_mb = 64;
+  cache_config_.hot_file_admission_hits = 2;
+  cache_config_.import_lookup_ttl_seconds = 30;
+  cache_config_.import_lookup_max_series = 4096;
+  cache_config_.sop_filter_bits_per_sop = 10;
+  cache_config_.sop_filter_min_capacity = 1048576;
+  cache_config_.directories_max_entries = 65536;
+  cache_config_.previews_folder = "cache/previews";
+  cache_config_.previews_memory_mb = 128;
+  cache_config_.previews_disk_mb = 2048;
+  cache_config_.previews_max_size = 1024;
+  cache_config_.previews_default_size = 256;
+  cache_config_.transcoded_folder = "cache/transcoded";
+  cache_config_.transcoded_disk_mb = 4096;
+  cache_config_.metadata_folder = "cache/metadata";
+  cache_config_.metadata_memory_mb = 64;
+  cache_config_.metadata_disk_mb = 1024;
+
+  import_config_.spool_folder = "spool/import";
+  import_config_.workers = 4;
+  import_config_.max_pending = 10000;
+  import_config_.max_attempts = 3;
+  import_config_.retention_hours = 24;
+  import_config_.batch_size = 500;
+  import_config_.aggregate_interval_ms = 1000;
+  import_config_.aggregate_batch_size = 1000;
+  import_config_.lock_stripes = 1024;
+
+  derived_config_.workers = 2;
+  derived_config_.stream_resolutions = 6;
+  derived_config_.stream_layers = 1;
+  derived_config_.icon_size = 128;
+  derived_config_.max_queued = 10000;
+  derived_config_.scan_batch_size = 100;
+  derived_config_.backlog_delay_ms = 50;
+  derived_config_.rescan_interval_seconds = 60;
+  derived_config_.pixel_statistics = true;
+  derived_config_.histogram_bins = 256;
+
+  image_compression_config_.workers = 1;
+  image_compression_config_.scan_batch_size = 100;
+  image_compression_config_.rescan_interval_seconds = 600;
+  image_compression_config_.release_delay_seconds = 600;
+
+  transcoding_config_.workers = 4;
+  transcoding_config_.max_pending = 64;
+
+  deduplication_config_.enabled = false;
+  deduplication_config_.gc_interval_seconds = 300;
+  deduplication_config_.gc_batch_size = 100;
+
+  file_release_config_.interval_seconds = 60;
+  file_release_config_.batch_size = 500;
+
+  tiering_config_.rules = Json::Value(Json::arrayValue);
+  tiering_config_.interval_seconds = 3600;
+  tiering_config_.batch_size = 20;
+  tiering_config_.max_bytes_per_second = 50 * 1024 * 1024;
+  tiering_config_.release_delay_seconds = 600;
+
+  packing_config_.enabled = false;
+  packing_config_.interval_seconds = 3600;
+  packing_config_.batch_size = 20;
+  packing_config_.min_idle_hours = 24;
+  packing_config_.min_instances = 10;
+  packing_config_.release_delay_seconds = 600;
+
+  archive_check_config_.threads = 8;
+  archive_check_config_.max_pending = 4;
+  archive_check_config_.retention_hours = 24;
+  archive_check_config_.min_file_age_seconds = 3600;
+  archive_check_config_.max_reported = 1000;
+
+  export_config_.readers = 4;
+  export_config_.max_buffered_mb = 32;
+  export_config_.max_concurrent = 4;
 }
 
 //------------------------------------------------------------------------------
@@ -113,6 +196,294 @@ bool config_service::load_config(const std::string& config_file_path) {
                 ? http["private_key_file"].asString()
                 : "certificates/private.key";
       }
+
+      // Parse nested compression configuration
+      if (http.isMember("compression")) {
+        const auto& comp = http["compression"];
+        compression_config_.enabled =
+            comp.isMember("enabled") ? comp["enabled"].asBool() : true;
+        compression_config_.min_size =
+            comp.isMember("min_size") ? comp["min_size"].asUInt() : 1024;
+        compression_config_.gzip_level =
+            comp.isMember("gzip_level") ? comp["gzip_level"].asInt() : 6;
+        compression_config_.zstd_level =
+            comp.isMember("zstd_level") ? comp["zstd_level"].asInt() : 3;
+      }
+    }
+
+    // Parse cache configuration
+    if (j.isMember("cache")) {
+      const auto& cache = j["cache"];
+      if (cache.isMember("hot_files")) {
+        const auto& hot = cache["hot_files"];
+        cache_config_.hot_file_budget_mb =
+            hot.isMember("budget_mb") ? hot["budget_mb"].asUInt() : 512;
+        cache_config_.hot_file_max_file_mb =
+            hot.isMember("max_file_mb") ? hot["max_file_mb"].asUInt() : 64;
+        cache_config_.hot_file_admission_hits =
+            hot.isMember("admission_hits") ? hot["admission_hits"].asUInt()
+                                           : 2;
+      }
+      if (cache.isMember("import_lookup")) {
+        const auto& lookup = cache["import_lookup"];
+        cache_config_.import_lookup_ttl_seconds =
+            lookup.isMember("ttl_seconds") ? lookup["ttl_seconds"].asUInt()
+                                           : 30;
+        cache_config_.import_lookup_max_series =
+            lookup.isMember("max_series") ? lookup["max_series"].asUInt()
+                                          : 4096;
+      }
+      if (cache.isMember("sop_filter")) {
+        const auto& filter = cache["sop_filter"];
+        cache_config_.sop_filter_bits_per_sop =
+            filter.isMember("bits_per_sop") ? filter["bits_per_sop"].asUInt()
+                                            : 10;
+        cache_config_.sop_filter_min_capacity =
+            filter.isMember("min_capacity") ? filter["min_capacity"].asUInt()
+                                            : 1048576;
+      }
+      if (cache.isMember("directories")) {
+        const auto& directories = cache["directories"];
+        cache_config_.directories_max_entries =
+            directories.isMember("max_entries")
+                ? directories["max_entries"].asUInt()
+                : 65536;
+      }
+      if (cache.isMember("previews")) {
+        const auto& previews = cache["previews"];
+        cache_config_.previews_folder = previews.isMember("folder")
+                                            ? previews["folder"].asString()
+                                            : "cache/previews";
+        cache_config_.previews_memory_mb =
+            previews.isMember("memory_mb") ? previews["memory_mb"].asUInt()
+                                           : 128;
+        cache_config_.previews_disk_mb =
+            previews.isMember("disk_mb") ? previews["disk_mb"].asUInt() : 2048;
+        cache_config_.previews_max_size =
+            previews.isMember("max_size") ? previews["max_size"].asUInt()
+                                          : 1024;
+        cache_config_.previews_default_size =
+            previews.isMember("default_size")
+                ? previews["default_size"].asUInt()
+                : 256;
+      }
+      if (cache.isMember("transcoded")) {
+        const auto& transcoded = cache["transcoded"];
+        cache_config_.transcoded_folder = transcoded.isMember("folder")
+                                              ? transcoded["folder"].asString()
+                                              : "cache/transcoded";
+        cache_config_.transcoded_disk_mb =
+            transcoded.isMember("disk_mb") ? transcoded["disk_mb"].asUInt()
+                                           : 4096;
+      }
+      if (cache.isMember("metadata")) {
+        const auto& metadata = cache["metadata"];
+        cache_config_.metadata_folder = metadata.isMember("folder")
+                                            ? metadata["folder"].asString()
+                                            : "cache/metadata";
+        cache_config_.metadata_memory_mb =
+            metadata.isMember("memory_mb") ? metadata["memory_mb"].asUInt()
+                                           : 64;
+        cache_config_.metadata_disk_mb =
+            metadata.isMember("disk_mb") ? metadata["disk_mb"].asUInt() : 1024;
+      }
+    }
+
+    // Parse import configuration
+    if (j.isMember("import")) {
+      const auto& imp = j["import"];
+      import_config_.spool_folder = imp.isMember("spool_folder")
+                                        ? imp["spool_folder"].asString()
+                                        : "spool/import";
+      import_config_.workers =
+          imp.isMember("workers") ? imp["workers"].asUInt() : 4;
+      import_config_.max_pending =
+          imp.isMember("max_pending") ? imp["max_pending"].asUInt() : 10000;
+      import_config_.max_attempts =
+          imp.isMember("max_attempts") ? imp["max_attempts"].asUInt() : 3;
+      import_config_.retention_hours = imp.isMember("retention_hours")
+                                           ? imp["retention_hours"].asUInt()
+                                           : 24;
+      import_config_.batch_size =
+          imp.isMember("batch_size") ? imp["batch_size"].asUInt() : 500;
+      import_config_.aggregate_interval_ms =
+          imp.isMember("aggregate_interval_ms")
+              ? imp["aggregate_interval_ms"].asUInt()
+              : 1000;
+      import_config_.aggregate_batch_size =
+          imp.isMember("aggregate_batch_size")
+              ? imp["aggregate_batch_size"].asUInt()
+              : 1000;
+      import_config_.lock_stripes = imp.isMember("lock_stripes")
+                                        ? imp["lock_stripes"].asUInt()
+                                        : 1024;
+    }
+
+    // Parse derived objects configuration
+    if (j.isMember("derived")) {
+      const auto& der = j["derived"];
+      derived_config_.workers =
+          der.isMember("workers") ? der["workers"].asUInt() : 2;
+      derived_config_.stream_resolutions =
+          der.isMember("stream_resolutions")
+              ? der["stream_resolutions"].asUInt()
+              : 6;
+      derived_config_.stream_layers =
+          der.isMember("stream_layers") ? der["stream_layers"].asUInt() : 1;
+      derived_config_.icon_size =
+          der.isMember("icon_size") ? der["icon_size"].asUInt() : 128;
+      derived_config_.max_queued =
+          der.isMember("max_queued") ? der["max_queued"].asUInt() : 10000;
+      derived_config_.scan_batch_size = der.isMember("scan_batch_size")
+                                            ? der["scan_batch_size"].asUInt()
+                                            : 100;
+      derived_config_.backlog_delay_ms = der.isMember("backlog_delay_ms")
+                                             ? der["backlog_delay_ms"].asUInt()
+                                             : 50;
+      derived_config_.rescan_interval_seconds =
+          der.isMember("rescan_interval_seconds")
+              ? der["rescan_interval_seconds"].asUInt()
+              : 60;
+      derived_config_.pixel_statistics =
+          der.isMember("pixel_statistics") ? der["pixel_statistics"].asBool()
+                                           : true;
+      derived_config_.histogram_bins = der.isMember("histogram_bins")
+                                           ? der["histogram_bins"].asUInt()
+                                           : 256;
+    }
+
+    // Parse image compression configuration
+    if (j.isMember("image_compression")) {
+      const auto& cmp = j["image_compression"];
+      image_compression_config_.workers =
+          cmp.isMember("workers") ? cmp["workers"].asUInt() : 1;
+      image_compression_config_.scan_batch_size =
+          cmp.isMember("scan_batch_size") ? cmp["scan_batch_size"].asUInt()
+                                          : 100;
+      image_compression_config_.rescan_interval_seconds =
+          cmp.isMember("rescan_interval_seconds")
+              ? cmp["rescan_interval_seconds"].asUInt()
+              : 600;
+      image_compression_config_.release_delay_seconds =
+          cmp.isMember("release_delay_seconds")
+              ? cmp["release_delay_seconds"].asUInt()
+              : 600;
+    }
+
+    // Parse transcoding configuration
+    if (j.isMember("transcoding")) {
+      const auto& trc = j["transcoding"];
+      transcoding_config_.workers =
+          trc.isMember("workers") ? trc["workers"].asUInt() : 4;
+      transcoding_config_.max_pending =
+          trc.isMember("max_pending") ? trc["max_pending"].asUInt() : 64;
+    }
+
+    // Parse deduplication configuration
+    if (j.isMember("deduplication")) {
+      const auto& dedup = j["deduplication"];
+      deduplication_config_.enabled =
+          dedup.isMember("enabled") ? dedup["enabled"].asBool() : false;
+      deduplication_config_.gc_interval_seconds =
+          dedup.isMember("gc_interval_seconds")
+              ? dedup["gc_interval_seconds"].asUInt()
+              : 300;
+      deduplication_config_.gc_batch_size =
+          dedup.isMember("gc_batch_size") ? dedup["gc_batch_size"].asUInt()
+                                          : 100;
+    }
+
+    // Parse file release configuration
+    if (j.isMember("file_release")) {
+      const auto& release = j["file_release"];
+      file_release_config_.interval_seconds =
+          release.isMember("interval_seconds")
+              ? release["interval_seconds"].asUInt()
+              : 60;
+      file_release_config_.batch_size =
+          release.isMember("batch_size") ? release["batch_size"].asUInt()
+                                         : 500;
+    }
+
+    // Parse tiering configuration
+    if (j.isMember("tiering")) {
+      const auto& tiering = j["tiering"];
+      tiering_config_.rules = tiering.isMember("rules") &&
+                                      tiering["rules"].isArray()
+                                  ? tiering["rules"]
+                                  : Json::Value(Json::arrayValue);
+      tiering_config_.interval_seconds =
+          tiering.isMember("interval_seconds")
+              ? tiering["interval_seconds"].asUInt()
+              : 3600;
+      tiering_config_.batch_size = tiering.isMember("batch_size")
+                                       ? tiering["batch_size"].asUInt()
+                                       : 20;
+      tiering_config_.max_bytes_per_second =
+          tiering.isMember("max_bytes_per_second")
+              ? tiering["max_bytes_per_second"].asUInt64()
+              : 50 * 1024 * 1024;
+      tiering_config_.release_delay_seconds =
+          tiering.isMember("release_delay_seconds")
+              ? tiering["release_delay_seconds"].asUInt()
+              : 600;
+    }
+
+    // Parse packing configuration
+    if (j.isMember("packing")) {
+      const auto& packing = j["packing"];
+      packing_config_.enabled =
+          packing.isMember("enabled") ? packing["enabled"].asBool() : false;
+      packing_config_.interval_seconds =
+          packing.isMember("interval_seconds")
+              ? packing["interval_seconds"].asUInt()
+              : 3600;
+      packing_config_.batch_size = packing.isMember("batch_size")
+                                       ? packing["batch_size"].asUInt()
+                                       : 20;
+      packing_config_.min_idle_hours =
+          packing.isMember("min_idle_hours")
+              ? packing["min_idle_hours"].asUInt()
+              : 24;
+      packing_config_.min_instances =
+          packing.isMember("min_instances")
+              ? packing["min_instances"].asUInt()
+              : 10;
+      packing_config_.release_delay_seconds =
+          packing.isMember("release_delay_seconds")
+              ? packing["release_delay_seconds"].asUInt()
+              : 600;
+    }
+
+    // Parse archive check configuration
+    if (j.isMember("archive_check")) {
+      const auto& check = j["archive_check"];
+      archive_check_config_.threads =
+          check.isMember("threads") ? check["threads"].asUInt() : 8;
+      archive_check_config_.max_pending =
+          check.isMember("max_pending") ? check["max_pending"].asUInt() : 4;
+      archive_check_config_.retention_hours =
+          check.isMember("retention_hours") ? check["retention_hours"].asUInt()
+                                            : 24;
+      archive_check_config_.min_file_age_seconds =
+          check.isMember("min_file_age_seconds")
+              ? check["min_file_age_seconds"].asUInt()
+              : 3600;
+      archive_check_config_.max_reported =
+          check.isMember("max_reported") ? check["max_reported"].asUInt()
+                                         : 1000;
+    }
+
+    // Parse export configuration
+    if (j.isMember("export")) {
+      const auto& exp = j["export"];
+      export_config_.readers =
+          exp.isMember("readers") ? exp["readers"].asUInt() : 4;
+      export_config_.max_buffered_mb =
+          exp.isMember("max_buffered_mb") ? exp["max_buffered_mb"].asUInt()
+                                          : 32;
+      export_config_.max_concurrent =
+          exp.isMember("max_concurrent") ? exp["max_concurrent"].asUInt() : 4;
     }
 
     is_valid_ = true;
@@ -146,6 +517,138 @@ bool config_service::save_config(const std::string& config_file_path) {
     j["http"]["ssl"]["enabled"] = http_config_.ssl_enabled;
     j["http"]["ssl"]["certificate_file"] = http_config_.ssl_certificate_file;
     j["http"]["ssl"]["private_key_file"] = http_config_.ssl_private_key_file;
+    j["http"]["compression"]["enabled"] = compression_config_.enabled;
+    j["http"]["compression"]["min_size"] =
+        static_cast<Json::UInt>(compression_config_.min_size);
+    j["http"]["compression"]["gzip_level"] = compression_config_.gzip_level;
+    j["http"]["compression"]["zstd_level"] = compression_config_.zstd_level;
+
+    // Cache configuration
+    j["cache"]["hot_files"]["budget_mb"] =
+        static_cast<Json::UInt>(cache_config_.hot_file_budget_mb);
+    j["cache"]["hot_files"]["max_file_mb"] =
+        static_cast<Json::UInt>(cache_config_.hot_file_max_file_mb);
+    j["cache"]["hot_files"]["admission_hits"] =
+        cache_config_.hot_file_admission_hits;
+    j["cache"]["import_lookup"]["ttl_seconds"] =
+        cache_config_.import_lookup_ttl_seconds;
+    j["cache"]["import_lookup"]["max_series"] =
+        static_cast<Json::UInt>(cache_config_.import_lookup_max_series);
+    j["cache"]["sop_filter"]["bits_per_sop"] =
+        cache_config_.sop_filter_bits_per_sop;
+    j["cache"]["sop_filter"]["min_capacity"] =
+        static_cast<Json::UInt>(cache_config_.sop_filter_min_capacity);
+    j["cache"]["directories"]["max_entries"] =
+        static_cast<Json::UInt>(cache_config_.directories_max_entries);
+    j["cache"]["previews"]["folder"] = cache_config_.previews_folder;
+    j["cache"]["previews"]["memory_mb"] =
+        static_cast<Json::UInt>(cache_config_.previews_memory_mb);
+    j["cache"]["previews"]["disk_mb"] =
+        static_cast<Json::UInt>(cache_config_.previews_disk_mb);
+    j["cache"]["previews"]["max_size"] = cache_config_.previews_max_size;
+    j["cache"]["previews"]["default_size"] =
+        cache_config_.previews_default_size;
+    j["cache"]["transcoded"]["folder"] = cache_config_.transcoded_folder;
+    j["cache"]["transcoded"]["disk_mb"] =
+        static_cast<Json::UInt>(cache_config_.transcoded_disk_mb);
+    j["cache"]["metadata"]["folder"] = cache_config_.metadata_folder;
+    j["cache"]["metadata"]["memory_mb"] =
+        static_cast<Json::UInt>(cache_config_.metadata_memory_mb);
+    j["cache"]["metadata"]["disk_mb"] =
+        static_cast<Json::UInt>(cache_config_.metadata_disk_mb);
+
+    // Import configuration
+    j["import"]["spool_folder"] = import_config_.spool_folder;
+    j["import"]["workers"] = import_config_.workers;
+    j["import"]["max_pending"] =
+        static_cast<Json::UInt>(import_config_.max_pending);
+    j["import"]["max_attempts"] = import_config_.max_attempts;
+    j["import"]["retention_hours"] = import_config_.retention_hours;
+    j["import"]["batch_size"] =
+        static_cast<Json::UInt>(import_config_.batch_size);
+    j["import"]["aggregate_interval_ms"] = import_config_.aggregate_interval_ms;
+    j["import"]["aggregate_batch_size"] =
+        static_cast<Json::UInt>(import_config_.aggregate_batch_size);
+    j["import"]["lock_stripes"] =
+        static_cast<Json::UInt>(import_config_.lock_stripes);
+
+    // Derived objects configuration
+    j["derived"]["workers"] = derived_config_.workers;
+    j["derived"]["stream_resolutions"] = derived_config_.stream_resolutions;
+    j["derived"]["stream_layers"] = derived_config_.stream_layers;
+    j["derived"]["icon_size"] = derived_config_.icon_size;
+    j["derived"]["max_queued"] =
+        static_cast<Json::UInt>(derived_config_.max_queued);
+    j["derived"]["scan_batch_size"] =
+        static_cast<Json::UInt>(derived_config_.scan_batch_size);
+    j["derived"]["backlog_delay_ms"] = derived_config_.backlog_delay_ms;
+    j["derived"]["rescan_interval_seconds"] =
+        derived_config_.rescan_interval_seconds;
+    j["derived"]["pixel_statistics"] = derived_config_.pixel_statistics;
+    j["derived"]["histogram_bins"] = derived_config_.histogram_bins;
+
+    // Image compression configuration
+    j["image_compression"]["workers"] = image_compression_config_.workers;
+    j["image_compression"]["scan_batch_size"] =
+        static_cast<Json::UInt>(image_compression_config_.scan_batch_size);
+    j["image_compression"]["rescan_interval_seconds"] =
+        image_compression_config_.rescan_interval_seconds;
+    j["image_compression"]["release_delay_seconds"] =
+        image_compression_config_.release_delay_seconds;
+
+    // Transcoding configuration
+    j["transcoding"]["workers"] = transcoding_config_.workers;
+    j["transcoding"]["max_pending"] =
+        static_cast<Json::UInt>(transcoding_config_.max_pending);
+
+    // Deduplication configuration
+    j["deduplication"]["enabled"] = deduplication_config_.enabled;
+    j["deduplication"]["gc_interval_seconds"] =
+        deduplication_config_.gc_interval_seconds;
+    j["deduplication"]["gc_batch_size"] =
+        static_cast<Json::UInt>(deduplication_config_.gc_batch_size);
+
+    // File release configuration
+    j["file_release"]["interval_seconds"] =
+        file_release_config_.interval_seconds;
+    j["file_release"]["batch_size"] =
+        static_cast<Json::UInt>(file_release_config_.batch_size);
+
+    // Tiering configuration
+    j["tiering"]["rules"] = tiering_config_.rules;
+    j["tiering"]["interval_seconds"] = tiering_config_.interval_seconds;
+    j["tiering"]["batch_size"] =
+        static_cast<Json::UInt>(tiering_config_.batch_size);
+    j["tiering"]["max_bytes_per_second"] =
+        static_cast<Json::UInt64>(tiering_config_.max_bytes_per_second);
+    j["tiering"]["release_delay_seconds"] =
+        tiering_config_.release_delay_seconds;
+
+    // Packing configuration
+    j["packing"]["enabled"] = packing_config_.enabled;
+    j["packing"]["interval_seconds"] = packing_config_.interval_seconds;
+    j["packing"]["batch_size"] =
+        static_cast<Json::UInt>(packing_config_.batch_size);
+    j["packing"]["min_idle_hours"] = packing_config_.min_idle_hours;
+    j["packing"]["min_instances"] = packing_config_.min_instances;
+    j["packing"]["release_delay_seconds"] =
+        packing_config_.release_delay_seconds;
+
+    // Archive check configuration
+    j["archive_check"]["threads"] = archive_check_config_.threads;
+    j["archive_check"]["max_pending"] =
+        static_cast<Json::UInt>(archive_check_config_.max_pending);
+    j["archive_check"]["retention_hours"] =
+        archive_check_config_.retention_hours;
+    j["archive_check"]["min_file_age_seconds"] =
+        archive_check_config_.min_file_age_seconds;
+    j["archive_check"]["max_reported"] = archive_check_config_.max_reported;
+
+    // Export configuration
+    j["export"]["readers"] = export_config_.readers;
+    j["export"]["max_buffered_mb"] =
+        static_cast<Json::UInt>(export_config_.max_buffered_mb);
+    j["export"]["max_concurrent"] = export_config_.max_concurrent;
 
     std::ofstream file(config_file_path);
     if (!file.is_open()) {
@@ -222,6 +725,338 @@ std::string config_service::get_ssl_private_key_file() const {
   return http_config_.ssl_private_key_file;
 }
 
+//------------------------------------------------------------------------------
+// HTTP compression configuration
+//------------------------------------------------------------------------------
+
+bool config_service::is_compression_enabled() const {
+  return compression_config_.enabled;
+}
+
+std::size_t config_service::get_compression_min_size() const {
+  return compression_config_.min_size;
+}
+
+int config_service::get_compression_gzip_level() const {
+  return compression_config_.gzip_level;
+}
+
+int config_service::get_compression_zstd_level() const {
+  return compression_config_.zstd_level;
+}
+
+//------------------------------------------------------------------------------
+// cache configuration
+//------------------------------------------------------------------------------
+
+std::size_t config_service::get_hot_file_cache_budget() const {
+  return cache_config_.hot_file_budget_mb * 1024 * 1024;
+}
+
+std::size_t config_service::get_hot_file_cache_max_file_size() const {
+  return cache_config_.hot_file_max_file_mb * 1024 * 1024;
+}
+
+std::uint32_t config_service::get_hot_file_cache_admission_hits() const {
+  return cache_config_.hot_file_admission_hits;
+}
+
+std::uint32_t config_service::get_import_lookup_cache_ttl() const {
+  return cache_config_.import_lookup_ttl_seconds;
+}
+
+std::size_t config_service::get_import_lookup_cache_max_series() const {
+  return cache_config_.import_lookup_max_series;
+}
+
+std::uint32_t config_service::get_sop_filter_bits_per_sop() const {
+  return cache_config_.sop_filter_bits_per_sop;
+}
+
+std::size_t config_service::get_sop_filter_min_capacity() const {
+  return cache_config_.sop_filter_min_capacity;
+}
+
+std::size_t config_service::get_directory_cache_max_entries() const {
+  return cache_config_.directories_max_entries;
+}
+
+std::string config_service::get_preview_cache_folder() const {
+  return cache_config_.previews_folder;
+}
+
+std::size_t config_service::get_preview_cache_memory_budget() const {
+  return cache_config_.previews_memory_mb * 1024 * 1024;
+}
+
+std::size_t config_service::get_preview_cache_disk_budget() const {
+  return cache_config_.previews_disk_mb * 1024 * 1024;
+}
+
+std::uint32_t config_service::get_preview_max_size() const {
+  return cache_config_.previews_max_size;
+}
+
+std::uint32_t config_service::get_preview_default_size() const {
+  return cache_config_.previews_default_size;
+}
+
+std::string config_service::get_transcoded_cache_folder() const {
+  return cache_config_.transcoded_folder;
+}
+
+std::size_t config_service::get_transcoded_cache_budget() const {
+  return cache_config_.transcoded_disk_mb * 1024 * 1024;
+}
+
+std::string config_service::get_metadata_cache_folder() const {
+  return cache_config_.metadata_folder;
+}
+
+std::size_t config_service::get_metadata_cache_memory_budget() const {
+  return cache_config_.metadata_memory_mb * 1024 * 1024;
+}
+
+std::size_t config_service::get_metadata_cache_disk_budget() const {
+  return cache_config_.metadata_disk_mb * 1024 * 1024;
+}
+
+//------------------------------------------------------------------------------
+// import configuration
+//------------------------------------------------------------------------------
+
+std::string config_service::get_import_spool_folder() const {
+  return import_config_.spool_folder;
+}
+
+std::uint32_t config_service::get_import_workers() const {
+  return import_config_.workers;
+}
+
+std::size_t config_service::get_import_max_pending() const {
+  return import_config_.max_pending;
+}
+
+std::uint32_t config_service::get_import_max_attempts() const {
+  return import_config_.max_attempts;
+}
+
+std::uint32_t config_service::get_import_retention_hours() const {
+  return import_config_.retention_hours;
+}
+
+std::size_t config_service::get_import_batch_size() const {
+  return import_config_.batch_size;
+}
+
+std::uint32_t config_service::get_import_aggregate_interval() const {
+  return import_config_.aggregate_interval_ms;
+}
+
+std::size_t config_service::get_import_aggregate_batch_size() const {
+  return import_config_.aggregate_batch_size;
+}
+
+std::size_t config_service::get_import_lock_stripes() const {
+  return import_config_.lock_stripes;
+}
+
+//------------------------------------------------------------------------------
+// derived objects configuration
+//------------------------------------------------------------------------------
+
+std::uint32_t config_service::get_derived_workers() const {
+  return derived_config_.workers;
+}
+
+std::uint32_t config_service::get_derived_stream_resolutions() const {
+  return derived_config_.stream_resolutions;
+}
+
+std::uint32_t config_service::get_derived_stream_layers() const {
+  return derived_config_.stream_layers;
+}
+
+std::uint32_t config_service::get_derived_icon_size() const {
+  return derived_config_.icon_size;
+}
+
+std::size_t config_service::get_derived_max_queued() const {
+  return derived_config_.max_queued;
+}
+
+std::size_t config_service::get_derived_scan_batch_size() const {
+  return derived_config_.scan_batch_size;
+}
+
+std::uint32_t config_service::get_derived_backlog_delay() const {
+  return derived_config_.backlog_delay_ms;
+}
+
+std::uint32_t config_service::get_derived_rescan_interval() const {
+  return derived_config_.rescan_interval_seconds;
+}
+
+bool config_service::is_pixel_statistics_enabled() const {
+  return derived_config_.pixel_statistics;
+}
+
+std::uint32_t config_service::get_pixel_histogram_bins() const {
+  return derived_config_.histogram_bins;
+}
+
+//------------------------------------------------------------------------------
+// image compression configuration
+//------------------------------------------------------------------------------
+
+std::uint32_t config_service::get_image_compression_workers() const {
+  return image_compression_config_.workers;
+}
+
+std::size_t config_service::get_image_compression_scan_batch_size() const {
+  return image_compression_config_.scan_batch_size;
+}
+
+std::uint32_t config_service::get_image_compression_rescan_interval() const {
+  return image_compression_config_.rescan_interval_seconds;
+}
+
+std::uint32_t config_service::get_image_compression_release_delay() const {
+  return image_compression_config_.release_delay_seconds;
+}
+
+//------------------------------------------------------------------------------
+// transcoding configuration
+//------------------------------------------------------------------------------
+
+std::uint32_t config_service::get_transcoding_workers() const {
+  return transcoding_config_.workers;
+}
+
+std::size_t config_service::get_transcoding_max_pending() const {
+  return transcoding_config_.max_pending;
+}
+
+//------------------------------------------------------------------------------
+// deduplication configuration
+//------------------------------------------------------------------------------
+
+bool config_service::is_deduplication_enabled() const {
+  return deduplication_config_.enabled;
+}
+
+std::uint32_t config_service::get_deduplication_gc_interval() const {
+  return deduplication_config_.gc_interval_seconds;
+}
+
+std::size_t config_service::get_deduplication_gc_batch_size() const {
+  return deduplication_config_.gc_batch_size;
+}
+
+//------------------------------------------------------------------------------
+// file release configuration
+//------------------------------------------------------------------------------
+
+std::uint32_t config_service::get_file_release_interval() const {
+  return file_release_config_.interval_seconds;
+}
+
+std::size_t config_service::get_file_release_batch_size() const {
+  return file_release_config_.batch_size;
+}
+
+//------------------------------------------------------------------------------
+// tiering configuration
+//------------------------------------------------------------------------------
+
+const Json::Value& config_service::get_tiering_rules() const {
+  return tiering_config_.rules;
+}
+
+std::uint32_t config_service::get_tiering_interval() const {
+  return tiering_config_.interval_seconds;
+}
+
+std::size_t config_service::get_tiering_batch_size() const {
+  return tiering_config_.batch_size;
+}
+
+std::uint64_t config_service::get_tiering_max_bytes_per_second() const {
+  return tiering_config_.max_bytes_per_second;
+}
+
+std::uint32_t config_service::get_tiering_release_delay() const {
+  return tiering_config_.release_delay_seconds;
+}
+
+//------------------------------------------------------------------------------
+// packing configuration
+//------------------------------------------------------------------------------
+
+bool config_service::is_packing_enabled() const {
+  return packing_config_.enabled;
+}
+
+std::uint32_t config_service::get_packing_interval() const {
+  return packing_config_.interval_seconds;
+}
+
+std::size_t config_service::get_packing_batch_size() const {
+  return packing_config_.batch_size;
+}
+
+std::uint32_t config_service::get_packing_min_idle_hours() const {
+  return packing_config_.min_idle_hours;
+}
+
+std::uint32_t config_service::get_packing_min_instances() const {
+  return packing_config_.min_instances;
+}
+
+std::uint32_t config_service::get_packing_release_delay() const {
+  return packing_config_.release_delay_seconds;
+}
+
+//------------------------------------------------------------------------------
+// archive check configuration
+//------------------------------------------------------------------------------
+
+std::uint32_t config_service::get_archive_check_threads() const {
+  return archive_check_config_.threads;
+}
+
+std::size_t config_service::get_archive_check_max_pending() const {
+  return archive_check_config_.max_pending;
+}
+
+std::uint32_t config_service::get_archive_check_retention_hours() const {
+  return archive_check_config_.retention_hours;
+}
+
+std::uint32_t config_service::get_archive_check_min_file_age() const {
+  return archive_check_config_.min_file_age_seconds;
+}
+
+std::uint32_t config_service::get_archive_check_max_reported() const {
+  return archive_check_config_.max_reported;
+}
+
+//------------------------------------------------------------------------------
+// export configuration
+//------------------------------------------------------------------------------
+
+std::uint32_t config_service::get_export_readers() const {
+  return export_config_.readers;
+}
+
+std::size_t config_service::get_export_max_buffered() const {
+  return export_config_.max_buffered_mb * 1024 * 1024;
+}
+
+std::uint32_t config_service::get_export_max_concurrent() const {
+  return export_config_.max_concurrent;
+}
+
 //------------------------------------------------------------------------------
 // configuration validation
 //------------------------------------------------------------------------------
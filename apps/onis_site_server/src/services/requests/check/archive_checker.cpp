@@ -0,0 +1,251 @@
+#include "../../../../include/services/requests/check/archive_checker.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/core/result.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// interval between two purges of the expired jobs:
+static const std::int64_t kPurgeInterval = 600;
+
+static std::int64_t get_current_time() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// archive_checker class
+////////////////////////////////////////////////////////////////////////////////
+
+const char* const archive_checker::kQueued = "queued";
+const char* const archive_checker::kRunning = "running";
+const char* const archive_checker::kCompleted = "completed";
+const char* const archive_checker::kFailed = "failed";
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+archive_checker_ptr archive_checker::create(std::uint32_t threads,
+                                            std::size_t max_pending,
+                                            std::uint32_t retention_hours) {
+  return std::make_shared<archive_checker>(threads, max_pending,
+                                           retention_hours);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+archive_checker::archive_checker(std::uint32_t threads,
+                                 std::size_t max_pending,
+                                 std::uint32_t retention_hours)
+    : threads_(std::min<std::uint32_t>(threads, 256)),
+      max_pending_(std::max<std::size_t>(max_pending, 1)),
+      retention_(static_cast<std::int64_t>(retention_hours) * 3600) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+archive_checker::~archive_checker() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+bool archive_checker::is_enabled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return worker_.joinable() && !stopping_;
+}
+
+void archive_checker::start(const handler_fn& handler) {
+  if (threads_ == 0)
+    return;
+  handler_ = handler;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  worker_ = std::thread(&archive_checker::worker, this);
+}
+
+void archive_checker::stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker.swap(worker_);
+  }
+  cv_.notify_all();
+  if (worker.get_id() == std::this_thread::get_id()) {
+    worker.detach();
+    return;
+  }
+  if (worker.joinable())
+    worker.join();
+}
+
+std::uint32_t archive_checker::get_threads() const {
+  return std::max<std::uint32_t>(threads_, 1);
+}
+
+//------------------------------------------------------------------------------
+// jobs
+//------------------------------------------------------------------------------
+
+void archive_checker::submit(const std::string& source,
+                             const Json::Value& input, Json::Value& job) {
+  job = input;
+  job["id"] = onis::util::uuid::generate_random_uuid();
+  job["source"] = source;
+  job["state"] = kQueued;
+  job["created"] = static_cast<Json::Int64>(get_current_time());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!worker_.joinable() || stopping_)
+      throw onis::exception(EOS_NOT_AVAILABLE, "Archive checks not running");
+    if (pending_.size() >= max_pending_)
+      throw onis::exception(EOS_BUSY, "Too many archive checks pending");
+    jobs_[job["id"].asString()] = job;
+    pending_.push_back(job["id"].asString());
+  }
+  accepted_++;
+  cv_.notify_one();
+}
+
+bool archive_checker::find_job(const std::string& id,
+                               Json::Value& job) const {
+  if (!onis::util::uuid::is_valid(id))
+    return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = jobs_.find(id);
+  if (it == jobs_.end())
+    return false;
+  job = it->second;
+  if (job["state"].asString() == kQueued) {
+    auto pos = std::find(pending_.begin(), pending_.end(), id);
+    if (pos != pending_.end())
+      job["position"] = static_cast<Json::UInt64>(pos - pending_.begin() + 1);
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void archive_checker::get_statistics(Json::Value& output) const {
+  output["threads"] = threads_;
+  output["accepted"] = static_cast<Json::UInt64>(accepted_);
+  output["completed"] = static_cast<Json::UInt64>(completed_);
+  output["failed"] = static_cast<Json::UInt64>(failed_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  output["pending"] = static_cast<Json::UInt64>(pending_.size());
+  output["running"] = running_;
+}
+
+//------------------------------------------------------------------------------
+// worker
+//------------------------------------------------------------------------------
+
+void archive_checker::worker() {
+  std::int64_t last_purge = get_current_time();
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    if (pending_.empty()) {
+      std::int64_t now = get_current_time();
+      if (now - last_purge >= kPurgeInterval) {
+        last_purge = now;
+        purge_expired_jobs();
+      }
+      cv_.wait_for(lock, std::chrono::seconds(kPurgeInterval));
+      continue;
+    }
+    std::string id = pending_.front();
+    pending_.pop_front();
+    running_ = true;
+    lock.unlock();
+    run_job(id);
+    lock.lock();
+    running_ = false;
+  }
+
+  // the checks not started are not run:
+  std::int64_t now = get_current_time();
+  for (const auto& id : pending_) {
+    Json::Value& job = jobs_[id];
+    job["state"] = kFailed;
+    job["error"]["status"] = EOS_NOT_AVAILABLE;
+    job["error"]["message"] = "Service stopped";
+    job["finished"] = static_cast<Json::Int64>(now);
+  }
+  pending_.clear();
+}
+
+void archive_checker::run_job(const std::string& id) {
+  Json::Value job;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value& item = jobs_[id];
+    item["state"] = kRunning;
+    item["started"] = static_cast<Json::Int64>(get_current_time());
+    job = item;
+  }
+
+  Json::Value result(Json::objectValue);
+  Json::Value error(Json::objectValue);
+  try {
+    handler_(
+        job,
+        [&](const Json::Value& progress) { return set_progress(id, progress); },
+        result);
+  } catch (const onis::exception& e) {
+    error["status"] = e.get_code();
+    error["message"] = e.what();
+  } catch (const std::exception& e) {
+    error["status"] = EOS_UNKNOWN;
+    error["message"] = e.what();
+  } catch (...) {
+    error["status"] = EOS_UNKNOWN;
+    error["message"] = "Unknown error";
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Json::Value& item = jobs_[id];
+  if (error.empty()) {
+    item["state"] = kCompleted;
+    item["result"] = result;
+    completed_++;
+  } else {
+    item["state"] = kFailed;
+    item["error"] = error;
+    failed_++;
+    std::cerr << "archive_checker: The check " << id
+              << " failed: " << error["message"].asString() << std::endl;
+  }
+  item["finished"] = static_cast<Json::Int64>(get_current_time());
+}
+
+bool archive_checker::set_progress(const std::string& id,
+                                   const Json::Value& progress) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = jobs_.find(id);
+  if (it != jobs_.end())
+    it->second["progress"] = progress;
+  return !stopping_;
+}
+
+void archive_checker::purge_expired_jobs() {
+  std::int64_t limit = get_current_time() - retention_;
+  for (auto it = jobs_.begin(); it != jobs_.end();) {
+    if (it->second.isMember("finished") &&
+        it->second["finished"].asInt64() <= limit)
+      it = jobs_.erase(it);
+    else
+      ++it;
+  }
+}
@@ -0,0 +1,114 @@
+#include "../../../../include/services/requests/check/directory_scanner.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// the folders waiting to be listed, shared by the threads:
+struct scan_state {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::vector<std::string> pending;
+  std::size_t active{0};
+  bool cancelled{false};
+  std::atomic<std::uint64_t> folders{0};
+  std::atomic<std::uint64_t> files{0};
+  std::atomic<std::uint64_t> errors{0};
+};
+
+// List a folder, the sub-folders are added to "folders":
+static void list_folder(const std::filesystem::path& root,
+                        const std::string& folder, std::size_t worker,
+                        const directory_scanner::file_fn& visit,
+                        scan_state& state, std::vector<std::string>& folders) {
+  std::error_code ec;
+  std::filesystem::directory_iterator it(
+      folder.empty() ? root : root / folder,
+      std::filesystem::directory_options::skip_permission_denied, ec);
+  if (ec) {
+    state.errors++;
+    return;
+  }
+  state.folders++;
+  for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    if (ec) {
+      state.errors++;
+      break;
+    }
+    const auto& entry = *it;
+    if (entry.is_symlink(ec))
+      continue;
+    std::string name = entry.path().filename().string();
+    std::string path = folder.empty() ? name : folder + "/" + name;
+    if (entry.is_directory(ec)) {
+      folders.push_back(std::move(path));
+    } else if (entry.is_regular_file(ec)) {
+      state.files++;
+      visit(worker, path);
+    }
+  }
+}
+
+static void scan_worker(const std::filesystem::path& root, std::size_t worker,
+                        const directory_scanner::file_fn& visit,
+                        const directory_scanner::cancel_fn& cancelled,
+                        scan_state& state) {
+  std::unique_lock<std::mutex> lock(state.mutex);
+  while (true) {
+    state.cv.wait(lock, [&] {
+      return state.cancelled || !state.pending.empty() || state.active == 0;
+    });
+    if (state.cancelled || state.pending.empty())
+      break;
+    // depth first, the pending folders stay few:
+    std::string folder = std::move(state.pending.back());
+    state.pending.pop_back();
+    state.active++;
+    lock.unlock();
+
+    std::vector<std::string> folders;
+    bool cancel = cancelled && cancelled();
+    if (!cancel)
+      list_folder(root, folder, worker, visit, state, folders);
+
+    lock.lock();
+    state.active--;
+    if (cancel)
+      state.cancelled = true;
+    for (auto& item : folders)
+      state.pending.push_back(std::move(item));
+    // the other threads wait for folders, or for the end of the scan:
+    if (cancel || !folders.empty() || state.active == 0)
+      state.cv.notify_all();
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// directory_scanner class
+////////////////////////////////////////////////////////////////////////////////
+
+bool directory_scanner::scan(const std::string& root,
+                             const std::string& folder, std::size_t threads,
+                             const file_fn& visit, const cancel_fn& cancelled,
+                             statistics& stats) {
+  scan_state state;
+  state.pending.push_back(folder);
+  std::filesystem::path root_path(root);
+  threads = std::clamp<std::size_t>(threads, 1, 256);
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < threads; i++)
+    workers.emplace_back(scan_worker, std::cref(root_path), i,
+                         std::cref(visit), std::cref(cancelled),
+                         std::ref(state));
+  scan_worker(root_path, 0, visit, cancelled, state);
+  for (auto& th : workers)
+    th.join();
+
+  stats.folders += state.folders;
+  stats.files += state.files;
+  stats.errors += state.errors;
+  return !state.cancelled;
+}
@@ -0,0 +1,195 @@
+#include "../../../../include/services/requests/compression/compression_worker.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+////////////////////////////////////////////////////////////////////////////////
+// compression_worker class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+compression_worker_ptr compression_worker::create(
+    std::uint32_t workers, std::size_t batch_size,
+    std::chrono::seconds rescan_interval) {
+  return std::make_shared<compression_worker>(workers, batch_size,
+                                              rescan_interval);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+compression_worker::compression_worker(std::uint32_t workers,
+                                       std::size_t batch_size,
+                                       std::chrono::seconds rescan_interval)
+    : workers_count_(workers),
+      batch_size_(static_cast<std::int32_t>(
+          std::clamp<std::size_t>(batch_size, 1, 10000))),
+      rescan_interval_(std::max(rescan_interval, std::chrono::seconds(1))) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+compression_worker::~compression_worker() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void compression_worker::start(const scan_fn& scan,
+                               const compress_fn& compress) {
+  if (workers_count_ == 0)
+    return;
+  scan_ = scan;
+  compress_ = compress;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  next_scan_ = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < workers_count_; i++)
+    workers_.emplace_back(&compression_worker::worker, this);
+}
+
+void compression_worker::stop() {
+  std::vector<std::thread> workers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    workers.swap(workers_);
+  }
+  cv_.notify_all();
+  // the running compressions are completed, the other images stay to
+  // compress:
+  for (auto& th : workers) {
+    if (th.get_id() == std::this_thread::get_id())
+      th.detach();
+    else if (th.joinable())
+      th.join();
+  }
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void compression_worker::get_statistics(Json::Value& output) const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    output["workers"] = static_cast<Json::UInt>(workers_.size());
+    output["pending"] = static_cast<Json::UInt64>(pending_.size());
+    output["running"] = static_cast<Json::UInt64>(running_.size());
+  }
+  output["compressed"] = static_cast<Json::UInt64>(compressed_);
+  output["unchanged"] = static_cast<Json::UInt64>(unchanged_);
+  output["failed"] = static_cast<Json::UInt64>(failed_);
+  output["skipped"] = static_cast<Json::UInt64>(skipped_);
+  output["errors"] = static_cast<Json::UInt64>(errors_);
+  output["saved_bytes"] = static_cast<Json::Int64>(saved_bytes_);
+}
+
+//------------------------------------------------------------------------------
+// workers
+//------------------------------------------------------------------------------
+
+void compression_worker::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    std::string seq;
+    if (!next(seq, lock))
+      continue;
+    running_.insert(seq);
+    lock.unlock();
+    try {
+      std::int64_t saved = 0;
+      switch (compress_(seq, saved)) {
+        case result::compressed:
+          compressed_++;
+          saved_bytes_ += saved;
+          break;
+        case result::unchanged:
+          unchanged_++;
+          break;
+        case result::failed:
+          failed_++;
+          break;
+        case result::skipped:
+          skipped_++;
+          break;
+      }
+    } catch (const std::exception& e) {
+      errors_++;
+      std::cerr << "compression_worker: Failed to compress the image " << seq
+                << ": " << e.what() << std::endl;
+    } catch (...) {
+      errors_++;
+      std::cerr << "compression_worker: Failed to compress the image " << seq
+                << std::endl;
+    }
+    lock.lock();
+    running_.erase(seq);
+  }
+}
+
+bool compression_worker::next(std::string& seq,
+                              std::unique_lock<std::mutex>& lock) {
+  // an image already being compressed by another worker is skipped:
+  while (!pending_.empty()) {
+    seq = std::move(pending_.front());
+    pending_.pop_front();
+    if (running_.find(seq) == running_.end())
+      return true;
+  }
+
+  // read the next page, one worker at a time:
+  auto now = std::chrono::steady_clock::now();
+  if (!scanning_ && now >= next_scan_) {
+    scan(lock);
+    return false;
+  }
+  if (scanning_)
+    cv_.wait_for(lock, std::chrono::seconds(1));
+  else
+    cv_.wait_until(lock, next_scan_);
+  return false;
+}
+
+void compression_worker::scan(std::unique_lock<std::mutex>& lock) {
+  scanning_ = true;
+  std::string cursor = cursor_;
+  lock.unlock();
+  std::vector<std::string> seqs;
+  std::string last;
+  bool succeeded = false;
+  try {
+    last = scan_(cursor, batch_size_, seqs);
+    succeeded = true;
+  } catch (const std::exception& e) {
+    std::cerr << "compression_worker: Failed to read the images to compress: "
+              << e.what() << std::endl;
+  } catch (...) {
+    std::cerr << "compression_worker: Failed to read the images to compress"
+              << std::endl;
+  }
+  lock.lock();
+  scanning_ = false;
+  if (!succeeded) {
+    errors_++;
+    next_scan_ = std::chrono::steady_clock::now() + rescan_interval_;
+    return;
+  }
+  for (auto& seq : seqs)
+    pending_.push_back(std::move(seq));
+
+  // once all the images were read, they are read again after the interval:
+  // the time windows may have opened, and the rules may have changed.
+  cursor_ = last;
+  if (last.empty())
+    next_scan_ = std::chrono::steady_clock::now() + rescan_interval_;
+  cv_.notify_all();
+}
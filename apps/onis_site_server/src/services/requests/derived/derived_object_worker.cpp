@@ -0,0 +1,218 @@
+#include "../../../../include/services/requests/derived/derived_object_worker.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+////////////////////////////////////////////////////////////////////////////////
+// derived_object_worker class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+derived_object_worker_ptr derived_object_worker::create(
+    std::uint32_t workers, std::size_t max_queued, std::size_t batch_size,
+    std::chrono::milliseconds backlog_delay,
+    std::chrono::seconds rescan_interval) {
+  return std::make_shared<derived_object_worker>(
+      workers, max_queued, batch_size, backlog_delay, rescan_interval);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+derived_object_worker::derived_object_worker(
+    std::uint32_t workers, std::size_t max_queued, std::size_t batch_size,
+    std::chrono::milliseconds backlog_delay,
+    std::chrono::seconds rescan_interval)
+    : workers_count_(workers),
+      max_queued_(max_queued),
+      batch_size_(static_cast<std::int32_t>(
+          std::clamp<std::size_t>(batch_size, 1, 10000))),
+      backlog_delay_(backlog_delay),
+      rescan_interval_(std::max(rescan_interval, std::chrono::seconds(1))) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+derived_object_worker::~derived_object_worker() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void derived_object_worker::start(const scan_fn& scan,
+                                  const generate_fn& generate) {
+  if (workers_count_ == 0)
+    return;
+  scan_ = scan;
+  generate_ = generate;
+
+  // the pending images left by the previous run are read at once:
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  next_scan_ = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < workers_count_; i++)
+    workers_.emplace_back(&derived_object_worker::worker, this);
+}
+
+void derived_object_worker::stop() {
+  std::vector<std::thread> workers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    workers.swap(workers_);
+  }
+  cv_.notify_all();
+  // the running generations are completed, the other images stay pending:
+  for (auto& th : workers) {
+    if (th.get_id() == std::this_thread::get_id())
+      th.detach();
+    else if (th.joinable())
+      th.join();
+  }
+}
+
+//------------------------------------------------------------------------------
+// images
+//------------------------------------------------------------------------------
+
+void derived_object_worker::add(const std::vector<std::string>& seqs) {
+  if (seqs.empty())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (workers_.empty() || stopping_)
+      return;
+    for (const auto& seq : seqs) {
+      // the images that do not fit are found again by the backlog scan:
+      if (queued_.size() >= max_queued_) {
+        dropped_++;
+        continue;
+      }
+      queued_.push_back(seq);
+    }
+  }
+  cv_.notify_all();
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void derived_object_worker::get_statistics(Json::Value& output) const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    output["workers"] = static_cast<Json::UInt>(workers_.size());
+    output["queued"] = static_cast<Json::UInt64>(queued_.size());
+    output["backlog"] = static_cast<Json::UInt64>(backlog_.size());
+    output["running"] = static_cast<Json::UInt64>(running_.size());
+  }
+  output["generated"] = static_cast<Json::UInt64>(generated_);
+  output["objects"] = static_cast<Json::UInt64>(objects_);
+  output["dropped"] = static_cast<Json::UInt64>(dropped_);
+  output["failures"] = static_cast<Json::UInt64>(failures_);
+}
+
+//------------------------------------------------------------------------------
+// workers
+//------------------------------------------------------------------------------
+
+void derived_object_worker::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    std::string seq;
+    bool backlog = false;
+    if (!next(seq, backlog, lock))
+      continue;
+    running_.insert(seq);
+    lock.unlock();
+    try {
+      objects_ += generate_(seq);
+      generated_++;
+    } catch (const std::exception& e) {
+      failures_++;
+      std::cerr << "derived_object_worker: Failed to generate the objects of "
+                << seq << ": " << e.what() << std::endl;
+    } catch (...) {
+      failures_++;
+      std::cerr << "derived_object_worker: Failed to generate the objects of "
+                << seq << std::endl;
+    }
+    lock.lock();
+    running_.erase(seq);
+
+    // the backlog is throttled, the queued images are not:
+    if (backlog && backlog_delay_.count() > 0)
+      cv_.wait_for(lock, backlog_delay_,
+                   [this] { return stopping_ || !queued_.empty(); });
+  }
+}
+
+bool derived_object_worker::next(std::string& seq, bool& backlog,
+                                 std::unique_lock<std::mutex>& lock) {
+  // the images of the imports first, then the backlog. An image already
+  // being generated by another worker is skipped:
+  for (auto* items : {&queued_, &backlog_}) {
+    while (!items->empty()) {
+      seq = std::move(items->front());
+      items->pop_front();
+      if (running_.find(seq) == running_.end()) {
+        backlog = items == &backlog_;
+        return true;
+      }
+    }
+  }
+
+  // read the next page of the backlog, one worker at a time:
+  auto now = std::chrono::steady_clock::now();
+  if (!scanning_ && now >= next_scan_) {
+    scan(lock);
+    return false;
+  }
+  if (scanning_)
+    cv_.wait_for(lock, std::chrono::seconds(1));
+  else
+    cv_.wait_until(lock, next_scan_);
+  return false;
+}
+
+void derived_object_worker::scan(std::unique_lock<std::mutex>& lock) {
+  scanning_ = true;
+  std::string cursor = backlog_cursor_;
+  lock.unlock();
+  std::vector<std::string> seqs;
+  std::string last;
+  bool succeeded = false;
+  try {
+    last = scan_(cursor, batch_size_, seqs);
+    succeeded = true;
+  } catch (const std::exception& e) {
+    std::cerr << "derived_object_worker: Failed to read the pending images: "
+              << e.what() << std::endl;
+  } catch (...) {
+    std::cerr << "derived_object_worker: Failed to read the pending images"
+              << std::endl;
+  }
+  lock.lock();
+  scanning_ = false;
+  if (!succeeded) {
+    failures_++;
+    next_scan_ = std::chrono::steady_clock::now() + rescan_interval_;
+    return;
+  }
+  for (auto& seq : seqs)
+    backlog_.push_back(std::move(seq));
+
+  // once all the pending images were read, they are read again after the
+  // interval: those whose generation failed are still pending.
+  backlog_cursor_ = last;
+  if (last.empty())
+    next_scan_ = std::chrono::steady_clock::now() + rescan_interval_;
+  cv_.notify_all();
+}
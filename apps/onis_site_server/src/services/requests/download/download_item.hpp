@@ -7,6 +7,8 @@
 #include <utility>
 #include <vector>
 
+#include "../../../../include/database/items/db_download_image.hpp"
+#include "../../../../include/services/cache/hot_file_cache.hpp"
 #include "../../../../include/services/requests/request_database.hpp"
 #include "../../../../include/services/requests/request_service.hpp"
 #include "../../../../include/site_api.hpp"
@@ -27,7 +29,9 @@ struct DlItem {
   std::int32_t index{-1};
   DlItemType type{DlItemType::kUnknown};
   std::string path;
+  std::size_t file_offset{0};
   std::size_t file_size{0};
+  bool packed{false};
 
   void init(const request_database& db, const std::string& download_seq) {
     if (!res.good() || !this->download_seq.empty())
@@ -52,8 +56,19 @@ struct DlItem {
     switch (image["type"].asInt()) {
       case 1:
         type = DlItemType::kDicomFile;
-        file_size = static_cast<std::size_t>(
-            onis::util::filesystem::get_file_size(path));
+        // a packed image is a range of its series container, whose size is
+        // known without accessing the file:
+        if (image.isMember(DI_PACK_SIZE_KEY) &&
+            image[DI_PACK_SIZE_KEY].asInt64() >= 0) {
+          packed = true;
+          file_offset =
+              static_cast<std::size_t>(image[DI_PACK_OFFSET_KEY].asInt64());
+          file_size =
+              static_cast<std::size_t>(image[DI_PACK_SIZE_KEY].asInt64());
+        } else {
+          file_size = static_cast<std::size_t>(
+              onis::util::filesystem::get_file_size(path));
+        }
         if (file_size <= 0) {
           res.set(OSRSP_FAILURE, EOS_FILE_OPEN, "Failed to open DICOM file",
                   false);
@@ -94,6 +109,8 @@ struct download_stream {
   std::size_t item_index{0};
   std::size_t phase_offset{0};
   std::ifstream current_file;
+  hot_file_cache_ptr file_cache;
+  hot_file_cache::buffer_ptr current_buffer;
   std::array<char, 8> magic{{'O', 'N', 'I', 'S', 'D', 'L', '0', '1'}};
 
   void on_data_written() {
@@ -170,25 +187,7 @@ struct download_stream {
         break;
       case download_stream::phase::kItemIndex:
         if (phase_offset == sizeof(std::uint32_t)) {
-          // open the file now:
-          current_file.close();
-          current_file.clear();
-          current_file.open(items[item_index]->path, std::ios::binary);
-          if (!current_file.is_open()) {
-            items[item_index]->res.set(OSRSP_FAILURE, EOS_FILE_OPEN,
-                                       "Failed to open file", false);
-          } else {
-            try {
-              current_file.seekg(0, std::ios::end);
-              std::streampos file_size = current_file.tellg();
-              items[item_index]->file_size =
-                  static_cast<std::size_t>(file_size);
-              current_file.seekg(0, std::ios::beg);
-            } catch (...) {
-              items[item_index]->res.set(OSRSP_FAILURE, EOS_FILE_OPEN,
-                                         "Failed to open file", false);
-            }
-          }
+          open_current_item();
           phase_offset = 0;
           current_phase = phase::kItemResult;
         }
@@ -232,6 +231,44 @@ struct download_stream {
   }
 
 private:
+  void open_current_item() {
+    // use the cached copy of the file if any, open the file otherwise:
+    auto& item = items[item_index];
+    current_file.close();
+    current_file.clear();
+    current_buffer.reset();
+    if (file_cache)
+      current_buffer = file_cache->load(item->path);
+    if (current_buffer && item->packed &&
+        item->file_offset + item->file_size > current_buffer->size())
+      current_buffer.reset();
+    if (current_buffer) {
+      if (!item->packed)
+        item->file_size = current_buffer->size();
+      return;
+    }
+    current_file.open(item->path, std::ios::binary);
+    if (!current_file.is_open()) {
+      item->res.set(OSRSP_FAILURE, EOS_FILE_OPEN, "Failed to open file", false);
+      return;
+    }
+    // the range of a packed image is read from its series container:
+    if (item->packed) {
+      if (!current_file.seekg(static_cast<std::streamoff>(item->file_offset)))
+        item->res.set(OSRSP_FAILURE, EOS_FILE_OPEN, "Failed to open file",
+                      false);
+      return;
+    }
+    try {
+      current_file.seekg(0, std::ios::end);
+      std::streampos file_size = current_file.tellg();
+      item->file_size = static_cast<std::size_t>(file_size);
+      current_file.seekg(0, std::ios::beg);
+    } catch (...) {
+      item->res.set(OSRSP_FAILURE, EOS_FILE_OPEN, "Failed to open file", false);
+    }
+  }
+
   void on_item_done() {
     item_index++;
     if (item_index < items.size()) {
@@ -0,0 +1,310 @@
+#include "../../../../include/services/requests/exporting/dicomdir_writer.hpp"
+#include <algorithm>
+#include <cstring>
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// Media Storage Directory Storage, and explicit VR little endian:
+static const char kDirectoryClassUid[] = "1.2.840.10008.1.3.10";
+static const char kExplicitLittleEndian[] = "1.2.840.10008.1.2.1";
+static const char kImplementationClassUid[] =
+    "2.25.294016444746394788479835181400199570671";
+static const char kImplementationVersion[] = "ONIS_5";
+static const char kFileSetId[] = "ONIS";
+
+namespace {
+
+// A directory record being encoded, with the positions of its offsets to
+// patch once all the records are laid out:
+struct encoded_record {
+  std::string content;
+  std::size_t next_position{0};
+  std::size_t child_position{0};
+  std::int32_t next{-1};
+  std::int32_t child{-1};
+};
+
+}  // namespace
+
+static void write_u16(std::string& output, std::uint16_t value) {
+  output.push_back(static_cast<char>(value & 0xFF));
+  output.push_back(static_cast<char>(value >> 8));
+}
+
+static void write_u32(std::string& output, std::uint32_t value) {
+  for (std::int32_t i = 0; i < 4; i++)
+    output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+static void patch_u32(std::string& output, std::size_t position,
+                      std::uint32_t value) {
+  for (std::int32_t i = 0; i < 4; i++)
+    output[position + i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+static void write_tag(std::string& output, std::uint32_t tag) {
+  write_u16(output, static_cast<std::uint16_t>(tag >> 16));
+  write_u16(output, static_cast<std::uint16_t>(tag & 0xFFFF));
+}
+
+// Write an element with a 16 bits length, padded to an even length:
+static void write_element(std::string& output, std::uint32_t tag,
+                          const char* vr, std::string value) {
+  if (value.size() % 2 != 0)
+    value.push_back(std::strcmp(vr, "UI") == 0 ? '\0' : ' ');
+  if (value.size() > 0xFFFE)
+    value.resize(0xFFFE);
+  write_tag(output, tag);
+  output.append(vr, 2);
+  write_u16(output, static_cast<std::uint16_t>(value.size()));
+  output.append(value);
+}
+
+// Write an UL element, returns the position of its value:
+static std::size_t write_ul(std::string& output, std::uint32_t tag,
+                            std::uint32_t value) {
+  write_tag(output, tag);
+  output.append("UL");
+  write_u16(output, 4);
+  std::size_t position = output.size();
+  write_u32(output, value);
+  return position;
+}
+
+static void write_us(std::string& output, std::uint32_t tag,
+                     std::uint16_t value) {
+  write_tag(output, tag);
+  output.append("US");
+  write_u16(output, 2);
+  write_u16(output, value);
+}
+
+static bool is_ascii(const std::vector<const std::string*>& values) {
+  for (const std::string* value : values) {
+    for (char c : *value) {
+      if (static_cast<unsigned char>(c) >= 0x80)
+        return false;
+    }
+  }
+  return true;
+}
+
+// Start a record of type "type", up to its specific character set:
+static encoded_record start_record(const char* type) {
+  encoded_record record;
+  record.next_position = write_ul(record.content, 0x00041400, 0);
+  write_us(record.content, 0x00041410, 0xFFFF);  // in use
+  record.child_position = write_ul(record.content, 0x00041420, 0);
+  write_element(record.content, 0x00041430, "CS", type);
+  return record;
+}
+
+static void write_charset(encoded_record& record,
+                          const std::vector<const std::string*>& values) {
+  if (!is_ascii(values))
+    write_element(record.content, 0x00080005, "CS", "ISO_IR 192");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// dicomdir_writer class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// encoding
+//------------------------------------------------------------------------------
+
+void dicomdir_writer::encode(const std::vector<patient_record>& patients,
+                             std::string& output) {
+  // the records, in the order of the directory record sequence, linked to
+  // their next sibling and their first child:
+  std::vector<encoded_record> records;
+  std::int32_t previous_patient = -1;
+  std::int32_t last_patient = -1;
+  for (const auto& patient : patients) {
+    std::vector<const std::string*> values = {&patient.name, &patient.id};
+    encoded_record record = start_record("PATIENT");
+    write_charset(record, values);
+    write_element(record.content, 0x00100010, "PN", patient.name);
+    write_element(record.content, 0x00100020, "LO", patient.id);
+    write_element(record.content, 0x00100030, "DA", patient.birth_date);
+    write_element(record.content, 0x00100040, "CS", patient.sex);
+    std::int32_t patient_index = static_cast<std::int32_t>(records.size());
+    if (previous_patient >= 0)
+      records[previous_patient].next = patient_index;
+    previous_patient = last_patient = patient_index;
+    records.push_back(std::move(record));
+
+    std::int32_t previous_study = -1;
+    for (const auto& study : patient.studies) {
+      values = {&study.accession_number, &study.id, &study.description};
+      record = start_record("STUDY");
+      write_charset(record, values);
+      write_element(record.content, 0x00080020, "DA", study.date);
+      write_element(record.content, 0x00080030, "TM", study.time);
+      write_element(record.content, 0x00080050, "SH", study.accession_number);
+      write_element(record.content, 0x00081030, "LO", study.description);
+      write_element(record.content, 0x0020000D, "UI", study.uid);
+      write_element(record.content, 0x00200010, "SH", study.id);
+      std::int32_t study_index = static_cast<std::int32_t>(records.size());
+      if (previous_study >= 0)
+        records[previous_study].next = study_index;
+      else
+        records[patient_index].child = study_index;
+      previous_study = study_index;
+      records.push_back(std::move(record));
+
+      std::int32_t previous_series = -1;
+      for (const auto& series : study.series) {
+        record = start_record("SERIES");
+        write_element(record.content, 0x00080060, "CS", series.modality);
+        write_element(record.content, 0x0020000E, "UI", series.uid);
+        write_element(record.content, 0x00200011, "IS", series.number);
+        std::int32_t series_index = static_cast<std::int32_t>(records.size());
+        if (previous_series >= 0)
+          records[previous_series].next = series_index;
+        else
+          records[study_index].child = series_index;
+        previous_series = series_index;
+        records.push_back(std::move(record));
+
+        std::int32_t previous_image = -1;
+        for (const auto& image : series.images) {
+          record = start_record("IMAGE");
+          write_element(record.content, 0x00041500, "CS", image.file_id);
+          write_element(record.content, 0x00041510, "UI", image.sop_class_uid);
+          write_element(record.content, 0x00041511, "UI",
+                        image.sop_instance_uid);
+          write_element(record.content, 0x00041512, "UI",
+                        image.transfer_syntax);
+          write_element(record.content, 0x00200013, "IS", image.number);
+          std::int32_t image_index = static_cast<std::int32_t>(records.size());
+          if (previous_image >= 0)
+            records[previous_image].next = image_index;
+          else
+            records[series_index].child = image_index;
+          previous_image = image_index;
+          records.push_back(std::move(record));
+        }
+      }
+    }
+  }
+
+  // file meta information:
+  std::string group;
+  write_tag(group, 0x00020001);
+  group.append("OB");
+  write_u16(group, 0);
+  write_u32(group, 2);
+  group.push_back('\0');
+  group.push_back('\1');
+  write_element(group, 0x00020002, "UI", kDirectoryClassUid);
+  write_element(group, 0x00020003, "UI", create_uid());
+  write_element(group, 0x00020010, "UI", kExplicitLittleEndian);
+  write_element(group, 0x00020012, "UI", kImplementationClassUid);
+  write_element(group, 0x00020013, "SH", kImplementationVersion);
+  output.append(128, '\0');
+  output.append("DICM");
+  write_ul(output, 0x00020000, static_cast<std::uint32_t>(group.size()));
+  output.append(group);
+
+  // the offsets are counted from the first byte of the file, up to the item
+  // of each record:
+  std::uint64_t position = output.size() + 12 + 12 + 12 + 10 + 12;
+  std::vector<std::uint32_t> offsets(records.size());
+  std::uint64_t sequence_size = 0;
+  for (std::size_t i = 0; i < records.size(); i++) {
+    offsets[i] = static_cast<std::uint32_t>(position + sequence_size);
+    sequence_size += 8 + records[i].content.size();
+  }
+  for (auto& record : records) {
+    if (record.next >= 0)
+      patch_u32(record.content, record.next_position, offsets[record.next]);
+    if (record.child >= 0)
+      patch_u32(record.content, record.child_position, offsets[record.child]);
+  }
+
+  write_element(output, 0x00041130, "CS", kFileSetId);
+  write_ul(output, 0x00041200, records.empty() ? 0 : offsets[0]);
+  write_ul(output, 0x00041202, last_patient < 0 ? 0 : offsets[last_patient]);
+  write_us(output, 0x00041212, 0);  // no inconsistency
+  write_tag(output, 0x00041220);
+  output.append("SQ");
+  write_u16(output, 0);
+  write_u32(output, static_cast<std::uint32_t>(sequence_size));
+  for (const auto& record : records) {
+    write_tag(output, 0xFFFEE000);
+    write_u32(output, static_cast<std::uint32_t>(record.content.size()));
+    output.append(record.content);
+  }
+}
+
+//------------------------------------------------------------------------------
+// utilities
+//------------------------------------------------------------------------------
+
+std::string dicomdir_writer::read_transfer_syntax(const char* data,
+                                                  std::size_t size) {
+  // the group 0002 is always encoded in explicit VR little endian:
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  if (size < 132 || std::memcmp(data + 128, "DICM", 4) != 0)
+    return "";
+  std::size_t position = 132;
+  while (position + 8 <= size) {
+    const unsigned char* tag = bytes + position;
+    std::uint16_t group = tag[0] | (tag[1] << 8);
+    std::uint16_t element = tag[2] | (tag[3] << 8);
+    if (group != 0x0002)
+      return "";
+    std::string vr(reinterpret_cast<const char*>(tag + 4), 2);
+    std::uint64_t length = tag[6] | (tag[7] << 8);
+    position += 8;
+    if (vr == "OB" || vr == "OW" || vr == "OF" || vr == "OD" || vr == "OL" ||
+        vr == "OV" || vr == "SQ" || vr == "UC" || vr == "UR" || vr == "UT" ||
+        vr == "UN") {
+      if (position + 4 > size)
+        return "";
+      length = bytes[position] | (bytes[position + 1] << 8) |
+               (bytes[position + 2] << 16) |
+               (static_cast<std::uint32_t>(bytes[position + 3]) << 24);
+      position += 4;
+    }
+    if (position + length > size)
+      return "";
+    if (element == 0x0010) {
+      std::string value(data + position, static_cast<std::size_t>(length));
+      while (!value.empty() && (value.back() == '\0' || value.back() == ' '))
+        value.pop_back();
+      return value;
+    }
+    position += static_cast<std::size_t>(length);
+  }
+  return "";
+}
+
+std::string dicomdir_writer::create_uid() {
+  // the 128 bits of the UUID, as a decimal number:
+  std::vector<std::uint8_t> digits;  // least significant first
+  for (char c : onis::util::uuid::generate_random_uuid()) {
+    std::uint32_t carry;
+    if (c >= '0' && c <= '9')
+      carry = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      carry = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      carry = c - 'A' + 10;
+    else
+      continue;
+    for (auto& digit : digits) {
+      std::uint32_t value = digit * 16 + carry;
+      digit = static_cast<std::uint8_t>(value % 10);
+      carry = value / 10;
+    }
+    for (; carry > 0; carry /= 10)
+      digits.push_back(static_cast<std::uint8_t>(carry % 10));
+  }
+  std::string uid = "2.25.";
+  if (digits.empty())
+    uid.push_back('0');
+  for (auto it = digits.rbegin(); it != digits.rend(); ++it)
+    uid.push_back(static_cast<char>('0' + *it));
+  return uid;
+}
@@ -0,0 +1,454 @@
+#include "../../../../include/services/requests/exporting/study_exporter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "../../../../include/services/requests/packing/series_container.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/core/result.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// size of the chunks read ahead:
+static const std::size_t kChunkSize = 1024 * 1024;
+
+// The identifying attributes emptied (type 2) or removed (type 3) by the
+// de-identification, after the basic profile of PS3.15 E. The UIDs are
+// retained, so that the exported images still match their references.
+static const struct {
+  std::int32_t tag;
+  const char* vr;
+} kEmptiedTags[] = {{TAG_PATIENT_BIRTH_DATE, "DA"},
+                    {TAG_PATIENT_SEX, "CS"},
+                    {TAG_ACCESSION_NUMBER, "SH"},
+                    {TAG_REFERRING_PHYSICIAN_NAME, "PN"}};
+static const std::int32_t kRemovedTags[] = {
+    TAG_INSTITUTION_NAME,
+    TAG_INSTITUTION_ADDRESS,
+    TAG_REFERRING_PHYSICIAN_ADDRESS,
+    TAG_REFERRING_PHYSICIAN_TELEPHONE_NUMBERS,
+    TAG_STATION_NAME,
+    TAG_INSTITUTIONAL_DEPARTMENT_NAME,
+    TAG_PERFORMING_PHYSICIAN_NAME,
+    TAG_OPERATORS_NAME,
+    TAG_ISSUER_OF_PATIENT_ID,
+    TAG_PATIENT_BIRTH_TIME,
+    TAG_OTHER_PATIENT_IDS,
+    TAG_OTHER_PATIENT_NAMES,
+    TAG_PATIENT_BIRTH_NAME,
+    TAG_PATIENT_ADDRESS,
+    TAG_PATIENT_MOTHER_BIRTH_NAME,
+    TAG_MILITARY_RANK,
+    TAG_BRANCH_OF_SERVICE,
+    TAG_MEDICAL_RECORD_LOCATOR,
+    TAG_PATIENT_TELEPHONE_NUMBERS,
+    TAG_ETHNIC_GROUP,
+    TAG_OCCUPATION,
+    TAG_ADDITIONAL_PATIENT_HISTORY,
+    TAG_PATIENT_RELIGIOUS_PREFERENCE,
+    TAG_PATIENT_COMMENTS,
+    TAG_DEVICE_SERIAL_NUMBER,
+    TAG_REQUESTING_PHYSICIAN};
+static const std::int32_t kPatientIdentityRemovedTag = 0x00120062;
+static const std::int32_t kDeidentificationMethodTag = 0x00120063;
+
+////////////////////////////////////////////////////////////////////////////////
+// study_exporter class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+study_exporter_ptr study_exporter::create(
+    const options& opts, const onis::dicom_manager_ptr& manager,
+    std::vector<dicomdir_writer::patient_record> directory,
+    std::vector<entry> entries) {
+  return std::make_shared<study_exporter>(opts, manager, std::move(directory),
+                                          std::move(entries));
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+study_exporter::study_exporter(
+    const options& opts, const onis::dicom_manager_ptr& manager,
+    std::vector<dicomdir_writer::patient_record> directory,
+    std::vector<entry> entries)
+    : options_(opts),
+      manager_(manager),
+      directory_(std::move(directory)),
+      entries_(std::move(entries)),
+      slots_(entries_.size()),
+      exported_(entries_.size(), false),
+      transfer_syntaxes_(entries_.size()) {
+  options_.readers = std::max<std::uint32_t>(options_.readers, 1);
+  options_.max_buffered = std::max(options_.max_buffered, kChunkSize);
+}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+study_exporter::~study_exporter() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void study_exporter::start() {
+  std::uint32_t count = static_cast<std::uint32_t>(
+      std::min<std::size_t>(options_.readers, entries_.size()));
+  for (std::uint32_t i = 0; i < count; i++)
+    readers_.emplace_back(&study_exporter::run_reader, this);
+}
+
+void study_exporter::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  data_cv_.notify_all();
+  space_cv_.notify_all();
+  for (auto& reader : readers_) {
+    if (reader.joinable())
+      reader.join();
+  }
+  readers_.clear();
+}
+
+//------------------------------------------------------------------------------
+// read ahead
+//------------------------------------------------------------------------------
+
+void study_exporter::run_reader() {
+  for (;;) {
+    std::size_t index;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      space_cv_.wait(lock, [this] {
+        return stopping_ || next_entry_ >= entries_.size() ||
+               buffered_ < options_.max_buffered ||
+               next_entry_ == write_entry_;
+      });
+      if (stopping_ || next_entry_ >= entries_.size())
+        return;
+      index = next_entry_++;
+    }
+    read_entry(index);
+  }
+}
+
+void study_exporter::read_entry(std::size_t index) {
+  const entry& item = entries_[index];
+  std::string error;
+  try {
+    if (options_.deidentify || !options_.transfer_syntax.empty()) {
+      // the processed image is read from a temporary file:
+      std::string path = process_entry(item);
+      std::error_code ec;
+      std::uintmax_t size = std::filesystem::file_size(path, ec);
+      try {
+        if (ec)
+          throw onis::exception(EOS_FILE_READ, "Failed to process the image");
+        read_file(index, path, 0, size);
+      } catch (...) {
+        onis::util::filesystem::delete_file(path);
+        throw;
+      }
+      onis::util::filesystem::delete_file(path);
+    } else {
+      read_file(index, item.path, item.offset, item.size);
+    }
+  } catch (const onis::exception& e) {
+    error = e.what();
+  } catch (const std::exception& e) {
+    error = e.what();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  slots_[index].done = true;
+  slots_[index].error = error;
+  data_cv_.notify_all();
+}
+
+// Read "size" bytes of "path" from "offset", chunk after chunk, each one
+// waiting for room in the buffer. The entry being written always gets a
+// chunk when none of its chunks is waiting, so that it cannot be blocked
+// by the entries read ahead.
+void study_exporter::read_file(std::size_t index, const std::string& path,
+                               std::uint64_t offset, std::uint64_t size) {
+  if (size > zip_stream_writer::max_entry_size)
+    throw onis::exception(EOS_FILE_SIZE, "The image is larger than 4 GB");
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open() || !file.seekg(static_cast<std::streamoff>(offset)))
+    throw onis::exception(EOS_FILE_OPEN, "Failed to open the image file");
+  std::uint64_t remaining = size;
+  bool first = true;
+  while (remaining > 0) {
+    std::size_t length = static_cast<std::size_t>(
+        std::min<std::uint64_t>(remaining, kChunkSize));
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      space_cv_.wait(lock, [&] {
+        return stopping_ || buffered_ + length <= options_.max_buffered ||
+               (index == write_entry_ && slots_[index].chunks.empty());
+      });
+      if (stopping_)
+        return;
+      buffered_ += length;
+    }
+    std::string chunk(length, '\0');
+    bool read = static_cast<bool>(file.read(chunk.data(), length));
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!read) {
+      buffered_ -= length;
+      space_cv_.notify_all();
+      throw onis::exception(EOS_FILE_READ, "Failed to read the image file");
+    }
+    slot& target = slots_[index];
+    if (first) {
+      target.transfer_syntax =
+          dicomdir_writer::read_transfer_syntax(chunk.data(), chunk.size());
+      first = false;
+    }
+    target.chunks.push_back(std::move(chunk));
+    data_cv_.notify_all();
+    remaining -= length;
+  }
+}
+
+// Save the image to a temporary file, de-identified and/or in the transfer
+// syntax of the export, returns its path:
+std::string study_exporter::process_entry(const entry& item) const {
+  std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+  std::string name = "EX_" + onis::util::uuid::generate_random_uuid();
+
+  // a packed image is read from a copy of its range of the container:
+  std::string image_path = item.path;
+  std::string packed_copy;
+  if (item.packed) {
+    packed_copy = (temp_dir / (name + ".dcm.tmp")).string();
+    if (!series_container::extract(item.path, item.offset, item.size,
+                                   packed_copy))
+      throw onis::exception(EOS_FILE_READ, "Failed to read the container");
+    image_path = packed_copy;
+  }
+
+  onis::dicom_file_ptr dcm =
+      manager_ != nullptr ? manager_->create_dicom_file() : nullptr;
+  bool loaded = dcm != nullptr && dcm->load_file(image_path);
+  if (!packed_copy.empty())
+    onis::util::filesystem::delete_file(packed_copy);
+  if (!loaded)
+    throw onis::exception(EOS_FILE_READ, "Failed to load the image");
+  if (options_.deidentify)
+    deidentify(dcm, directory_[item.patient]);
+
+  std::string output_path = (temp_dir / (name + ".out.tmp")).string();
+  if (!dcm->save_file(output_path, options_.transfer_syntax)) {
+    onis::util::filesystem::delete_file(output_path);
+    throw onis::exception(EOS_FILE_CONVERSION,
+                          options_.transfer_syntax.empty()
+                              ? "Failed to save the image"
+                              : "Failed to transcode the image to " +
+                                    options_.transfer_syntax);
+  }
+  return output_path;
+}
+
+// Replace the patient by the one of its DICOMDIR record, and remove the
+// other identifying attributes and the private attributes:
+void study_exporter::deidentify(
+    const onis::dicom_file_ptr& dcm,
+    const dicomdir_writer::patient_record& patient) const {
+  dcm->set_string_element(TAG_PATIENT_NAME, "PN", patient.name, true);
+  dcm->set_string_element(TAG_PATIENT_ID, "LO", patient.id, true);
+  for (const auto& item : kEmptiedTags)
+    dcm->set_string_element(item.tag, item.vr, "", false);
+  for (std::int32_t tag : kRemovedTags)
+    dcm->remove_element(tag);
+
+  // the private attributes (odd groups) of the dataset:
+  std::vector<std::int32_t> private_tags;
+  dcm->lock();
+  std::int32_t tag;
+  std::string vr;
+  std::int32_t vm;
+  void* elem = dcm->get_next_element(1, nullptr, &tag, &vr, &vm);
+  while (elem != nullptr) {
+    if ((static_cast<std::uint32_t>(tag) >> 16) & 1)
+      private_tags.push_back(tag);
+    elem = dcm->get_next_element(1, elem, &tag, &vr, &vm);
+  }
+  dcm->unlock();
+  for (std::int32_t private_tag : private_tags)
+    dcm->remove_element(private_tag);
+
+  dcm->set_string_element(kPatientIdentityRemovedTag, "CS", "YES", true);
+  dcm->set_string_element(kDeidentificationMethodTag, "LO",
+                          "Basic profile, retain UIDs", true);
+}
+
+//------------------------------------------------------------------------------
+// writer
+//------------------------------------------------------------------------------
+
+std::size_t study_exporter::read(char* buffer, std::size_t size) {
+  if (buffer == nullptr) {
+    stop();
+    return 0;
+  }
+  std::size_t written = 0;
+  while (written < size) {
+    if (pending_.empty()) {
+      // what is ready is sent without waiting for the rest:
+      if (written > 0 || !next_output())
+        break;
+      continue;
+    }
+    const std::string& data = pending_.front();
+    std::size_t length =
+        std::min(size - written, data.size() - pending_position_);
+    std::memcpy(buffer + written, data.data() + pending_position_, length);
+    written += length;
+    pending_position_ += length;
+    if (pending_position_ == data.size()) {
+      pending_.pop_front();
+      pending_position_ = 0;
+    }
+  }
+  return written;
+}
+
+// Queue the next part of the archive in the pending output, waiting for
+// the readers when needed. Returns false once the archive is complete.
+bool study_exporter::next_output() {
+  while (pending_.empty()) {
+    switch (stage_) {
+      case stage::kEntries: {
+        if (write_entry_ == entries_.size()) {
+          stage_ = stage::kDicomdir;
+          break;
+        }
+        const entry& item = entries_[write_entry_];
+        std::unique_lock<std::mutex> lock(mutex_);
+        slot& source = slots_[write_entry_];
+        data_cv_.wait(lock, [&] {
+          return stopping_ || !source.chunks.empty() || source.done;
+        });
+        if (stopping_)
+          return false;
+        if (!source.chunks.empty()) {
+          std::string chunk = std::move(source.chunks.front());
+          source.chunks.pop_front();
+          buffered_ -= chunk.size();
+          lock.unlock();
+          space_cv_.notify_all();
+          std::string header;
+          if (!zip_.has_open_entry()) {
+            zip_.begin_entry(item.name, header);
+            pending_.push_back(std::move(header));
+          }
+          zip_.add_data(chunk.data(), chunk.size());
+          pending_.push_back(std::move(chunk));
+          break;
+        }
+
+        // the entry is read (a failed image is left out of the archive,
+        // a truncated one out of the DICOMDIR):
+        std::string error = source.error;
+        transfer_syntaxes_[write_entry_] = source.transfer_syntax;
+        write_entry_++;
+        lock.unlock();
+        space_cv_.notify_all();
+        if (!error.empty()) {
+          errors_.push_back(item.name + ": " + error +
+                            (zip_.has_open_entry() ? " (truncated)" : ""));
+        } else {
+          exported_[write_entry_ - 1] = true;
+        }
+        std::string descriptor;
+        if (!zip_.has_open_entry() && error.empty())
+          zip_.begin_entry(item.name, descriptor);
+        if (zip_.has_open_entry())
+          zip_.end_entry(descriptor);
+        if (!descriptor.empty())
+          pending_.push_back(std::move(descriptor));
+        break;
+      }
+      case stage::kDicomdir:
+        if (options_.dicomdir)
+          write_dicomdir();
+        stage_ = stage::kErrors;
+        break;
+      case stage::kErrors:
+        if (!errors_.empty()) {
+          std::string text;
+          for (const auto& error : errors_)
+            text += error + "\r\n";
+          write_entry("EXPORT_ERRORS.TXT", text);
+        }
+        stage_ = stage::kDirectory;
+        break;
+      case stage::kDirectory: {
+        std::string directory;
+        zip_.finish(directory);
+        pending_.push_back(std::move(directory));
+        stage_ = stage::kDone;
+        break;
+      }
+      case stage::kDone:
+        return false;
+    }
+  }
+  return true;
+}
+
+// Queue an entry produced in memory:
+void study_exporter::write_entry(const std::string& name,
+                                 const std::string& data) {
+  std::string header;
+  zip_.begin_entry(name, header);
+  pending_.push_back(std::move(header));
+  zip_.add_data(data.data(), data.size());
+  pending_.push_back(data);
+  std::string descriptor;
+  zip_.end_entry(descriptor);
+  pending_.push_back(std::move(descriptor));
+}
+
+// The DICOMDIR of the exported images, with their transfer syntaxes (the
+// images left out of the archive, and the series and studies left empty,
+// are not listed):
+void study_exporter::write_dicomdir() {
+  std::vector<dicomdir_writer::patient_record> directory = directory_;
+  std::size_t index = 0;
+  for (auto& patient : directory) {
+    for (auto& study : patient.studies) {
+      for (auto& series : study.series) {
+        std::vector<dicomdir_writer::image_record> images;
+        for (auto& image : series.images) {
+          if (index < exported_.size() && exported_[index]) {
+            image.transfer_syntax = transfer_syntaxes_[index];
+            images.push_back(std::move(image));
+          }
+          index++;
+        }
+        series.images = std::move(images);
+      }
+      std::erase_if(study.series, [](const auto& series) {
+        return series.images.empty();
+      });
+    }
+    std::erase_if(patient.studies, [](const auto& study) {
+      return study.series.empty();
+    });
+  }
+  std::string data;
+  dicomdir_writer::encode(directory, data);
+  write_entry("DICOMDIR", data);
+}
@@ -0,0 +1,188 @@
+#include "../../../../include/services/requests/exporting/zip_stream_writer.hpp"
+#include <zlib.h>
+#include <algorithm>
+#include <ctime>
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/core/result.hpp"
+
+// general purpose flags: sizes in a data descriptor, names in UTF-8
+static const std::uint16_t kEntryFlags = 0x0808;
+// versions needed to extract: 2.0, or 4.5 for the ZIP64 extensions
+static const std::uint16_t kVersion = 20;
+static const std::uint16_t kVersionZip64 = 45;
+static const std::uint32_t kMax32 = 0xFFFFFFFFU;
+static const std::uint16_t kMax16 = 0xFFFF;
+
+static void write_u16(std::string& output, std::uint16_t value) {
+  output.push_back(static_cast<char>(value & 0xFF));
+  output.push_back(static_cast<char>(value >> 8));
+}
+
+static void write_u32(std::string& output, std::uint32_t value) {
+  for (std::int32_t i = 0; i < 4; i++)
+    output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+static void write_u64(std::string& output, std::uint64_t value) {
+  for (std::int32_t i = 0; i < 8; i++)
+    output.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// zip_stream_writer class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+zip_stream_writer::zip_stream_writer() {
+  // all the entries are dated from the creation of the archive:
+  std::time_t now = std::time(nullptr);
+  std::tm local{};
+  localtime_r(&now, &local);
+  dos_time_ = static_cast<std::uint16_t>(
+      (local.tm_hour << 11) | (local.tm_min << 5) | (local.tm_sec / 2));
+  dos_date_ = static_cast<std::uint16_t>(
+      (std::max(local.tm_year - 80, 0) << 9) | ((local.tm_mon + 1) << 5) |
+      local.tm_mday);
+}
+
+//------------------------------------------------------------------------------
+// entries
+//------------------------------------------------------------------------------
+
+void zip_stream_writer::begin_entry(const std::string& name,
+                                    std::string& output) {
+  if (open_)
+    throw onis::exception(EOS_INTERNAL, "An entry is already open");
+  if (name.empty() || name.size() > kMax16)
+    throw onis::exception(EOS_PARAM, "Invalid entry name");
+  entry item;
+  item.name = name;
+  item.crc = static_cast<std::uint32_t>(crc32(0L, Z_NULL, 0));
+  item.offset = offset_;
+  entries_.push_back(item);
+  open_ = true;
+
+  // local file header, the CRC and sizes are left to the data descriptor:
+  std::size_t start = output.size();
+  write_u32(output, 0x04034b50);
+  write_u16(output, kVersion);
+  write_u16(output, kEntryFlags);
+  write_u16(output, 0);  // stored
+  write_u16(output, dos_time_);
+  write_u16(output, dos_date_);
+  write_u32(output, 0);
+  write_u32(output, 0);
+  write_u32(output, 0);
+  write_u16(output, static_cast<std::uint16_t>(name.size()));
+  write_u16(output, 0);
+  output.append(name);
+  offset_ += output.size() - start;
+}
+
+void zip_stream_writer::add_data(const char* data, std::size_t size) {
+  if (!open_)
+    throw onis::exception(EOS_INTERNAL, "No entry is open");
+  entry& item = entries_.back();
+  if (item.size + size > max_entry_size)
+    throw onis::exception(EOS_FILE_SIZE, "The entry is too large");
+  // crc32 takes the length as a 32 bits value:
+  const Bytef* bytes = reinterpret_cast<const Bytef*>(data);
+  std::size_t remaining = size;
+  while (remaining > 0) {
+    uInt length = static_cast<uInt>(std::min<std::size_t>(remaining, kMax32));
+    item.crc = static_cast<std::uint32_t>(crc32(item.crc, bytes, length));
+    bytes += length;
+    remaining -= length;
+  }
+  item.size += size;
+  offset_ += size;
+}
+
+void zip_stream_writer::end_entry(std::string& output) {
+  if (!open_)
+    throw onis::exception(EOS_INTERNAL, "No entry is open");
+  const entry& item = entries_.back();
+  std::size_t start = output.size();
+  write_u32(output, 0x08074b50);
+  write_u32(output, item.crc);
+  write_u32(output, static_cast<std::uint32_t>(item.size));
+  write_u32(output, static_cast<std::uint32_t>(item.size));
+  offset_ += output.size() - start;
+  open_ = false;
+}
+
+//------------------------------------------------------------------------------
+// central directory and end records
+//------------------------------------------------------------------------------
+
+void zip_stream_writer::finish(std::string& output) {
+  if (open_)
+    throw onis::exception(EOS_INTERNAL, "An entry is still open");
+  std::size_t start = output.size();
+  std::uint64_t directory_offset = offset_;
+  for (const auto& item : entries_) {
+    // the offsets past 4 GB move to a ZIP64 extra field:
+    bool zip64 = item.offset >= kMax32;
+    write_u32(output, 0x02014b50);
+    write_u16(output, (3 << 8) | kVersionZip64);  // made by: unix
+    write_u16(output, zip64 ? kVersionZip64 : kVersion);
+    write_u16(output, kEntryFlags);
+    write_u16(output, 0);
+    write_u16(output, dos_time_);
+    write_u16(output, dos_date_);
+    write_u32(output, item.crc);
+    write_u32(output, static_cast<std::uint32_t>(item.size));
+    write_u32(output, static_cast<std::uint32_t>(item.size));
+    write_u16(output, static_cast<std::uint16_t>(item.name.size()));
+    write_u16(output, zip64 ? 12 : 0);
+    write_u16(output, 0);  // comment
+    write_u16(output, 0);  // disk
+    write_u16(output, 0);  // internal attributes
+    write_u32(output, 0100644U << 16);  // external attributes: rw-r--r--
+    write_u32(output,
+              zip64 ? kMax32 : static_cast<std::uint32_t>(item.offset));
+    output.append(item.name);
+    if (zip64) {
+      write_u16(output, 0x0001);
+      write_u16(output, 8);
+      write_u64(output, item.offset);
+    }
+  }
+  std::uint64_t directory_size = output.size() - start;
+  std::uint64_t count = entries_.size();
+  std::uint64_t end_offset = directory_offset + directory_size;
+
+  bool zip64 = count >= kMax16 || directory_offset >= kMax32 ||
+               directory_size >= kMax32;
+  if (zip64) {
+    // ZIP64 end of central directory record, and its locator:
+    write_u32(output, 0x06064b50);
+    write_u64(output, 44);
+    write_u16(output, (3 << 8) | kVersionZip64);
+    write_u16(output, kVersionZip64);
+    write_u32(output, 0);
+    write_u32(output, 0);
+    write_u64(output, count);
+    write_u64(output, count);
+    write_u64(output, directory_size);
+    write_u64(output, directory_offset);
+    write_u32(output, 0x07064b50);
+    write_u32(output, 0);
+    write_u64(output, end_offset);
+    write_u32(output, 1);
+  }
+  write_u32(output, 0x06054b50);
+  write_u16(output, 0);
+  write_u16(output, 0);
+  write_u16(output, zip64 ? kMax16 : static_cast<std::uint16_t>(count));
+  write_u16(output, zip64 ? kMax16 : static_cast<std::uint16_t>(count));
+  write_u32(output,
+            zip64 ? kMax32 : static_cast<std::uint32_t>(directory_size));
+  write_u32(output,
+            zip64 ? kMax32 : static_cast<std::uint32_t>(directory_offset));
+  write_u16(output, 0);
+  offset_ += output.size() - start;
+}
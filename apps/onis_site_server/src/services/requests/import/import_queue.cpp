@@ -0,0 +1,418 @@
+#include "../../../../include/services/requests/import/import_queue.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/core/result.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// delay before a failed job is tried again (multiplied by the attempts):
+static const std::int64_t kRetryDelay = 30;
+
+// interval between two purges of the expired journals:
+static const std::int64_t kPurgeInterval = 600;
+
+static std::int64_t get_current_time() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// import_queue class
+////////////////////////////////////////////////////////////////////////////////
+
+const char* const import_queue::kQueued = "queued";
+const char* const import_queue::kRunning = "running";
+const char* const import_queue::kCompleted = "completed";
+const char* const import_queue::kFailed = "failed";
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+import_queue_ptr import_queue::create(const std::string& folder,
+                                      std::uint32_t workers,
+                                      std::size_t max_pending,
+                                      std::uint32_t max_attempts,
+                                      std::uint32_t retention_hours) {
+  return std::make_shared<import_queue>(folder, workers, max_pending,
+                                        max_attempts, retention_hours);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+import_queue::import_queue(const std::string& folder, std::uint32_t workers,
+                           std::size_t max_pending,
+                           std::uint32_t max_attempts,
+                           std::uint32_t retention_hours)
+    : folder_(folder),
+      worker_count_(workers),
+      max_pending_(max_pending),
+      max_attempts_(std::max<std::uint32_t>(max_attempts, 1)),
+      retention_(static_cast<std::int64_t>(retention_hours) * 3600) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+import_queue::~import_queue() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+bool import_queue::is_enabled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !workers_.empty() && !stopping_;
+}
+
+void import_queue::start(const handler_fn& handler) {
+  if (worker_count_ == 0 || folder_.empty())
+    return;
+  if (!onis::util::filesystem::create_multi_directories(folder_)) {
+    std::cerr << "import_queue: Failed to create the spool folder: "
+              << folder_ << std::endl;
+    return;
+  }
+  handler_ = handler;
+  replay();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  for (std::uint32_t i = 0; i < worker_count_; i++)
+    workers_.emplace_back(&import_queue::worker, this);
+}
+
+void import_queue::stop() {
+  std::vector<std::thread> workers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    workers.swap(workers_);
+  }
+  cv_.notify_all();
+  // the running jobs are completed, the pending ones stay in the journal:
+  for (auto& th : workers) {
+    if (th.get_id() == std::this_thread::get_id())
+      th.detach();
+    else if (th.joinable())
+      th.join();
+  }
+}
+
+//------------------------------------------------------------------------------
+// jobs
+//------------------------------------------------------------------------------
+
+void import_queue::submit(const std::string& source, const Json::Value& input,
+                          Json::Value& job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (workers_.empty() || stopping_)
+      throw onis::exception(EOS_NOT_AVAILABLE, "Import queue not running");
+    if (pending_.size() >= max_pending_)
+      throw onis::exception(EOS_BUSY, "Import queue is full");
+  }
+
+  job = input;
+  job["id"] = onis::util::uuid::generate_random_uuid();
+  job["source"] = source;
+  job["state"] = kQueued;
+  job["attempts"] = 0;
+  job["created"] = static_cast<Json::Int64>(get_current_time());
+
+  // the job is only accepted once it is journaled:
+  if (!write_journal(job))
+    throw onis::exception(EOS_FILE_WRITE, "Failed to journal the import job");
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_[job["id"].asString()] = job;
+    pending_.push_back(job["id"].asString());
+  }
+  accepted_++;
+  cv_.notify_one();
+}
+
+bool import_queue::find_job(const std::string& id, Json::Value& job) const {
+  if (!onis::util::uuid::is_valid(id))
+    return false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it != jobs_.end()) {
+      job = it->second;
+      if (job["state"].asString() == kQueued) {
+        auto pos = std::find(pending_.begin(), pending_.end(), id);
+        if (pos != pending_.end())
+          job["position"] =
+              static_cast<Json::UInt64>(pos - pending_.begin() + 1);
+      }
+      return true;
+    }
+  }
+
+  // the finished jobs are only kept in the journal:
+  std::ifstream file(get_journal_path(id));
+  if (!file.is_open())
+    return false;
+  Json::Reader reader;
+  return reader.parse(file, job) && job.isObject();
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void import_queue::get_statistics(Json::Value& output) const {
+  output["accepted"] = static_cast<Json::UInt64>(accepted_);
+  output["completed"] = static_cast<Json::UInt64>(completed_);
+  output["failed"] = static_cast<Json::UInt64>(failed_);
+  output["retried"] = static_cast<Json::UInt64>(retried_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  output["workers"] = static_cast<Json::UInt64>(workers_.size());
+  output["pending"] = static_cast<Json::UInt64>(pending_.size());
+  output["running"] = static_cast<Json::UInt64>(running_);
+}
+
+//------------------------------------------------------------------------------
+// journal replay
+//------------------------------------------------------------------------------
+
+void import_queue::replay() {
+  std::vector<Json::Value> jobs;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(folder_, ec)) {
+    std::string path = entry.path().string();
+    if (entry.path().extension() == ".tmp") {
+      // interrupted journal update, the previous version is still valid:
+      onis::util::filesystem::delete_file(path);
+      continue;
+    }
+    if (entry.path().extension() != ".job")
+      continue;
+    std::ifstream file(path);
+    Json::Value job;
+    Json::Reader reader;
+    if (!file.is_open() || !reader.parse(file, job) || !job.isObject()) {
+      std::cerr << "import_queue: Invalid journal: " << path << std::endl;
+      continue;
+    }
+    // an interrupted job is imported again, after the files committed by its
+    // previous run (recorded in its progress after each batch):
+    std::string state = job["state"].asString();
+    if (state == kQueued || state == kRunning) {
+      job["state"] = kQueued;
+      jobs.push_back(job);
+    }
+  }
+
+  std::sort(jobs.begin(), jobs.end(),
+            [](const Json::Value& a, const Json::Value& b) {
+              return a["created"].asInt64() < b["created"].asInt64();
+            });
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& job : jobs) {
+    jobs_[job["id"].asString()] = job;
+    pending_.push_back(job["id"].asString());
+  }
+  if (!jobs.empty())
+    std::cout << "import_queue: " << jobs.size()
+              << " import job(s) resumed from the journal" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+// workers
+//------------------------------------------------------------------------------
+
+void import_queue::worker() {
+  std::int64_t last_purge = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    // first pending job whose retry delay has elapsed:
+    std::int64_t now = get_current_time();
+    auto it = std::find_if(pending_.begin(), pending_.end(),
+                           [&](const std::string& id) {
+                             return jobs_[id]["retry_at"].asInt64() <= now;
+                           });
+    if (it == pending_.end()) {
+      if (now - last_purge >= kPurgeInterval) {
+        last_purge = now;
+        lock.unlock();
+        purge_expired_jobs();
+        lock.lock();
+        continue;
+      }
+      cv_.wait_for(lock, std::chrono::seconds(1));
+      continue;
+    }
+    std::string id = *it;
+    pending_.erase(it);
+    running_++;
+    lock.unlock();
+    run_job(id);
+    lock.lock();
+    running_--;
+  }
+}
+
+void import_queue::run_job(const std::string& id) {
+  Json::Value job;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value& item = jobs_[id];
+    item["state"] = kRunning;
+    item["attempts"] = item["attempts"].asUInt() + 1;
+    item["started"] = static_cast<Json::Int64>(get_current_time());
+    item.removeMember("retry_at");
+    job = item;
+  }
+  write_journal(job);
+
+  Json::Value result(Json::objectValue);
+  Json::Value error(Json::objectValue);
+  try {
+    handler_(
+        job, [&](const Json::Value& progress) { set_progress(id, progress); },
+        result);
+  } catch (const onis::exception& e) {
+    error["status"] = e.get_code();
+    error["message"] = e.what();
+  } catch (const std::exception& e) {
+    error["status"] = EOS_UNKNOWN;
+    error["message"] = e.what();
+  } catch (...) {
+    error["status"] = EOS_UNKNOWN;
+    error["message"] = "Unknown error";
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  // a job tried again resumes after the files committed by this attempt:
+  const Json::Value& progress = jobs_[id]["progress"];
+  if (!progress.isNull())
+    job["progress"] = progress;
+  bool requeue = false;
+  if (error.empty()) {
+    job["state"] = kCompleted;
+    job["result"] = result;
+    job.removeMember("error");
+    completed_++;
+  } else if (stopping_) {
+    // interrupted by the shutdown, not counted as an attempt:
+    job["state"] = kQueued;
+    job["attempts"] = job["attempts"].asUInt() - 1;
+    requeue = true;
+  } else if (job["attempts"].asUInt() < max_attempts_) {
+    job["state"] = kQueued;
+    job["error"] = error;
+    job["retry_at"] = static_cast<Json::Int64>(
+        get_current_time() + kRetryDelay * job["attempts"].asInt64());
+    requeue = true;
+    retried_++;
+  } else {
+    job["state"] = kFailed;
+    job["error"] = error;
+    failed_++;
+  }
+  if (!requeue)
+    job["finished"] = static_cast<Json::Int64>(get_current_time());
+  lock.unlock();
+
+  write_journal(job);
+  if (job["state"].asString() == kFailed)
+    delete_spooled_files(job);
+
+  lock.lock();
+  if (requeue) {
+    jobs_[id] = job;
+    if (!stopping_)
+      pending_.push_back(id);
+  } else {
+    jobs_.erase(id);
+  }
+}
+
+void import_queue::set_progress(const std::string& id,
+                                const Json::Value& progress) {
+  Json::Value job;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end())
+      return;
+    it->second["progress"] = progress;
+    job = it->second;
+  }
+  write_journal(job);
+}
+
+void import_queue::delete_spooled_files(const Json::Value& job) {
+  for (const auto& file : job["files"]) {
+    std::string path = file["path"].asString();
+    if (!path.empty() && onis::util::filesystem::exist_file(path))
+      onis::util::filesystem::delete_file(path);
+  }
+}
+
+void import_queue::purge_expired_jobs() {
+  std::int64_t limit = get_current_time() - retention_;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(folder_, ec)) {
+    if (entry.path().extension() != ".job")
+      continue;
+    std::ifstream file(entry.path());
+    Json::Value job;
+    Json::Reader reader;
+    if (!file.is_open() || !reader.parse(file, job))
+      continue;
+    file.close();
+    if (job.isMember("finished") && job["finished"].asInt64() <= limit)
+      delete_journal(job["id"].asString());
+  }
+}
+
+//------------------------------------------------------------------------------
+// journal
+//------------------------------------------------------------------------------
+
+bool import_queue::write_journal(const Json::Value& job) const {
+  // the journal is written aside, flushed to the disk and renamed, so that a
+  // crash never leaves a truncated job behind, and the rename is flushed
+  // before the job is acknowledged:
+  std::string path = get_journal_path(job["id"].asString());
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    file << Json::writeString(builder, job);
+    file.flush();
+    if (!file.good())
+      return false;
+  }
+  if (!onis::util::filesystem::sync_file(tmp_path))
+    return false;
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  return !ec && onis::util::filesystem::sync_directory(folder_);
+}
+
+void import_queue::delete_journal(const std::string& id) const {
+  onis::util::filesystem::delete_file(get_journal_path(id));
+}
+
+std::string import_queue::get_journal_path(const std::string& id) const {
+  std::string path = folder_;
+  onis::util::filesystem::concat(path, id + ".job");
+  return path;
+}
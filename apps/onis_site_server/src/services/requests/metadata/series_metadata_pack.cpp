@@ -0,0 +1,180 @@
+#include "../../../../include/services/requests/metadata/series_metadata_pack.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+static const char kPackMagic[8] = {'O', 'N', 'I', 'S', 'M', 'D', '0', '2'};
+
+// The values of these VRs are bulk data:
+static bool is_bulk_vr(const std::string& vr) {
+  return vr == "OB" || vr == "OW" || vr == "OF" || vr == "OD" || vr == "OL" ||
+         vr == "OV" || vr == "UN";
+}
+
+static void write_varint(std::vector<char>& output, std::uint64_t value) {
+  while (value >= 0x80) {
+    output.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  output.push_back(static_cast<char>(value));
+}
+
+static void write_string(std::vector<char>& output, const std::string& value) {
+  write_varint(output, value.size());
+  output.insert(output.end(), value.begin(), value.end());
+}
+
+static void write_u32(std::vector<char>& output, std::uint32_t value) {
+  for (std::int32_t shift = 0; shift < 32; shift += 8)
+    output.push_back(static_cast<char>((value >> shift) & 0xFF));
+}
+
+static void write_element(std::vector<char>& output,
+                          const series_metadata_pack::element& item) {
+  write_u32(output, item.tag);
+  char vr[2] = {' ', ' '};
+  std::memcpy(vr, item.vr.data(), std::min<std::size_t>(item.vr.size(), 2));
+  output.insert(output.end(), vr, vr + 2);
+  write_varint(output, item.vm);
+  write_string(output, item.value);
+}
+
+static void write_region(std::vector<char>& output,
+                         const series_metadata_pack::region& item) {
+  write_u32(output, static_cast<std::uint32_t>(item.spatial_format));
+  write_u32(output, static_cast<std::uint32_t>(item.data_type));
+  for (std::int32_t value : item.area)
+    write_u32(output, static_cast<std::uint32_t>(value));
+  for (std::int32_t value : item.units)
+    write_u32(output, static_cast<std::uint32_t>(value));
+  for (double value : item.spacing) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    write_u32(output, static_cast<std::uint32_t>(bits & 0xFFFFFFFF));
+    write_u32(output, static_cast<std::uint32_t>(bits >> 32));
+  }
+}
+
+static bool is_same_element(const series_metadata_pack::element& a,
+                            const series_metadata_pack::element& b) {
+  return a.tag == b.tag && a.vm == b.vm && a.vr == b.vr && a.value == b.value;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// series_metadata_pack class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// elements
+//------------------------------------------------------------------------------
+
+void series_metadata_pack::read_elements(const onis::dicom_file_ptr& dcm,
+                                         std::vector<element>& output) {
+  output.clear();
+  if (dcm == nullptr)
+    return;
+  dcm->lock();
+  std::string charset;
+  dcm->get_string_element(charset, TAG_SPECIFIC_CHARACTER_SET, "CS", "");
+  std::int32_t tag;
+  std::string vr;
+  std::int32_t vm;
+  for (std::int32_t i = 0; i < 2; i++) {
+    void* elem = dcm->get_next_element(i, nullptr, &tag, &vr, &vm);
+    while (elem != nullptr) {
+      std::uint16_t parts[2];
+      std::memcpy(parts, &tag, sizeof(parts));
+      element item;
+      item.tag = (static_cast<std::uint32_t>(parts[1]) << 16) | parts[0];
+      if (parts[1] != 0x7FE0 && parts[1] != 0xFFFE && !is_bulk_vr(vr)) {
+        item.vr = vr;
+        item.vm = static_cast<std::uint32_t>(std::max(vm, 0));
+        dcm->get_string_from_element(item.value, elem, charset);
+        output.push_back(std::move(item));
+      }
+      elem = dcm->get_next_element(i, elem, &tag, &vr, &vm);
+    }
+  }
+  dcm->unlock();
+  std::stable_sort(output.begin(), output.end(),
+                   [](const element& a, const element& b) {
+                     return a.tag < b.tag;
+                   });
+}
+
+void series_metadata_pack::read_regions(const onis::dicom_file_ptr& dcm,
+                                        std::vector<region>& output) {
+  output.clear();
+  if (dcm == nullptr)
+    return;
+  onis::frame_region_list regions;
+  dcm->lock();
+  dcm->get_regions(regions);
+  dcm->unlock();
+  for (const auto& item : regions) {
+    region& value = output.emplace_back();
+    value.spatial_format = item->spatial_format;
+    value.data_type = item->data_type;
+    value.area[0] = item->x0;
+    value.area[1] = item->x1;
+    value.area[2] = item->y0;
+    value.area[3] = item->y1;
+    value.units[0] = item->original_unit[0];
+    value.units[1] = item->original_unit[1];
+    value.spacing[0] = item->original_spacing[0];
+    value.spacing[1] = item->original_spacing[1];
+  }
+}
+
+//------------------------------------------------------------------------------
+// encoding
+//------------------------------------------------------------------------------
+
+void series_metadata_pack::encode(const std::vector<instance>& instances,
+                                  std::vector<char>& output) {
+  // the common elements are those of the first image found with the same
+  // value in all the others:
+  std::map<std::uint32_t, std::pair<const element*, std::size_t>> candidates;
+  if (!instances.empty()) {
+    for (const auto& item : instances[0].elements)
+      candidates[item.tag] = {&item, 1};
+    for (std::size_t i = 1; i < instances.size(); i++) {
+      for (const auto& item : instances[i].elements) {
+        auto it = candidates.find(item.tag);
+        if (it != candidates.end() && is_same_element(*it->second.first, item))
+          it->second.second++;
+      }
+    }
+  }
+  std::vector<const element*> common;
+  for (const auto& [tag, candidate] : candidates) {
+    if (candidate.second == instances.size())
+      common.push_back(candidate.first);
+  }
+
+  output.clear();
+  output.insert(output.end(), kPackMagic, kPackMagic + sizeof(kPackMagic));
+  write_varint(output, instances.size());
+  write_varint(output, common.size());
+  for (const element* item : common)
+    write_element(output, *item);
+
+  for (const auto& image : instances) {
+    write_string(output, image.seq);
+    std::vector<const element*> own;
+    std::size_t next = 0;
+    for (const auto& item : image.elements) {
+      while (next < common.size() && common[next]->tag < item.tag)
+        next++;
+      if (next < common.size() && common[next]->tag == item.tag)
+        continue;
+      own.push_back(&item);
+    }
+    write_varint(output, own.size());
+    for (const element* item : own)
+      write_element(output, *item);
+    write_varint(output, image.regions.size());
+    for (const auto& item : image.regions)
+      write_region(output, item);
+  }
+}
@@ -0,0 +1,250 @@
+#include "../../../../include/services/requests/packing/series_container.hpp"
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+static const std::array<char, 8> kMagic{{'O', 'N', 'I', 'S', 'P', 'K', '0',
+                                         '1'}};
+static const std::array<char, 8> kIndexMagic{{'O', 'N', 'I', 'S', 'P', 'K',
+                                              'I', 'X'}};
+// index offset, count, previous size and magic:
+static const std::uint64_t kTrailerSize = 8 + 4 + 8 + 8;
+// size of the blocks copied at once:
+static const std::size_t kCopyBlockSize = 1024 * 1024;
+
+//------------------------------------------------------------------------------
+// little endian integers
+//------------------------------------------------------------------------------
+
+static void write_le(std::ostream& output, std::uint64_t value,
+                     std::size_t bytes) {
+  std::array<char, 8> buffer;
+  for (std::size_t i = 0; i < bytes; i++)
+    buffer[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+  output.write(buffer.data(), static_cast<std::streamsize>(bytes));
+}
+
+static bool read_le(std::istream& input, std::size_t bytes,
+                    std::uint64_t& value) {
+  std::array<unsigned char, 8> buffer;
+  if (!input.read(reinterpret_cast<char*>(buffer.data()),
+                  static_cast<std::streamsize>(bytes)))
+    return false;
+  value = 0;
+  for (std::size_t i = bytes; i > 0; i--)
+    value = (value << 8) | buffer[i - 1];
+  return true;
+}
+
+//------------------------------------------------------------------------------
+// trailer
+//------------------------------------------------------------------------------
+
+struct container_trailer {
+  std::uint64_t index_offset{0};
+  std::uint64_t count{0};
+  std::uint64_t previous_size{0};
+};
+
+// Read the trailer of the append ending at "end":
+static bool read_trailer(std::istream& input, std::uint64_t end,
+                         container_trailer& trailer) {
+  if (end < kMagic.size() + kTrailerSize)
+    return false;
+  std::array<char, 8> magic;
+  input.clear();
+  if (!input.seekg(static_cast<std::streamoff>(end - kTrailerSize)) ||
+      !read_le(input, 8, trailer.index_offset) ||
+      !read_le(input, 4, trailer.count) ||
+      !read_le(input, 8, trailer.previous_size) ||
+      !input.read(magic.data(), static_cast<std::streamsize>(magic.size())) ||
+      magic != kIndexMagic)
+    return false;
+  return trailer.index_offset >= kMagic.size() &&
+         trailer.index_offset <= end - kTrailerSize &&
+         trailer.previous_size <= trailer.index_offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// series_container class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// name
+//------------------------------------------------------------------------------
+
+std::string series_container::create_name() {
+  return "SR_" + onis::util::uuid::generate_random_uuid() + ".pack";
+}
+
+//------------------------------------------------------------------------------
+// append
+//------------------------------------------------------------------------------
+
+bool series_container::append(const std::string& path,
+                              std::vector<entry>& entries,
+                              std::uint64_t& previous_size) {
+  previous_size = 0;
+  if (entries.empty() ||
+      entries.size() > std::numeric_limits<std::uint32_t>::max())
+    return false;
+
+  std::error_code ec;
+  std::fstream file;
+  if (std::filesystem::exists(path, ec)) {
+    previous_size = std::filesystem::file_size(path, ec);
+    if (ec)
+      return false;
+    file.open(path, std::ios::in | std::ios::out | std::ios::binary);
+    container_trailer trailer;
+    if (!file.is_open() || !read_trailer(file, previous_size, trailer))
+      return false;
+    file.clear();
+    file.seekp(static_cast<std::streamoff>(previous_size));
+  } else {
+    file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+      return false;
+    file.write(kMagic.data(), static_cast<std::streamsize>(kMagic.size()));
+  }
+
+  // the files:
+  std::uint64_t position = previous_size ? previous_size : kMagic.size();
+  std::vector<char> buffer(kCopyBlockSize);
+  bool stored = static_cast<bool>(file);
+  for (auto& item : entries) {
+    if (!stored)
+      break;
+    std::ifstream input(item.source, std::ios::binary);
+    if (!input) {
+      stored = false;
+      break;
+    }
+    item.offset = position;
+    while (input) {
+      input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      std::streamsize count = input.gcount();
+      if (count <= 0)
+        break;
+      if (!file.write(buffer.data(), count)) {
+        stored = false;
+        break;
+      }
+      position += static_cast<std::uint64_t>(count);
+    }
+    stored = stored && input.eof();
+    item.size = position - item.offset;
+  }
+
+  // their index, and the trailer:
+  if (stored) {
+    std::uint64_t index_offset = position;
+    for (const auto& item : entries) {
+      write_le(file, item.seq.size(), 2);
+      file.write(item.seq.data(),
+                 static_cast<std::streamsize>(item.seq.size()));
+      write_le(file, item.offset, 8);
+      write_le(file, item.size, 8);
+    }
+    write_le(file, index_offset, 8);
+    write_le(file, entries.size(), 4);
+    write_le(file, previous_size, 8);
+    file.write(kIndexMagic.data(),
+               static_cast<std::streamsize>(kIndexMagic.size()));
+    file.flush();
+    stored = static_cast<bool>(file);
+  }
+  file.close();
+  if (!stored || file.fail()) {
+    discard(path, previous_size);
+    return false;
+  }
+  return true;
+}
+
+void series_container::discard(const std::string& path,
+                               std::uint64_t previous_size) {
+  if (previous_size == 0) {
+    onis::util::filesystem::delete_file(path);
+    return;
+  }
+  std::error_code ec;
+  std::filesystem::resize_file(path, previous_size, ec);
+}
+
+//------------------------------------------------------------------------------
+// reading
+//------------------------------------------------------------------------------
+
+bool series_container::is_valid(const std::string& path) {
+  std::error_code ec;
+  std::uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  std::ifstream file(path, std::ios::binary);
+  container_trailer trailer;
+  return file.is_open() && read_trailer(file, size, trailer);
+}
+
+bool series_container::read_index(const std::string& path,
+                                  std::vector<entry>& entries) {
+  std::error_code ec;
+  std::uint64_t end = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+    return false;
+
+  // the appends are read from the last one:
+  while (end > 0) {
+    container_trailer trailer;
+    if (!read_trailer(file, end, trailer))
+      return false;
+    file.clear();
+    file.seekg(static_cast<std::streamoff>(trailer.index_offset));
+    for (std::uint64_t i = 0; i < trailer.count; i++) {
+      entry item;
+      std::uint64_t length = 0;
+      if (!read_le(file, 2, length))
+        return false;
+      item.seq.resize(static_cast<std::size_t>(length));
+      if (!file.read(item.seq.data(), static_cast<std::streamsize>(length)) ||
+          !read_le(file, 8, item.offset) || !read_le(file, 8, item.size) ||
+          item.offset < trailer.previous_size ||
+          item.offset + item.size > trailer.index_offset)
+        return false;
+      entries.push_back(std::move(item));
+    }
+    end = trailer.previous_size;
+  }
+  return true;
+}
+
+bool series_container::extract(const std::string& path, std::uint64_t offset,
+                               std::uint64_t size,
+                               const std::string& destination) {
+  std::ifstream input(path, std::ios::binary);
+  if (!input || !input.seekg(static_cast<std::streamoff>(offset)))
+    return false;
+  std::ofstream output(destination, std::ios::binary | std::ios::trunc);
+  if (!output)
+    return false;
+  std::vector<char> buffer(kCopyBlockSize);
+  while (size > 0) {
+    std::size_t length = static_cast<std::size_t>(
+        std::min<std::uint64_t>(size, buffer.size()));
+    if (!input.read(buffer.data(), static_cast<std::streamsize>(length)) ||
+        !output.write(buffer.data(), static_cast<std::streamsize>(length))) {
+      output.close();
+      onis::util::filesystem::delete_file(destination);
+      return false;
+    }
+    size -= length;
+  }
+  return true;
+}
@@ -0,0 +1,158 @@
+#include "../../../../include/services/requests/packing/series_packer.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+////////////////////////////////////////////////////////////////////////////////
+// series_packer class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+series_packer_ptr series_packer::create(bool enabled,
+                                        std::chrono::seconds interval,
+                                        std::size_t batch_size) {
+  return std::make_shared<series_packer>(enabled, interval, batch_size);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+series_packer::series_packer(bool enabled, std::chrono::seconds interval,
+                             std::size_t batch_size)
+    : enabled_(enabled),
+      interval_(std::max(interval, std::chrono::seconds(1))),
+      batch_size_(static_cast<std::int32_t>(
+          std::clamp<std::size_t>(batch_size, 1, 10000))) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+series_packer::~series_packer() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void series_packer::start(const scan_fn& scan, const pack_fn& pack) {
+  if (!enabled_)
+    return;
+  scan_ = scan;
+  pack_ = pack;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  worker_ = std::thread(&series_packer::worker, this);
+}
+
+void series_packer::stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker.swap(worker_);
+  }
+  cv_.notify_all();
+  if (worker.get_id() == std::this_thread::get_id())
+    worker.detach();
+  else if (worker.joinable())
+    worker.join();
+}
+
+//------------------------------------------------------------------------------
+// packing
+//------------------------------------------------------------------------------
+
+bool series_packer::is_enabled() const {
+  return enabled_;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void series_packer::get_statistics(Json::Value& output) const {
+  output["enabled"] = enabled_;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    output["running"] = worker_.joinable();
+  }
+  output["packed"] = static_cast<Json::UInt64>(packed_);
+  output["skipped"] = static_cast<Json::UInt64>(skipped_);
+  output["failed"] = static_cast<Json::UInt64>(failed_);
+  output["errors"] = static_cast<Json::UInt64>(errors_);
+  output["files"] = static_cast<Json::Int64>(files_);
+  output["bytes"] = static_cast<Json::Int64>(bytes_);
+}
+
+//------------------------------------------------------------------------------
+// worker
+//------------------------------------------------------------------------------
+
+void series_packer::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    lock.unlock();
+    pack_all();
+    lock.lock();
+    cv_.wait_for(lock, interval_, [this] { return stopping_; });
+  }
+}
+
+void series_packer::pack_all() {
+  std::string cursor;
+  do {
+    std::vector<std::string> seqs;
+    try {
+      cursor = scan_(cursor, batch_size_, seqs);
+    } catch (const std::exception& e) {
+      errors_++;
+      std::cerr << "series_packer: Failed to read the series to pack: "
+                << e.what() << std::endl;
+      return;
+    } catch (...) {
+      errors_++;
+      std::cerr << "series_packer: Failed to read the series to pack"
+                << std::endl;
+      return;
+    }
+
+    for (const auto& seq : seqs) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_)
+          return;
+      }
+      std::int64_t files = 0;
+      std::int64_t bytes = 0;
+      try {
+        switch (pack_(seq, files, bytes)) {
+          case result::packed:
+            packed_++;
+            break;
+          case result::skipped:
+            skipped_++;
+            break;
+          case result::failed:
+            failed_++;
+            break;
+        }
+      } catch (const std::exception& e) {
+        errors_++;
+        std::cerr << "series_packer: Failed to pack the series " << seq << ": "
+                  << e.what() << std::endl;
+      } catch (...) {
+        errors_++;
+        std::cerr << "series_packer: Failed to pack the series " << seq
+                  << std::endl;
+      }
+      files_ += files;
+      bytes_ += bytes;
+    }
+  } while (!cursor.empty());
+}
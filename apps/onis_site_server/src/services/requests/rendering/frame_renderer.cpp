@@ -0,0 +1,84 @@
+#include "../../../../include/services/requests/rendering/frame_renderer.hpp"
+#include <algorithm>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// frame_renderer class
+////////////////////////////////////////////////////////////////////////////////
+
+onis::core::bitmap_ptr frame_renderer::render(
+    const onis::dicom_frame_ptr& frame, std::uint32_t size) {
+  onis::core::bitmap_ptr image = frame->create_bitmap(24);
+  if (image == nullptr)
+    return nullptr;
+  std::size_t width = image->get_width();
+  std::size_t height = image->get_height();
+  if (width == 0 || height == 0)
+    return nullptr;
+
+  std::size_t largest = std::max(width, height);
+  std::size_t target =
+      std::max<std::size_t>(std::min<std::size_t>(size, largest), 1);
+  if (target == largest)
+    return image;
+  return reduce(image, std::max<std::size_t>(width * target / largest, 1),
+                std::max<std::size_t>(height * target / largest, 1));
+}
+
+onis::core::bitmap_ptr frame_renderer::reduce(
+    const onis::core::bitmap_ptr& image, std::size_t width,
+    std::size_t height) {
+  std::size_t source_width = image->get_width();
+  std::size_t source_height = image->get_height();
+  if (image->get_pixel_format() != onis::core::PixelFormat::Rgb24 ||
+      width == 0 || height == 0 || width > source_width ||
+      height > source_height)
+    return nullptr;
+  onis::core::bitmap_ptr result = onis::core::bitmap::create(
+      width, height, onis::core::PixelFormat::Rgb24);
+  if (result == nullptr)
+    return nullptr;
+
+  // the columns covered by each pixel are the same on every row:
+  std::vector<std::size_t> columns(width + 1);
+  for (std::size_t x = 0; x <= width; x++)
+    columns[x] = x * source_width / width;
+
+  image->lock_bits();
+  result->lock_bits();
+  const std::uint8_t* source = image->get_bytes();
+  std::size_t source_stride = image->get_bytes_per_row();
+  std::uint8_t* dest = result->get_bytes();
+  std::size_t dest_stride = result->get_bytes_per_row();
+  bool ok = source != nullptr && dest != nullptr;
+  std::vector<std::uint32_t> sums(width * 3);
+  for (std::size_t y = 0; ok && y < height; y++) {
+    std::size_t y0 = y * source_height / height;
+    std::size_t y1 = std::max((y + 1) * source_height / height, y0 + 1);
+    std::fill(sums.begin(), sums.end(), 0);
+    for (std::size_t sy = y0; sy < y1; sy++) {
+      const std::uint8_t* row = source + sy * source_stride;
+      for (std::size_t x = 0; x < width; x++) {
+        std::uint32_t* sum = &sums[x * 3];
+        std::size_t x1 = std::max(columns[x + 1], columns[x] + 1);
+        for (std::size_t sx = columns[x]; sx < x1; sx++) {
+          sum[0] += row[sx * 3];
+          sum[1] += row[sx * 3 + 1];
+          sum[2] += row[sx * 3 + 2];
+        }
+      }
+    }
+    std::uint8_t* line = dest + y * dest_stride;
+    for (std::size_t x = 0; x < width; x++) {
+      std::size_t x1 = std::max(columns[x + 1], columns[x] + 1);
+      std::uint32_t pixel_count =
+          static_cast<std::uint32_t>((y1 - y0) * (x1 - columns[x]));
+      for (std::size_t c = 0; c < 3; c++)
+        line[x * 3 + c] =
+            static_cast<std::uint8_t>(sums[x * 3 + c] / pixel_count);
+    }
+  }
+  result->unlock_bits();
+  image->unlock_bits();
+  return ok ? result : nullptr;
+}
@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/check/directory_scanner.hpp"
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/site_api.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+// number of rows read at once:
+static const std::int32_t kPageSize = 10000;
+// number of files imported again between two progress updates:
+static const std::size_t kRebuildChunkSize = 1000;
+// number of folders listed between two progress updates:
+static const std::uint64_t kScanProgressInterval = 256;
+
+// the files of an image, by kind of file:
+static const char* const kFileKinds[] = {"image", "stream", "icon"};
+static const char* const kFileMediaKeys[] = {
+    IM_IMAGE_MEDIA_KEY, IM_STREAM_MEDIA_KEY, IM_ICON_MEDIA_KEY};
+static const char* const kFilePathKeys[] = {
+    IM_IMAGE_PATH_KEY, IM_STREAM_PATH_KEY, IM_ICON_PATH_KEY};
+
+// the levels of the counters, see site_database::get_counter_mismatches:
+static const char* const kCounterLevels[] = {"patient", "study", "series"};
+
+// the files found in the folder of the partition on a media, and whether
+// they are referenced:
+struct media_files {
+  std::string folder;
+  bool available{false};
+  std::unordered_map<std::string, bool> files;
+};
+
+// a file that no row refers to:
+struct orphan_file {
+  std::int32_t media{-1};
+  std::string path;
+  std::string type;
+  std::string sop;
+};
+
+// The type of an orphan file, by its name: the derived objects and the
+// containers are recognized, the other files are read as DICOM files.
+static std::string get_orphan_type(const std::string& path) {
+  std::string name = std::filesystem::path(path).filename().string();
+  auto has = [&](const char* prefix, const char* extension) {
+    std::string ext = extension;
+    return name.rfind(prefix, 0) == 0 && name.size() >= ext.size() &&
+           name.compare(name.size() - ext.size(), ext.size(), ext) == 0;
+  };
+  if (has("IC_", ".png"))
+    return "icon";
+  if (has("ST_", ".j2k"))
+    return "stream";
+  if (has("SR_", ".pack"))
+    return "container";
+  return "dicom";
+}
+
+// Mark a file as referenced, returns false if it was not found:
+static bool set_referenced(std::map<std::int32_t, media_files>& media,
+                           std::int32_t num, const std::string& path) {
+  auto it = media.find(num);
+  if (it == media.end())
+    return false;
+  auto file = it->second.files.find(path);
+  if (file == it->second.files.end())
+    return false;
+  file->second = true;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_check_archive_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_check_archive_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  onis::database::item::verify_string_value(req->input_json, "source", false,
+                                            false);
+  std::string source_id = req->input_json["source"].asString();
+  {
+    request_database db(this);
+    verify_partition_access_permission(db, req->session, source_id, nullptr,
+                                       0, onis::database::lock_mode::NO_LOCK);
+  }
+
+  // the missing rows are only rebuilt, and the counters fixed, on request:
+  Json::Value input(Json::objectValue);
+  input["rebuild"] = req->input_json.get("rebuild", false).asBool();
+  input["fix_counters"] = req->input_json.get("fix_counters", false).asBool();
+  Json::Value job;
+  archive_checker_->submit(source_id, input, job);
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+        output["job"] = job;
+      });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_get_archive_check_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_get_archive_check_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  onis::database::item::verify_string_value(req->input_json, "id", false,
+                                            false);
+  Json::Value job;
+  if (!archive_checker_->find_job(req->input_json["id"].asString(), job))
+    throw onis::exception(EOS_NOT_FOUND, "Archive check not found");
+
+  // the check is visible to the sessions allowed to access its partition:
+  {
+    request_database db(this);
+    verify_partition_access_permission(db, req->session,
+                                       job["source"].asString(), nullptr, 0,
+                                       onis::database::lock_mode::NO_LOCK);
+  }
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+        output["job"] = job;
+      });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// check_archive
+////////////////////////////////////////////////////////////////////////////////
+
+// Compare the media folders of a partition with its rows. The folder of the
+// partition is scanned on each media of its volume, then the files the rows
+// refer to are read page by page:
+// - the files referenced but not found are "missing" (when "rebuild" is set,
+//   the missing stream files and icons are created again),
+// - the files found but not referenced, and older than the minimum age (the
+//   imports in progress write their files before their rows), are "orphans".
+//   Their header is read (without their pixel data): the DICOM files whose
+//   sop is not in the partition are "unindexed", and imported again when
+//   "rebuild" is set. The copies of images already indexed are "duplicates",
+//   they are only reported.
+// - the counters that differ from the rows they count are reported, and
+//   fixed when "fix_counters" is set.
+// Only "max_reported" items of each kind are detailed.
+void request_service::check_archive(
+    const Json::Value& job, const archive_checker::progress_fn& progress,
+    Json::Value& output) {
+  auto started = std::chrono::steady_clock::now();
+  // the permission was verified when the job was submitted:
+  request_database db(this);
+  std::string source_id = job["source"].asString();
+  bool rebuild = job["rebuild"].asBool();
+  bool fix_counters = job["fix_counters"].asBool();
+  Json::Value partition(Json::objectValue);
+  verify_partition_access_permission(
+      db, nullptr, source_id, &partition,
+      onis::database::info_partition_volume |
+          onis::database::info_partition_parameters,
+      onis::database::lock_mode::NO_LOCK);
+  std::string volume_seq = partition[PT_VOLUME_KEY].asString();
+  std::size_t threads = archive_checker_->get_threads();
+  Json::ArrayIndex max_reported = config_->get_archive_check_max_reported();
+  auto update_progress = [&](const char* phase, Json::Value status) {
+    status["phase"] = phase;
+    if (!progress(status))
+      throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+  };
+
+  // the files of the partition on each media:
+  std::map<std::int32_t, media_files> media;
+  std::uint64_t scanned = 0;
+  Json::Value& media_output = output["media"];
+  media_output = Json::Value(Json::arrayValue);
+  request_coalescer::value_ptr media_list =
+      load_volume_media_list(volume_seq, db);
+  for (const auto& item : *media_list) {
+    std::int32_t num = item[ME_NUM_KEY].asInt();
+    media_files& files = media[num];
+    files.folder = item[ME_PATH_KEY].asString();
+    files.available = onis::util::filesystem::exist_directory(files.folder);
+    Json::Value& info = media_output.append(Json::objectValue);
+    info["media"] = num;
+    info["available"] = files.available;
+    std::string root = files.folder;
+    onis::util::filesystem::concat(root, source_id);
+    if (!files.available || !onis::util::filesystem::exist_directory(root))
+      continue;
+
+    std::vector<std::vector<std::string>> found(threads);
+    std::atomic<std::uint64_t> listed{0};
+    directory_scanner::statistics stats;
+    bool completed = directory_scanner::scan(
+        files.folder, source_id, threads,
+        [&](std::size_t worker, const std::string& path) {
+          if (!onis::util::filesystem::has_tmp_extension(path))
+            found[worker].push_back(path);
+        },
+        [&]() {
+          std::uint64_t count = ++listed;
+          if (count % kScanProgressInterval != 0)
+            return false;
+          Json::Value status(Json::objectValue);
+          status["phase"] = "scan";
+          status["media"] = num;
+          status["folders"] = static_cast<Json::UInt64>(count);
+          return !progress(status);
+        },
+        stats);
+    if (!completed)
+      throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+
+    std::size_t count = 0;
+    for (const auto& list : found)
+      count += list.size();
+    files.files.reserve(count);
+    for (auto& list : found) {
+      for (auto& path : list)
+        files.files.emplace(std::move(path), false);
+      list.clear();
+    }
+    info["folders"] = static_cast<Json::UInt64>(stats.folders);
+    info["files"] = static_cast<Json::UInt64>(files.files.size());
+    info["errors"] = static_cast<Json::UInt64>(stats.errors);
+    scanned += files.files.size();
+  }
+  auto scan_time = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started);
+
+  // the files the images refer to. A file not found by the scan is checked
+  // again, it may have been created since (by a migration or a packing), or
+  // be stored in the folder of another partition (a shared content):
+  std::unordered_set<std::string> sops;
+  std::uint64_t image_count = 0;
+  std::uint64_t unverified = 0;
+  std::uint64_t missing_count[3] = {0, 0, 0};
+  std::uint64_t reset = 0;
+  Json::Value missing_items(Json::arrayValue);
+  std::string cursor;
+  do {
+    Json::Value page(Json::arrayValue);
+    cursor = db->get_check_images(source_id, cursor, kPageSize, page);
+    for (const auto& image : page) {
+      image_count++;
+      sops.insert(image[IM_UID_KEY].asString());
+      for (std::int32_t kind = 0; kind < 3; kind++) {
+        std::int32_t num = image[kFileMediaKeys[kind]].asInt();
+        std::string path = image[kFilePathKeys[kind]].asString();
+        if (num < 0 || path.empty() || set_referenced(media, num, path))
+          continue;
+        auto it = media.find(num);
+        if (it == media.end() || !it->second.available) {
+          unverified++;
+          continue;
+        }
+        std::string full_path = it->second.folder;
+        onis::util::filesystem::concat(full_path, path);
+        if (onis::util::filesystem::exist_file(full_path))
+          continue;
+        missing_count[kind]++;
+        std::string seq = image[BASE_SEQ_KEY].asString();
+        bool reset_object =
+            rebuild && kind > 0 &&
+            db->reset_derived_object(seq, kind, num, path);
+        if (reset_object)
+          reset++;
+        if (missing_items.size() < max_reported) {
+          Json::Value& item = missing_items.append(Json::objectValue);
+          item[BASE_SEQ_KEY] = seq;
+          item["kind"] = kFileKinds[kind];
+          item["media"] = num;
+          item["path"] = path;
+          if (reset_object)
+            item["reset"] = true;
+        }
+      }
+    }
+    Json::Value status(Json::objectValue);
+    status["images"] = static_cast<Json::UInt64>(image_count);
+    update_progress("images", status);
+  } while (!cursor.empty());
+
+  // the icons of the series, and the contents of the volume (the ones waiting
+  // to be collected included), are not orphans:
+  do {
+    Json::Value page(Json::arrayValue);
+    cursor = db->get_check_series_icons(source_id, cursor, kPageSize, page);
+    for (const auto& icon : page)
+      set_referenced(media, icon["media"].asInt(), icon["path"].asString());
+  } while (!cursor.empty());
+  do {
+    Json::Value page(Json::arrayValue);
+    cursor = db->get_check_contents(volume_seq, cursor, kPageSize, page);
+    for (const auto& content : page)
+      set_referenced(media, content["media"].asInt(),
+                     content["path"].asString());
+  } while (!cursor.empty());
+
+  // the orphan files old enough:
+  std::chrono::seconds min_age(config_->get_archive_check_min_file_age());
+  auto min_time = std::filesystem::file_time_type::clock::now() - min_age;
+  std::vector<orphan_file> orphans;
+  std::uint64_t recent = 0;
+  for (auto& [num, files] : media) {
+    for (const auto& [path, referenced] : files.files) {
+      if (referenced)
+        continue;
+      std::string full_path = files.folder;
+      onis::util::filesystem::concat(full_path, path);
+      std::error_code ec;
+      auto time = std::filesystem::last_write_time(full_path, ec);
+      if (ec)
+        continue;
+      if (time > min_time) {
+        recent++;
+        continue;
+      }
+      orphans.push_back({num, path, get_orphan_type(path), ""});
+    }
+    files.files.clear();
+  }
+
+  // their header is read in parallel:
+  {
+    Json::Value status(Json::objectValue);
+    status["orphans"] = static_cast<Json::UInt64>(orphans.size());
+    update_progress("orphans", status);
+  }
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  std::atomic<std::size_t> next{0};
+  auto read_headers = [&]() {
+    for (std::size_t i = next++; i < orphans.size(); i = next++) {
+      orphan_file& orphan = orphans[i];
+      if (orphan.type != "dicom")
+        continue;
+      std::string full_path = media.at(orphan.media).folder;
+      onis::util::filesystem::concat(full_path, orphan.path);
+      try {
+        onis::dicom_file_ptr dcm =
+            manager != nullptr ? manager->create_dicom_file() : nullptr;
+        if (dcm == nullptr || !dcm->load_file_metadata(full_path) ||
+            !dcm->get_string_element(orphan.sop, TAG_SOP_INSTANCE_UID, "UI"))
+          orphan.sop.clear();
+      } catch (...) {
+        orphan.sop.clear();
+      }
+      if (orphan.sop.empty())
+        orphan.type = "unreadable";
+      else
+        orphan.type = sops.count(orphan.sop) ? "duplicate" : "unindexed";
+    }
+  };
+  std::vector<std::thread> readers;
+  for (std::size_t i = 1; i < std::min(threads, orphans.size()); i++)
+    readers.emplace_back(read_headers);
+  read_headers();
+  for (auto& th : readers)
+    th.join();
+  sops.clear();
+
+  std::map<std::string, std::uint64_t> orphan_count;
+  Json::Value orphan_items(Json::arrayValue);
+  for (const auto& orphan : orphans) {
+    orphan_count[orphan.type]++;
+    if (orphan_items.size() < max_reported) {
+      Json::Value& item = orphan_items.append(Json::objectValue);
+      item["media"] = orphan.media;
+      item["path"] = orphan.path;
+      item["type"] = orphan.type;
+      if (!orphan.sop.empty())
+        item["sop"] = orphan.sop;
+    }
+  }
+
+  // the unindexed files are imported again, in the folders of their series
+  // on the current media (renamed when they already are on it). The files
+  // that were copied are deleted once imported:
+  Json::Value rebuilt(Json::objectValue);
+  rebuilt["total"] = 0;
+  rebuilt["imported"] = 0;
+  rebuilt["failed"] = 0;
+  rebuilt["errors"] = Json::Value(Json::arrayValue);
+  if (rebuild && orphan_count["unindexed"] > 0) {
+    std::int32_t current_media = -1;
+    std::string folder = get_current_media_folder(
+        onis::database::media_for_images, volume_seq, &current_media, db);
+    if (folder.empty())
+      throw onis::exception(EOS_MEDIA, "No media to import the files");
+    std::map<std::int32_t, std::vector<const orphan_file*>> unindexed;
+    for (const auto& orphan : orphans) {
+      if (orphan.type == "unindexed")
+        unindexed[orphan.media].push_back(&orphan);
+    }
+    for (const auto& [num, list] : unindexed) {
+      bool staged = num == current_media;
+      for (std::size_t first = 0; first < list.size();
+           first += kRebuildChunkSize) {
+        std::size_t last = std::min(first + kRebuildChunkSize, list.size());
+        std::vector<std::string> paths;
+        for (std::size_t i = first; i < last; i++) {
+          paths.push_back(media.at(num).folder);
+          onis::util::filesystem::concat(paths.back(), list[i]->path);
+        }
+        Json::Value results(Json::arrayValue);
+        import_dicom_files(db, source_id, partition, current_media, folder,
+                           paths, staged, nullptr, results);
+        for (Json::ArrayIndex i = 0; i < results.size(); i++) {
+          rebuilt["total"] = rebuilt["total"].asUInt() + 1;
+          if (results[i]["status"].asInt() == EOS_NONE) {
+            rebuilt["imported"] = rebuilt["imported"].asUInt() + 1;
+            if (onis::util::filesystem::exist_file(paths[i]))
+              onis::util::filesystem::delete_file(paths[i]);
+            continue;
+          }
+          rebuilt["failed"] = rebuilt["failed"].asUInt() + 1;
+          Json::Value& errors = rebuilt["errors"];
+          if (errors.size() < max_reported) {
+            Json::Value& error = errors.append(Json::objectValue);
+            error["media"] = num;
+            error["path"] = list[first + i]->path;
+            error["status"] = results[i]["status"];
+            error["message"] = results[i].get("message", "");
+          }
+        }
+        Json::Value status(Json::objectValue);
+        status["imported"] = rebuilt["imported"];
+        status["failed"] = rebuilt["failed"];
+        update_progress("rebuild", status);
+      }
+    }
+  }
+
+  // the counters (the rows imported again are counted by their deltas):
+  std::uint64_t mismatch_count = 0;
+  std::uint64_t fixed = 0;
+  Json::Value counter_items(Json::arrayValue);
+  for (const char* level : kCounterLevels) {
+    do {
+      Json::Value page(Json::arrayValue);
+      cursor = db->get_counter_mismatches(level, source_id, cursor, kPageSize,
+                                          page);
+      for (auto& item : page) {
+        mismatch_count++;
+        if (fix_counters &&
+            db->fix_counters(level, item[BASE_SEQ_KEY].asString())) {
+          fixed++;
+          item["fixed"] = true;
+        }
+        if (counter_items.size() < max_reported)
+          counter_items.append(item);
+      }
+      Json::Value status(Json::objectValue);
+      status["level"] = level;
+      status["mismatches"] = static_cast<Json::UInt64>(mismatch_count);
+      update_progress("counters", status);
+    } while (!cursor.empty());
+  }
+
+  // the report:
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started);
+  output["files"] = static_cast<Json::UInt64>(scanned);
+  output["scan_ms"] = static_cast<Json::Int64>(scan_time.count());
+  output["files_per_second"] = static_cast<Json::UInt64>(
+      scanned * 1000 / std::max<std::int64_t>(scan_time.count(), 1));
+  output["images"] = static_cast<Json::UInt64>(image_count);
+  output["unverified"] = static_cast<Json::UInt64>(unverified);
+
+  Json::Value& missing = output["missing"];
+  missing["images"] = static_cast<Json::UInt64>(missing_count[0]);
+  missing["streams"] = static_cast<Json::UInt64>(missing_count[1]);
+  missing["icons"] = static_cast<Json::UInt64>(missing_count[2]);
+  missing["reset"] = static_cast<Json::UInt64>(reset);
+  missing["items"] = missing_items;
+
+  Json::Value& orphan_output = output["orphans"];
+  orphan_output["total"] = static_cast<Json::UInt64>(orphans.size());
+  orphan_output["recent"] = static_cast<Json::UInt64>(recent);
+  for (const char* type : {"unindexed", "duplicate", "unreadable", "icon",
+                           "stream", "container"})
+    orphan_output[type] = static_cast<Json::UInt64>(orphan_count[type]);
+  orphan_output["items"] = orphan_items;
+
+  output["rebuild"] = rebuilt;
+
+  Json::Value& counters = output["counters"];
+  counters["mismatches"] = static_cast<Json::UInt64>(mismatch_count);
+  counters["fixed"] = static_cast<Json::UInt64>(fixed);
+  counters["items"] = counter_items;
+  output["duration_ms"] = static_cast<Json::Int64>(elapsed.count());
+}
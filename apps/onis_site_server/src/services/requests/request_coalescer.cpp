@@ -0,0 +1,95 @@
+#include "../../../include/services/requests/request_coalescer.hpp"
+#include <openssl/evp.h>
+#include <cstdio>
+
+////////////////////////////////////////////////////////////////////////////////
+// request_coalescer class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+request_coalescer_ptr request_coalescer::create(
+    std::chrono::milliseconds ttl) {
+  return std::make_shared<request_coalescer>(ttl);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+request_coalescer::request_coalescer(std::chrono::milliseconds ttl)
+    : ttl_(ttl) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+request_coalescer::~request_coalescer() {}
+
+//------------------------------------------------------------------------------
+// canonical request key
+//------------------------------------------------------------------------------
+
+std::string request_coalescer::make_key(const std::string& operation,
+                                        const Json::Value& params) {
+  // JsonCpp keeps object members sorted, so the compact serialization is
+  // canonical: two requests with the same parameters produce the same text.
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  std::string text = operation + "\n" + Json::writeString(builder, params);
+
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int length = 0;
+  if (!EVP_Digest(text.data(), text.size(), digest, &length, EVP_sha256(),
+                  nullptr))
+    return text;
+
+  std::string key = operation + ":";
+  char buf[3];
+  for (unsigned int i = 0; i < length; i++) {
+    snprintf(buf, sizeof(buf), "%02x", digest[i]);
+    key += buf;
+  }
+  return key;
+}
+
+//------------------------------------------------------------------------------
+// invalidation
+//------------------------------------------------------------------------------
+
+void request_coalescer::invalidate(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // an in-flight entry is only detached: its current waiters still get the
+  // leader result, but new callers will start a fresh read.
+  flights_.erase(key);
+}
+
+void request_coalescer::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  flights_.clear();
+}
+
+void request_coalescer::purge_expired(
+    std::chrono::steady_clock::time_point now) {
+  auto it = flights_.begin();
+  while (it != flights_.end()) {
+    if (it->second->done && it->second->expires <= now)
+      it = flights_.erase(it);
+    else
+      ++it;
+  }
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+std::uint64_t request_coalescer::get_leader_count() const {
+  return leader_count_;
+}
+
+std::uint64_t request_coalescer::get_shared_count() const {
+  return shared_count_;
+}
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// collect_contents
+////////////////////////////////////////////////////////////////////////////////
+
+// Remove the contents no longer referenced by any image. Their files are
+// deleted once their removal is committed: until then, an import may still
+// reference them again.
+std::size_t request_service::collect_contents(std::int32_t limit) {
+  request_database db(this);
+  std::vector<Json::Value> contents;
+  std::size_t count = 0;
+  db->begin_transaction();
+  try {
+    count = db->collect_contents(limit, contents);
+    db->commit();
+  } catch (...) {
+    try {
+      db->rollback();
+    } catch (...) {
+    }
+    throw;
+  }
+
+  for (const auto& content : contents) {
+    std::string path =
+        get_media_folder(onis::database::media_for_images,
+                         content[PT_VOLUME_KEY].asString(),
+                         content["media"].asInt(), db);
+    if (path.empty()) {
+      std::cerr << "collect_contents: Media not available, the file "
+                << content["path"].asString() << " was not deleted"
+                << std::endl;
+      continue;
+    }
+    onis::util::filesystem::concat(path, content["path"].asString());
+    hot_file_cache_->invalidate(path);
+    onis::util::filesystem::delete_file(path);
+  }
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// measure_contents
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::measure_contents(Json::Value& output) {
+  request_database db(this);
+  db->get_content_statistics(output);
+}
@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <vector>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/database/items/db_series.hpp"
+#include "../../../include/services/requests/packing/series_container.hpp"
+#include "../../../include/services/requests/rendering/frame_renderer.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/site_api.hpp"
+#include "onis_j2k_kit.hpp"
+#include "onis_kit/include/core/bitmap.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+// the viewer reads up to 6 resolutions, the encoder produces 6 at most:
+static const std::int32_t kMaxStreamResolutions = 6;
+// compression ratio added by each quality layer above the lossless one:
+static const float kLayerRateStep = 20.0f;
+// bins of the histograms of the pixel statistics:
+static const std::size_t kMinHistogramBins = 16;
+static const std::size_t kMaxHistogramBins = 4096;
+
+////////////////////////////////////////////////////////////////////////////////
+// Stream files
+////////////////////////////////////////////////////////////////////////////////
+//
+// A stream file is the progressive J2K codestream of the first frame of an
+// image, after a header read by the viewer before the codestream: the count
+// of resolutions and of layers, the width and height of each resolution,
+// and for each of them the length of the codestream needed to decode it. All
+// the values are 32 bits little endian integers.
+
+static void write_stream_value(std::ofstream& file, std::uint32_t value) {
+  std::uint8_t bytes[4] = {static_cast<std::uint8_t>(value),
+                           static_cast<std::uint8_t>(value >> 8),
+                           static_cast<std::uint8_t>(value >> 16),
+                           static_cast<std::uint8_t>(value >> 24)};
+  file.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+static bool write_stream_file(const onis::dicom_frame_ptr& frame,
+                              std::int32_t resolutions, std::int32_t layers,
+                              const std::string& path) {
+  std::size_t width = 0;
+  std::size_t height = 0;
+  bool signed_data = false;
+  std::int32_t bits = frame->get_representation(&signed_data);
+  std::size_t count = 0;
+  const void* pixels = frame->get_intermediate_pixel_data(&count);
+  if (pixels == nullptr || !frame->get_dimensions(&width, &height) ||
+      width == 0 || height == 0 || (bits != 8 && bits != 16 && bits != 32))
+    return false;
+
+  os_j2k_encoder_input input;
+  std::memset(&input, 0, sizeof(input));
+  input.columns = static_cast<std::uint32_t>(width);
+  input.rows = static_cast<std::uint32_t>(height);
+  input.bits_allocated = static_cast<std::uint8_t>(bits);
+  input.bits_used = static_cast<std::uint8_t>(bits);
+  input.signed_data = signed_data;
+  input.progression_order = 1;
+  input.resolution_count = static_cast<std::uint8_t>(resolutions);
+  input.layer_count = static_cast<std::uint8_t>(layers);
+  for (std::int32_t i = 0; i < layers; i++)
+    input.layer_qualities[i] = (layers - 1 - i) * kLayerRateStep;
+
+  // the color frames are held as one plane per component:
+  std::vector<std::uint8_t> planes;
+  if (frame->is_monochrome()) {
+    input.sample_per_pixels = 1;
+    input.data = static_cast<std::uint8_t*>(const_cast<void*>(pixels));
+  } else {
+    std::size_t plane_size = width * height * (bits / 8);
+    const void* const* sources = static_cast<const void* const*>(pixels);
+    planes.resize(plane_size * 3);
+    for (std::size_t i = 0; i < 3; i++)
+      std::memcpy(&planes[i * plane_size], sources[i], plane_size);
+    input.sample_per_pixels = 3;
+    input.pc = 1;
+    input.data = planes.data();
+  }
+
+  std::unique_ptr<os_j2k_encoder_output> output(
+      os_create_j2k_streaming_data(&input));
+  if (output == nullptr || output->data == nullptr ||
+      output->resolution_layer_offsets == nullptr ||
+      output->dimensions == nullptr)
+    return false;
+
+  std::vector<std::uint8_t> codestream(
+      static_cast<std::size_t>(output->data->get_data_length()));
+  if (!codestream.empty() &&
+      output->data->read(codestream.data(), codestream.size()) !=
+          static_cast<std::int64_t>(codestream.size()))
+    return false;
+
+  // the file is written aside, and renamed once complete:
+  std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file)
+      return false;
+    write_stream_value(file, output->resolution_count);
+    write_stream_value(file, output->layer_count);
+    for (std::int32_t i = 0; i < output->resolution_count * 2; i++)
+      write_stream_value(file, output->dimensions[i]);
+    for (std::int32_t i = 0;
+         i < output->resolution_count * output->layer_count; i++)
+      write_stream_value(file, output->resolution_layer_offsets[i]);
+    file.write(reinterpret_cast<const char*>(codestream.data()),
+               static_cast<std::streamsize>(codestream.size()));
+    if (!file) {
+      file.close();
+      onis::util::filesystem::delete_file(tmp_path);
+      return false;
+    }
+  }
+  return onis::util::filesystem::move_file(tmp_path, path);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Icons
+////////////////////////////////////////////////////////////////////////////////
+
+// Render the frame with its window level, reduced to fit in a square of
+// "size" pixels:
+static bool write_icon_file(const onis::dicom_frame_ptr& frame,
+                            std::uint32_t size, const std::string& path) {
+  onis::core::bitmap_ptr icon = frame_renderer::render(frame, size);
+  if (icon == nullptr)
+    return false;
+
+  std::string tmp_path = path + ".tmp";
+  if (!icon->save_file(tmp_path, onis::core::BitmapType::Png))
+    return false;
+  return onis::util::filesystem::move_file(tmp_path, path);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Pixel statistics
+////////////////////////////////////////////////////////////////////////////////
+//
+// The statistics of an image describe the modality values (the rescale slope
+// and intercept applied) of its first frame, so that a viewer can window it
+// before decoding it: their range, the count of pixels, their histogram in
+// bins of equal width over the range, and windows framing percentile ranges
+// of the pixels, the first one being the suggested window. Those of a series
+// merge the histograms of its images. Only the monochrome images have them.
+
+// the percentile ranges of the windows, the first one being suggested:
+static const double kWindowPercentiles[][2] = {
+    {1.0, 99.0}, {5.0, 95.0}, {0.5, 99.5}};
+// the 8 and 16 bits values are counted one by one before being binned:
+static const std::int64_t kMaxValueCounts = 65536;
+
+static std::size_t get_histogram_bin(double value, double min, double max,
+                                     std::size_t bins) {
+  if (max <= min)
+    return 0;
+  double position = (value - min) / (max - min) * static_cast<double>(bins);
+  return std::min(static_cast<std::size_t>(std::max(position, 0.0)),
+                  bins - 1);
+}
+
+// Record the histogram, and the windows found from it:
+static void set_histogram(double min, double max, std::uint64_t count,
+                          const std::vector<std::uint64_t>& bins,
+                          Json::Value& output) {
+  output["min"] = min;
+  output["max"] = max;
+  output["count"] = static_cast<Json::UInt64>(count);
+  Json::Value& values = output["bins"] = Json::Value(Json::arrayValue);
+  for (std::uint64_t value : bins)
+    values.append(static_cast<Json::UInt64>(value));
+
+  double step = (max - min) / static_cast<double>(bins.size());
+  Json::Value& windows = output["windows"] = Json::Value(Json::arrayValue);
+  for (const auto& percentiles : kWindowPercentiles) {
+    double limits[2] = {percentiles[0] * count / 100.0,
+                        percentiles[1] * count / 100.0};
+    std::size_t found[2] = {bins.size() - 1, bins.size() - 1};
+    std::uint64_t total = 0;
+    for (std::size_t i = 0, j = 0; i < bins.size() && j < 2; i++) {
+      total += bins[i];
+      while (j < 2 && static_cast<double>(total) >= limits[j])
+        found[j++] = i;
+    }
+    double low = min + found[0] * step;
+    double high = min + (found[1] + 1) * step;
+    Json::Value& window = windows.append(Json::objectValue);
+    window["low"] = percentiles[0];
+    window["high"] = percentiles[1];
+    window["center"] = (low + high) / 2.0;
+    window["width"] = high > low ? high - low : 1.0;
+  }
+}
+
+template <typename T>
+static void compute_histogram(const T* pixels, std::size_t count,
+                              double slope, double intercept,
+                              std::size_t bin_count, Json::Value& output) {
+  T raw_min = pixels[0];
+  T raw_max = pixels[0];
+  for (std::size_t i = 1; i < count; i++) {
+    if (pixels[i] < raw_min)
+      raw_min = pixels[i];
+    else if (pixels[i] > raw_max)
+      raw_max = pixels[i];
+  }
+  double min = raw_min * slope + intercept;
+  double max = raw_max * slope + intercept;
+  if (min > max)
+    std::swap(min, max);
+
+  std::vector<std::uint64_t> bins(bin_count, 0);
+  std::int64_t range = static_cast<std::int64_t>(raw_max) - raw_min;
+  if (range < kMaxValueCounts) {
+    std::vector<std::uint64_t> counts(static_cast<std::size_t>(range) + 1, 0);
+    for (std::size_t i = 0; i < count; i++)
+      counts[static_cast<std::size_t>(pixels[i] - raw_min)]++;
+    for (std::size_t i = 0; i < counts.size(); i++) {
+      if (counts[i] != 0)
+        bins[get_histogram_bin((raw_min + static_cast<double>(i)) * slope +
+                                   intercept,
+                               min, max, bin_count)] += counts[i];
+    }
+  } else {
+    for (std::size_t i = 0; i < count; i++)
+      bins[get_histogram_bin(pixels[i] * slope + intercept, min, max,
+                             bin_count)]++;
+  }
+  set_histogram(min, max, count, bins, output);
+}
+
+// Compute the statistics of the frame, returns false if it has none:
+static bool compute_pixel_statistics(const onis::dicom_frame_ptr& frame,
+                                     std::size_t bins, Json::Value& output) {
+  std::size_t width = 0;
+  std::size_t height = 0;
+  bool signed_data = false;
+  std::int32_t bits = frame->get_representation(&signed_data);
+  const void* pixels = frame->get_intermediate_pixel_data(nullptr);
+  if (!frame->is_monochrome() || pixels == nullptr ||
+      !frame->get_dimensions(&width, &height) || width == 0 || height == 0)
+    return false;
+  double slope = 1.0;
+  double intercept = 0.0;
+  if (!frame->get_rescale_and_intercept(&slope, &intercept) || slope == 0.0) {
+    slope = 1.0;
+    intercept = 0.0;
+  }
+
+  std::size_t count = width * height;
+  if (bits == 8 && signed_data)
+    compute_histogram(static_cast<const std::int8_t*>(pixels), count, slope,
+                      intercept, bins, output);
+  else if (bits == 8)
+    compute_histogram(static_cast<const std::uint8_t*>(pixels), count, slope,
+                      intercept, bins, output);
+  else if (bits == 16 && signed_data)
+    compute_histogram(static_cast<const std::int16_t*>(pixels), count, slope,
+                      intercept, bins, output);
+  else if (bits == 16)
+    compute_histogram(static_cast<const std::uint16_t*>(pixels), count, slope,
+                      intercept, bins, output);
+  else if (bits == 32 && signed_data)
+    compute_histogram(static_cast<const std::int32_t*>(pixels), count, slope,
+                      intercept, bins, output);
+  else if (bits == 32)
+    compute_histogram(static_cast<const std::uint32_t*>(pixels), count, slope,
+                      intercept, bins, output);
+  else
+    return false;
+  return true;
+}
+
+// Add the histogram of "statistics" to "bins", spread over [min, max], each
+// of its bins going to the one its center falls in:
+static void add_histogram(const Json::Value& statistics, double min,
+                          double max, std::vector<std::uint64_t>& bins) {
+  const Json::Value& values = statistics["bins"];
+  double source_min = statistics["min"].asDouble();
+  double step = (statistics["max"].asDouble() - source_min) /
+                std::max<double>(values.size(), 1.0);
+  for (Json::ArrayIndex i = 0; i < values.size(); i++)
+    bins[get_histogram_bin(source_min + (i + 0.5) * step, min, max,
+                           bins.size())] += values[i].asUInt64();
+}
+
+// Merge the statistics of an image with those of its series:
+static void merge_pixel_statistics(const Json::Value& image, std::size_t bins,
+                                   Json::Value& series) {
+  if (!series.isObject() || !series["bins"].isArray()) {
+    series = image;
+    series["images"] = 1;
+    return;
+  }
+  double min = std::min(series["min"].asDouble(), image["min"].asDouble());
+  double max = std::max(series["max"].asDouble(), image["max"].asDouble());
+  std::vector<std::uint64_t> values(bins, 0);
+  add_histogram(series, min, max, values);
+  add_histogram(image, min, max, values);
+  std::uint64_t count =
+      series["count"].asUInt64() + image["count"].asUInt64();
+  Json::UInt images = series["images"].asUInt() + 1;
+  set_histogram(min, max, count, values, series);
+  series["images"] = images;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// get_pending_derived_images
+////////////////////////////////////////////////////////////////////////////////
+
+std::string request_service::get_pending_derived_images(
+    const std::string& after_seq, std::int32_t limit,
+    std::vector<std::string>& seqs) {
+  request_database db(this);
+  return db->get_pending_derived_images(
+      after_seq, limit, config_->is_pixel_statistics_enabled(), seqs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// generate_derived_objects
+////////////////////////////////////////////////////////////////////////////////
+
+// Create the stream file, the icon and the pixel statistics of an image when
+// they are pending. The files are written next to the image file, on the
+// current media of the volume, and recorded with -1 when the image cannot be
+// rendered (the statistics being recorded empty). Throws when the media or
+// the database is not available, the image then stays pending.
+std::size_t request_service::generate_derived_objects(const std::string& seq) {
+  request_database db(this);
+  Json::Value source(Json::objectValue);
+  if (!db->find_derived_image_source(seq, source))
+    return 0;
+  bool create_stream = source[IM_STREAM_MEDIA_KEY].asInt() == -2;
+  bool create_icon = source[IM_ICON_MEDIA_KEY].asInt() == -2;
+  bool create_statistics = source["pending_statistics"].asBool() &&
+                           config_->is_pixel_statistics_enabled();
+  if (!create_stream && !create_icon && !create_statistics)
+    return 0;
+
+  std::string volume_seq = source[PT_VOLUME_KEY].asString();
+  std::string image_path = get_media_folder(
+      onis::database::media_for_images, volume_seq,
+      source[IM_IMAGE_MEDIA_KEY].asInt(), db);
+  if (image_path.empty())
+    throw onis::exception(EOS_MEDIA, "Media not available");
+  std::string relative_path = source[IM_IMAGE_PATH_KEY].asString();
+  onis::util::filesystem::concat(image_path, relative_path);
+
+  std::int32_t media = -1;
+  std::string relative_dir =
+      onis::util::filesystem::get_directory(relative_path);
+  std::string dir;
+  if (create_stream || create_icon) {
+    std::string folder = get_current_media_folder(
+        onis::database::media_for_images, volume_seq, &media, db);
+    if (folder.empty())
+      throw onis::exception(EOS_MEDIA,
+                            "No media to store the derived objects");
+    dir = folder;
+    onis::util::filesystem::concat(dir, relative_dir);
+    if (!directory_cache_->create_directories(dir))
+      throw onis::exception(EOS_FILE_WRITE, "Failed to create the directory");
+  }
+
+  // a packed image is read from a copy of its range of the container:
+  std::string packed_copy;
+  if (source.isMember(IM_PACK_SIZE_KEY)) {
+    packed_copy =
+        (std::filesystem::temp_directory_path() / ("IM_" + seq + ".dcm.tmp"))
+            .string();
+    if (!series_container::extract(image_path,
+                                   source[IM_PACK_OFFSET_KEY].asUInt64(),
+                                   source[IM_PACK_SIZE_KEY].asUInt64(),
+                                   packed_copy))
+      throw onis::exception(EOS_FILE_READ, "Failed to read the container");
+    image_path = packed_copy;
+  }
+
+  // an image that cannot be loaded or rendered will never be:
+  onis::dicom_frame_ptr frame;
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  onis::dicom_file_ptr dcm =
+      manager != nullptr ? manager->create_dicom_file() : nullptr;
+  if (dcm != nullptr && dcm->load_file(image_path))
+    frame = dcm->extract_frame(0);
+  if (!packed_copy.empty())
+    onis::util::filesystem::delete_file(packed_copy);
+  if (frame == nullptr)
+    std::cerr << "generate_derived_objects: Failed to load the image " << seq
+              << std::endl;
+
+  std::size_t created = 0;
+  if (create_stream) {
+    std::string name = "ST_" + seq + ".j2k";
+    std::string path = dir;
+    onis::util::filesystem::concat(path, name);
+    std::int32_t resolutions = std::clamp<std::int32_t>(
+        config_->get_derived_stream_resolutions(), 1, kMaxStreamResolutions);
+    std::int32_t layers = std::clamp<std::int32_t>(
+        config_->get_derived_stream_layers(), 1, 100);
+    bool ok = frame != nullptr &&
+              write_stream_file(frame, resolutions, layers, path);
+    std::string stream_path;
+    if (ok) {
+      stream_path = relative_dir;
+      onis::util::filesystem::concat(stream_path, name);
+      created++;
+    }
+    db->set_image_stream(seq, ok ? media : -1, stream_path);
+  }
+
+  if (create_icon) {
+    std::string name = "IC_" + seq + ".png";
+    std::string path = dir;
+    onis::util::filesystem::concat(path, name);
+    bool ok = frame != nullptr &&
+              write_icon_file(frame, config_->get_derived_icon_size(), path);
+    std::string icon_path;
+    if (ok) {
+      icon_path = relative_dir;
+      onis::util::filesystem::concat(icon_path, name);
+      created++;
+    }
+    db->set_image_icon(seq, ok ? media : -1, icon_path);
+    if (ok && source["series"][SR_ICON_MEDIA_KEY].asInt() == -2)
+      db->set_series_icon(source["series"][BASE_SEQ_KEY].asString(), media,
+                          icon_path);
+  }
+
+  // the statistics of the series are merged under its lock, the images of a
+  // series being processed concurrently:
+  if (create_statistics) {
+    std::size_t bins = std::clamp<std::size_t>(
+        config_->get_pixel_histogram_bins(), kMinHistogramBins,
+        kMaxHistogramBins);
+    Json::Value statistics(Json::objectValue);
+    bool ok = frame != nullptr &&
+              compute_pixel_statistics(frame, bins, statistics);
+    std::string series_seq = source["series"][BASE_SEQ_KEY].asString();
+    db->begin_transaction();
+    try {
+      if (db->set_image_pixel_statistics(
+              seq, ok ? onis::database::json_to_string(statistics) : "") &&
+          ok) {
+        Json::Value series;
+        db->get_series_pixel_statistics(
+            series_seq, onis::database::lock_mode::EXCLUSIVE_LOCK, series);
+        merge_pixel_statistics(statistics, bins, series);
+        db->set_series_pixel_statistics(
+            series_seq, onis::database::json_to_string(series));
+        created++;
+      }
+      db->commit();
+    } catch (...) {
+      db->rollback();
+      throw;
+    }
+  }
+  return created;
+}
@@ -31,6 +31,7 @@ void request_service::process_download_images_request(
 
   // prepare the download items array:
   download_stream_ptr dstream = std::make_shared<download_stream>();
+  dstream->file_cache = hot_file_cache_;
   std::size_t dlitems_index = 0;
   std::size_t max_bytes = req->input_json["max_bytes"].asInt();
   std::size_t total_bytes = 0;
@@ -228,6 +229,20 @@ void request_service::process_download_images_request(
           }
           const std::size_t to_read =
               std::min(max_len - written, file_remaining);
+          if (dstream->current_buffer) {
+            // served from the hot file cache:
+            std::memcpy(out + written,
+                        dstream->current_buffer->data() + item->file_offset +
+                            dstream->phase_offset,
+                        to_read);
+            written += to_read;
+            dstream->phase_offset += to_read;
+            if (dstream->phase_offset >= item->file_size) {
+              dstream->current_buffer.reset();
+              dstream->on_data_written();
+            }
+            break;
+          }
           dstream->current_file.read(out + written,
                                      static_cast<std::streamsize>(to_read));
           const std::size_t read_count =
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/database/items/db_patient.hpp"
+#include "../../../include/database/items/db_series.hpp"
+#include "../../../include/database/items/db_study.hpp"
+#include "../../../include/services/requests/exporting/study_exporter.hpp"
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/site_api.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// most studies exported at once, and most items of each level of the
+// file-set (the file IDs are limited to 8 characters):
+static const Json::ArrayIndex kMaxExportedStudies = 256;
+static const std::size_t kMaxFileSetItems = 99999;
+
+// Numeric value of a string (the numbers of the series and images), the
+// items without one are sorted last:
+static long long read_number(const Json::Value& value) {
+  try {
+    return std::stoll(value.asString());
+  } catch (const std::exception&) {
+    return std::numeric_limits<long long>::max();
+  }
+}
+
+// The items of "items" in the order of their numbers "key":
+static std::vector<Json::ArrayIndex> sort_items(const Json::Value& items,
+                                                const char* key) {
+  std::vector<Json::ArrayIndex> order(items.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](Json::ArrayIndex a, Json::ArrayIndex b) {
+                     return read_number(items[a][key]) <
+                            read_number(items[b][key]);
+                   });
+  return order;
+}
+
+// File ID component of the item "index" of a level ("PAT00001"):
+static std::string get_file_id(const char* prefix, std::size_t index) {
+  if (index >= kMaxFileSetItems)
+    throw onis::exception(EOS_PARAM, "Too many items to export");
+  char id[16];
+  std::snprintf(id, sizeof(id), "%s%05zu", prefix, index + 1);
+  return id;
+}
+
+// Keep the characters of a file name that are safe in a header:
+static std::string get_archive_name(const Json::Value& input) {
+  std::string name;
+  if (input.isMember("name")) {
+    for (char c : input["name"].asString()) {
+      if (std::isalnum(static_cast<unsigned char>(c)) || c == '-' ||
+          c == '_' || c == '.')
+        name.push_back(c);
+    }
+  }
+  if (name.empty() || name.size() > 64)
+    name = "export";
+  return name + ".zip";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_export_studies_request
+////////////////////////////////////////////////////////////////////////////////
+
+// Stream the images of the studies as a ZIP archive, with their DICOMDIR
+// when "dicomdir" is set. The images can be transcoded ("transfer_syntax")
+// and de-identified ("deidentify", true or an object with the replacing
+// "patient_name" and "patient_id"). The archive is produced while it is
+// sent, by a study_exporter.
+void request_service::process_export_studies_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  const Json::Value& input = req->input_json;
+  onis::database::item::verify_array_value(input, "studies", false);
+  onis::database::item::verify_boolean_value(input, "dicomdir", true);
+  onis::database::item::verify_string_value(input, "transfer_syntax", true,
+                                            true, 64);
+  const Json::Value& studies = input["studies"];
+  if (studies.empty() || studies.size() > kMaxExportedStudies)
+    throw onis::exception(EOS_PARAM, "Invalid studies");
+  for (const auto& study : studies) {
+    if (!study.isString() || study.asString().empty())
+      throw onis::exception(EOS_PARAM, "Invalid studies");
+  }
+
+  study_exporter::options options;
+  options.dicomdir = input.isMember("dicomdir") && input["dicomdir"].asBool();
+  options.transfer_syntax = input.isMember("transfer_syntax")
+                                ? input["transfer_syntax"].asString()
+                                : "";
+  if (options.transfer_syntax.find_first_not_of("0123456789.") !=
+      std::string::npos)
+    throw onis::exception(EOS_PARAM, "Invalid transfer syntax");
+  std::string patient_name;
+  std::string patient_id;
+  if (input.isMember("deidentify")) {
+    const Json::Value& deidentify = input["deidentify"];
+    if (deidentify.isObject()) {
+      onis::database::item::verify_string_value(deidentify, "patient_name",
+                                                true, false, 64);
+      onis::database::item::verify_string_value(deidentify, "patient_id",
+                                                true, false, 64);
+      options.deidentify = true;
+      patient_name = deidentify.get("patient_name", "").asString();
+      patient_id = deidentify.get("patient_id", "").asString();
+    } else if (deidentify.isBool()) {
+      options.deidentify = deidentify.asBool();
+    } else {
+      throw onis::exception(EOS_PARAM, "Invalid deidentify");
+    }
+  }
+  options.readers = config_->get_export_readers();
+  options.max_buffered = config_->get_export_max_buffered();
+
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  if (manager == nullptr &&
+      (options.deidentify || !options.transfer_syntax.empty()))
+    throw onis::exception(EOS_NOT_AVAILABLE, "No dicom manager");
+
+  // each export holds its reader threads until the archive is sent:
+  if (running_exports_.fetch_add(1) >= config_->get_export_max_concurrent()) {
+    running_exports_--;
+    rejected_exports_++;
+    throw onis::exception(EOS_BUSY, "Too many exports in progress");
+  }
+  std::shared_ptr<void> slot(nullptr, [this](void*) { running_exports_--; });
+
+  // the file-set, a patient for each distinct patient of the studies:
+  std::vector<dicomdir_writer::patient_record> directory;
+  std::vector<study_exporter::entry> entries;
+  std::map<std::string, std::size_t> patients;
+  std::set<std::string> exported_studies;
+  {
+    request_database db(this);
+    for (const auto& study_seq : studies) {
+      if (!exported_studies.insert(study_seq.asString()).second)
+        continue;
+      Json::Value files(Json::objectValue);
+      db->find_export_images(study_seq.asString(), files);
+      verify_partition_access_permission(
+          db, req->session, files["partition"].asString(), nullptr, 0,
+          onis::database::lock_mode::NO_LOCK);
+      std::string volume_seq = files[PT_VOLUME_KEY].asString();
+
+      const Json::Value& patient = files["patient"];
+      std::string patient_key = patient[PA_UID_KEY].asString() + '\\' +
+                                patient[PA_NAME_KEY].asString();
+      auto found = patients.find(patient_key);
+      if (found == patients.end()) {
+        found = patients.emplace(patient_key, directory.size()).first;
+        dicomdir_writer::patient_record& record = directory.emplace_back();
+        if (options.deidentify) {
+          record.name = patient_name.empty() ? "ANONYMOUS" : patient_name;
+          record.id = patient_id;
+          if (record.id.empty()) {
+            // a random identifier for each patient of the export:
+            std::string uuid = onis::util::uuid::generate_random_uuid();
+            record.id = "ANON" + uuid.substr(0, 8);
+            std::transform(record.id.begin(), record.id.end(),
+                           record.id.begin(), ::toupper);
+          }
+        } else {
+          record.name = patient[PA_NAME_KEY].asString();
+          record.id = patient[PA_UID_KEY].asString();
+          record.birth_date = patient[PA_BDATE_KEY].asString();
+          record.sex = patient[PA_SEX_KEY].asString();
+        }
+      }
+      std::size_t patient_index = found->second;
+      dicomdir_writer::patient_record& patient_record =
+          directory[patient_index];
+      std::string patient_id_component = get_file_id("PAT", patient_index);
+      std::string study_id_component =
+          get_file_id("STU", patient_record.studies.size());
+
+      const Json::Value& study = files["study"];
+      dicomdir_writer::study_record& study_record =
+          patient_record.studies.emplace_back();
+      study_record.uid = study[ST_UID_KEY].asString();
+      study_record.date = study[ST_DATE_KEY].asString();
+      study_record.time = study[ST_TIME_KEY].asString();
+      study_record.id = study[ST_STUDYID_KEY].asString();
+      study_record.description = study[ST_DESC_KEY].asString();
+      if (!options.deidentify)
+        study_record.accession_number = study[ST_ACCNUM_KEY].asString();
+
+      const Json::Value& series_items = files["series"];
+      for (Json::ArrayIndex i : sort_items(series_items, SR_NUM_KEY)) {
+        const Json::Value& series = series_items[i];
+        std::string series_id_component =
+            get_file_id("SER", study_record.series.size());
+        dicomdir_writer::series_record& series_record =
+            study_record.series.emplace_back();
+        series_record.uid = series[SR_UID_KEY].asString();
+        series_record.modality = series[SR_MODALITY_KEY].asString();
+        series_record.number = series[SR_NUM_KEY].asString();
+
+        const Json::Value& images = series["images"];
+        for (Json::ArrayIndex j : sort_items(images, IM_INSTNUM_KEY)) {
+          const Json::Value& image = images[j];
+          std::string image_id_component =
+              get_file_id("IMG", series_record.images.size());
+          dicomdir_writer::image_record& image_record =
+              series_record.images.emplace_back();
+          image_record.file_id = "DICOM\\" + patient_id_component + '\\' +
+                                 study_id_component + '\\' +
+                                 series_id_component + '\\' +
+                                 image_id_component;
+          image_record.sop_class_uid = image[IM_SOPCLASS_KEY].asString();
+          image_record.sop_instance_uid = image[IM_UID_KEY].asString();
+          image_record.number = image[IM_INSTNUM_KEY].asString();
+
+          study_exporter::entry& item = entries.emplace_back();
+          item.name = image_record.file_id;
+          std::replace(item.name.begin(), item.name.end(), '\\', '/');
+          item.path =
+              get_media_folder(onis::database::media_for_images, volume_seq,
+                               image[IM_IMAGE_MEDIA_KEY].asInt(), db);
+          if (item.path.empty())
+            throw onis::exception(EOS_MEDIA, "Media not available");
+          onis::util::filesystem::concat(item.path,
+                                         image[IM_IMAGE_PATH_KEY].asString());
+          item.patient = patient_index;
+          if (image.isMember(IM_PACK_SIZE_KEY)) {
+            item.packed = true;
+            item.offset = image[IM_PACK_OFFSET_KEY].asUInt64();
+            item.size = image[IM_PACK_SIZE_KEY].asUInt64();
+          } else {
+            // a missing file is reported in the archive:
+            std::error_code ec;
+            item.size = std::filesystem::file_size(item.path, ec);
+            if (ec)
+              item.size = 0;
+          }
+        }
+      }
+    }
+  }
+
+  // the reading starts before the response, so that the first bytes are
+  // ready when it is sent:
+  study_exporter_ptr exporter = study_exporter::create(
+      options, manager, std::move(directory), std::move(entries));
+  exporter->start();
+  exports_++;
+  std::string filename = get_archive_name(input);
+  req->write_output([&](json& output, std::vector<std::uint8_t>& binary_output,
+                        request_data::stream_reader_fn& stream_reader) {
+    output["status"] = EOS_NONE;
+    output["filename"] = filename;
+    stream_reader = [exporter, slot](char* buffer, std::size_t size) {
+      return exporter->read(buffer, size);
+    };
+  });
+}
@@ -0,0 +1,42 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// release_files
+////////////////////////////////////////////////////////////////////////////////
+
+// Delete the replaced files whose date is passed (see
+// site_database::add_file_release). The files are deleted before their
+// records are removed: if the server stops meanwhile, they are released again
+// at the next start.
+std::size_t request_service::release_files(std::int32_t limit) {
+  request_database db(this);
+  std::vector<Json::Value> releases;
+  db->get_due_file_releases(limit, releases);
+
+  std::vector<std::string> seqs;
+  for (const auto& release : releases) {
+    seqs.push_back(release[BASE_SEQ_KEY].asString());
+    std::string path =
+        get_media_folder(onis::database::media_for_images,
+                         release[PT_VOLUME_KEY].asString(),
+                         release["media"].asInt(), db);
+    if (path.empty()) {
+      std::cerr << "release_files: Media not available, the file "
+                << release["path"].asString() << " was not deleted"
+                << std::endl;
+      continue;
+    }
+    onis::util::filesystem::concat(path, release["path"].asString());
+    hot_file_cache_->invalidate(path);
+    onis::util::filesystem::delete_file(path);
+  }
+  db->delete_file_releases(seqs);
+  return seqs.size();
+}
@@ -234,28 +234,54 @@ void request_service::process_find_studies_request(
             source_output["status"] = 0;
           } else {
             // Use real database
-            request_database db(this);
             const Json::Value& filters = req->input_json["filters"];
-            db->find_studies(source.seq, source.reject_empty_request,
-                             source.limit, filters, onis::database::info_all,
-                             onis::database::info_all, true,
-                             onis::database::lock_mode::NO_LOCK, studies);
-
+            bool with_series = false;
             if (req->input_json.isMember("with-series")) {
               onis::database::item::verify_boolean_value(req->input_json,
                                                          "with-series", false);
-              bool with_series = req->input_json["with-series"].asBool();
-              if (with_series) {
-                for (auto& study : studies) {
-                  Json::Value& series = study["series"] =
-                      Json::Value(Json::arrayValue);
-                  db->find_series(study["study"][BASE_SEQ_KEY].asString(),
-                                  onis::database::info_all, true,
-                                  onis::database::lock_mode::NO_LOCK, series);
-                }
-              }
+              with_series = req->input_json["with-series"].asBool();
             }
 
+            // identical searches running at the same time share one query:
+            Json::Value params(Json::objectValue);
+            params["source"] = source.seq;
+            params["reject_empty"] = source.reject_empty_request;
+            params["limit"] = source.limit;
+            params["filters"] = filters;
+            params["with_series"] = with_series;
+            std::string key =
+                request_coalescer::make_key("find_studies", params);
+            request_coalescer::value_ptr result =
+                read_coalescer_->run(key, [&](Json::Value& result) {
+                  request_database db(this);
+                  // the counters include the pending deltas, read again when
+                  // a round applied some of them in between:
+                  for (std::int32_t attempt = 0; attempt < 3; attempt++) {
+                    std::uint64_t generation =
+                        aggregate_updater_->get_generation();
+                    result = Json::Value(Json::arrayValue);
+                    db->find_studies(
+                        source.seq, source.reject_empty_request,
+                        source.limit, filters, onis::database::info_all,
+                        onis::database::info_all, true,
+                        onis::database::lock_mode::NO_LOCK, result);
+                    if (with_series) {
+                      for (auto& study : result) {
+                        Json::Value& series = study["series"] =
+                            Json::Value(Json::arrayValue);
+                        db->find_series(
+                            study["study"][BASE_SEQ_KEY].asString(),
+                            onis::database::info_all, true,
+                            onis::database::lock_mode::NO_LOCK, series);
+                      }
+                    }
+                    db->add_pending_counter_deltas(result);
+                    if (generation % 2 == 0 &&
+                        generation == aggregate_updater_->get_generation())
+                      break;
+                  }
+                });
+            studies = *result;
             source_output["status"] = 0;
           }
         } catch (request_exception& e) {
@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/packing/series_container.hpp"
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/site_api.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// The transfer syntaxes produced on retrieval, all lossless: implicit and
+// explicit VR little endian, JPEG lossless (process 14, selection value 1),
+// JPEG-LS lossless and JPEG 2000 lossless.
+static const char* const kTranscodeTargets[] = {
+    "1.2.840.10008.1.2", "1.2.840.10008.1.2.1", "1.2.840.10008.1.2.4.70",
+    "1.2.840.10008.1.2.4.80", "1.2.840.10008.1.2.4.90"};
+
+// Read the transfer syntaxes accepted by the client ("*" for any of them):
+static std::vector<std::string> read_transfer_syntaxes(
+    const Json::Value& input) {
+  std::vector<std::string> syntaxes;
+  if (!input.isMember("transfer_syntaxes"))
+    return syntaxes;
+  const Json::Value& items = input["transfer_syntaxes"];
+  if (!items.isArray())
+    throw onis::exception(EOS_PARAM, "Invalid transfer syntaxes");
+  for (const auto& item : items) {
+    if (!item.isString() || item.asString().empty() ||
+        item.asString().size() > 64)
+      throw onis::exception(EOS_PARAM, "Invalid transfer syntaxes");
+    syntaxes.push_back(item.asString());
+  }
+  return syntaxes;
+}
+
+// The first accepted transfer syntax that can be produced, or an empty
+// string when there is none:
+static std::string find_transcode_target(
+    const std::vector<std::string>& syntaxes) {
+  for (const auto& syntax : syntaxes) {
+    for (const char* target : kTranscodeTargets) {
+      if (syntax == target)
+        return syntax;
+    }
+  }
+  return "";
+}
+
+// Read the transfer syntax from the file meta information of the DICOM file
+// starting at "offset" of "path", without loading the dataset (the group
+// 0002 is always encoded in explicit VR little endian). Returns an empty
+// string when it cannot be found.
+static std::string read_transfer_syntax(const std::string& path,
+                                        std::uint64_t offset) {
+  std::ifstream file(path, std::ios::binary);
+  char header[132];
+  if (!file.seekg(static_cast<std::streamoff>(offset)) ||
+      !file.read(header, sizeof(header)) ||
+      std::memcmp(header + 128, "DICM", 4) != 0)
+    return "";
+  for (std::int32_t i = 0; i < 64; i++) {
+    unsigned char tag[8];
+    if (!file.read(reinterpret_cast<char*>(tag), sizeof(tag)))
+      return "";
+    std::uint16_t group = tag[0] | (tag[1] << 8);
+    std::uint16_t element = tag[2] | (tag[3] << 8);
+    if (group != 0x0002)
+      return "";
+    std::string vr(reinterpret_cast<char*>(tag + 4), 2);
+    std::uint32_t length = tag[6] | (tag[7] << 8);
+    if (vr == "OB" || vr == "OW" || vr == "OF" || vr == "OD" || vr == "OL" ||
+        vr == "OV" || vr == "SQ" || vr == "UC" || vr == "UR" || vr == "UT" ||
+        vr == "UN") {
+      unsigned char size[4];
+      if (!file.read(reinterpret_cast<char*>(size), sizeof(size)))
+        return "";
+      length = size[0] | (size[1] << 8) | (size[2] << 16) |
+               (static_cast<std::uint32_t>(size[3]) << 24);
+    }
+    if (element != 0x0010) {
+      if (length > 65536 || !file.seekg(length, std::ios::cur))
+        return "";
+      continue;
+    }
+    if (length > 64)
+      return "";
+    std::string value(length, '\0');
+    if (!file.read(value.data(), length))
+      return "";
+    while (!value.empty() && (value.back() == '\0' || value.back() == ' '))
+      value.pop_back();
+    return value;
+  }
+  return "";
+}
+
+// Write the DICOM file "path" (or the range of a packed image) to
+// "output_path" with the transfer syntax "transfer":
+static void transcode_image(const std::string& path,
+                            const Json::Value& location,
+                            const std::string& transfer,
+                            const std::string& output_path) {
+  // a packed image is read from a copy of its range of the container:
+  std::string image_path = path;
+  std::string packed_copy;
+  if (location.isMember(IM_PACK_SIZE_KEY)) {
+    packed_copy = (std::filesystem::temp_directory_path() /
+                   ("TC_" + onis::util::uuid::generate_random_uuid() +
+                    ".dcm.tmp"))
+                      .string();
+    if (!series_container::extract(path,
+                                   location[IM_PACK_OFFSET_KEY].asUInt64(),
+                                   location[IM_PACK_SIZE_KEY].asUInt64(),
+                                   packed_copy))
+      throw onis::exception(EOS_FILE_READ, "Failed to read the container");
+    image_path = packed_copy;
+  }
+
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  onis::dicom_file_ptr dcm =
+      manager != nullptr ? manager->create_dicom_file() : nullptr;
+  bool loaded = dcm != nullptr && dcm->load_file(image_path);
+  if (!packed_copy.empty())
+    onis::util::filesystem::delete_file(packed_copy);
+  if (!loaded)
+    throw onis::exception(EOS_FILE_READ, "Failed to load the image");
+  if (!dcm->save_file(output_path, transfer)) {
+    onis::util::filesystem::delete_file(output_path);
+    throw onis::exception(EOS_FILE_CONVERSION,
+                          "Failed to transcode the image to " + transfer);
+  }
+}
+
+// The transcoded files up to this size are sent from memory, the larger ones
+// are streamed:
+static const std::streamsize kMaxBufferedSize = 16 * 1024 * 1024;
+
+// Read a transcoded file in "output", or open it in "reader" when it is
+// large: it can then be deleted (evicted from the cache, or temporary)
+// before the response is sent. Returns false if it cannot be read.
+static bool open_transcoded_file(const std::string& path,
+                                 std::vector<std::uint8_t>& output,
+                                 request_data::stream_reader_fn& reader) {
+  auto file = std::make_shared<std::ifstream>(
+      path, std::ios::binary | std::ios::ate);
+  std::streamsize size =
+      file->is_open() ? std::streamsize(file->tellg()) : -1;
+  if (size <= 0 || !file->seekg(0))
+    return false;
+  if (size > kMaxBufferedSize) {
+    reader = [file](char* buffer, std::size_t length) -> std::size_t {
+      file->read(buffer, static_cast<std::streamsize>(length));
+      return static_cast<std::size_t>(file->gcount());
+    };
+    return true;
+  }
+  output.resize(static_cast<std::size_t>(size));
+  return static_cast<bool>(
+      file->read(reinterpret_cast<char*>(output.data()), size));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_get_image_file_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_get_image_file_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  onis::database::item::verify_string_value(req->input_json, "seq", false,
+                                            false);
+  std::string seq = req->input_json["seq"].asString();
+  std::vector<std::string> syntaxes = read_transfer_syntaxes(req->input_json);
+  bool any_syntax =
+      std::find(syntaxes.begin(), syntaxes.end(), "*") != syntaxes.end();
+  // a transfer syntax can only be negotiated for the DICOM file:
+  bool dicom_only = !syntaxes.empty() ||
+                    (req->input_json.isMember("format") &&
+                     req->input_json["format"].asString() == "dicom");
+
+  request_coalescer::value_ptr location =
+      find_image_file(req, seq, dicom_only);
+
+  // the entity tag changes whenever the file is rewritten:
+  std::string path = (*location)["path"].asString();
+  std::int32_t type = (*location)["type"].asInt();
+  std::error_code ec;
+  std::uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec)
+    throw onis::exception(EOS_FILE_MISSING, "Image file is missing");
+  std::uint64_t offset = 0;
+  std::ostringstream etag;
+  if (location->isMember(IM_PACK_SIZE_KEY)) {
+    // a packed image is a range of its series container, never rewritten
+    // (the container is only appended to):
+    offset = (*location)[IM_PACK_OFFSET_KEY].asUInt64();
+    std::uint64_t pack_size = (*location)[IM_PACK_SIZE_KEY].asUInt64();
+    if (offset + pack_size > size)
+      throw onis::exception(EOS_FILE_SIZE,
+                            "Image is beyond the end of its container");
+    size = pack_size;
+    etag << '"' << seq << '-' << type << '-' << std::hex << size << "-p"
+         << offset << '"';
+  } else {
+    auto write_time = std::filesystem::last_write_time(path, ec);
+    if (ec)
+      throw onis::exception(EOS_FILE_MISSING, "Image file is missing");
+    etag << '"' << seq << '-' << type << '-' << std::hex << size << '-'
+         << write_time.time_since_epoch().count() << '"';
+  }
+
+  // the file is served as it is when its transfer syntax is accepted:
+  std::string transfer;
+  if (!syntaxes.empty() && !any_syntax) {
+    transfer = read_transfer_syntax(path, offset);
+    if (std::find(syntaxes.begin(), syntaxes.end(), transfer) ==
+        syntaxes.end()) {
+      std::string target = find_transcode_target(syntaxes);
+      if (target.empty())
+        throw onis::exception(EOS_CHANGE_TRANSFER,
+                              "None of the transfer syntaxes can be produced");
+      write_transcoded_image_file(req, *location, etag.str(), target);
+      return;
+    }
+  }
+
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+        output["path"] = path;
+        output["type"] = type;
+        output["offset"] = static_cast<Json::UInt64>(offset);
+        output["size"] = static_cast<Json::UInt64>(size);
+        output["etag"] = etag.str();
+        if (!transfer.empty())
+          output["transfer_syntax"] = transfer;
+      });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// write_transcoded_image_file
+////////////////////////////////////////////////////////////////////////////////
+
+// Serve the image in the transfer syntax "transfer". The transcoded files
+// are kept by the transcode cache, under a key holding the version of the
+// image file, and the concurrent requests of the same file share a single
+// transcoding. A file too large for the cache is not shared. The files are
+// sent from memory, or streamed when they are large, and are read or opened
+// before the response is written: the cache may remove them meanwhile.
+void request_service::write_transcoded_image_file(
+    const request_data_ptr& req, const Json::Value& location,
+    const std::string& version, const std::string& transfer) {
+  Json::Value params(Json::objectValue);
+  params["seq"] = req->input_json["seq"];
+  params["transfer_syntax"] = transfer;
+  params["version"] = version;
+  std::string key = request_coalescer::make_key("image_transcode", params);
+  std::string etag = "\"" + key.substr(key.rfind(':') + 1) + "\"";
+
+  // the client already has it:
+  if (req->input_json.isMember("if_none_match")) {
+    std::string if_none_match = req->input_json["if_none_match"].asString();
+    if (if_none_match == "*" || if_none_match.find(etag) != std::string::npos) {
+      req->write_output(
+          [&](json& output, std::vector<std::uint8_t>& binary_output) {
+            output["status"] = EOS_NONE;
+            output["not_modified"] = true;
+            output["etag"] = etag;
+            output["transfer_syntax"] = transfer;
+          });
+      return;
+    }
+  }
+
+  std::string path = location["path"].asString();
+  std::string cache = "hit";
+  std::chrono::microseconds duration{0};
+  std::string file_path = transcode_cache_->find_file(key);
+  std::string temp_path;
+  if (file_path.empty()) {
+    // the first request transcodes the file, the others wait for it:
+    bool leader = false;
+    request_coalescer::value_ptr result =
+        read_coalescer_->run(key, [&](Json::Value& result) {
+          leader = true;
+          std::string output_path = transcode_cache_->create_temp_path();
+          duration = transcode_pool_->run([&] {
+            transcode_image(path, location, transfer, output_path);
+          });
+          std::string stored =
+              transcode_cache_->insert_file(key, output_path);
+          result["path"] = stored;
+          if (stored.empty())
+            temp_path = output_path;
+        });
+    file_path = (*result)["path"].asString();
+    cache = leader ? "miss" : "shared";
+
+    // not kept by the cache, the other requests transcode it again:
+    if (file_path.empty() && !leader) {
+      temp_path = transcode_cache_->create_temp_path();
+      duration = transcode_pool_->run(
+          [&] { transcode_image(path, location, transfer, temp_path); });
+      cache = "miss";
+    }
+  }
+
+  // a file of the cache removed by another insertion since it was found is
+  // transcoded again:
+  std::vector<std::uint8_t> content;
+  request_data::stream_reader_fn reader;
+  if (!file_path.empty() &&
+      !open_transcoded_file(file_path, content, reader)) {
+    temp_path = transcode_cache_->create_temp_path();
+    duration = transcode_pool_->run(
+        [&] { transcode_image(path, location, transfer, temp_path); });
+    cache = "miss";
+  }
+  if (!temp_path.empty()) {
+    bool opened = open_transcoded_file(temp_path, content, reader);
+    onis::util::filesystem::delete_file(temp_path);
+    if (!opened)
+      throw onis::exception(EOS_FILE_READ,
+                            "Failed to read the transcoded file");
+  }
+
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output,
+          request_data::stream_reader_fn& stream_reader) {
+        output["status"] = EOS_NONE;
+        binary_output.swap(content);
+        stream_reader = reader;
+        output["type"] = 1;
+        output["etag"] = etag;
+        output["transfer_syntax"] = transfer;
+        output["transcode_cache"] = cache;
+        output["transcode_ms"] =
+            static_cast<double>(duration.count()) / 1000.0;
+      });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// find_image_file
+////////////////////////////////////////////////////////////////////////////////
+
+request_coalescer::value_ptr request_service::find_image_file(
+    const request_data_ptr& req, const std::string& seq, bool dicom_only) {
+  // resolve the file the same way the series download does: the J2K stream
+  // file when there is one, the DICOM file otherwise.
+  Json::Value params(Json::objectValue);
+  params["seq"] = seq;
+  params["dicom_only"] = dicom_only;
+  std::string key = request_coalescer::make_key("image_file", params);
+  request_coalescer::value_ptr location =
+      read_coalescer_->run(key, [&](Json::Value& location) {
+        request_database db(this);
+        Json::Value image(Json::objectValue);
+        std::string partition_seq;
+        db->find_image_location(seq,
+                                onis::database::info_image_path |
+                                    onis::database::info_image_stream,
+                                onis::database::lock_mode::NO_LOCK, image,
+                                nullptr, partition_seq);
+
+        Json::Value partition(Json::objectValue);
+        verify_partition_access_permission(
+            db, req->session, partition_seq, &partition,
+            onis::database::info_partition_volume,
+            onis::database::lock_mode::NO_LOCK);
+
+        std::int32_t media = -1;
+        std::int32_t type = 1;
+        std::string relative_path = image[IM_STREAM_PATH_KEY].asString();
+        if (!dicom_only && !relative_path.empty()) {
+          media = image[IM_STREAM_MEDIA_KEY].asInt();
+          type = 2;
+        } else {
+          relative_path = image[IM_IMAGE_PATH_KEY].asString();
+          media = image[IM_IMAGE_MEDIA_KEY].asInt();
+        }
+        if (relative_path.empty())
+          throw onis::exception(EOS_NO_FILE, "No file for this image");
+
+        std::string full_path =
+            get_media_folder(onis::database::media_for_images,
+                             partition[PT_VOLUME_KEY].asString(), media, db);
+        if (full_path.empty())
+          throw onis::exception(EOS_MEDIA, "Media not available");
+        onis::util::filesystem::concat(full_path, relative_path);
+        location["partition"] = partition_seq;
+        location["path"] = full_path;
+        location["type"] = type;
+        if (type == 1 && image.isMember(IM_PACK_SIZE_KEY)) {
+          location[IM_PACK_OFFSET_KEY] = image[IM_PACK_OFFSET_KEY];
+          location[IM_PACK_SIZE_KEY] = image[IM_PACK_SIZE_KEY];
+        }
+      });
+
+  // the permission is verified for each request, the location may have been
+  // resolved for another session:
+  {
+    request_database db(this);
+    verify_partition_access_permission(db, req->session,
+                                       (*location)["partition"].asString(),
+                                       nullptr, 0,
+                                       onis::database::lock_mode::NO_LOCK);
+  }
+  return location;
+}
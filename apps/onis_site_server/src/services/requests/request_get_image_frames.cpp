@@ -0,0 +1,213 @@
+#include <filesystem>
+#include <sstream>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/services/requests/store/local_store_request.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+//------------------------------------------------------------------------------
+// frame table
+//------------------------------------------------------------------------------
+
+// Parse the frame table stored with the image (see
+// local_store_request::read_pixel_data_offsets) into one array of
+// [offset, length] fragments per frame.
+static void parse_frame_table(const std::string& table, Json::Value& frames) {
+  frames = Json::Value(Json::arrayValue);
+  Json::Value* fragments = &frames.append(Json::arrayValue);
+  std::size_t pos = 0;
+  while (pos < table.size()) {
+    std::size_t colon = table.find(':', pos);
+    if (colon == std::string::npos)
+      throw onis::exception(EOS_DB_VALUE, "Invalid frame table");
+    std::size_t next = table.find_first_of(",+", colon);
+    if (next == std::string::npos)
+      next = table.size();
+    Json::Value& fragment = fragments->append(Json::arrayValue);
+    try {
+      fragment.append(static_cast<Json::UInt64>(
+          std::stoull(table.substr(pos, colon - pos))));
+      fragment.append(static_cast<Json::UInt64>(
+          std::stoull(table.substr(colon + 1, next - colon - 1))));
+    } catch (const std::exception&) {
+      throw onis::exception(EOS_DB_VALUE, "Invalid frame table");
+    }
+    if (next < table.size() && table[next] == ',')
+      fragments = &frames.append(Json::arrayValue);
+    pos = next + 1;
+  }
+}
+
+// Frame numbers start at 1, as in DICOM. The range is either a single frame
+// ("3") or an inclusive interval ("3-7").
+static void parse_frame_range(const std::string& range, std::int32_t count,
+                              std::int32_t& first, std::int32_t& last) {
+  if (range.empty()) {
+    first = 1;
+    last = count;
+    return;
+  }
+  try {
+    std::size_t dash = range.find('-');
+    first = std::stoi(range.substr(0, dash));
+    last = dash == std::string::npos ? first
+                                     : std::stoi(range.substr(dash + 1));
+  } catch (const std::exception&) {
+    throw onis::exception(EOS_PARAM, "Invalid frame range");
+  }
+  if (first < 1 || last < first || last > count)
+    throw onis::exception(EOS_PARAM, "Frame range out of bounds");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_get_image_frames_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_get_image_frames_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  onis::database::item::verify_string_value(req->input_json, "seq", false,
+                                            false);
+  onis::database::item::verify_string_value(req->input_json, "frames", true,
+                                            true);
+  std::string seq = req->input_json["seq"].asString();
+  std::string range = req->input_json.isMember("frames")
+                          ? req->input_json["frames"].asString()
+                          : "";
+
+  // the frame offsets always refer to the DICOM file, not to the stream file.
+  Json::Value params(Json::objectValue);
+  params["seq"] = seq;
+  std::string key = request_coalescer::make_key("image_frames", params);
+  request_coalescer::value_ptr location =
+      read_coalescer_->run(key, [&](Json::Value& location) {
+        request_database db(this);
+        Json::Value image(Json::objectValue);
+        std::string partition_seq;
+        db->find_image_frames(seq, onis::database::lock_mode::NO_LOCK, image,
+                              partition_seq);
+
+        Json::Value partition(Json::objectValue);
+        verify_partition_access_permission(
+            db, req->session, partition_seq, &partition,
+            onis::database::info_partition_volume,
+            onis::database::lock_mode::NO_LOCK);
+
+        std::string relative_path = image[IM_IMAGE_PATH_KEY].asString();
+        if (relative_path.empty())
+          throw onis::exception(EOS_NO_FILE, "No file for this image");
+        std::string full_path = get_media_folder(
+            onis::database::media_for_images,
+            partition[PT_VOLUME_KEY].asString(),
+            image[IM_IMAGE_MEDIA_KEY].asInt(), db);
+        if (full_path.empty())
+          throw onis::exception(EOS_MEDIA, "Media not available");
+        onis::util::filesystem::concat(full_path, relative_path);
+
+        // images stored before the offsets were recorded at import time get
+        // their frame table on first access (the packed images always have
+        // one, see pack_series):
+        if (!image.isMember(IM_FRAME_TABLE_KEY)) {
+          if (image.isMember(IM_PACK_SIZE_KEY) ||
+              !local_store_request::read_pixel_data_offsets(full_path, image))
+            throw onis::exception(EOS_NOSUPPORT,
+                                  "The frames of this image cannot be located");
+          db->set_image_frames(seq, image);
+        }
+
+        location["partition"] = partition_seq;
+        location["path"] = full_path;
+        location[IM_PIXEL_OFFSET_KEY] = image[IM_PIXEL_OFFSET_KEY];
+        if (image.isMember(IM_PACK_SIZE_KEY)) {
+          location[IM_PACK_OFFSET_KEY] = image[IM_PACK_OFFSET_KEY];
+          location[IM_PACK_SIZE_KEY] = image[IM_PACK_SIZE_KEY];
+        }
+        parse_frame_table(image[IM_FRAME_TABLE_KEY].asString(),
+                          location["frames"]);
+      });
+
+  // the permission is verified for each request, the location may have been
+  // resolved for another session:
+  {
+    request_database db(this);
+    verify_partition_access_permission(db, req->session,
+                                       (*location)["partition"].asString(),
+                                       nullptr, 0,
+                                       onis::database::lock_mode::NO_LOCK);
+  }
+
+  const Json::Value& frames = (*location)["frames"];
+  std::int32_t first = 0, last = 0;
+  parse_frame_range(range, static_cast<std::int32_t>(frames.size()), first,
+                    last);
+
+  // same entity tag as the image file, so that the byte ranges can be
+  // requested on the file with If-Range:
+  std::string path = (*location)["path"].asString();
+  std::error_code ec;
+  std::uintmax_t size = std::filesystem::file_size(path, ec);
+  if (ec)
+    throw onis::exception(EOS_FILE_MISSING, "Image file is missing");
+  std::uint64_t file_offset = 0;
+  std::ostringstream etag;
+  if (location->isMember(IM_PACK_SIZE_KEY)) {
+    // the offsets of the frame table are relative to the packed image:
+    file_offset = (*location)[IM_PACK_OFFSET_KEY].asUInt64();
+    std::uint64_t pack_size = (*location)[IM_PACK_SIZE_KEY].asUInt64();
+    if (file_offset + pack_size > size)
+      throw onis::exception(EOS_FILE_SIZE,
+                            "Image is beyond the end of its container");
+    size = pack_size;
+    etag << '"' << seq << "-1-" << std::hex << size << "-p" << file_offset
+         << '"';
+  } else {
+    auto write_time = std::filesystem::last_write_time(path, ec);
+    if (ec)
+      throw onis::exception(EOS_FILE_MISSING, "Image file is missing");
+    etag << '"' << seq << "-1-" << std::hex << size << '-'
+         << write_time.time_since_epoch().count() << '"';
+  }
+
+  // byte span covering the requested frames:
+  const Json::Value& first_frame = frames[first - 1];
+  const Json::Value& last_fragment =
+      frames[last - 1][frames[last - 1].size() - 1];
+  std::uint64_t offset = first_frame[0][0].asUInt64();
+  std::uint64_t end =
+      last_fragment[0].asUInt64() + last_fragment[1].asUInt64();
+  if (end > size || offset >= end)
+    throw onis::exception(EOS_FILE_SIZE,
+                          "Frame table does not match the file");
+
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+        output["path"] = path;
+        output["file_offset"] = static_cast<Json::UInt64>(file_offset);
+        output["size"] = static_cast<Json::UInt64>(size);
+        output["etag"] = etag.str();
+        output[IM_PIXEL_OFFSET_KEY] = (*location)[IM_PIXEL_OFFSET_KEY];
+        output[IM_FRAME_COUNT_KEY] = static_cast<Json::Int>(frames.size());
+        output["offset"] = static_cast<Json::UInt64>(offset);
+        output["length"] = static_cast<Json::UInt64>(end - offset);
+        Json::Value& list = output["frames"] = Json::Value(Json::arrayValue);
+        for (std::int32_t i = first; i <= last; i++) {
+          const Json::Value& fragments = frames[i - 1];
+          const Json::Value& tail = fragments[fragments.size() - 1];
+          Json::Value& frame = list.append(Json::objectValue);
+          frame["number"] = i;
+          frame["offset"] = fragments[0][0];
+          frame["length"] = static_cast<Json::UInt64>(
+              tail[0].asUInt64() + tail[1].asUInt64() -
+              fragments[0][0].asUInt64());
+          // encapsulated frames split in several fragments, the span above
+          // also covers the item headers between them:
+          if (fragments.size() > 1)
+            frame["fragments"] = fragments;
+        }
+      });
+}
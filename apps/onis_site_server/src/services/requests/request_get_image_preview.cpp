@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/services/requests/packing/series_container.hpp"
+#include "../../../include/services/requests/rendering/frame_renderer.hpp"
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/site_api.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// smallest preview rendered:
+static const std::uint32_t kMinPreviewSize = 16;
+
+// Read a numeric parameter (sent as a string by the query strings), returns
+// false when it is missing:
+static bool read_number(const Json::Value& input, const char* key,
+                        double& value) {
+  if (!input.isMember(key))
+    return false;
+  const Json::Value& item = input[key];
+  if (item.isNumeric()) {
+    value = item.asDouble();
+    return true;
+  }
+  if (item.isString()) {
+    std::string text = item.asString();
+    try {
+      std::size_t end = 0;
+      value = std::stod(text, &end);
+      if (end == text.size() && std::isfinite(value))
+        return true;
+    } catch (const std::exception&) {
+    }
+  }
+  throw onis::exception(EOS_PARAM, std::string("Invalid parameter: ") + key);
+}
+
+static bool read_integer(const Json::Value& input, const char* key,
+                         std::uint32_t min, std::uint32_t max,
+                         std::uint32_t& value) {
+  double number = 0;
+  if (!read_number(input, key, number))
+    return false;
+  if (number != std::floor(number) || number < min || number > max)
+    throw onis::exception(EOS_PARAM, std::string("Invalid parameter: ") + key);
+  value = static_cast<std::uint32_t>(number);
+  return true;
+}
+
+// Read a whole file, then delete it:
+static derived_file_cache::buffer_ptr read_preview_file(
+    const std::string& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  std::streamsize size = file.is_open() ? std::streamsize(file.tellg()) : -1;
+  std::shared_ptr<std::vector<char>> buffer;
+  if (size > 0 && file.seekg(0)) {
+    buffer = std::make_shared<std::vector<char>>(
+        static_cast<std::size_t>(size));
+    if (!file.read(buffer->data(), size))
+      buffer.reset();
+  }
+  file.close();
+  onis::util::filesystem::delete_file(path);
+  return buffer;
+}
+
+// Render a frame of the DICOM file "path" (or of the range of a packed image)
+// with the window "window" (center and width, in modality values) when there
+// is one, its own window level otherwise:
+static derived_file_cache::buffer_ptr render_preview(
+    const std::string& path, const Json::Value& location,
+    std::uint32_t frame_index, std::uint32_t size, onis::core::BitmapType type,
+    const double* window) {
+  std::filesystem::path temp_dir = std::filesystem::temp_directory_path();
+  std::string name = "PV_" + onis::util::uuid::generate_random_uuid();
+
+  // a packed image is read from a copy of its range of the container:
+  std::string image_path = path;
+  std::string packed_copy;
+  if (location.isMember(IM_PACK_SIZE_KEY)) {
+    packed_copy = (temp_dir / (name + ".dcm.tmp")).string();
+    if (!series_container::extract(path,
+                                   location[IM_PACK_OFFSET_KEY].asUInt64(),
+                                   location[IM_PACK_SIZE_KEY].asUInt64(),
+                                   packed_copy))
+      throw onis::exception(EOS_FILE_READ, "Failed to read the container");
+    image_path = packed_copy;
+  }
+
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  onis::dicom_file_ptr dcm =
+      manager != nullptr ? manager->create_dicom_file() : nullptr;
+  bool loaded = dcm != nullptr && dcm->load_file(image_path);
+  if (!packed_copy.empty())
+    onis::util::filesystem::delete_file(packed_copy);
+  if (!loaded)
+    throw onis::exception(EOS_FILE_READ, "Failed to load the image");
+  onis::dicom_frame_ptr frame =
+      dcm->extract_frame(static_cast<std::int32_t>(frame_index));
+  if (frame == nullptr)
+    throw onis::exception(EOS_NOT_FOUND, "Frame not found");
+  if (window != nullptr)
+    frame->set_window_level(window[0], window[1]);
+
+  onis::core::bitmap_ptr preview = frame_renderer::render(frame, size);
+  if (preview == nullptr)
+    throw onis::exception(EOS_NOSUPPORT, "The image cannot be rendered");
+  std::string preview_path = (temp_dir / (name + ".tmp")).string();
+  if (!preview->save_file(preview_path, type)) {
+    onis::util::filesystem::delete_file(preview_path);
+    throw onis::exception(EOS_FILE_WRITE, "Failed to encode the preview");
+  }
+  derived_file_cache::buffer_ptr buffer = read_preview_file(preview_path);
+  if (buffer == nullptr)
+    throw onis::exception(EOS_FILE_READ, "Failed to read the preview");
+  return buffer;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_get_image_preview_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_get_image_preview_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  const Json::Value& input = req->input_json;
+  onis::database::item::verify_string_value(input, "seq", false, false);
+  std::string seq = input["seq"].asString();
+  std::uint32_t frame = 0;
+  read_integer(input, "frame", 0, std::numeric_limits<std::int32_t>::max(),
+               frame);
+  std::uint32_t max_size =
+      std::max(config_->get_preview_max_size(), kMinPreviewSize);
+  std::uint32_t size = std::clamp(config_->get_preview_default_size(),
+                                  kMinPreviewSize, max_size);
+  read_integer(input, "size", kMinPreviewSize, max_size, size);
+  std::string format =
+      input.isMember("format") ? input["format"].asString() : "png";
+  if (format == "jpg")
+    format = "jpeg";
+  if (format != "png" && format != "jpeg")
+    throw onis::exception(EOS_PARAM, "Invalid preview format");
+  double window[2] = {0, 0};
+  bool has_center = read_number(input, "center", window[0]);
+  bool has_width = read_number(input, "width", window[1]);
+  if (has_center != has_width || (has_width && window[1] <= 0))
+    throw onis::exception(EOS_PARAM, "Invalid window");
+
+  // the previews are rendered from the DICOM file:
+  request_coalescer::value_ptr location = find_image_file(req, seq, true);
+  std::string path = (*location)["path"].asString();
+  std::error_code ec;
+  std::uintmax_t file_size = std::filesystem::file_size(path, ec);
+  if (ec)
+    throw onis::exception(EOS_FILE_MISSING, "Image file is missing");
+
+  // the key holds the version of the file, so that a rewritten file gets
+  // new previews (a packed image is never rewritten):
+  Json::Value params(Json::objectValue);
+  params["seq"] = seq;
+  params["frame"] = frame;
+  params["size"] = size;
+  params["format"] = format;
+  if (has_width) {
+    params["center"] = window[0];
+    params["width"] = window[1];
+  }
+  if (location->isMember(IM_PACK_SIZE_KEY)) {
+    params["version"] =
+        "p" + std::to_string((*location)[IM_PACK_OFFSET_KEY].asUInt64());
+  } else {
+    auto write_time = std::filesystem::last_write_time(path, ec);
+    if (ec)
+      throw onis::exception(EOS_FILE_MISSING, "Image file is missing");
+    params["version"] =
+        std::to_string(file_size) + "-" +
+        std::to_string(write_time.time_since_epoch().count());
+  }
+  std::string key = request_coalescer::make_key("image_preview", params);
+  std::string etag = "\"" + key.substr(key.rfind(':') + 1) + "\"";
+  std::string content_type = format == "png" ? "image/png" : "image/jpeg";
+
+  // the client already has it:
+  if (input.isMember("if_none_match")) {
+    std::string if_none_match = input["if_none_match"].asString();
+    if (if_none_match == "*" || if_none_match.find(etag) != std::string::npos) {
+      req->write_output(
+          [&](json& output, std::vector<std::uint8_t>& binary_output) {
+            output["status"] = EOS_NONE;
+            output["not_modified"] = true;
+            output["etag"] = etag;
+            output["content_type"] = content_type;
+          });
+      return;
+    }
+  }
+
+  derived_file_cache::buffer_ptr preview = preview_cache_->find(key);
+  if (preview == nullptr) {
+    preview = render_preview(
+        path, *location, frame, size,
+        format == "png" ? onis::core::BitmapType::Png
+                        : onis::core::BitmapType::Jpg,
+        has_width ? window : nullptr);
+    preview_cache_->insert(key, preview);
+  }
+
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+        output["etag"] = etag;
+        output["content_type"] = content_type;
+        binary_output.assign(preview->begin(), preview->end());
+      });
+}
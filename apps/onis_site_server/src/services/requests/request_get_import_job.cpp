@@ -0,0 +1,36 @@
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "onis_kit/include/core/exception.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// process_get_import_job_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_get_import_job_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  onis::database::item::verify_string_value(req->input_json, "id", false,
+                                            false);
+  Json::Value job;
+  if (!import_queue_->find_job(req->input_json["id"].asString(), job))
+    throw onis::exception(EOS_NOT_FOUND, "Import job not found");
+
+  // the job is visible to the sessions allowed to import into its partition:
+  {
+    request_database db(this);
+    verify_partition_access_permission(db, req->session,
+                                       job["source"].asString(), nullptr, 0,
+                                       onis::database::lock_mode::NO_LOCK);
+  }
+
+  // the spool paths are internal to the server:
+  if (job.isMember("files")) {
+    for (auto& file : job["files"])
+      file.removeMember("path");
+  }
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+        output["job"] = job;
+      });
+}
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/metadata/series_metadata_pack.hpp"
+#include "../../../include/services/requests/packing/series_container.hpp"
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/site_api.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+// The key of the pack of a series holds the files of its images, so that a
+// new, moved or rewritten file gets a new pack, and the version of the
+// encoding, so that the packs kept by the cache are not served once it
+// changed:
+static std::string get_series_metadata_key(const std::string& seq,
+                                           const Json::Value& files) {
+  Json::Value params(Json::objectValue);
+  params["seq"] = seq;
+  params["version"] = series_metadata_pack::version;
+  params["images"] = files["images"];
+  return request_coalescer::make_key("series_metadata", params);
+}
+
+// The images in the order of their instance numbers (then of their seqs):
+static std::vector<Json::ArrayIndex> sort_series_images(
+    const Json::Value& images) {
+  std::vector<Json::ArrayIndex> order(images.size());
+  std::iota(order.begin(), order.end(), 0);
+  auto number = [&](Json::ArrayIndex i) {
+    try {
+      return std::stoll(images[i][IM_INSTNUM_KEY].asString());
+    } catch (const std::exception&) {
+      return std::numeric_limits<long long>::max();
+    }
+  };
+  std::stable_sort(order.begin(), order.end(),
+                   [&](Json::ArrayIndex a, Json::ArrayIndex b) {
+                     return number(a) < number(b);
+                   });
+  return order;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_get_series_metadata_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_get_series_metadata_request(
+    const request_data_ptr& req) {
+  // Verify input parameters:
+  const Json::Value& input = req->input_json;
+  onis::database::item::verify_string_value(input, "seq", false, false);
+  std::string seq = input["seq"].asString();
+
+  request_database db(this);
+  Json::Value files(Json::objectValue);
+  db->find_series_image_files(seq, files);
+  verify_partition_access_permission(db, req->session,
+                                     files["partition"].asString(), nullptr,
+                                     0, onis::database::lock_mode::NO_LOCK);
+
+  std::string key = get_series_metadata_key(seq, files);
+  std::string etag = "\"" + key.substr(key.rfind(':') + 1) + "\"";
+
+  // the client already has it:
+  if (input.isMember("if_none_match")) {
+    std::string if_none_match = input["if_none_match"].asString();
+    if (if_none_match == "*" || if_none_match.find(etag) != std::string::npos) {
+      req->write_output(
+          [&](json& output, std::vector<std::uint8_t>& binary_output) {
+            output["status"] = EOS_NONE;
+            output["not_modified"] = true;
+            output["etag"] = etag;
+          });
+      return;
+    }
+  }
+
+  derived_file_cache::buffer_ptr pack = load_series_metadata(key, files, db);
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+        output["etag"] = etag;
+        output["instances"] = files["images"].size();
+        binary_output.assign(pack->begin(), pack->end());
+      });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// series metadata packs
+////////////////////////////////////////////////////////////////////////////////
+
+// Prepare the pack of a completed series, so that it is opened without
+// reading its files:
+void request_service::prepare_series_metadata(const std::string& seq,
+                                              const request_database& db) {
+  Json::Value files(Json::objectValue);
+  db->find_series_image_files(seq, files);
+  if (!files["images"].empty())
+    load_series_metadata(get_series_metadata_key(seq, files), files, db);
+}
+
+// The pack is read from the cache, or built once for the concurrent
+// requests. A pack that the cache did not keep is built again.
+derived_file_cache::buffer_ptr request_service::load_series_metadata(
+    const std::string& key, const Json::Value& files,
+    const request_database& db) {
+  derived_file_cache::buffer_ptr pack = metadata_cache_->find(key);
+  if (pack != nullptr)
+    return pack;
+  read_coalescer_->run(key, [&](Json::Value& result) {
+    pack = build_series_metadata(files, db);
+    metadata_cache_->insert(key, pack);
+  });
+  if (pack == nullptr)
+    pack = metadata_cache_->find(key);
+  if (pack == nullptr)
+    pack = build_series_metadata(files, db);
+  return pack;
+}
+
+// Read the headers of the images of a series (without their pixel data)
+// and encode them:
+derived_file_cache::buffer_ptr request_service::build_series_metadata(
+    const Json::Value& files, const request_database& db) {
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  if (manager == nullptr)
+    throw onis::exception(EOS_NOT_AVAILABLE, "No dicom manager");
+  std::string volume_seq = files[PT_VOLUME_KEY].asString();
+  const Json::Value& images = files["images"];
+
+  std::vector<series_metadata_pack::instance> instances;
+  instances.reserve(images.size());
+  for (Json::ArrayIndex i : sort_series_images(images)) {
+    const Json::Value& image = images[i];
+    std::string path =
+        get_media_folder(onis::database::media_for_images, volume_seq,
+                         image[IM_IMAGE_MEDIA_KEY].asInt(), db);
+    if (path.empty())
+      throw onis::exception(EOS_MEDIA, "Media not available");
+    onis::util::filesystem::concat(path, image[IM_IMAGE_PATH_KEY].asString());
+
+    // a packed image is read from a copy of its range of the container:
+    std::string packed_copy;
+    if (image.isMember(IM_PACK_SIZE_KEY)) {
+      packed_copy = (std::filesystem::temp_directory_path() /
+                     ("MD_" + onis::util::uuid::generate_random_uuid() +
+                      ".dcm.tmp"))
+                        .string();
+      if (!series_container::extract(path,
+                                     image[IM_PACK_OFFSET_KEY].asUInt64(),
+                                     image[IM_PACK_SIZE_KEY].asUInt64(),
+                                     packed_copy))
+        throw onis::exception(EOS_FILE_READ, "Failed to read the container");
+      path = packed_copy;
+    }
+
+    // the long values are read from the file when they are converted:
+    onis::dicom_file_ptr dcm = manager->create_dicom_file();
+    bool loaded = dcm != nullptr && dcm->load_file_metadata(path);
+    if (loaded) {
+      series_metadata_pack::instance& instance = instances.emplace_back();
+      instance.seq = image[BASE_SEQ_KEY].asString();
+      series_metadata_pack::read_elements(dcm, instance.elements);
+      series_metadata_pack::read_regions(dcm, instance.regions);
+    }
+    dcm.reset();
+    if (!packed_copy.empty())
+      onis::util::filesystem::delete_file(packed_copy);
+    if (!loaded)
+      throw onis::exception(EOS_FILE_READ,
+                            "Failed to load the image " +
+                                image[BASE_SEQ_KEY].asString());
+  }
+
+  auto pack = std::make_shared<std::vector<char>>();
+  series_metadata_pack::encode(instances, *pack);
+  return pack;
+}
@@ -0,0 +1,69 @@
+#include "../../../include/services/requests/request_data.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "onis_kit/include/core/exception.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// process_get_statistics_request
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_get_statistics_request(
+    const request_data_ptr& req) {
+  req->write_output(
+      [&](json& output, std::vector<std::uint8_t>& binary_output) {
+        output["status"] = EOS_NONE;
+
+        // request coalescing:
+        Json::Value& coalescing = output["coalescing"];
+        coalescing["leaders"] =
+            static_cast<Json::UInt64>(read_coalescer_->get_leader_count());
+        coalescing["shared"] =
+            static_cast<Json::UInt64>(read_coalescer_->get_shared_count());
+
+        // caches:
+        hot_file_cache_->get_statistics(output["cache"]["hot_files"]);
+        import_lookup_cache_->get_statistics(output["cache"]["import_lookup"]);
+        sop_filter_->get_statistics(output["cache"]["sop_filter"]);
+        directory_cache_->get_statistics(output["cache"]["directories"]);
+        preview_cache_->get_statistics(output["cache"]["previews"]);
+        transcode_cache_->get_statistics(output["cache"]["transcoded"]);
+        metadata_cache_->get_statistics(output["cache"]["metadata"]);
+
+        // asynchronous imports:
+        import_queue_->get_statistics(output["import"]);
+        import_lock_manager_->get_statistics(output["import"]["locks"]);
+
+        // deferred counter updates:
+        aggregate_updater_->get_statistics(output["aggregates"]);
+
+        // stream files and icons:
+        derived_object_worker_->get_statistics(output["derived"]);
+
+        // image compression:
+        compression_worker_->get_statistics(output["image_compression"]);
+
+        // transcoding on retrieval:
+        transcode_pool_->get_statistics(output["transcoding"]);
+
+        // deduplication (with the ratio of the partitions):
+        content_store_->get_statistics(output["deduplication"]);
+
+        // replaced files:
+        file_releaser_->get_statistics(output["file_release"]);
+
+        // tiering:
+        migration_worker_->get_statistics(output["tiering"]);
+
+        // series containers:
+        series_packer_->get_statistics(output["packing"]);
+
+        // consistency checks:
+        archive_checker_->get_statistics(output["archive_check"]);
+
+        // exports:
+        Json::Value& exports = output["exports"];
+        exports["running"] = running_exports_.load();
+        exports["started"] = static_cast<Json::UInt64>(exports_.load());
+        exports["rejected"] =
+            static_cast<Json::UInt64>(rejected_exports_.load());
+      });
+}
@@ -0,0 +1,210 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../../../include/database/items/db_compression.hpp"
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/services/requests/store/local_store_request.hpp"
+#include "../../../include/site_api.hpp"
+#include "onis_kit/include/core/date_time.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/dicom/dicom.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+#include "onis_kit/include/utilities/string.hpp"
+#include "onis_kit/include/utilities/uuid.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// Compression rules
+////////////////////////////////////////////////////////////////////////////////
+
+static std::int32_t get_current_hour() {
+  onis::core::date_time now;
+  now.init_current_time();
+  return static_cast<std::int32_t>(now.hour());
+}
+
+// A rule applies when it is active, and for the scheduled ones, during their
+// window (see site_database::get_images_to_compress):
+static bool is_compression_applicable(const Json::Value& rule,
+                                      std::int32_t hour) {
+  if (rule[CP_ENABLE_KEY].asInt() != 1 ||
+      rule[CP_TRANSFER_KEY].asString().empty())
+    return false;
+  if (rule[CP_MODE_KEY].asInt() != onis::database::compression_mode_scheduled)
+    return true;
+  std::int32_t start = rule[CP_START_KEY].asInt();
+  std::int32_t stop = rule[CP_STOP_KEY].asInt();
+  if (start == stop)
+    return true;
+  if (start < stop)
+    return hour >= start && hour < stop;
+  return hour >= start || hour < stop;
+}
+
+bool request_service::find_partition_compression(
+    const std::string& partition_seq, const request_database& db,
+    Json::Value& output) {
+  Json::Value compressions(Json::arrayValue);
+  if (!import_lookup_cache_->find_compressions(partition_seq, compressions)) {
+    db->get_partition_compressions(partition_seq, onis::database::info_all,
+                                   onis::database::lock_mode::NO_LOCK,
+                                   compressions);
+    import_lookup_cache_->store_compressions(partition_seq, compressions);
+  }
+  if (compressions.size() != 1)
+    return false;
+  output = compressions[0];
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// get_images_to_compress
+////////////////////////////////////////////////////////////////////////////////
+
+std::string request_service::get_images_to_compress(
+    const std::string& after_seq, std::int32_t limit,
+    std::vector<std::string>& seqs) {
+  request_database db(this);
+  return db->get_images_to_compress(get_current_hour(), after_seq, limit,
+                                    seqs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// compress_image
+////////////////////////////////////////////////////////////////////////////////
+
+// Transcode an image to the transfer syntax of the rule of its partition. The
+// new file is written aside, next to the current one, and recorded in place
+// of it only if the image still refers to the current one, the downloads in
+// progress being redirected to it. The current file is recorded in the same
+// transaction to be deleted after a delay, once these downloads are completed
+// (see file_releaser). An image that cannot be transcoded, or that would not
+// be smaller, is left as is and recorded as done for this version of the
+// rule. Throws when the media or the database is not available, the image
+// then stays to compress.
+compression_worker::result request_service::compress_image(
+    const std::string& seq, std::int64_t& saved) {
+  request_database db(this);
+  Json::Value source(Json::objectValue);
+  if (!db->find_compression_image_source(seq, source))
+    return compression_worker::result::skipped;
+  Json::Value rule(Json::objectValue);
+  if (!find_partition_compression(source["partition"].asString(), db, rule) ||
+      !is_compression_applicable(rule, get_current_hour()))
+    return compression_worker::result::skipped;
+  std::int32_t update = rule[CP_UPDATE_KEY].asInt();
+  if (source[IM_COMP_STATUS_KEY].asInt() !=
+          onis::database::image_compression_none &&
+      source[IM_COMP_UPDATE_KEY].asInt() == update)
+    return compression_worker::result::skipped;
+
+  std::int32_t media = source[IM_IMAGE_MEDIA_KEY].asInt();
+  std::string relative_path = source[IM_IMAGE_PATH_KEY].asString();
+  std::string folder =
+      get_media_folder(onis::database::media_for_images,
+                       source[PT_VOLUME_KEY].asString(), media, db);
+  if (folder.empty())
+    throw onis::exception(EOS_MEDIA, "Media not available");
+  std::string path = folder;
+  onis::util::filesystem::concat(path, relative_path);
+  if (!onis::util::filesystem::exist_file(path))
+    throw onis::exception(EOS_FILE_OPEN, "Image file not available");
+
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  onis::dicom_file_ptr dcm =
+      manager != nullptr ? manager->create_dicom_file() : nullptr;
+  if (dcm == nullptr)
+    throw onis::exception(EOS_NOT_AVAILABLE, "No dicom manager");
+  if (!dcm->load_file(path)) {
+    std::cerr << "compress_image: Failed to load the image " << seq
+              << std::endl;
+    db->set_image_compression_status(seq, media, relative_path,
+                                     onis::database::image_compression_failed,
+                                     update);
+    return compression_worker::result::failed;
+  }
+
+  std::string transfer = rule[CP_TRANSFER_KEY].asString();
+  std::string current_transfer;
+  dcm->get_string_element(current_transfer, TAG_TRANSFER_SYNTAX_UID, "UI");
+  if (current_transfer == transfer) {
+    db->set_image_compression_status(seq, media, relative_path,
+                                     onis::database::image_compression_done,
+                                     update);
+    return compression_worker::result::unchanged;
+  }
+
+  // the new file is written aside, and renamed once complete:
+  std::string id = onis::util::uuid::generate_random_uuid();
+  if (id.empty())
+    throw onis::exception(EOS_FILE_WRITE, "Failed to create a file name");
+  std::string new_relative_path =
+      onis::util::filesystem::get_directory(relative_path);
+  onis::util::filesystem::concat(new_relative_path, "IM_" + id + ".dcm");
+  onis::util::string::replace_antislash_by_slash(new_relative_path);
+  std::string new_path = folder;
+  onis::util::filesystem::concat(new_path, new_relative_path);
+  std::string tmp_path = new_path + ".tmp";
+  if (!dcm->save_file(tmp_path, transfer)) {
+    onis::util::filesystem::delete_file(tmp_path);
+    std::cerr << "compress_image: Failed to transcode the image " << seq
+              << " to " << transfer << std::endl;
+    db->set_image_compression_status(seq, media, relative_path,
+                                     onis::database::image_compression_failed,
+                                     update);
+    return compression_worker::result::failed;
+  }
+  dcm.reset();
+
+  std::int64_t size = onis::util::filesystem::get_file_size(path);
+  std::int64_t new_size = onis::util::filesystem::get_file_size(tmp_path);
+  Json::Value pixel_data(Json::nullValue);
+  if (new_size <= 0 || new_size >= size ||
+      !local_store_request::read_pixel_data_offsets(tmp_path, pixel_data)) {
+    onis::util::filesystem::delete_file(tmp_path);
+    db->set_image_compression_status(seq, media, relative_path,
+                                     onis::database::image_compression_done,
+                                     update);
+    return compression_worker::result::unchanged;
+  }
+  if (!onis::util::filesystem::move_file(tmp_path, new_path)) {
+    onis::util::filesystem::delete_file(tmp_path);
+    throw onis::exception(EOS_FILE_MOVE, "Failed to store the compressed file");
+  }
+
+  // the image may have been modified or deleted meanwhile, or its content
+  // shared with another image (the compressed file has another content):
+  bool recorded = false;
+  db->begin_transaction();
+  try {
+    recorded = db->release_image_content(seq) &&
+               db->set_image_compressed(seq, media, relative_path,
+                                        new_relative_path, pixel_data, update);
+    if (recorded) {
+      db->redirect_series_downloads(source["series"].asString(), path,
+                                    new_path);
+      db->add_file_release(source[PT_VOLUME_KEY].asString(), media,
+                           relative_path,
+                           static_cast<std::int32_t>(
+                               config_->get_image_compression_release_delay()));
+    }
+    db->commit();
+  } catch (...) {
+    try {
+      db->rollback();
+    } catch (...) {
+    }
+    onis::util::filesystem::delete_file(new_path);
+    throw;
+  }
+  if (!recorded) {
+    onis::util::filesystem::delete_file(new_path);
+    return compression_worker::result::skipped;
+  }
+  saved = size - new_size;
+  return compression_worker::result::compressed;
+}
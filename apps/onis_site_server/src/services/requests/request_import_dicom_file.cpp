@@ -1,5 +1,6 @@
-#include <cstdlib>
-#include <ctime>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
 #include <random>
 #include <string>
 #include <vector>
@@ -13,16 +14,106 @@
 #include "../../../include/services/requests/request_service.hpp"
 #include "../../../include/services/requests/store/local_store_request.hpp"
 #include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
 #include "onis_kit/include/utilities/uuid.hpp"
 
+//------------------------------------------------------------------------------
+// utilities
+//------------------------------------------------------------------------------
+
+// number of failed files detailed in an import summary:
+static const Json::ArrayIndex kMaxReportedErrors = 100;
+
+static void delete_staged_files(const Json::Value& files) {
+  for (const auto& file : files) {
+    std::string path = file["path"].asString();
+    if (!path.empty() && onis::util::filesystem::exist_file(path))
+      onis::util::filesystem::delete_file(path);
+  }
+}
+
+// Add the results of the imported files to the summary of an import. The
+// files are reported by name (or by path when the list of names is empty).
+static void add_import_results(const Json::Value& results,
+                               const std::vector<std::string>& names,
+                               Json::Value& summary) {
+  Json::Value& errors = summary["errors"];
+  if (!errors.isArray())
+    errors = Json::Value(Json::arrayValue);
+  for (Json::ArrayIndex i = 0; i < results.size(); i++) {
+    summary["total"] = summary["total"].asUInt() + 1;
+    if (results[i]["status"].asInt() == EOS_NONE) {
+      summary["imported"] = summary["imported"].asUInt() + 1;
+      continue;
+    }
+    summary["failed"] = summary["failed"].asUInt() + 1;
+    if (errors.size() < kMaxReportedErrors) {
+      Json::Value& error = errors.append(Json::objectValue);
+      error["file"] = i < names.size() ? names[i] : "";
+      error["status"] = results[i]["status"];
+      error["message"] = results[i].get("message", "");
+    }
+  }
+}
+
+static void init_import_summary(Json::Value& summary) {
+  summary["total"] = 0;
+  summary["imported"] = 0;
+  summary["failed"] = 0;
+  summary["errors"] = Json::Value(Json::arrayValue);
+}
+
+// Visit the files of a folder and of its sub-folders in the order of their
+// names, so that an interrupted import of the folder can skip the files it
+// already imported:
+static void visit_folder_files(
+    const std::filesystem::path& dir,
+    const std::function<void(const std::string&)>& visit) {
+  std::vector<std::filesystem::path> files;
+  std::vector<std::filesystem::path> folders;
+  std::error_code ec;
+  std::filesystem::directory_iterator it(
+      dir, std::filesystem::directory_options::skip_permission_denied, ec);
+  if (ec)
+    return;
+  for (; it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    if (ec)
+      break;
+    if (it->is_symlink(ec) && it->is_directory(ec))
+      continue;
+    if (it->is_directory(ec))
+      folders.push_back(it->path());
+    else if (it->is_regular_file(ec))
+      files.push_back(it->path());
+  }
+  std::sort(files.begin(), files.end());
+  std::sort(folders.begin(), folders.end());
+  for (const auto& file : files) {
+    std::string path = file.string();
+    if (!onis::util::filesystem::has_tmp_extension(path))
+      visit(path);
+  }
+  for (const auto& folder : folders)
+    visit_folder_files(folder, visit);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_import_dicom_file_request
+////////////////////////////////////////////////////////////////////////////////
+
 void request_service::process_import_dicom_file_request(
     const request_data_ptr& req) {
   // Verify input parameters:
   onis::database::item::verify_string_value(req->input_json, "source", false,
                                             false);
   // onis::database::item::verify_integer_value(req->input_json, "type", false);
-  onis::database::item::verify_string_value(req->input_json, "dicom_file_path",
-                                            false, false);
+  bool has_folder = req->input_json.isMember("dicom_folder_path");
+  if (has_folder)
+    onis::database::item::verify_string_value(
+        req->input_json, "dicom_folder_path", false, false);
+  else if (req->input_files.empty())
+    onis::database::item::verify_string_value(
+        req->input_json, "dicom_file_path", false, false);
 
   request_database db(this);
   std::string source_id = req->input_json["source"].asString();
@@ -33,41 +124,362 @@ void request_service::process_import_dicom_file_request(
           onis::database::info_partition_parameters,
       onis::database::lock_mode::NO_LOCK);
 
-  std::string partition_name = partition.isMember(PT_NAME_KEY)
-                                   ? partition[PT_NAME_KEY].asString()
-                                   : source_id;
-
   // get the storage media:
   std::int32_t media = -1;
   std::string folder =
       get_current_media_folder(onis::database::media_for_images,
                                partition[PT_VOLUME_KEY].asString(), &media, db);
 
-  // start a transaction:
-  db->begin_transaction();
+  // the files of a folder of the server are imported where they are:
+  if (has_folder) {
+    std::string folder_path = req->input_json["dicom_folder_path"].asString();
+    if (!onis::util::filesystem::exist_directory(folder_path))
+      throw onis::exception(EOS_NOT_FOUND, "Folder not found");
+    Json::Value job;
+    if (import_queue_->is_enabled()) {
+      Json::Value input(Json::objectValue);
+      input["folder"] = folder_path;
+      import_queue_->submit(source_id, input, job);
+    }
+    req->write_output(
+        [&](Json::Value& output, std::vector<std::uint8_t>& binary_output) {
+          if (job.isObject()) {
+            output["status"] = EOS_NONE;
+            output["job"] = job;
+            return;
+          }
+          Json::Value summary(Json::objectValue);
+          import_dicom_folder(db, source_id, partition, media, folder,
+                              folder_path, nullptr, summary);
+          output = summary;
+          output["status"] = EOS_NONE;
+        });
+    return;
+  }
 
-  try {
-    // import the dicom file into the partition:
+  if (req->input_files.empty()) {
     std::string dicom_file_path = req->input_json["dicom_file_path"].asString();
     req->write_output(
         [&](Json::Value& output, std::vector<std::uint8_t>& binary_output) {
-          std::uint32_t flags[4] = {0, onis::database::info_study_status, 0, 0};
-          local_store_request store(shared_from_this());
-          /*store.set_origin(req->session->user_seq,
-                           "Imported by " + req->session->login,
-                           req->log_info->get_client_ip());*/
-          store.import_file_to_partition(
-              db, source_id, partition[PT_PARAM_KEY].asString(), media, folder,
-              dicom_file_path, true, &output, flags);
+          import_dicom_file(db, source_id, partition, media, folder,
+                            dicom_file_path, false, output);
         });
-  } catch (const onis::exception& e) {
-    db->rollback();
-    throw e;
+    return;
+  }
+
+  // the uploaded files are staged on the media volume, so that they can be
+  // renamed into their final location instead of being copied there:
+  if (folder.empty())
+    throw onis::exception(EOS_FILE_WRITE, "No media to store the image");
+  std::string staging_dir = folder;
+  onis::util::filesystem::concat(staging_dir, ".staging");
+  if (!onis::util::filesystem::create_multi_directories(staging_dir))
+    throw onis::exception(EOS_DIR_CREATE,
+                          "Failed to create the staging directory");
+  // the uploads imported in the background are on the disk before the job is
+  // accepted:
+  bool queued = import_queue_->is_enabled();
+  Json::Value files(Json::arrayValue);
+  std::vector<std::string> paths;
+  std::vector<std::string> names;
+  try {
+    for (const auto& upload : req->input_files) {
+      std::string path = staging_dir;
+      onis::util::filesystem::concat(
+          path, "UP_" + onis::util::uuid::generate_random_uuid() + ".dcm");
+      Json::Value& file = files.append(Json::objectValue);
+      file["path"] = path;
+      file["name"] = upload.name;
+      if (!upload.write(path) ||
+          (queued && !onis::util::filesystem::sync_file(path)))
+        throw onis::exception(EOS_FILE_WRITE, "Failed to write the upload");
+      paths.push_back(path);
+      names.push_back(upload.name);
+    }
+    if (queued && !onis::util::filesystem::sync_directory(staging_dir))
+      throw onis::exception(EOS_FILE_WRITE, "Failed to write the upload");
   } catch (...) {
-    db->rollback();
+    delete_staged_files(files);
     throw;
   }
 
+  // the staged uploads are imported in the background:
+  if (queued) {
+    Json::Value input(Json::objectValue);
+    input["files"] = files;
+    Json::Value job;
+    try {
+      import_queue_->submit(source_id, input, job);
+    } catch (...) {
+      delete_staged_files(files);
+      throw;
+    }
+    for (auto& file : job["files"])
+      file.removeMember("path");
+    req->write_output(
+        [&](Json::Value& output, std::vector<std::uint8_t>& binary_output) {
+          output["status"] = EOS_NONE;
+          output["job"] = job;
+        });
+    return;
+  }
+
+  try {
+    req->write_output(
+        [&](Json::Value& output, std::vector<std::uint8_t>& binary_output) {
+          if (paths.size() == 1) {
+            import_dicom_file(db, source_id, partition, media, folder,
+                              paths[0], true, output);
+            return;
+          }
+          Json::Value results(Json::arrayValue);
+          import_dicom_files(db, source_id, partition, media, folder, paths,
+                             true, nullptr, results);
+          init_import_summary(output);
+          add_import_results(results, names, output);
+          output.removeMember("errors");
+          for (Json::ArrayIndex i = 0; i < results.size(); i++)
+            results[i]["name"] = names[i];
+          output["status"] = EOS_NONE;
+          output["files"] = results;
+        });
+  } catch (...) {
+    delete_staged_files(files);
+    throw;
+  }
+
+  // the staged files are still there if they had to be written again:
+  delete_staged_files(files);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// process_import_job
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::process_import_job(
+    const Json::Value& job, const import_queue::progress_fn& progress,
+    Json::Value& output) {
+  // the permission was verified when the job was submitted:
+  request_database db(this);
+  std::string source_id = job["source"].asString();
+  Json::Value partition(Json::objectValue);
+  verify_partition_access_permission(
+      db, nullptr, source_id, &partition,
+      onis::database::info_partition_volume |
+          onis::database::info_partition_parameters,
+      onis::database::lock_mode::NO_LOCK);
+
+  // get the storage media:
+  std::int32_t media = -1;
+  std::string folder =
+      get_current_media_folder(onis::database::media_for_images,
+                               partition[PT_VOLUME_KEY].asString(), &media, db);
+
+  // an interrupted job resumes after the files committed by its previous
+  // runs, whose summary was journaled with its progress:
+  const Json::Value& previous = job["progress"];
+  Json::Value summary(Json::objectValue);
+  if (previous.isObject() && previous["summary"].isObject())
+    summary = previous["summary"];
+
+  if (job.isMember("folder")) {
+    std::string folder_path = job["folder"].asString();
+    if (!onis::util::filesystem::exist_directory(folder_path))
+      throw onis::exception(EOS_NOT_FOUND, "Folder not found");
+    import_dicom_folder(db, source_id, partition, media, folder, folder_path,
+                        progress, summary);
+    output = summary;
+    return;
+  }
+
+  // the spooled files can only be renamed if they were staged on this media:
+  std::string staging_dir = folder;
+  onis::util::filesystem::concat(staging_dir, ".staging");
+  const Json::Value& files = job["files"];
+  std::vector<std::string> paths;
+  std::vector<std::string> names;
+  bool staged = !folder.empty();
+  for (const auto& file : files) {
+    paths.push_back(file["path"].asString());
+    names.push_back(file["name"].asString());
+    if (std::filesystem::path(paths.back()).parent_path() !=
+        std::filesystem::path(staging_dir))
+      staged = false;
+  }
+
+  if (!summary.isMember("total"))
+    init_import_summary(summary);
+  std::size_t committed = std::min<std::size_t>(
+      previous.isObject() ? previous["committed"].asUInt64() : 0,
+      paths.size());
+
+  // a staged file missing when the job is resumed was renamed into place by
+  // a batch committed before its progress could be journaled:
+  bool resumed = previous.isObject() || job["attempts"].asUInt() > 1;
+  std::vector<std::string> remaining_paths;
+  std::vector<std::string> remaining_names;
+  std::vector<std::size_t> positions;
+  for (std::size_t i = committed; i < paths.size(); i++) {
+    if (resumed && staged && !onis::util::filesystem::exist_file(paths[i])) {
+      summary["total"] = summary["total"].asUInt() + 1;
+      summary["imported"] = summary["imported"].asUInt() + 1;
+      continue;
+    }
+    remaining_paths.push_back(paths[i]);
+    remaining_names.push_back(names[i]);
+    positions.push_back(i);
+  }
+
+  // the progress is journaled after each committed batch:
+  Json::Value results(Json::arrayValue);
+  auto report = [&](const Json::Value& status) {
+    Json::Value current = summary;
+    add_import_results(results, remaining_names, current);
+    Json::Value state(Json::objectValue);
+    state["processed"] = current["total"];
+    state["total"] = static_cast<Json::UInt64>(paths.size());
+    state["committed"] = static_cast<Json::UInt64>(
+        results.empty() ? committed : positions[results.size() - 1] + 1);
+    state["summary"] = current;
+    if (progress)
+      progress(state);
+  };
+  import_dicom_files(db, source_id, partition, media, folder, remaining_paths,
+                     staged, report, results);
+  output = summary;
+  add_import_results(results, remaining_names, output);
+  delete_staged_files(files);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// import_dicom_file
+////////////////////////////////////////////////////////////////////////////////
+
+void request_service::import_dicom_file(const request_database& db,
+                                        const std::string& source_id,
+                                        const Json::Value& partition,
+                                        std::int32_t media,
+                                        const std::string& folder,
+                                        const std::string& dicom_file_path,
+                                        bool staged, Json::Value& output) {
+  // the import runs in its own transaction:
+  std::uint32_t flags[4] = {0, onis::database::info_study_status, 0, 0};
+  std::string partition_seq = source_id;
+  local_store_request store(shared_from_this());
+  /*store.set_origin(req->session->user_seq,
+                   "Imported by " + req->session->login,
+                   req->log_info->get_client_ip());*/
+  store.import_file_in_transaction(db, partition_seq,
+                                   partition[PT_PARAM_KEY].asString(), media,
+                                   folder, dicom_file_path, staged, &output,
+                                   flags);
+
   // must clean up after the commit:
   // store.cleanup(req->res);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+// import_dicom_files
+////////////////////////////////////////////////////////////////////////////////
+
+// The files are imported in batches, each one committed in a single
+// transaction (see local_store_request::import_files_to_partition). One
+// result is appended per file, in order.
+void request_service::import_dicom_files(
+    const request_database& db, const std::string& source_id,
+    const Json::Value& partition, std::int32_t media,
+    const std::string& folder, const std::vector<std::string>& dicom_file_paths,
+    bool staged, const import_queue::progress_fn& progress,
+    Json::Value& results) {
+  std::size_t batch_size = std::max<std::size_t>(
+      1, config_->get_import_batch_size());
+  for (std::size_t first = 0; first < dicom_file_paths.size();
+       first += batch_size) {
+    std::vector<std::string> batch(
+        dicom_file_paths.begin() + first,
+        dicom_file_paths.begin() +
+            std::min(first + batch_size, dicom_file_paths.size()));
+    std::string partition_seq = source_id;
+    db->begin_transaction();
+    local_store_request store(shared_from_this());
+    store.set_move_source_file(staged);
+    store.import_files_to_partition(db, partition_seq,
+                                    partition[PT_PARAM_KEY].asString(), media,
+                                    folder, batch, results);
+    if (progress) {
+      Json::Value status(Json::objectValue);
+      status["processed"] = results.size();
+      status["total"] = static_cast<Json::UInt64>(dicom_file_paths.size());
+      progress(status);
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// import_dicom_folder
+////////////////////////////////////////////////////////////////////////////////
+
+// The files found in the folder and its sub-folders are imported in batches,
+// in the order of their names, only the summary of the import is kept. The
+// summary can be the one of an interrupted import of the folder: its files
+// ("total") are then skipped.
+void request_service::import_dicom_folder(
+    const request_database& db, const std::string& source_id,
+    const Json::Value& partition, std::int32_t media,
+    const std::string& folder, const std::string& dicom_folder_path,
+    const import_queue::progress_fn& progress, Json::Value& summary) {
+  if (!summary.isMember("total"))
+    init_import_summary(summary);
+  std::uint64_t skipped = summary["total"].asUInt64();
+  std::uint64_t index = 0;
+  std::size_t batch_size = std::max<std::size_t>(
+      1, config_->get_import_batch_size());
+  std::vector<std::string> batch;
+  auto flush = [&]() {
+    Json::Value results(Json::arrayValue);
+    import_dicom_files(db, source_id, partition, media, folder, batch, false,
+                       nullptr, results);
+    add_import_results(results, batch, summary);
+    batch.clear();
+    if (progress) {
+      Json::Value status(Json::objectValue);
+      status["processed"] = summary["total"];
+      status["imported"] = summary["imported"];
+      status["failed"] = summary["failed"];
+      status["committed"] = summary["total"];
+      status["summary"] = summary;
+      progress(status);
+    }
+  };
+
+  visit_folder_files(dicom_folder_path, [&](const std::string& path) {
+    if (index++ < skipped)
+      return;
+    batch.push_back(path);
+    if (batch.size() >= batch_size)
+      flush();
+  });
+  if (!batch.empty())
+    flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// apply_counter_deltas
+////////////////////////////////////////////////////////////////////////////////
+
+// Apply the counter deltas logged by the imports, in their own transaction.
+std::size_t request_service::apply_counter_deltas(std::int32_t limit) {
+  request_database db(this);
+  db->begin_transaction();
+  try {
+    std::size_t count = db->apply_counter_deltas(limit);
+    db->commit();
+    return count;
+  } catch (...) {
+    try {
+      db->rollback();
+    } catch (...) {
+    }
+    throw;
+  }
+}
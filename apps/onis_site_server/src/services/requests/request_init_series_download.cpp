@@ -69,23 +69,76 @@ void request_service::process_init_series_download_request(
     request_database db(this);
     db->begin_transaction();
     try {
-      Json::Value images(Json::arrayValue);
       Json::Value partition(Json::objectValue);
       verify_partition_access_permission(db, req->session, source_id,
                                          &partition,
                                          onis::database::info_partition_volume,
                                          onis::database::lock_mode::NO_LOCK);
       std::string volume_seq = partition[PT_VOLUME_KEY].asString();
-      site_database_entity_access_info info(source_id, "", patient_seq,
-                                            patient_id, study_seq, study_uid,
-                                            series_seq, series_uid, "", "");
-      info.find(db, onis::database::lock_mode::NO_LOCK, 0, 0,
-                onis::database::info_series_properties, 0);
-      db->find_images(series_seq, onis::database::info_all, false,
-                      onis::database::lock_mode::NO_LOCK, images);
-      if (images.size() == 0) {
-        throw onis::exception(EOS_NO_IMAGE, "No image found for series");
-      }
+
+      // resolve the files of the series (shared by the workstations opening
+      // the same series at the same time):
+      Json::Value params(Json::objectValue);
+      params["source"] = source_id;
+      params["volume"] = volume_seq;
+      params["patient_seq"] = patient_seq;
+      params["patient_id"] = patient_id;
+      params["study_seq"] = study_seq;
+      params["study_uid"] = study_uid;
+      params["series_seq"] = series_seq;
+      params["series_uid"] = series_uid;
+      std::string key = request_coalescer::make_key("series_files", params);
+      request_coalescer::value_ptr files = read_coalescer_->run(
+          key, [&](Json::Value& files) {
+            files = Json::Value(Json::arrayValue);
+            Json::Value images(Json::arrayValue);
+            site_database_entity_access_info info(
+                source_id, "", patient_seq, patient_id, study_seq, study_uid,
+                series_seq, series_uid, "", "");
+            info.find(db, onis::database::lock_mode::NO_LOCK, 0, 0,
+                      onis::database::info_series_properties, 0);
+            db->find_images(series_seq, onis::database::info_all, false,
+                            onis::database::lock_mode::NO_LOCK, images);
+            if (images.size() == 0) {
+              throw onis::exception(EOS_NO_IMAGE, "No image found for series");
+            }
+            for (Json::ArrayIndex i = 0; i < images.size(); i++) {
+              std::string full_path;
+              std::int32_t media = -1;
+              std::int32_t type = -1;
+              std::string relative_path =
+                  images[i][IM_STREAM_PATH_KEY].asString();
+              if (!relative_path.empty()) {
+                media = images[i][IM_STREAM_MEDIA_KEY].asInt();
+                type = 2;
+              } else {
+                type = 1;
+                relative_path = images[i][IM_IMAGE_PATH_KEY].asString();
+                media = images[i][IM_IMAGE_MEDIA_KEY].asInt();
+              }
+              if (!relative_path.empty()) {
+                full_path = get_media_folder(onis::database::media_for_images,
+                                             volume_seq, media, db);
+                if (!full_path.empty())
+                  onis::util::filesystem::concat(full_path, relative_path);
+              }
+              Json::Value& file = files.append(Json::objectValue);
+              file["path"] = full_path;
+              file["type"] = type;
+              // a packed image is downloaded from its series container:
+              if (type == 1 && images[i].isMember(IM_PACK_SIZE_KEY)) {
+                file["offset"] = images[i][IM_PACK_OFFSET_KEY];
+                file["size"] = images[i][IM_PACK_SIZE_KEY];
+              }
+              // the first image is windowed before anything is decoded:
+              if (i == 0 && images[i][IM_PIXEL_STATS_KEY].isObject())
+                file[IM_PIXEL_STATS_KEY] = images[i][IM_PIXEL_STATS_KEY];
+            }
+          });
+      Json::Value series_statistics;
+      if (!series_seq.empty())
+        db->get_series_pixel_statistics(
+            series_seq, onis::database::lock_mode::NO_LOCK, series_statistics);
 
       // record the download process in the database:
       onis::core::date_time current_time;
@@ -93,34 +146,23 @@ void request_service::process_init_series_download_request(
       Json::Value download_series(Json::objectValue);
       db->create_download_series(
           series_seq, /*req->session->session_id*/ "fdsafsdfasf", current_time,
-          0, EOS_NONE, static_cast<std::int32_t>(images.size()),
+          0, EOS_NONE, static_cast<std::int32_t>(files->size()),
           download_series);
       std::string seq = download_series[BASE_SEQ_KEY].asString();
+      // the tiering rules move the series no longer downloaded:
+      if (!series_seq.empty())
+        db->set_series_access(series_seq);
 
-      std::string full_path;
-      for (Json::ArrayIndex i = 0; i < images.size(); i++) {
-        full_path.clear();
-        std::int32_t media = -1;
-        std::int32_t type = -1;
-        std::string relative_path = images[i][IM_STREAM_PATH_KEY].asString();
-        if (!relative_path.empty()) {
-          media = images[i][IM_STREAM_MEDIA_KEY].asInt();
-          type = 2;
-        } else {
-          type = 1;
-          relative_path = images[i][IM_IMAGE_PATH_KEY].asString();
-          media = images[i][IM_IMAGE_MEDIA_KEY].asInt();
-        }
-        if (!relative_path.empty()) {
-          full_path = get_media_folder(onis::database::media_for_images,
-                                       volume_seq, media, db);
-          if (!full_path.empty())
-            onis::util::filesystem::concat(full_path, relative_path);
-        }
+      for (Json::ArrayIndex i = 0; i < files->size(); i++) {
+        const Json::Value& file = (*files)[i];
+        std::int32_t type = file["type"].asInt();
         Json::Value download_image(Json::objectValue);
-        db->create_download_image(download_series[BASE_SEQ_KEY].asString(), i,
-                                  full_path, type, type == 2 ? 6 : 1, EOS_NONE,
-                                  download_image);
+        db->create_download_image(
+            download_series[BASE_SEQ_KEY].asString(), i,
+            file["path"].asString(), type, type == 2 ? 6 : 1, EOS_NONE,
+            file.isMember("size") ? file["offset"].asInt64() : -1,
+            file.isMember("size") ? file["size"].asInt64() : -1,
+            download_image);
       }
       db->commit();
 
@@ -128,7 +170,12 @@ void request_service::process_init_series_download_request(
           [&](json& output, std::vector<std::uint8_t>& binary_output) {
             Json::Value& item = output["data"][output["data"].size() - 1];
             item["seq"] = seq;
-            item["image_count"] = images.size();
+            item["image_count"] = files->size();
+            if (series_statistics.isObject())
+              item[SR_PIXEL_STATS_KEY]["series"] = series_statistics;
+            if ((*files)[0].isMember(IM_PIXEL_STATS_KEY))
+              item[SR_PIXEL_STATS_KEY]["first_image"] =
+                  (*files)[0][IM_PIXEL_STATS_KEY];
           });
 
     } catch (const onis::exception& e) {
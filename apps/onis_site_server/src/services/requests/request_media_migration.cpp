@@ -0,0 +1,242 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+// size of the blocks copied at once (and throttled):
+static const std::size_t kCopyBlockSize = 1024 * 1024;
+
+////////////////////////////////////////////////////////////////////////////////
+// Copy
+////////////////////////////////////////////////////////////////////////////////
+
+// Copy a file to another media, at the rate allowed by the worker. The copy
+// is written aside, compared with the source file (hash and size), and
+// renamed once verified. Returns false if it could not be completed.
+static bool copy_verified_file(const std::string& source,
+                               const std::string& target,
+                               const media_migration_worker_ptr& worker,
+                               std::int64_t& size) {
+  std::string tmp_path = target + ".tmp";
+  {
+    std::ifstream input(source, std::ios::binary);
+    std::ofstream output(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!input || !output)
+      return false;
+    std::vector<char> buffer(kCopyBlockSize);
+    while (input) {
+      input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      std::streamsize count = input.gcount();
+      if (count <= 0)
+        break;
+      if (!worker->throttle(static_cast<std::uint64_t>(count)) ||
+          !output.write(buffer.data(), count)) {
+        output.close();
+        onis::util::filesystem::delete_file(tmp_path);
+        return false;
+      }
+    }
+    output.close();
+    if (!input.eof() || !output) {
+      onis::util::filesystem::delete_file(tmp_path);
+      return false;
+    }
+  }
+
+  // the copy is read back, to check what was written:
+  std::string source_hash, target_hash;
+  std::int64_t target_size = 0;
+  if (!content_store::hash_file(source, source_hash, size) ||
+      !content_store::hash_file(tmp_path, target_hash, target_size) ||
+      source_hash != target_hash || size != target_size ||
+      !onis::util::filesystem::move_file(tmp_path, target)) {
+    onis::util::filesystem::delete_file(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// get_series_to_migrate
+////////////////////////////////////////////////////////////////////////////////
+
+std::string request_service::get_series_to_migrate(
+    const Json::Value& rule, const std::string& after_seq, std::int32_t limit,
+    std::vector<std::string>& seqs) {
+  request_database db(this);
+  return db->get_series_to_migrate(
+      rule["partition"].asString(), rule["from_media"].asInt(),
+      rule["min_age_days"].asInt(), rule["min_idle_days"].asInt(), after_seq,
+      limit, seqs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// migrate_series
+////////////////////////////////////////////////////////////////////////////////
+
+// Move the files of a series from a media of its volume to another one. The
+// files are copied and verified first, then all the images are recorded on
+// the new media in a single transaction, the downloads in progress being
+// redirected to the new files. The previous files are recorded in the same
+// transaction to be deleted after a delay, once the downloads that already
+// read their path are completed (see file_releaser). The images modified
+// meanwhile keep their previous file, as the images packed meanwhile in a
+// container being moved: the container is then kept on both media.
+media_migration_worker::result request_service::migrate_series(
+    const Json::Value& rule, const std::string& seq, std::int64_t& files,
+    std::int64_t& bytes) {
+  struct file_move {
+    std::vector<std::string> image_seqs;
+    std::int32_t kind;
+    std::string relative_path;
+    std::string source;
+    std::string target;
+    std::int64_t size{0};
+    bool existed{false};
+    bool recorded{false};
+  };
+  static const char* const kMediaKeys[] = {
+      IM_IMAGE_MEDIA_KEY, IM_STREAM_MEDIA_KEY, IM_ICON_MEDIA_KEY};
+  static const char* const kPathKeys[] = {IM_IMAGE_PATH_KEY, IM_STREAM_PATH_KEY,
+                                          IM_ICON_PATH_KEY};
+
+  std::int32_t from_media = rule["from_media"].asInt();
+  std::int32_t to_media = rule["to_media"].asInt();
+  if (from_media == to_media)
+    return media_migration_worker::result::skipped;
+
+  request_database db(this);
+  Json::Value source(Json::objectValue);
+  if (!db->find_migration_files(seq, source))
+    return media_migration_worker::result::skipped;
+  std::string volume_seq = source[PT_VOLUME_KEY].asString();
+  std::string from_folder = get_media_folder(onis::database::media_for_images,
+                                             volume_seq, from_media, db);
+  std::string to_folder = get_media_folder(onis::database::media_for_images,
+                                           volume_seq, to_media, db);
+  if (from_folder.empty() || to_folder.empty())
+    throw onis::exception(EOS_MEDIA, "Media not available");
+  if (from_folder == to_folder)
+    return media_migration_worker::result::skipped;
+
+  // a series container is moved once, with all the images it stores:
+  std::vector<file_move> moves;
+  std::map<std::pair<std::int32_t, std::string>, std::size_t> move_indexes;
+  std::int64_t total = 0;
+  for (const auto& image : source["images"]) {
+    for (std::int32_t kind = 0; kind < 3; kind++) {
+      std::string relative_path = image[kPathKeys[kind]].asString();
+      if (image[kMediaKeys[kind]].asInt() != from_media ||
+          relative_path.empty())
+        continue;
+      auto found = move_indexes.find({kind, relative_path});
+      if (found != move_indexes.end()) {
+        moves[found->second].image_seqs.push_back(
+            image[BASE_SEQ_KEY].asString());
+        continue;
+      }
+      file_move move;
+      move.image_seqs.push_back(image[BASE_SEQ_KEY].asString());
+      move.kind = kind;
+      move.relative_path = relative_path;
+      move.source = from_folder;
+      onis::util::filesystem::concat(move.source, relative_path);
+      move.target = to_folder;
+      onis::util::filesystem::concat(move.target, relative_path);
+      // a file that is missing is left to the consistency checks:
+      if (!onis::util::filesystem::exist_file(move.source))
+        continue;
+      total += onis::util::filesystem::get_file_size(move.source);
+      move_indexes[{kind, relative_path}] = moves.size();
+      moves.push_back(std::move(move));
+    }
+  }
+  if (moves.empty())
+    return media_migration_worker::result::skipped;
+
+  std::error_code ec;
+  std::filesystem::space_info space = std::filesystem::space(to_folder, ec);
+  if (ec || space.available < static_cast<std::uintmax_t>(total))
+    throw onis::exception(EOS_MEDIA, "Not enough space on the target media");
+
+  // copy the files (a target that already exists is a container moved before
+  // for other images of the series, it is replaced by a longer copy but never
+  // deleted):
+  std::vector<file_move> copied;
+  for (auto& move : moves) {
+    move.existed = onis::util::filesystem::exist_file(move.target);
+    directory_cache_->create_directories(
+        onis::util::filesystem::get_directory(move.target));
+    if (!copy_verified_file(move.source, move.target, migration_worker_,
+                            move.size)) {
+      std::cerr << "migrate_series: Failed to copy " << move.source << " to "
+                << move.target << std::endl;
+      for (const auto& item : copied) {
+        if (!item.existed)
+          onis::util::filesystem::delete_file(item.target);
+      }
+      return media_migration_worker::result::failed;
+    }
+    copied.push_back(move);
+  }
+
+  // record the new media of the files:
+  bool migrated = false;
+  db->begin_transaction();
+  try {
+    for (auto& move : copied) {
+      for (const auto& image_seq : move.image_seqs) {
+        // a content is stored on a media, the one of a single image is
+        // released (unless it was shared meanwhile):
+        if (move.kind == 0 && !db->release_image_content(image_seq))
+          continue;
+        if (db->set_image_file_media(image_seq, move.kind, from_media,
+                                     to_media, move.relative_path))
+          move.recorded = true;
+      }
+      if (move.recorded) {
+        // a file moved back before its release is kept:
+        db->cancel_file_release(volume_seq, to_media, move.relative_path);
+        db->redirect_series_downloads(seq, move.source, move.target);
+        if (!db->is_image_file_used(seq, move.kind, from_media,
+                                    move.relative_path))
+          db->add_file_release(volume_seq, from_media, move.relative_path,
+                               static_cast<std::int32_t>(
+                                   config_->get_tiering_release_delay()));
+        migrated = true;
+      }
+    }
+    db->commit();
+  } catch (...) {
+    try {
+      db->rollback();
+    } catch (...) {
+    }
+    for (const auto& move : copied) {
+      if (!move.existed)
+        onis::util::filesystem::delete_file(move.target);
+    }
+    throw;
+  }
+
+  for (const auto& move : copied) {
+    if (move.recorded) {
+      files++;
+      bytes += move.size;
+    } else if (!move.existed) {
+      onis::util::filesystem::delete_file(move.target);
+    }
+  }
+  return migrated ? media_migration_worker::result::migrated
+                  : media_migration_worker::result::skipped;
+}
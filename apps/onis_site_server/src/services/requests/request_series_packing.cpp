@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "../../../include/database/items/db_image.hpp"
+#include "../../../include/database/items/db_media.hpp"
+#include "../../../include/database/items/db_partition.hpp"
+#include "../../../include/services/requests/packing/series_container.hpp"
+#include "../../../include/services/requests/request_service.hpp"
+#include "../../../include/services/requests/store/local_store_request.hpp"
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/utilities/filesystem.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// get_series_to_pack
+////////////////////////////////////////////////////////////////////////////////
+
+std::string request_service::get_series_to_pack(
+    const std::string& after_seq, std::int32_t limit,
+    std::vector<std::string>& seqs) {
+  request_database db(this);
+  return db->get_series_to_pack(
+      static_cast<std::int32_t>(config_->get_packing_min_idle_hours()),
+      static_cast<std::int32_t>(
+          std::max<std::uint32_t>(config_->get_packing_min_instances(), 1)),
+      after_seq, limit, seqs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// pack_series
+////////////////////////////////////////////////////////////////////////////////
+
+// Append the files of the images of a series to a container of their media:
+// the one the series already has there, or a new one in the folder of the
+// series. The images are recorded in the container in a single transaction,
+// the downloads in progress being redirected to their range. The previous
+// files are recorded in the same transaction to be deleted after a delay,
+// once the downloads that already read their path are completed (see
+// file_releaser). The images modified meanwhile keep their previous file,
+// their copy remaining unused in the container.
+series_packer::result request_service::pack_series(const std::string& seq,
+                                                   std::int64_t& files,
+                                                   std::int64_t& bytes) {
+  request_database db(this);
+  Json::Value source(Json::objectValue);
+  if (!db->find_packing_images(seq, source))
+    return series_packer::result::skipped;
+  std::string volume_seq = source[PT_VOLUME_KEY].asString();
+
+  std::map<std::int32_t, std::vector<const Json::Value*>> media_images;
+  for (const auto& image : source["images"])
+    media_images[image[IM_IMAGE_MEDIA_KEY].asInt()].push_back(&image);
+
+  bool packed = false;
+  bool failed = false;
+  for (const auto& [media, images] : media_images) {
+    std::string folder = get_media_folder(onis::database::media_for_images,
+                                          volume_seq, media, db);
+    if (folder.empty())
+      throw onis::exception(EOS_MEDIA, "Media not available");
+
+    std::vector<series_container::entry> entries;
+    std::vector<std::string> relative_paths;
+    for (const auto* image : images) {
+      series_container::entry entry;
+      entry.seq = (*image)[BASE_SEQ_KEY].asString();
+      std::string relative_path = (*image)[IM_IMAGE_PATH_KEY].asString();
+      entry.source = folder;
+      onis::util::filesystem::concat(entry.source, relative_path);
+      // a file that is missing is left to the consistency checks:
+      if (!onis::util::filesystem::exist_file(entry.source))
+        continue;
+      // the frames of a packed image are only located by its frame table:
+      if (!(*image)["frames"].asBool()) {
+        Json::Value pixel_data(Json::objectValue);
+        if (local_store_request::read_pixel_data_offsets(entry.source,
+                                                         pixel_data))
+          db->set_image_frames(entry.seq, pixel_data);
+      }
+      entries.push_back(std::move(entry));
+      relative_paths.push_back(relative_path);
+    }
+    if (entries.empty())
+      continue;
+
+    // the container of the series on the media, a new one if it has none or
+    // if its last append was interrupted:
+    std::string container = db->find_series_container(seq, media);
+    std::string container_path = folder;
+    onis::util::filesystem::concat(container_path, container);
+    bool appending =
+        !container.empty() && series_container::is_valid(container_path);
+    if (!appending) {
+      container = onis::util::filesystem::get_directory(relative_paths[0]);
+      onis::util::filesystem::concat(container,
+                                     series_container::create_name());
+      container_path = folder;
+      onis::util::filesystem::concat(container_path, container);
+    }
+
+    std::uint64_t previous_size = 0;
+    if (!series_container::append(container_path, entries, previous_size)) {
+      std::cerr << "pack_series: Failed to append the files of the series "
+                << seq << " to " << container_path << std::endl;
+      failed = true;
+      continue;
+    }
+
+    // record the images in the container (unless a migration moved it
+    // meanwhile):
+    std::vector<std::size_t> recorded;
+    db->begin_transaction();
+    try {
+      if (!appending || db->lock_series_container(seq, media, container)) {
+        for (std::size_t i = 0; i < entries.size(); i++) {
+          const auto& entry = entries[i];
+          // a packed file is no longer a content:
+          if (db->release_image_content(entry.seq) &&
+              db->set_image_packed(entry.seq, media, relative_paths[i],
+                                   container, entry.offset, entry.size)) {
+            db->redirect_packed_downloads(seq, entry.source, container_path,
+                                          entry.offset, entry.size);
+            db->add_file_release(volume_seq, media, relative_paths[i],
+                                 static_cast<std::int32_t>(
+                                     config_->get_packing_release_delay()));
+            recorded.push_back(i);
+          }
+        }
+      }
+      db->commit();
+    } catch (...) {
+      try {
+        db->rollback();
+      } catch (...) {
+      }
+      series_container::discard(container_path, previous_size);
+      throw;
+    }
+
+    if (recorded.empty()) {
+      series_container::discard(container_path, previous_size);
+      continue;
+    }
+    for (std::size_t i : recorded) {
+      files++;
+      bytes += static_cast<std::int64_t>(entries[i].size);
+    }
+    packed = true;
+  }
+  if (packed) {
+    // the series is completed, its metadata pack is prepared for the viewers
+    // (with the new locations of its files):
+    try {
+      prepare_series_metadata(seq, db);
+    } catch (const std::exception& e) {
+      std::cerr << "pack_series: Failed to prepare the metadata of the series "
+                << seq << ": " << e.what() << std::endl;
+    }
+    return series_packer::result::packed;
+  }
+  return failed ? series_packer::result::failed
+                : series_packer::result::skipped;
+}
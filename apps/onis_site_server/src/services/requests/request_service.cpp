@@ -8,6 +8,9 @@
 #include "onis_kit/include/core/result.hpp"
 #include "onis_kit/include/database/postgresql/postgresql_connection.hpp"
 
+// number of sops read at once to build the sop filter of a partition:
+static const std::int32_t kSopFilterPageSize = 100000;
+
 ////////////////////////////////////////////////////////////////////////////////
 // request_service class
 ////////////////////////////////////////////////////////////////////////////////
@@ -16,8 +19,167 @@
 // static constructor
 //------------------------------------------------------------------------------
 
-request_service_ptr request_service::create() {
-  request_service_ptr ret = std::make_shared<request_service>();
+request_service_ptr request_service::create(
+    const config_service_ptr& config) {
+  request_service_ptr ret = std::make_shared<request_service>(config);
+
+  // the import workers only hold a weak reference to the service:
+  std::weak_ptr<request_service> weak = ret;
+  ret->import_queue_->start(
+      [weak](const Json::Value& job, const import_queue::progress_fn& progress,
+             Json::Value& output) {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        srv->process_import_job(job, progress, output);
+      });
+
+  // the sop filters are built from the database in the background:
+  ret->sop_filter_->start(
+      [weak](std::vector<std::string>& seqs) {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          return;
+        request_database db(srv.get());
+        db->get_partition_seqs(seqs);
+      },
+      [weak](const std::string& partition_seq, const sop_filter::add_fn& add) {
+        std::string after_seq;
+        do {
+          request_service_ptr srv = weak.lock();
+          if (!srv)
+            throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+          std::vector<std::string> sops;
+          {
+            request_database db(srv.get());
+            after_seq = db->get_partition_sops(partition_seq, after_seq,
+                                               kSopFilterPageSize, sops);
+          }
+          for (const auto& sop : sops) {
+            if (!add(sop))
+              return;
+          }
+        } while (!after_seq.empty());
+      });
+
+  // the counter deltas logged by the imports are applied in the background:
+  ret->aggregate_updater_->start([weak](std::int32_t limit) -> std::size_t {
+    request_service_ptr srv = weak.lock();
+    if (!srv)
+      throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+    return srv->apply_counter_deltas(limit);
+  });
+
+  // the stream files, icons and pixel statistics of the images are created
+  // in the background:
+  ret->derived_object_worker_->start(
+      [weak](const std::string& after_seq, std::int32_t limit,
+             std::vector<std::string>& seqs) -> std::string {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->get_pending_derived_images(after_seq, limit, seqs);
+      },
+      [weak](const std::string& seq) -> std::size_t {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->generate_derived_objects(seq);
+      });
+
+  // the images are compressed with the rules of their partitions:
+  ret->compression_worker_->start(
+      [weak](const std::string& after_seq, std::int32_t limit,
+             std::vector<std::string>& seqs) -> std::string {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->get_images_to_compress(after_seq, limit, seqs);
+      },
+      [weak](const std::string& seq,
+             std::int64_t& saved) -> compression_worker::result {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->compress_image(seq, saved);
+      });
+
+  // the contents no longer referenced are removed in the background:
+  if (ret->content_store_->is_enabled()) {
+    ret->content_store_->start(
+        [weak](std::int32_t limit) -> std::size_t {
+          request_service_ptr srv = weak.lock();
+          if (!srv)
+            throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+          return srv->collect_contents(limit);
+        },
+        [weak](Json::Value& output) {
+          request_service_ptr srv = weak.lock();
+          if (!srv)
+            throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+          srv->measure_contents(output);
+        });
+  }
+
+  // the replaced files are deleted once their delay expired, those replaced
+  // before a restart too:
+  ret->file_releaser_->start([weak](std::int32_t limit) -> std::size_t {
+    request_service_ptr srv = weak.lock();
+    if (!srv)
+      throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+    return srv->release_files(limit);
+  });
+
+  // the series are moved between the media by the tiering rules:
+  ret->migration_worker_->start(
+      [weak](const Json::Value& rule, const std::string& after_seq,
+             std::int32_t limit,
+             std::vector<std::string>& seqs) -> std::string {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->get_series_to_migrate(rule, after_seq, limit, seqs);
+      },
+      [weak](const Json::Value& rule, const std::string& seq,
+             std::int64_t& files,
+             std::int64_t& bytes) -> media_migration_worker::result {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->migrate_series(rule, seq, files, bytes);
+      });
+
+  // the completed series are stored in containers:
+  ret->series_packer_->start(
+      [weak](const std::string& after_seq, std::int32_t limit,
+             std::vector<std::string>& seqs) -> std::string {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->get_series_to_pack(after_seq, limit, seqs);
+      },
+      [weak](const std::string& seq, std::int64_t& files,
+             std::int64_t& bytes) -> series_packer::result {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        return srv->pack_series(seq, files, bytes);
+      });
+
+  // the consistency checks of the partitions run in the background:
+  ret->archive_checker_->start(
+      [weak](const Json::Value& job,
+             const archive_checker::progress_fn& progress,
+             Json::Value& output) {
+        request_service_ptr srv = weak.lock();
+        if (!srv)
+          throw onis::exception(EOS_NOT_AVAILABLE, "Service stopped");
+        srv->check_archive(job, progress, output);
+      });
+
+  // the images retrieved in another transfer syntax are transcoded by a pool
+  // of workers:
+  ret->transcode_pool_->start();
   return ret;
 }
 
@@ -25,7 +187,122 @@ request_service_ptr request_service::create() {
 // constructor
 //------------------------------------------------------------------------------
 
-request_service::request_service() : session_timeout_(std::chrono::hours(1)) {
+request_service::request_service(const config_service_ptr& config)
+    : config_(config), session_timeout_(std::chrono::hours(1)) {
+  // Identical concurrent reads are coalesced, results are kept 500ms:
+  read_coalescer_ = request_coalescer::create(std::chrono::milliseconds(500));
+
+  // Popular files served by the downloads are kept in memory:
+  hot_file_cache_ = hot_file_cache::create(
+      config_->get_hot_file_cache_budget(),
+      config_->get_hot_file_cache_max_file_size(),
+      config_->get_hot_file_cache_admission_hits());
+
+  // The images of a series are attached to the series resolved by the
+  // previous ones:
+  import_lookup_cache_ = import_lookup_cache::create(
+      std::chrono::seconds(config_->get_import_lookup_cache_ttl()),
+      config_->get_import_lookup_cache_max_series());
+
+  // The duplicate sops are only searched when the filter may contain them:
+  sop_filter_ = sop_filter::create(config_->get_sop_filter_bits_per_sop(),
+                                   config_->get_sop_filter_min_capacity());
+
+  // The storage directories are only created by the first image of a series:
+  directory_cache_ =
+      directory_cache::create(config_->get_directory_cache_max_entries());
+
+  // The rendered previews are kept in memory and on disk, across restarts:
+  preview_cache_ = derived_file_cache::create(
+      config_->get_preview_cache_folder(),
+      config_->get_preview_cache_memory_budget(),
+      config_->get_preview_cache_disk_budget());
+  preview_cache_->start();
+
+  // The files transcoded on retrieval are only kept on disk, across restarts:
+  transcode_cache_ = derived_file_cache::create(
+      config_->get_transcoded_cache_folder(), 0,
+      config_->get_transcoded_cache_budget());
+  transcode_cache_->start();
+
+  // The metadata packs of the series are kept in memory and on disk, across
+  // restarts:
+  metadata_cache_ = derived_file_cache::create(
+      config_->get_metadata_cache_folder(),
+      config_->get_metadata_cache_memory_budget(),
+      config_->get_metadata_cache_disk_budget());
+  metadata_cache_->start();
+
+  // Uploads are spooled and imported in the background:
+  import_queue_ = import_queue::create(
+      config_->get_import_spool_folder(), config_->get_import_workers(),
+      config_->get_import_max_pending(), config_->get_import_max_attempts(),
+      config_->get_import_retention_hours());
+
+  // The counters of the patients, studies and series are updated in bulk:
+  aggregate_updater_ = aggregate_updater::create(
+      std::chrono::milliseconds(config_->get_import_aggregate_interval()),
+      config_->get_import_aggregate_batch_size());
+
+  // The imports of the same study or patient run one after the other:
+  import_lock_manager_ =
+      import_lock_manager::create(config_->get_import_lock_stripes());
+
+  // The stream files and icons are created after the imports, those of the
+  // last imported images first:
+  derived_object_worker_ = derived_object_worker::create(
+      config_->get_derived_workers(), config_->get_derived_max_queued(),
+      config_->get_derived_scan_batch_size(),
+      std::chrono::milliseconds(config_->get_derived_backlog_delay()),
+      std::chrono::seconds(config_->get_derived_rescan_interval()));
+
+  // The stored images are compressed in the background, when the rules of
+  // their partitions allow it:
+  compression_worker_ = compression_worker::create(
+      config_->get_image_compression_workers(),
+      config_->get_image_compression_scan_batch_size(),
+      std::chrono::seconds(config_->get_image_compression_rescan_interval()));
+
+  // The images requested in another transfer syntax are transcoded on
+  // retrieval, in parallel:
+  transcode_pool_ =
+      transcode_pool::create(config_->get_transcoding_workers(),
+                             config_->get_transcoding_max_pending());
+
+  // The files with the same content are stored once per media:
+  content_store_ = content_store::create(
+      config_->is_deduplication_enabled(),
+      std::chrono::seconds(config_->get_deduplication_gc_interval()),
+      config_->get_deduplication_gc_batch_size());
+
+  // The files replaced by another one are kept while they may still be
+  // downloaded, and deleted later:
+  file_releaser_ = file_releaser::create(
+      std::chrono::seconds(config_->get_file_release_interval()),
+      config_->get_file_release_batch_size());
+
+  // The series are moved between the media of their volume by the tiering
+  // rules:
+  migration_worker_ = media_migration_worker::create(
+      config_->get_tiering_rules(),
+      std::chrono::seconds(config_->get_tiering_interval()),
+      config_->get_tiering_batch_size(),
+      config_->get_tiering_max_bytes_per_second());
+
+  // The completed series are stored in a container per media, instead of a
+  // file per image:
+  series_packer_ = series_packer::create(
+      config_->is_packing_enabled(),
+      std::chrono::seconds(config_->get_packing_interval()),
+      config_->get_packing_batch_size());
+
+  // The media folders of the partitions are compared with the database on
+  // request:
+  archive_checker_ = archive_checker::create(
+      config_->get_archive_check_threads(),
+      config_->get_archive_check_max_pending(),
+      config_->get_archive_check_retention_hours());
+
   // Initialize database pool with default max size of 10
   database_pool_ = std::make_unique<site_database_pool>(10);
 
@@ -54,7 +331,38 @@ request_service::request_service() : session_timeout_(std::chrono::hours(1)) {
 // destructor
 //------------------------------------------------------------------------------
 
-request_service::~request_service() {}
+request_service::~request_service() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// background workers
+//------------------------------------------------------------------------------
+
+void request_service::stop() {
+  if (archive_checker_)
+    archive_checker_->stop();
+  if (import_queue_)
+    import_queue_->stop();
+  if (sop_filter_)
+    sop_filter_->stop();
+  if (aggregate_updater_)
+    aggregate_updater_->stop();
+  if (derived_object_worker_)
+    derived_object_worker_->stop();
+  if (compression_worker_)
+    compression_worker_->stop();
+  if (transcode_pool_)
+    transcode_pool_->stop();
+  if (content_store_)
+    content_store_->stop();
+  if (file_releaser_)
+    file_releaser_->stop();
+  if (migration_worker_)
+    migration_worker_->stop();
+  if (series_packer_)
+    series_packer_->stop();
+}
 
 //------------------------------------------------------------------------------
 // database pool access
@@ -69,6 +377,130 @@ void request_service::return_database_connection(
   database_pool_->return_connection(connection);
 }
 
+//------------------------------------------------------------------------------
+// request coalescing
+//------------------------------------------------------------------------------
+
+request_coalescer_ptr request_service::get_read_coalescer() const {
+  return read_coalescer_;
+}
+
+//------------------------------------------------------------------------------
+// caches
+//------------------------------------------------------------------------------
+
+hot_file_cache_ptr request_service::get_hot_file_cache() const {
+  return hot_file_cache_;
+}
+
+import_lookup_cache_ptr request_service::get_import_lookup_cache() const {
+  return import_lookup_cache_;
+}
+
+sop_filter_ptr request_service::get_sop_filter() const {
+  return sop_filter_;
+}
+
+directory_cache_ptr request_service::get_directory_cache() const {
+  return directory_cache_;
+}
+
+derived_file_cache_ptr request_service::get_preview_cache() const {
+  return preview_cache_;
+}
+
+derived_file_cache_ptr request_service::get_transcode_cache() const {
+  return transcode_cache_;
+}
+
+derived_file_cache_ptr request_service::get_metadata_cache() const {
+  return metadata_cache_;
+}
+
+//------------------------------------------------------------------------------
+// asynchronous imports
+//------------------------------------------------------------------------------
+
+import_queue_ptr request_service::get_import_queue() const {
+  return import_queue_;
+}
+
+import_lock_manager_ptr request_service::get_import_lock_manager() const {
+  return import_lock_manager_;
+}
+
+//------------------------------------------------------------------------------
+// counters of the patients, studies and series
+//------------------------------------------------------------------------------
+
+aggregate_updater_ptr request_service::get_aggregate_updater() const {
+  return aggregate_updater_;
+}
+
+//------------------------------------------------------------------------------
+// derived objects
+//------------------------------------------------------------------------------
+
+derived_object_worker_ptr request_service::get_derived_object_worker() const {
+  return derived_object_worker_;
+}
+
+bool request_service::is_pixel_statistics_enabled() const {
+  return config_->is_pixel_statistics_enabled();
+}
+
+//------------------------------------------------------------------------------
+// image compression
+//------------------------------------------------------------------------------
+
+compression_worker_ptr request_service::get_compression_worker() const {
+  return compression_worker_;
+}
+
+//------------------------------------------------------------------------------
+// transcoding on retrieval
+//------------------------------------------------------------------------------
+
+transcode_pool_ptr request_service::get_transcode_pool() const {
+  return transcode_pool_;
+}
+
+//------------------------------------------------------------------------------
+// deduplication
+//------------------------------------------------------------------------------
+
+content_store_ptr request_service::get_content_store() const {
+  return content_store_;
+}
+
+file_releaser_ptr request_service::get_file_releaser() const {
+  return file_releaser_;
+}
+
+//------------------------------------------------------------------------------
+// tiering
+//------------------------------------------------------------------------------
+
+media_migration_worker_ptr request_service::get_migration_worker() const {
+  return migration_worker_;
+}
+
+//------------------------------------------------------------------------------
+// packing
+//------------------------------------------------------------------------------
+
+series_packer_ptr request_service::get_series_packer() const {
+  return series_packer_;
+}
+
+//------------------------------------------------------------------------------
+// consistency checks
+//------------------------------------------------------------------------------
+
+archive_checker_ptr request_service::get_archive_checker() const {
+  return archive_checker_;
+}
+
 //------------------------------------------------------------------------------
 // sessions
 //------------------------------------------------------------------------------
@@ -149,12 +581,39 @@ void request_service::process_request(const request_data_ptr& req) {
       case request_type::kImportDicom:
         process_import_dicom_file_request(req);
         break;
+      case request_type::kGetImportJob:
+        process_get_import_job_request(req);
+        break;
       case request_type::kInitSeriesDownload:
         process_init_series_download_request(req);
         break;
       case request_type::kDownloadImages:
         process_download_images_request(req);
         break;
+      case request_type::kGetImageFile:
+        process_get_image_file_request(req);
+        break;
+      case request_type::kGetImageFrames:
+        process_get_image_frames_request(req);
+        break;
+      case request_type::kGetImagePreview:
+        process_get_image_preview_request(req);
+        break;
+      case request_type::kGetSeriesMetadata:
+        process_get_series_metadata_request(req);
+        break;
+      case request_type::kGetStatistics:
+        process_get_statistics_request(req);
+        break;
+      case request_type::kCheckArchive:
+        process_check_archive_request(req);
+        break;
+      case request_type::kGetArchiveCheck:
+        process_get_archive_check_request(req);
+        break;
+      case request_type::kExportStudies:
+        process_export_studies_request(req);
+        break;
       default:
         break;
     }
@@ -236,6 +695,9 @@ void request_service::check_media() {
   for (const auto& key : keys_to_erase) {
     _media.erase(key);
   }
+  // the images will be stored on other media roots:
+  if (!keys_to_erase.empty() && directory_cache_)
+    directory_cache_->clear();
 }
 
 std::string request_service::get_current_media_folder(
@@ -244,26 +706,27 @@ std::string request_service::get_current_media_folder(
   std::string folder;
   if (target == onis::database::media_for_images) {
     if (!volume_seq.empty()) {
-      std::lock_guard<std::recursive_mutex> lock(_media_mutex);
-      if (_media.find(volume_seq) != _media.end()) {
-        media_info_ptr info = _media[volume_seq];
-        if (info != NULL) {
-          *media = info->num;
-          folder = info->folder;
-        }
-      } else {
-        Json::Value media_list(Json::arrayValue);
-        db->get_volume_media_list(volume_seq, onis::database::info_all,
-                                  onis::database::lock_mode::NO_LOCK,
-                                  media_list);
-        for (const auto& item : media_list) {
-          if (item[ME_STATUS_KEY].asInt() == onis::database::media_available) {
-            *media = item[ME_NUM_KEY].asInt();
-            folder = item[ME_PATH_KEY].asString();
-            _media[volume_seq] = media_info::create(
-                *media, folder, item[ME_RATIO_KEY].asFloat());
-            break;
+      {
+        std::lock_guard<std::recursive_mutex> lock(_media_mutex);
+        if (_media.find(volume_seq) != _media.end()) {
+          media_info_ptr info = _media[volume_seq];
+          if (info != NULL) {
+            *media = info->num;
+            folder = info->folder;
           }
+          return folder;
+        }
+      }
+      request_coalescer::value_ptr media_list =
+          load_volume_media_list(volume_seq, db);
+      std::lock_guard<std::recursive_mutex> lock(_media_mutex);
+      for (const auto& item : *media_list) {
+        if (item[ME_STATUS_KEY].asInt() == onis::database::media_available) {
+          *media = item[ME_NUM_KEY].asInt();
+          folder = item[ME_PATH_KEY].asString();
+          _media[volume_seq] = media_info::create(*media, folder,
+                                                  item[ME_RATIO_KEY].asFloat());
+          break;
         }
       }
     }
@@ -278,35 +741,52 @@ std::string request_service::get_media_folder(std::int32_t target,
   std::string folder;
   if (target == onis::database::media_for_images) {
     if (!volume_seq.empty()) {
-      std::lock_guard<std::recursive_mutex> lock(_media_mutex);
-      if (_media_list.find(volume_seq) != _media_list.end()) {
-        std::vector<media_info_ptr>& list = _media_list[volume_seq];
-        for (const auto& info : list) {
-          if (info->num == media) {
-            folder = info->folder;
-            break;
+      {
+        std::lock_guard<std::recursive_mutex> lock(_media_mutex);
+        if (_media_list.find(volume_seq) != _media_list.end()) {
+          std::vector<media_info_ptr>& list = _media_list[volume_seq];
+          for (const auto& info : list) {
+            if (info->num == media) {
+              folder = info->folder;
+              break;
+            }
           }
+          return folder;
         }
-      } else {
-        Json::Value media_list(Json::arrayValue);
-        db->get_volume_media_list(volume_seq, onis::database::info_all,
-                                  onis::database::lock_mode::NO_LOCK,
-                                  media_list);
-        std::vector<media_info_ptr>& list = _media_list[volume_seq];
-        for (const auto& item : media_list) {
-          media_info_ptr info = media_info::create(
-              item[ME_NUM_KEY].asInt(), item[ME_PATH_KEY].asString(),
-              item[ME_RATIO_KEY].asFloat());
+      }
+      request_coalescer::value_ptr media_list =
+          load_volume_media_list(volume_seq, db);
+      std::lock_guard<std::recursive_mutex> lock(_media_mutex);
+      bool populate = _media_list.find(volume_seq) == _media_list.end();
+      std::vector<media_info_ptr>& list = _media_list[volume_seq];
+      for (const auto& item : *media_list) {
+        media_info_ptr info = media_info::create(item[ME_NUM_KEY].asInt(),
+                                                 item[ME_PATH_KEY].asString(),
+                                                 item[ME_RATIO_KEY].asFloat());
+        if (populate)
           list.push_back(info);
-          if (info->num == media)
-            folder = info->folder;
-        }
+        if (info->num == media)
+          folder = info->folder;
       }
     }
   }
   return folder;
 }
 
+request_coalescer::value_ptr request_service::load_volume_media_list(
+    const std::string& volume_seq, const request_database& db) {
+  // the database is queried outside of the media lock, and only once when
+  // several requests miss the cache for the same volume at the same time:
+  Json::Value params(Json::objectValue);
+  params["volume"] = volume_seq;
+  std::string key = request_coalescer::make_key("media_list", params);
+  return read_coalescer_->run(key, [&](Json::Value& media_list) {
+    media_list = Json::Value(Json::arrayValue);
+    db->get_volume_media_list(volume_seq, onis::database::info_all,
+                              onis::database::lock_mode::NO_LOCK, media_list);
+  });
+}
+
 //------------------------------------------------------------------------------
 // utilities
 //------------------------------------------------------------------------------
@@ -0,0 +1,148 @@
+#include "../../../../include/services/requests/store/aggregate_updater.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+////////////////////////////////////////////////////////////////////////////////
+// aggregate_updater class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+aggregate_updater_ptr aggregate_updater::create(
+    std::chrono::milliseconds interval, std::size_t batch_size) {
+  return std::make_shared<aggregate_updater>(interval, batch_size);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+aggregate_updater::aggregate_updater(std::chrono::milliseconds interval,
+                                     std::size_t batch_size)
+    : interval_(std::max(interval, std::chrono::milliseconds(10))),
+      batch_size_(static_cast<std::int32_t>(
+          std::clamp<std::size_t>(batch_size, 1, 100000))) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+aggregate_updater::~aggregate_updater() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void aggregate_updater::start(const apply_fn& apply) {
+  {
+    std::lock_guard<std::mutex> lock(apply_mutex_);
+    apply_ = apply;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  worker_ = std::thread(&aggregate_updater::worker, this);
+}
+
+void aggregate_updater::stop() {
+  // the deltas still pending are applied at the next start:
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker.swap(worker_);
+  }
+  cv_.notify_all();
+  if (worker.get_id() == std::this_thread::get_id())
+    worker.detach();
+  else if (worker.joinable())
+    worker.join();
+}
+
+//------------------------------------------------------------------------------
+// deltas
+//------------------------------------------------------------------------------
+
+void aggregate_updater::add_pending(std::size_t count) {
+  if (count == 0)
+    return;
+  std::size_t pending = pending_ += count;
+  if (pending >= static_cast<std::size_t>(batch_size_))
+    cv_.notify_one();
+}
+
+std::uint64_t aggregate_updater::get_generation() const {
+  return generation_;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void aggregate_updater::get_statistics(Json::Value& output) const {
+  output["pending"] = static_cast<Json::UInt64>(pending_.load());
+  output["applied"] = static_cast<Json::UInt64>(applied_);
+  output["rounds"] = static_cast<Json::UInt64>(rounds_);
+  output["failures"] = static_cast<Json::UInt64>(failures_);
+}
+
+//------------------------------------------------------------------------------
+// rounds
+//------------------------------------------------------------------------------
+
+void aggregate_updater::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  bool succeeded = true;
+  bool first = true;
+  while (!stopping_) {
+    if (!first) {
+      // after a failure (a deadlock with an import, for example), the next
+      // round waits for the full interval:
+      cv_.wait_for(lock, interval_, [this, succeeded] {
+        return stopping_ ||
+               (succeeded &&
+                pending_ >= static_cast<std::size_t>(batch_size_));
+      });
+      if (stopping_)
+        break;
+    }
+    first = false;
+    lock.unlock();
+    succeeded = drain();
+    lock.lock();
+  }
+}
+
+bool aggregate_updater::drain() {
+  std::lock_guard<std::mutex> lock(apply_mutex_);
+  if (!apply_ || (recovered_ && pending_ == 0))
+    return true;
+
+  std::size_t pending = pending_.exchange(0);
+  generation_++;
+  try {
+    std::size_t count = 0;
+    do {
+      count = apply_(batch_size_);
+      applied_ += count;
+      rounds_++;
+    } while (count >= static_cast<std::size_t>(batch_size_));
+    generation_++;
+    recovered_ = true;
+    return true;
+  } catch (const std::exception& e) {
+    std::cerr << "aggregate_updater: Failed to apply the counter deltas: "
+              << e.what() << std::endl;
+  } catch (...) {
+    std::cerr << "aggregate_updater: Failed to apply the counter deltas"
+              << std::endl;
+  }
+  generation_++;
+  pending_ += std::max<std::size_t>(pending, 1);
+  failures_++;
+  return false;
+}
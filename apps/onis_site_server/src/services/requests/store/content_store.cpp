@@ -0,0 +1,177 @@
+#include "../../../../include/services/requests/store/content_store.hpp"
+#include <openssl/evp.h>
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+// content_store class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+content_store_ptr content_store::create(bool enabled,
+                                        std::chrono::seconds interval,
+                                        std::size_t batch_size) {
+  return std::make_shared<content_store>(enabled, interval, batch_size);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+content_store::content_store(bool enabled, std::chrono::seconds interval,
+                             std::size_t batch_size)
+    : enabled_(enabled),
+      interval_(std::max(interval, std::chrono::seconds(1))),
+      batch_size_(static_cast<std::int32_t>(
+          std::clamp<std::size_t>(batch_size, 1, 10000))),
+      figures_(Json::objectValue) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+content_store::~content_store() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void content_store::start(const collect_fn& collect,
+                          const measure_fn& measure) {
+  collect_ = collect;
+  measure_ = measure;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  worker_ = std::thread(&content_store::worker, this);
+}
+
+void content_store::stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker.swap(worker_);
+  }
+  cv_.notify_all();
+  if (worker.get_id() == std::this_thread::get_id())
+    worker.detach();
+  else if (worker.joinable())
+    worker.join();
+}
+
+//------------------------------------------------------------------------------
+// contents
+//------------------------------------------------------------------------------
+
+bool content_store::is_enabled() const {
+  return enabled_;
+}
+
+// Hash the content of a file, "hash" receives the hexadecimal digest:
+bool content_store::hash_file(const std::string& path, std::string& hash,
+                              std::int64_t& size) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> context(
+      EVP_MD_CTX_new(), &EVP_MD_CTX_free);
+  if (context == nullptr ||
+      !EVP_DigestInit_ex(context.get(), EVP_blake2b512(), nullptr))
+    return false;
+
+  std::vector<char> buffer(1 << 16);
+  size = 0;
+  while (file) {
+    file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    std::streamsize count = file.gcount();
+    if (count > 0 &&
+        !EVP_DigestUpdate(context.get(), buffer.data(),
+                          static_cast<std::size_t>(count)))
+      return false;
+    size += count;
+  }
+  if (!file.eof())
+    return false;
+
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int length = 0;
+  if (!EVP_DigestFinal_ex(context.get(), digest, &length))
+    return false;
+  static const char kHex[] = "0123456789abcdef";
+  hash.clear();
+  hash.reserve(length * 2);
+  for (unsigned int i = 0; i < length; i++) {
+    hash += kHex[digest[i] >> 4];
+    hash += kHex[digest[i] & 0x0f];
+  }
+  return true;
+}
+
+void content_store::add_imported(std::size_t stored, std::size_t shared,
+                                 std::int64_t saved_bytes) {
+  stored_ += stored;
+  shared_ += shared;
+  saved_bytes_ += saved_bytes;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void content_store::get_statistics(Json::Value& output) const {
+  output["enabled"] = enabled_;
+  output["stored"] = static_cast<Json::UInt64>(stored_);
+  output["shared"] = static_cast<Json::UInt64>(shared_);
+  output["saved_bytes"] = static_cast<Json::Int64>(saved_bytes_);
+  output["collected"] = static_cast<Json::UInt64>(collected_);
+  output["failures"] = static_cast<Json::UInt64>(failures_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& key : figures_.getMemberNames())
+    output[key] = figures_[key];
+}
+
+//------------------------------------------------------------------------------
+// garbage collection
+//------------------------------------------------------------------------------
+
+void content_store::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    lock.unlock();
+    collect();
+    lock.lock();
+    cv_.wait_for(lock, interval_, [this] { return stopping_; });
+  }
+}
+
+void content_store::collect() {
+  try {
+    std::size_t count = 0;
+    do {
+      count = collect_(batch_size_);
+      collected_ += count;
+    } while (count >= static_cast<std::size_t>(batch_size_));
+
+    // the figures are measured once the contents were collected:
+    Json::Value figures(Json::objectValue);
+    measure_(figures);
+    std::lock_guard<std::mutex> lock(mutex_);
+    figures_ = figures;
+  } catch (const std::exception& e) {
+    failures_++;
+    std::cerr << "content_store: Failed to collect the contents: " << e.what()
+              << std::endl;
+  } catch (...) {
+    failures_++;
+    std::cerr << "content_store: Failed to collect the contents" << std::endl;
+  }
+}
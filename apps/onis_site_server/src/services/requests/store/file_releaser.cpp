@@ -0,0 +1,101 @@
+#include "../../../../include/services/requests/store/file_releaser.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+////////////////////////////////////////////////////////////////////////////////
+// file_releaser class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+file_releaser_ptr file_releaser::create(std::chrono::seconds interval,
+                                        std::size_t batch_size) {
+  return std::make_shared<file_releaser>(interval, batch_size);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+file_releaser::file_releaser(std::chrono::seconds interval,
+                             std::size_t batch_size)
+    : interval_(std::max(interval, std::chrono::seconds(1))),
+      batch_size_(static_cast<std::int32_t>(
+          std::clamp<std::size_t>(batch_size, 1, 10000))) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+file_releaser::~file_releaser() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void file_releaser::start(const release_fn& release) {
+  release_ = release;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  worker_ = std::thread(&file_releaser::worker, this);
+}
+
+void file_releaser::stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker.swap(worker_);
+  }
+  cv_.notify_all();
+  if (worker.get_id() == std::this_thread::get_id())
+    worker.detach();
+  else if (worker.joinable())
+    worker.join();
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void file_releaser::get_statistics(Json::Value& output) const {
+  output["released"] = static_cast<Json::UInt64>(released_);
+  output["failures"] = static_cast<Json::UInt64>(failures_);
+}
+
+//------------------------------------------------------------------------------
+// release
+//------------------------------------------------------------------------------
+
+void file_releaser::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    lock.unlock();
+    release();
+    lock.lock();
+    cv_.wait_for(lock, interval_, [this] { return stopping_; });
+  }
+}
+
+void file_releaser::release() {
+  try {
+    std::size_t count = 0;
+    do {
+      count = release_(batch_size_);
+      released_ += count;
+    } while (count >= static_cast<std::size_t>(batch_size_));
+  } catch (const std::exception& e) {
+    failures_++;
+    std::cerr << "file_releaser: Failed to delete the replaced files: "
+              << e.what() << std::endl;
+  } catch (...) {
+    failures_++;
+    std::cerr << "file_releaser: Failed to delete the replaced files"
+              << std::endl;
+  }
+}
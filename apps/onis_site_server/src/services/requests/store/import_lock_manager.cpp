@@ -0,0 +1,128 @@
+#include "../../../../include/services/requests/store/import_lock_manager.hpp"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+////////////////////////////////////////////////////////////////////////////////
+// import_lock_manager class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+import_lock_manager_ptr import_lock_manager::create(std::size_t stripes) {
+  return std::make_shared<import_lock_manager>(stripes);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+import_lock_manager::import_lock_manager(std::size_t stripes)
+    : stripe_count_(std::max<std::size_t>(stripes, 1)),
+      stripes_(new std::mutex[stripe_count_]) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+import_lock_manager::~import_lock_manager() {}
+
+//------------------------------------------------------------------------------
+// locks
+//------------------------------------------------------------------------------
+
+import_lock_manager::guard import_lock_manager::lock(
+    const std::string& partition_seq, const std::set<std::string>& study_uids,
+    const std::set<std::string>& patient_ids) {
+  std::vector<std::size_t> stripes;
+  for (const auto& uid : study_uids)
+    stripes.push_back(get_stripe(partition_seq, 's', uid));
+  for (const auto& id : patient_ids)
+    stripes.push_back(get_stripe(partition_seq, 'p', id));
+  std::sort(stripes.begin(), stripes.end());
+  stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+
+  for (std::size_t i = 0; i < stripes.size(); i++) {
+    std::mutex& stripe = stripes_[stripes[i]];
+    if (stripe.try_lock())
+      continue;
+    auto start = std::chrono::steady_clock::now();
+    stripe.lock();
+    waits_++;
+    wait_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  }
+  acquisitions_++;
+  return guard(this, std::move(stripes));
+}
+
+void import_lock_manager::unlock(const std::vector<std::size_t>& stripes) {
+  for (auto it = stripes.rbegin(); it != stripes.rend(); ++it)
+    stripes_[*it].unlock();
+}
+
+std::size_t import_lock_manager::get_stripe(const std::string& partition_seq,
+                                            char type,
+                                            const std::string& value) const {
+  // the uids and ids cannot contain a backslash:
+  std::string key = partition_seq + "\\" + type + "\\" + value;
+  return std::hash<std::string>()(key) % stripe_count_;
+}
+
+//------------------------------------------------------------------------------
+// retries
+//------------------------------------------------------------------------------
+
+void import_lock_manager::add_retry() {
+  retries_++;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void import_lock_manager::get_statistics(Json::Value& output) const {
+  output["stripes"] = static_cast<Json::UInt64>(stripe_count_);
+  output["acquisitions"] = static_cast<Json::UInt64>(acquisitions_);
+  output["waits"] = static_cast<Json::UInt64>(waits_);
+  output["wait_ms"] = static_cast<Json::UInt64>(wait_us_ / 1000);
+  output["retries"] = static_cast<Json::UInt64>(retries_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// import_lock_manager::guard class
+////////////////////////////////////////////////////////////////////////////////
+
+import_lock_manager::guard::guard(import_lock_manager* manager,
+                                  std::vector<std::size_t>&& stripes)
+    : manager_(manager), stripes_(std::move(stripes)) {}
+
+import_lock_manager::guard::~guard() {
+  release();
+}
+
+import_lock_manager::guard::guard(guard&& other) noexcept
+    : manager_(other.manager_), stripes_(std::move(other.stripes_)) {
+  other.manager_ = nullptr;
+}
+
+import_lock_manager::guard& import_lock_manager::guard::operator=(
+    guard&& other) noexcept {
+  if (this != &other) {
+    release();
+    manager_ = other.manager_;
+    stripes_ = std::move(other.stripes_);
+    other.manager_ = nullptr;
+  }
+  return *this;
+}
+
+void import_lock_manager::guard::release() {
+  if (manager_ != nullptr)
+    manager_->unlock(stripes_);
+  manager_ = nullptr;
+  stripes_.clear();
+}
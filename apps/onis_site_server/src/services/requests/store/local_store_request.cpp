@@ -1,4 +1,12 @@
 #include "../../../../include/services/requests/store/local_store_request.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include "../../../../include/database/items/db_compression.hpp"
 #include "../../../../include/database/items/db_image.hpp"
 #include "../../../../include/database/items/db_patient.hpp"
 #include "../../../../include/database/items/db_series.hpp"
@@ -13,6 +21,11 @@
 #include "onis_kit/include/utilities/string.hpp"
 #include "onis_kit/include/utilities/uuid.hpp"
 
+// attempts of an import failing on a deadlock or a serialization failure,
+// and delay before the first new attempt (doubled by each one):
+static const std::int32_t kMaxTransactionAttempts = 5;
+static const std::int32_t kRetryDelayMs = 20;
+
 ////////////////////////////////////////////////////////////////////////////////
 // local_store_request class
 ////////////////////////////////////////////////////////////////////////////////
@@ -39,53 +52,95 @@ void local_store_request::import_file_to_partition(
     const std::string& partition_parameters, std::int32_t media,
     const std::string& media_folder, const std::string& dicom_file_path,
     bool do_commit, Json::Value* output, std::uint32_t* output_flags) {
+  import_lock_manager::guard locks;
+  bool moved = false;
   try {
     init(partition_parameters, dicom_file_path, media, media_folder);
+    // the imports of the same study or patient run one after the other:
+    locks = service_->get_import_lock_manager()->lock(
+        partition_seq, {study_uid_}, {patient_id_});
+    // the source file is renamed just before the commit, so that it is still
+    // there if the import is run again:
+    defer_source_moves_ = do_commit;
     import_file(db, partition_seq, output, output_flags);
     if (do_commit) {
+      apply_source_moves();
+      moved = true;
       db->commit();
+      publish_locations();
+      publish_counter_deltas();
+      publish_derived_images();
+      publish_contents();
     }
+    defer_source_moves_ = false;
+    source_moves_.clear();
     created_files_.clear();
     cleanup();
-  } catch (const onis::exception& e) {
-    cleanup();
-    throw e;
   } catch (...) {
+    if (moved)
+      revert_source_moves();
+    defer_source_moves_ = false;
+    source_moves_.clear();
     cleanup();
     throw;
-    cleanup();
   }
 }
 
+void local_store_request::import_file_in_transaction(
+    const request_database& db, std::string& partition_seq,
+    const std::string& partition_parameters, std::int32_t media,
+    const std::string& media_folder, const std::string& dicom_file_path,
+    bool move, Json::Value* output, std::uint32_t* output_flags) {
+  for (std::int32_t attempt = 1;; attempt++) {
+    db->begin_transaction();
+    try {
+      set_move_source_file(move);
+      import_file_to_partition(db, partition_seq, partition_parameters, media,
+                               media_folder, dicom_file_path, true, output,
+                               output_flags);
+      return;
+    } catch (const onis::exception& e) {
+      try {
+        db->rollback();
+      } catch (...) {
+      }
+      if (e.get_code() != EOS_DB_RETRY || attempt >= kMaxTransactionAttempts)
+        throw;
+    } catch (...) {
+      try {
+        db->rollback();
+      } catch (...) {
+      }
+      throw;
+    }
+    wait_before_retry(attempt);
+  }
+}
+
+void local_store_request::wait_before_retry(std::int32_t attempt) {
+  service_->get_import_lock_manager()->add_retry();
+  // the transactions that deadlocked must not meet again at once:
+  thread_local std::mt19937 generator(std::random_device{}());
+  std::int32_t delay = kRetryDelayMs << std::min(attempt - 1, 6);
+  std::uniform_int_distribution<std::int32_t> jitter(delay, delay * 2);
+  std::this_thread::sleep_for(std::chrono::milliseconds(jitter(generator)));
+}
+
 void local_store_request::init(const std::string& parameters,
                                const std::string& path, std::int32_t media,
                                const std::string& media_folder) {
   if (media_folder.empty()) {
     throw onis::exception(EOS_FILE_WRITE, "No media to store the image");
   }
-
-  site_api_ptr api = site_api::get_instance();
   media_ = media;
   media_folder_ = media_folder;
+  load_dicom_file(path);
+  read_partition_parameters(parameters);
+  read_dicom_file_information();
+}
 
-  // get the dicom manager:
-  onis::dicom_manager_ptr manager = api->get_dicom_manager();
-  if (manager == NULL) {
-    throw onis::exception(EOS_INTERNAL, "Missing Dicom manager");
-  }
-
-  // create a DICOM file:
-  dcm_.reset();
-  dcm_ = manager->create_dicom_file();
-  if (dcm_ == nullptr) {
-    throw onis::exception(EOS_INTERNAL, "Failed to create a new DICOM file");
-  }
-
-  // load the DICOM file:
-  if (!dcm_->load_file(path)) {
-    throw onis::exception(EOS_FILE_FORMAT, "Failed to load the DICOM file");
-  }
-
+void local_store_request::read_partition_parameters(
+    const std::string& parameters) {
   if (!parameters.empty()) {
     Json::Reader reader;
     Json::Value param;
@@ -115,7 +170,33 @@ void local_store_request::init(const std::string& parameters,
                               ? param[PT_STREAM_DATA].asInt() != 0
                               : false;
   }
+}
+
+void local_store_request::load_dicom_file(const std::string& path) {
+  site_api_ptr api = site_api::get_instance();
+  source_path_ = path;
 
+  // get the dicom manager:
+  onis::dicom_manager_ptr manager = api->get_dicom_manager();
+  if (manager == NULL) {
+    throw onis::exception(EOS_INTERNAL, "Missing Dicom manager");
+  }
+
+  // create a DICOM file:
+  dcm_.reset();
+  dcm_ = manager->create_dicom_file();
+  if (dcm_ == nullptr) {
+    throw onis::exception(EOS_INTERNAL, "Failed to create a new DICOM file");
+  }
+
+  // load the DICOM file. Import never transcodes, so only the attributes are
+  // read: the large values are read from the file if it is written again.
+  if (!dcm_->load_file_metadata(path)) {
+    throw onis::exception(EOS_FILE_FORMAT, "Failed to load the DICOM file");
+  }
+}
+
+void local_store_request::read_dicom_file_information() {
   // read the necessary information from the dicom file:
   site_database::get_patient_info_to_insert(dcm_, &charset_, &name_, &ideogram_,
                                             &phonetic_, &birthdate_,
@@ -162,6 +243,16 @@ void local_store_request::set_origin(const std::string& id,
   origin_ip_ = ip;
 }
 
+//------------------------------------------------------------------------------
+// source file
+//------------------------------------------------------------------------------
+
+void local_store_request::set_move_source_file(bool move) {
+  // the source file must be on the volume of the media folder, it is then
+  // renamed into place instead of being written again:
+  move_source_file_ = move;
+}
+
 //------------------------------------------------------------------------------
 // import file
 //------------------------------------------------------------------------------
@@ -169,7 +260,8 @@ void local_store_request::set_origin(const std::string& id,
 void local_store_request::import_file(const request_database& db,
                                       const std::string& partition_seq,
                                       Json::Value* output,
-                                      std::uint32_t* output_flags) {
+                                      std::uint32_t* output_flags,
+                                      batch_group* group) {
   Json::Value created_items[4] = {
       Json::Value(Json::objectValue), Json::Value(Json::objectValue),
       Json::Value(Json::objectValue), Json::Value(Json::objectValue)};
@@ -189,6 +281,17 @@ void local_store_request::import_file(const request_database& db,
       partition_seq_, onis::database::info_partition_conflict, 0, 0,
       onis::database::lock_mode::SHARE_LOCK, &site_seq, partition);
 
+  // the images of a series follow each other, the series may have been
+  // resolved by a previous import:
+  import_lookup_cache_ptr cache = service_->get_import_lookup_cache();
+  std::uint64_t generation = cache->get_generation(partition_seq_);
+  import_lookup_cache::location cached;
+  if (cache->find(partition_seq_, study_uid_, series_uid_, cached) &&
+      cached.identity == get_patient_and_study_identity() &&
+      import_file_to_cached_location(db, cached, generation, output,
+                                     output_flags, group))
+    return;
+
   // we retrieve all the online and conflicted studies matching the study uid:
   Json::Value studies(Json::arrayValue);
   db->find_online_and_conflicted_studies(
@@ -210,30 +313,18 @@ void local_store_request::import_file(const request_database& db,
     }
   }*/
 
-  // retrieve and lock the online patients matching the patient id:
+  // retrieve and lock the online patients matching the patient id (their
+  // counters are updated later, from the deltas):
   Json::Value patients(Json::arrayValue);
   db->find_online_patients(partition_seq_, patient_id_,
                            onis::database::info_all, false,
-                           onis::database::lock_mode::EXCLUSIVE_LOCK, patients);
+                           onis::database::lock_mode::SHARE_LOCK, patients);
   // make sure that the sop does not already exist under any online or
   // conflicted study:
-  bool sop_already_exist =
-      (studies.empty())
-          ? false
-          : db->check_if_sop_already_exist_under_online_or_conflicted_study(
-                sop_, studies);
+  bool sop_already_exist = sop_exists(db, studies);
   if (sop_already_exist) {
     // the image already exist in the database
-    switch (overwrite_mode_) {
-      case onis::database::partition::no_overwrite_failure:
-        throw onis::exception(EOS_DUPLICATE,
-                              "The sop already exist in the database");
-      case onis::database::partition::no_overwrite_success:
-        break;
-      default:
-        throw onis::exception(EOS_PARAM,
-                              "Unsupported value for overwrite behavior");
-    }
+    check_existing_sop();
   } else {
     // the image is unique
     // the study might be in conflict with an existing study !
@@ -283,7 +374,7 @@ void local_store_request::import_file(const request_database& db,
         // !
         if (db->get_online_series((*existing_items[1])[ST_SEQ_KEY].asString(),
                                   series_uid_, onis::database::info_all, false,
-                                  onis::database::lock_mode::EXCLUSIVE_LOCK,
+                                  onis::database::lock_mode::SHARE_LOCK,
                                   existing_series)) {
           existing_items[2] = &existing_series;
         }
@@ -304,6 +395,8 @@ void local_store_request::import_file(const request_database& db,
         partition[PT_HAVE_CONFLICT_KEY] = 1;
         db->modify_partition(partition, 0);
       }
+      // the studies with this uid changed:
+      cache->invalidate_study(partition_seq_, study_uid_);
     }
 
     if (conflict_study == nullptr) {
@@ -314,21 +407,397 @@ void local_store_request::import_file(const request_database& db,
           NULL, NULL, NULL, res);*/
     }
 
-    if (output != nullptr && output_flags != nullptr) {
-      (*output)["patient"] = Json::Value(Json::objectValue);
-      (*output)["study"] = Json::Value(Json::objectValue);
-      (*output)["series"] = Json::Value(Json::objectValue);
-      (*output)["image"] = Json::Value(Json::objectValue);
-      onis::database::patient::copy(*final_items[0], output_flags[0], true,
-                                    (*output)["patient"]);
-      onis::database::study::copy(*final_items[1], output_flags[1], true,
-                                  (*output)["study"]);
-      onis::database::series::copy(*final_items[2], output_flags[2], true,
-                                   (*output)["series"]);
-      onis::database::image::copy(*final_items[3], output_flags[3], true,
-                                  (*output)["image"]);
+    complete_import(studies, final_items, conflict_study == nullptr,
+                    generation, output, output_flags, group);
+  }
+}
+
+bool local_store_request::import_file_to_cached_location(
+    const request_database& db, const import_lookup_cache::location& cached,
+    std::uint64_t generation, Json::Value* output, std::uint32_t* output_flags,
+    batch_group* group) {
+  import_lookup_cache_ptr cache = service_->get_import_lookup_cache();
+
+  // the rows are locked in the same order as by the full lookup, and
+  // checked in case they were modified since the location was cached:
+  Json::Value patient(Json::objectValue);
+  Json::Value study(Json::objectValue);
+  Json::Value series(Json::objectValue);
+  std::string patient_seq, study_seq;
+  db->find_study_by_seq(cached.study_seq, onis::database::info_all, false,
+                        onis::database::lock_mode::EXCLUSIVE_LOCK, study,
+                        &patient_seq);
+  if (study.empty() || study[ST_STATUS_KEY].asString() != ONLINE_STATUS ||
+      patient_seq != cached.patient_seq) {
+    cache->invalidate_study(partition_seq_, study_uid_);
+    return false;
+  }
+  db->find_patient_by_seq(cached.patient_seq, onis::database::info_all, false,
+                          onis::database::lock_mode::SHARE_LOCK, patient,
+                          nullptr);
+  try {
+    db->find_series_by_seq(cached.series_seq, onis::database::info_all, false,
+                           onis::database::lock_mode::SHARE_LOCK, series,
+                           &study_seq);
+  } catch (const onis::exception& e) {
+    if (e.get_code() != EOS_NOT_FOUND)
+      throw;
+    series = Json::Value(Json::objectValue);
+  }
+  if (series.empty() || series[SR_STATUS_KEY].asString() != ONLINE_STATUS ||
+      study_seq != cached.study_seq) {
+    cache->invalidate_study(partition_seq_, study_uid_);
+    return false;
+  }
+
+  if (sop_exists(db, cached.studies)) {
+    check_existing_sop();
+    return true;
+  }
+
+  Json::Value created_items[4] = {
+      Json::Value(Json::objectValue), Json::Value(Json::objectValue),
+      Json::Value(Json::objectValue), Json::Value(Json::objectValue)};
+  Json::Value* existing_items[4] = {&patient, &study, &series, nullptr};
+  add_new_image_to_partition(db, nullptr, existing_items, created_items);
+  Json::Value* final_items[4] = {&patient, &study, &series, &created_items[3]};
+  complete_import(cached.studies, final_items, true, generation, output,
+                  output_flags, group);
+  return true;
+}
+
+void local_store_request::complete_import(
+    const Json::Value& studies, Json::Value* final_items[4], bool cacheable,
+    std::uint64_t generation, Json::Value* output, std::uint32_t* output_flags,
+    batch_group* group) {
+  // the next images of the series in the batch go to the same location:
+  if (group != nullptr) {
+    group->resolved = true;
+    group->study_uid = study_uid_;
+    group->series_uid = series_uid_;
+    group->identity = get_patient_and_study_identity();
+    group->studies = studies;
+    group->patient = *final_items[0];
+    group->study = *final_items[1];
+    group->series = *final_items[2];
+    batch_sops_.insert(study_uid_ + "\\" + sop_);
+  }
+
+  // and so do the next imports of the series, once committed:
+  if (cacheable) {
+    pending_location pending;
+    pending.study_uid = study_uid_;
+    pending.series_uid = series_uid_;
+    pending.generation = generation;
+    import_lookup_cache::location& item = pending.item;
+    item.patient_seq = (*final_items[0])[BASE_SEQ_KEY].asString();
+    item.study_seq = (*final_items[1])[BASE_SEQ_KEY].asString();
+    item.series_seq = (*final_items[2])[BASE_SEQ_KEY].asString();
+    item.identity = get_patient_and_study_identity();
+    // only the seqs are needed to search the sops, including the one of a
+    // study created by this import:
+    item.studies = Json::Value(Json::arrayValue);
+    bool found = false;
+    for (const auto& entry : studies) {
+      std::string seq = entry["study"][ST_SEQ_KEY].asString();
+      item.studies.append(Json::objectValue)["study"][ST_SEQ_KEY] = seq;
+      found = found || seq == item.study_seq;
     }
+    if (!found)
+      item.studies.append(Json::objectValue)["study"][ST_SEQ_KEY] =
+          item.study_seq;
+    pending_locations_.push_back(std::move(pending));
+  }
+
+  if (output != nullptr && output_flags != nullptr) {
+    (*output)["patient"] = Json::Value(Json::objectValue);
+    (*output)["study"] = Json::Value(Json::objectValue);
+    (*output)["series"] = Json::Value(Json::objectValue);
+    (*output)["image"] = Json::Value(Json::objectValue);
+    onis::database::patient::copy(*final_items[0], output_flags[0], true,
+                                  (*output)["patient"]);
+    onis::database::study::copy(*final_items[1], output_flags[1], true,
+                                (*output)["study"]);
+    onis::database::series::copy(*final_items[2], output_flags[2], true,
+                                 (*output)["series"]);
+    onis::database::image::copy(*final_items[3], output_flags[3], true,
+                                (*output)["image"]);
+  }
+}
+
+void local_store_request::publish_locations() {
+  import_lookup_cache_ptr cache = service_->get_import_lookup_cache();
+  for (const auto& pending : pending_locations_)
+    cache->store(partition_seq_, pending.study_uid, pending.series_uid,
+                 pending.item, pending.generation);
+  pending_locations_.clear();
+}
+
+void local_store_request::publish_counter_deltas() {
+  service_->get_aggregate_updater()->add_pending(counter_deltas_);
+  counter_deltas_ = 0;
+}
+
+void local_store_request::publish_derived_images() {
+  service_->get_derived_object_worker()->add(derived_images_);
+  derived_images_.clear();
+}
+
+void local_store_request::publish_contents() {
+  if (stored_contents_ != 0 || shared_contents_ != 0) {
+    service_->get_content_store()->add_imported(
+        stored_contents_, shared_contents_, shared_bytes_);
   }
+  stored_contents_ = 0;
+  shared_contents_ = 0;
+  shared_bytes_ = 0;
+}
+
+//------------------------------------------------------------------------------
+// batch import
+//------------------------------------------------------------------------------
+
+void local_store_request::import_files_to_partition(
+    const request_database& db, std::string& partition_seq,
+    const std::string& partition_parameters, std::int32_t media,
+    const std::string& media_folder,
+    const std::vector<std::string>& dicom_file_paths, Json::Value& output) {
+  if (!output.isArray())
+    output = Json::Value(Json::arrayValue);
+  bool move = move_source_file_;
+  std::uint32_t flags[4] = {0, 0, 0, 0};
+
+  // load the attributes of all the files:
+  std::vector<batch_instance> instances;
+  try {
+    if (media_folder.empty())
+      throw onis::exception(EOS_FILE_WRITE, "No media to store the image");
+    media_ = media;
+    media_folder_ = media_folder;
+    partition_seq_ = partition_seq;
+    read_partition_parameters(partition_parameters);
+  } catch (...) {
+    cleanup();
+    db->rollback();
+    throw;
+  }
+  for (const auto& path : dicom_file_paths) {
+    Json::Value::ArrayIndex index = output.size();
+    Json::Value& result = output.append(Json::Value(Json::objectValue));
+    try {
+      load_dicom_file(path);
+      read_dicom_file_information();
+      instances.push_back(
+          {index, path, dcm_, study_uid_, series_uid_, patient_id_});
+    } catch (const onis::exception& e) {
+      result["status"] = e.get_code();
+      result["message"] = e.what();
+    }
+  }
+
+  // import them in a single transaction, once the imports of the same
+  // studies and patients are over:
+  std::set<std::string> study_uids, patient_ids;
+  for (const auto& instance : instances) {
+    study_uids.insert(instance.study_uid);
+    patient_ids.insert(instance.patient_id);
+  }
+  import_lock_manager::guard locks = service_->get_import_lock_manager()->lock(
+      partition_seq_, study_uids, patient_ids);
+  bool failed = false;
+  bool moved = false;
+  defer_source_moves_ = true;
+  try {
+    import_batch(db, instances, output);
+    apply_source_moves();
+    moved = true;
+    db->commit();
+    publish_locations();
+    publish_counter_deltas();
+    publish_derived_images();
+    publish_contents();
+  } catch (...) {
+    failed = true;
+    try {
+      db->rollback();
+    } catch (...) {
+    }
+    if (moved)
+      revert_source_moves();
+  }
+  defer_source_moves_ = false;
+  source_moves_.clear();
+  batch_sops_.clear();
+  if (!failed)
+    created_files_.clear();
+  cleanup();
+  locks.release();
+  if (!failed)
+    return;
+
+  // the batch failed, each file is imported in its own transaction so that
+  // a single failure does not reject the others:
+  for (auto& instance : instances) {
+    Json::Value& result = output[instance.result];
+    result = Json::Value(Json::objectValue);
+    instance.dcm.reset();
+    try {
+      import_file_in_transaction(db, partition_seq, partition_parameters,
+                                 media, media_folder, instance.path, move,
+                                 &result, flags);
+      result["status"] = EOS_NONE;
+    } catch (const onis::exception& e) {
+      result = Json::Value(Json::objectValue);
+      result["status"] = e.get_code();
+      result["message"] = e.what();
+    } catch (const std::exception& e) {
+      result = Json::Value(Json::objectValue);
+      result["status"] = EOS_UNKNOWN;
+      result["message"] = e.what();
+    }
+  }
+}
+
+void local_store_request::import_batch(const request_database& db,
+                                       std::vector<batch_instance>& instances,
+                                       Json::Value& output) {
+  std::uint32_t flags[4] = {0, 0, 0, 0};
+
+  // the images of a series follow each other:
+  std::stable_sort(instances.begin(), instances.end(),
+                   [](const batch_instance& a, const batch_instance& b) {
+                     if (a.study_uid != b.study_uid)
+                       return a.study_uid < b.study_uid;
+                     return a.series_uid < b.series_uid;
+                   });
+
+  batch_group group;
+  for (auto& instance : instances) {
+    Json::Value& result = output[instance.result];
+    dcm_ = instance.dcm;
+    source_path_ = instance.path;
+    read_dicom_file_information();
+    try {
+      if (group.resolved && group.study_uid == study_uid_ &&
+          group.series_uid == series_uid_ &&
+          group.identity == get_patient_and_study_identity()) {
+        add_image_to_group(db, group, instance.result);
+      } else {
+        flush_group(db, group, output);
+        group = batch_group();
+        import_file(db, partition_seq_, &result, flags, &group);
+      }
+      result["status"] = EOS_NONE;
+    } catch (const onis::exception& e) {
+      // the rejected images did not modify the database:
+      if (e.get_code() != EOS_DUPLICATE && e.get_code() != EOS_CONFLICT)
+        throw;
+      result["status"] = e.get_code();
+      result["message"] = e.what();
+    }
+    // the dataset is no longer needed:
+    instance.dcm.reset();
+  }
+  flush_group(db, group, output);
+}
+
+void local_store_request::add_image_to_group(const request_database& db,
+                                             batch_group& group,
+                                             Json::Value::ArrayIndex result) {
+  // the sop might already be in the batch, or under one of the studies that
+  // existed before:
+  std::string key = study_uid_ + "\\" + sop_;
+  bool sop_already_exist = batch_sops_.find(key) != batch_sops_.end() ||
+                           sop_exists(db, group.studies);
+  if (sop_already_exist) {
+    check_existing_sop();
+    return;
+  }
+
+  // save the dicom file, the image is inserted with the rest of the group:
+  std::string image_path, image_relative_path;
+  Json::Value pixel_data(Json::nullValue);
+  std::int32_t compression_update = 0;
+  std::string transfer_syntax = get_import_compression(db, compression_update);
+  std::int32_t compression_status = store_dicom_file(
+      &image_path, &image_relative_path, pixel_data, transfer_syntax);
+  std::string content = store_content(db, &image_path, &image_relative_path);
+  move_source_file();
+  batch_sops_.insert(key);
+  add_sop_to_filter();
+  group.results.push_back(result);
+  group.datasets.push_back(dcm_);
+  group.paths.push_back(image_relative_path);
+  group.pixel_data.push_back(pixel_data);
+  group.compression_status.push_back(compression_status);
+  group.compression_update = compression_update;
+  group.contents.push_back(content);
+
+  Json::Value* items[4] = {&group.patient, &group.study, &group.series,
+                           nullptr};
+  increase_counters(items, items);
+}
+
+void local_store_request::flush_group(const request_database& db,
+                                      batch_group& group,
+                                      Json::Value& output) {
+  if (group.datasets.empty())
+    return;
+
+  std::vector<Json::Value> images;
+  db->create_images(group.compression_status, group.compression_update,
+                    group.series[BASE_SEQ_KEY].asString(), current_time_,
+                    group.datasets, media_, group.paths, group.pixel_data,
+                    create_stream_file_, create_image_icon_, origin_id_,
+                    origin_name_, origin_ip_, images);
+  if (service_->get_content_store()->is_enabled()) {
+    std::vector<std::string> seqs;
+    for (const auto& image : images)
+      seqs.push_back(image[BASE_SEQ_KEY].asString());
+    db->set_images_content(seqs, group.contents);
+  }
+  if (create_stream_file_ || create_image_icon_ ||
+      service_->is_pixel_statistics_enabled()) {
+    for (const auto& image : images)
+      derived_images_.push_back(image[BASE_SEQ_KEY].asString());
+  }
+
+  // the series already exists, the study summary is unchanged:
+  Json::Value* items[4] = {&group.patient, &group.study, &group.series,
+                           nullptr};
+  log_counter_delta(db, items, static_cast<std::int32_t>(images.size()), false,
+                    false);
+
+  for (std::size_t i = 0; i < images.size(); i++) {
+    Json::Value& result = output[group.results[i]];
+    onis::database::patient::copy(group.patient, 0, true, result["patient"]);
+    onis::database::study::copy(group.study, 0, true, result["study"]);
+    onis::database::series::copy(group.series, 0, true, result["series"]);
+    onis::database::image::copy(images[i], 0, true, result["image"]);
+  }
+  group.results.clear();
+  group.datasets.clear();
+  group.paths.clear();
+  group.pixel_data.clear();
+  group.compression_status.clear();
+  group.contents.clear();
+}
+
+void local_store_request::apply_source_moves() {
+  for (std::size_t i = 0; i < source_moves_.size(); i++) {
+    if (!onis::util::filesystem::move_file(source_moves_[i].first,
+                                           source_moves_[i].second)) {
+      source_moves_.resize(i);
+      revert_source_moves();
+      throw onis::exception(EOS_FILE_MOVE, "Failed to store the dicom file.");
+    }
+  }
+}
+
+void local_store_request::revert_source_moves() {
+  for (const auto& move : source_moves_)
+    onis::util::filesystem::move_file(move.second, move.first);
+  source_moves_.clear();
 }
 
 //------------------------------------------------------------------------------
@@ -336,8 +805,14 @@ void local_store_request::import_file(const request_database& db,
 //------------------------------------------------------------------------------
 
 void local_store_request::cleanup() {
+  // the transaction is over, committed or not:
+  service_->get_sop_filter()->release(partition_seq_, inserted_sops_);
+  inserted_sops_.clear();
   dcm_.reset();
   media_folder_.clear();
+  source_path_.clear();
+  target_path_.clear();
+  move_source_file_ = false;
   origin_id_.clear();
   origin_name_.clear();
   origin_ip_.clear();
@@ -371,6 +846,12 @@ void local_store_request::cleanup() {
     onis::util::filesystem::delete_file(file);
   }
   created_files_.clear();
+  pending_locations_.clear();
+  counter_deltas_ = 0;
+  derived_images_.clear();
+  stored_contents_ = 0;
+  shared_contents_ = 0;
+  shared_bytes_ = 0;
 }
 
 //------------------------------------------------------------------------------
@@ -380,21 +861,14 @@ void local_store_request::cleanup() {
 void local_store_request::add_new_image_to_partition(
     const request_database& db, const Json::Value* conflict_study,
     Json::Value* existing_items[4], Json::Value* created_items) {
-  // search the compression information for the partition:
-  Json::Value compressions(Json::arrayValue);
-  db->get_partition_compressions(partition_seq_, onis::database::info_all,
-                                 onis::database::lock_mode::NO_LOCK,
-                                 compressions);
-  std::string compression_id =
-      compressions.size() == 1 ? compressions[0][BASE_SEQ_KEY].asString() : "";
-
-  // save the dicom file:
+  // save the dicom file, compressed if the partition is compressed at import:
   std::string image_path, image_relative_path;
   std::string stream_path, stream_relative_path;
-  save_dicom_file(dcm_, media_folder_, partition_seq_, study_date_, modality_,
-                  series_uid_, sop_, &image_path, &image_relative_path);
-  if (!image_path.empty())
-    created_files_.push_back(image_path);
+  Json::Value pixel_data(Json::nullValue);
+  std::int32_t compression_update = 0;
+  std::string transfer_syntax = get_import_compression(db, compression_update);
+  std::int32_t compression_status = store_dicom_file(
+      &image_path, &image_relative_path, pixel_data, transfer_syntax);
 
   // create the necessary items:
   if (existing_items[0] == nullptr && created_items[0].empty()) {
@@ -420,13 +894,23 @@ void local_store_request::add_new_image_to_partition(
   }
 
   if (existing_items[3] == nullptr && created_items[3].empty()) {
-    db->create_image(0, 0,
+    std::string content =
+        store_content(db, &image_path, &image_relative_path);
+    db->create_image(compression_status, compression_update,
                      existing_items[2] == NULL
                          ? created_items[2][BASE_SEQ_KEY].asString()
                          : (*existing_items[2])[BASE_SEQ_KEY].asString(),
                      current_time_, dcm_, media_, image_relative_path,
-                     create_stream_file_, create_image_icon_, origin_id_,
-                     origin_name_, origin_ip_, created_items[3]);
+                     pixel_data, create_stream_file_, create_image_icon_,
+                     origin_id_, origin_name_, origin_ip_, created_items[3]);
+    if (!content.empty()) {
+      db->set_images_content({created_items[3][BASE_SEQ_KEY].asString()},
+                             {content});
+    }
+    add_sop_to_filter();
+    if (create_stream_file_ || create_image_icon_ ||
+        service_->is_pixel_statistics_enabled())
+      derived_images_.push_back(created_items[3][BASE_SEQ_KEY].asString());
   }
 
   Json::Value* final_items[4];
@@ -434,6 +918,23 @@ void local_store_request::add_new_image_to_partition(
     final_items[i] =
         existing_items[i] == nullptr ? &created_items[i] : existing_items[i];
 
+  increase_counters(existing_items, final_items);
+  log_counter_delta(db, final_items, 1, existing_items[1] == nullptr,
+                    existing_items[2] == nullptr);
+
+  // nothing else has to be read from the source file:
+  move_source_file();
+
+  // update the albums:
+  /*if (res.good()) {
+    db->update_albums_after_adding_images(
+        *final_items[0], *final_items[1], *final_items[2],
+        existing_items[2] == NULL ? OSTRUE : OSFALSE, 1, res);
+  }*/
+}
+
+void local_store_request::increase_counters(Json::Value* existing_items[4],
+                                            Json::Value* final_items[4]) {
   // increase the image count:
   (*final_items[2])[SR_IMCNT_KEY] = (*final_items[2])[SR_IMCNT_KEY].asInt() + 1;
   (*final_items[1])[ST_IMCNT_KEY] = (*final_items[1])[ST_IMCNT_KEY].asInt() + 1;
@@ -456,30 +957,25 @@ void local_store_request::add_new_image_to_partition(
       (*final_items[0])[PA_STCNT_KEY] =
           (*final_items[0])[PA_STCNT_KEY].asInt() + 1;
   }
+}
 
-  // define the modalities, body parts and station names for the study:
-  bool modif = db->update_study_modalities_bodyparts_and_station_names(
-      *final_items[1], "");
-
-  // now update the database:
-  if ((*final_items[1])[ST_STATUS_KEY].asString() == ONLINE_STATUS) {
-    db->modify_patient(*final_items[0],
-                       onis::database::info_patient_statistics);
-  }
-  db->modify_series(*final_items[2], onis::database::info_series_statistics);
-  db->modify_study(*final_items[1],
-                   modif ? onis::database::info_study_statistics |
-                               onis::database::info_study_body_parts |
-                               onis::database::info_study_modalities |
-                               onis::database::info_study_stations
-                         : onis::database::info_study_statistics);
+void local_store_request::log_counter_delta(const request_database& db,
+                                            Json::Value* final_items[4],
+                                            std::int32_t images, bool new_study,
+                                            bool new_series) {
+  // the patient only counts the online studies:
+  bool online = (*final_items[1])[ST_STATUS_KEY].asString() == ONLINE_STATUS;
 
-  // update the albums:
-  /*if (res.good()) {
-    db->update_albums_after_adding_images(
-        *final_items[0], *final_items[1], *final_items[2],
-        existing_items[2] == NULL ? OSTRUE : OSFALSE, 1, res);
-  }*/
+  // the rows are updated later and in bulk, the imports only read them. Only
+  // a new series changes the modalities, body parts and station names of the
+  // study:
+  db->create_counter_delta((*final_items[0])[BASE_SEQ_KEY].asString(),
+                           (*final_items[1])[BASE_SEQ_KEY].asString(),
+                           (*final_items[2])[BASE_SEQ_KEY].asString(),
+                           online && new_study ? 1 : 0,
+                           online && new_series ? 1 : 0, online ? images : 0,
+                           new_series ? 1 : 0, images, new_series);
+  counter_deltas_++;
 }
 
 //------------------------------------------------------------------------------
@@ -506,6 +1002,13 @@ void local_store_request::check_study_date_format(std::string& study_date) {
   }
 }
 
+std::string local_store_request::get_patient_and_study_identity() const {
+  // the attributes that decide where an image is attached:
+  return patient_id_ + '\n' + name_ + '\n' + ideogram_ + '\n' + phonetic_ +
+         '\n' + birthdate_ + '\n' + birthtime_ + '\n' + sex_ + '\n' +
+         acc_num_ + '\n' + study_id_ + '\n' + study_desc_;
+}
+
 Json::Value* local_store_request::find_matching_patient(Json::Value& patients) {
   for (auto& patient : patients) {
     if (patient[PA_UID_KEY].asString() == patient_id_ &&
@@ -575,6 +1078,36 @@ Json::Value* local_store_request::find_conflict_study(Json::Value& items) {
   return conflict_study;
 }
 
+bool local_store_request::sop_exists(const request_database& db,
+                                     const Json::Value& studies) {
+  // obviously, the sop does not exist if the study list is empty. The filter
+  // has no false negative, the database is searched for its possible hits:
+  if (studies.empty() ||
+      !service_->get_sop_filter()->may_contain(partition_seq_, sop_))
+    return false;
+  return db->check_if_sop_already_exist_under_online_or_conflicted_study(
+      sop_, studies);
+}
+
+void local_store_request::add_sop_to_filter() {
+  service_->get_sop_filter()->insert(partition_seq_, sop_);
+  inserted_sops_.push_back(sop_);
+}
+
+void local_store_request::check_existing_sop() const {
+  // the image already exists, it is either rejected or ignored:
+  switch (overwrite_mode_) {
+    case onis::database::partition::no_overwrite_failure:
+      throw onis::exception(EOS_DUPLICATE,
+                            "The sop already exist in the database");
+    case onis::database::partition::no_overwrite_success:
+      break;
+    default:
+      throw onis::exception(EOS_PARAM,
+                            "Unsupported value for overwrite behavior");
+  }
+}
+
 bool local_store_request::study_is_in_conflict(const Json::Value* item) {
   // analyze:
   const Json::Value& patient = (*item)["patient"];
@@ -621,16 +1154,175 @@ bool local_store_request::study_is_in_conflict(const Json::Value* item) {
 // Dicom file saving
 //------------------------------------------------------------------------------
 
+// The transfer syntax the images are compressed to when stored, or an empty
+// string if the partition is not compressed at import ("update" receives the
+// version of its compression rule):
+std::string local_store_request::get_import_compression(
+    const request_database& db, std::int32_t& update) {
+  Json::Value rule(Json::objectValue);
+  if (!service_->find_partition_compression(partition_seq_, db, rule) ||
+      rule[CP_ENABLE_KEY].asInt() != 1 ||
+      rule[CP_MODE_KEY].asInt() != onis::database::compression_mode_import)
+    return "";
+  update = rule[CP_UPDATE_KEY].asInt();
+  return rule[CP_TRANSFER_KEY].asString();
+}
+
+// Store the dicom file, returns its compression status: done if it was
+// written with "transfer_syntax" (or already had it). A file that cannot be
+// transcoded is stored as received, it is left to the background compression.
+std::int32_t local_store_request::store_dicom_file(
+    std::string* file_path, std::string* relative_path,
+    Json::Value& pixel_data, const std::string& transfer_syntax) {
+  bool transcode = false;
+  if (!transfer_syntax.empty()) {
+    std::string current_transfer;
+    dcm_->get_string_element(current_transfer, TAG_TRANSFER_SYNTAX_UID, "UI");
+    transcode = current_transfer != transfer_syntax;
+  }
+  if (transcode) {
+    try {
+      save_dicom_file(dcm_, media_folder_, partition_seq_, study_date_,
+                      modality_, series_uid_, sop_, file_path, relative_path,
+                      service_->get_directory_cache(), transfer_syntax);
+      created_files_.push_back(*file_path);
+      read_pixel_data_offsets(*file_path, pixel_data);
+      return onis::database::image_compression_done;
+    } catch (const onis::exception& e) {
+      std::cerr << "store_dicom_file: Failed to compress " << sop_ << " to "
+                << transfer_syntax << ": " << e.what() << std::endl;
+      file_path->clear();
+      relative_path->clear();
+    }
+  }
+  std::int32_t status = transfer_syntax.empty() || transcode
+                            ? onis::database::image_compression_none
+                            : onis::database::image_compression_done;
+
+  // a complete DICOM file can be kept as received: it is renamed into its
+  // final location. Otherwise it is written again, with its meta information.
+  if (!move_source_file_ || !has_file_meta_information(source_path_)) {
+    save_dicom_file(dcm_, media_folder_, partition_seq_, study_date_,
+                    modality_, series_uid_, sop_, file_path, relative_path,
+                    service_->get_directory_cache());
+    if (!file_path->empty()) {
+      created_files_.push_back(*file_path);
+      // record where the frames are in the stored file, so that they can be
+      // retrieved without reading the rest of it:
+      read_pixel_data_offsets(*file_path, pixel_data);
+    }
+    return status;
+  }
+
+  std::string full_path = get_dicom_file_path_saving_directory(
+      dcm_, media_folder_, partition_seq_, study_date_, modality_, series_uid_,
+      sop_, service_->get_directory_cache());
+  std::string id = onis::util::uuid::generate_random_uuid();
+  if (id.empty()) {
+    throw onis::exception(
+        EOS_FILE_WRITE,
+        "Failed to create a unique file name for storing dicom file.");
+  }
+  onis::util::filesystem::concat(full_path, "IM_" + id + ".dcm");
+
+  // the stored file has the same bytes as the source file, the frame offsets
+  // are read from the already loaded dataset:
+  get_pixel_data_offsets(dcm_, pixel_data);
+
+  // the values that were not loaded are still read from the source file, it
+  // is renamed once the image was added (see move_source_file):
+  target_path_ = full_path;
+
+  *file_path = full_path;
+  onis::util::string::replace_antislash_by_slash(*file_path);
+  *relative_path = onis::util::filesystem::get_relative_path(full_path,
+                                                             media_folder_);
+  onis::util::string::replace_antislash_by_slash(*relative_path);
+  return status;
+}
+
+// Share the stored file with the images having the same content on the media,
+// when the deduplication is enabled. Returns the seq of the content, or an
+// empty string if the file is not shared. If the content was already stored,
+// the file of the image is not kept: "file_path" and "relative_path" receive
+// those of the stored one.
+std::string local_store_request::store_content(const request_database& db,
+                                               std::string* file_path,
+                                               std::string* relative_path) {
+  if (!service_->get_content_store()->is_enabled() || relative_path->empty())
+    return "";
+  // the source file is not renamed yet, it has the same bytes:
+  const std::string& path = target_path_.empty() ? *file_path : source_path_;
+  std::string hash;
+  std::int64_t size = 0;
+  if (!content_store::hash_file(path, hash, size)) {
+    std::cerr << "store_content: Failed to hash the file of " << sop_
+              << std::endl;
+    return "";
+  }
+  Json::Value content(Json::objectValue);
+  if (db->acquire_content(partition_seq_, media_, hash, size, *relative_path,
+                          current_time_, content)) {
+    stored_contents_++;
+    return content[BASE_SEQ_KEY].asString();
+  }
+
+  // the content is already stored on the media:
+  if (target_path_.empty()) {
+    onis::util::filesystem::delete_file(*file_path);
+    created_files_.erase(
+        std::remove(created_files_.begin(), created_files_.end(), *file_path),
+        created_files_.end());
+  } else {
+    target_path_.clear();
+  }
+  *relative_path = content["path"].asString();
+  *file_path = media_folder_;
+  onis::util::filesystem::concat(*file_path, *relative_path);
+  onis::util::string::replace_antislash_by_slash(*file_path);
+  shared_contents_++;
+  shared_bytes_ += size;
+  return content[BASE_SEQ_KEY].asString();
+}
+
+void local_store_request::move_source_file() {
+  if (target_path_.empty())
+    return;
+  // in a batch, the files are renamed just before the commit:
+  if (defer_source_moves_) {
+    source_moves_.emplace_back(source_path_, target_path_);
+    target_path_.clear();
+    return;
+  }
+  if (!onis::util::filesystem::move_file(source_path_, target_path_))
+    throw onis::exception(EOS_FILE_MOVE, "Failed to store the dicom file.");
+  created_files_.push_back(target_path_);
+  target_path_.clear();
+}
+
+bool local_store_request::has_file_meta_information(const std::string& path) {
+  // DICOM part 10 files start with a 128 bytes preamble and "DICM":
+  std::ifstream file(path, std::ios::binary);
+  char header[132];
+  if (!file.read(header, sizeof(header)))
+    return false;
+  return std::memcmp(header + 128, "DICM", 4) == 0;
+}
+
 void local_store_request::save_dicom_file(
     const onis::dicom_file_ptr& dcm, const std::string& folder,
     const std::string& partition_id, std::string study_date,
     std::string modality, std::string series_uid, std::string sop,
-    std::string* file_path, std::string* relative_path) {
+    std::string* file_path, std::string* relative_path,
+    const directory_cache_ptr& directories,
+    const std::string& transfer_syntax) {
   if (sop.empty())
     dcm->get_string_element(sop, TAG_SOP_INSTANCE_UID, "UI");
   std::string full_path = get_dicom_file_path_saving_directory(
-      dcm, folder, partition_id, study_date, modality, series_uid, sop);
+      dcm, folder, partition_id, study_date, modality, series_uid, sop,
+      directories);
   if (!full_path.empty()) {
+    std::string dir = full_path;
     // we need to save the file into our directory
     std::string id = onis::util::uuid::generate_random_uuid();
     if (id.empty()) {
@@ -640,7 +1332,16 @@ void local_store_request::save_dicom_file(
     }
     std::string file_name = "IM_" + id + ".dcm";
     onis::util::filesystem::concat(full_path, file_name);
-    if (!dcm->save_file(full_path)) {
+    bool saved = dcm->save_file(full_path, transfer_syntax);
+    // the cached directory may have been removed since it was created:
+    if (!saved && directories != nullptr &&
+        !onis::util::filesystem::exist_directory(dir)) {
+      directories->invalidate(dir);
+      saved = directories->create_directories(dir) &&
+              dcm->save_file(full_path, transfer_syntax);
+    }
+    if (!saved) {
+      onis::util::filesystem::delete_file(full_path);
       throw onis::exception(EOS_FILE_WRITE, "Failed to store the dicom file.");
     }
     if (file_path != nullptr) {
@@ -658,7 +1359,8 @@ void local_store_request::save_dicom_file(
 std::string local_store_request::get_dicom_file_path_saving_directory(
     const onis::dicom_file_ptr& dcm, const std::string& folder,
     const std::string& partition_id, std::string study_date,
-    std::string modality, std::string series_uid, std::string sop) {
+    std::string modality, std::string series_uid, std::string sop,
+    const directory_cache_ptr& directories) {
   if (folder.empty()) {
     throw onis::exception(EOS_FILE_WRITE, "No folder to save the dicom file");
   } else {
@@ -679,8 +1381,61 @@ std::string local_store_request::get_dicom_file_path_saving_directory(
     onis::util::filesystem::concat(dir, series_uid);
     std::string full_path = folder;
     onis::util::filesystem::concat(full_path, dir);
-    if (!onis::util::filesystem::create_multi_directories(full_path))
+    bool created = directories != nullptr
+                       ? directories->create_directories(full_path)
+                       : onis::util::filesystem::create_multi_directories(
+                             full_path);
+    if (!created)
       throw onis::exception(EOS_FILE_WRITE, "Failed to create the directory");
     return full_path;
   }
-}
\ No newline at end of file
+}
+
+//------------------------------------------------------------------------------
+// Pixel data offsets
+//------------------------------------------------------------------------------
+
+bool local_store_request::read_pixel_data_offsets(const std::string& path,
+                                                  Json::Value& output) {
+  onis::dicom_manager_ptr manager =
+      site_api::get_instance()->get_dicom_manager();
+  if (manager == nullptr)
+    return false;
+
+  // only the position of the pixel data is read, not its value:
+  onis::dicom_file_ptr dcm = manager->create_dicom_file();
+  if (dcm == nullptr || !dcm->load_file_metadata(path))
+    return false;
+  return get_pixel_data_offsets(dcm, output);
+}
+
+bool local_store_request::get_pixel_data_offsets(
+    const onis::dicom_file_ptr& dcm, Json::Value& output) {
+  std::int32_t count = 0;
+  std::unique_ptr<onis::dicom_frame_offsets[]> frames(
+      dcm->get_pixel_data_positions(count));
+  if (frames == nullptr || count <= 0)
+    return false;
+
+  // one "offset:length" entry per fragment, fragments of a same frame are
+  // separated by '+' and frames by ',':
+  std::string table;
+  for (std::int32_t i = 0; i < count; i++) {
+    for (std::int32_t j = 0; j < frames[i].count; j++) {
+      std::uint64_t start = frames[i].offsets[j * 2];
+      std::uint64_t end = frames[i].offsets[j * 2 + 1];
+      if (j > 0)
+        table += '+';
+      else if (i > 0)
+        table += ',';
+      table += std::to_string(start) + ":" + std::to_string(end - start + 1);
+    }
+  }
+
+  output = Json::Value(Json::objectValue);
+  output[IM_PIXEL_OFFSET_KEY] =
+      static_cast<Json::UInt64>(frames[0].offsets[0]);
+  output[IM_FRAME_COUNT_KEY] = count;
+  output[IM_FRAME_TABLE_KEY] = table;
+  return true;
+}
@@ -0,0 +1,183 @@
+#include "../../../../include/services/requests/tiering/media_migration_worker.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+////////////////////////////////////////////////////////////////////////////////
+// media_migration_worker class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+media_migration_worker_ptr media_migration_worker::create(
+    const Json::Value& rules, std::chrono::seconds interval,
+    std::size_t batch_size, std::uint64_t max_bytes_per_second) {
+  return std::make_shared<media_migration_worker>(rules, interval, batch_size,
+                                                  max_bytes_per_second);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+media_migration_worker::media_migration_worker(
+    const Json::Value& rules, std::chrono::seconds interval,
+    std::size_t batch_size, std::uint64_t max_bytes_per_second)
+    : rules_(rules.isArray() ? rules : Json::Value(Json::arrayValue)),
+      interval_(std::max(interval, std::chrono::seconds(1))),
+      batch_size_(static_cast<std::int32_t>(
+          std::clamp<std::size_t>(batch_size, 1, 10000))),
+      max_bytes_per_second_(max_bytes_per_second) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+media_migration_worker::~media_migration_worker() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+void media_migration_worker::start(const scan_fn& scan,
+                                   const migrate_fn& migrate) {
+  if (rules_.empty())
+    return;
+  scan_ = scan;
+  migrate_ = migrate;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  next_io_ = std::chrono::steady_clock::now();
+  worker_ = std::thread(&media_migration_worker::worker, this);
+}
+
+void media_migration_worker::stop() {
+  std::thread worker;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    worker.swap(worker_);
+  }
+  cv_.notify_all();
+  if (worker.get_id() == std::this_thread::get_id())
+    worker.detach();
+  else if (worker.joinable())
+    worker.join();
+}
+
+//------------------------------------------------------------------------------
+// throttling
+//------------------------------------------------------------------------------
+
+bool media_migration_worker::throttle(std::uint64_t bytes) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (max_bytes_per_second_ == 0 || stopping_)
+    return !stopping_;
+  // each copy waits for the time the previous ones should have taken:
+  auto now = std::chrono::steady_clock::now();
+  if (next_io_ < now)
+    next_io_ = now;
+  auto start = next_io_;
+  next_io_ += std::chrono::microseconds(
+      static_cast<std::int64_t>(bytes * 1000000 / max_bytes_per_second_));
+  if (start > now) {
+    cv_.wait_until(lock, start, [this] { return stopping_; });
+    throttled_ms_ += static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(start - now)
+            .count());
+  }
+  return !stopping_;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void media_migration_worker::get_statistics(Json::Value& output) const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    output["running"] = worker_.joinable();
+  }
+  output["rules"] = rules_.size();
+  output["migrated"] = static_cast<Json::UInt64>(migrated_);
+  output["skipped"] = static_cast<Json::UInt64>(skipped_);
+  output["failed"] = static_cast<Json::UInt64>(failed_);
+  output["errors"] = static_cast<Json::UInt64>(errors_);
+  output["files"] = static_cast<Json::Int64>(files_);
+  output["bytes"] = static_cast<Json::Int64>(bytes_);
+  output["throttled_ms"] = static_cast<Json::UInt64>(throttled_ms_);
+}
+
+//------------------------------------------------------------------------------
+// worker
+//------------------------------------------------------------------------------
+
+void media_migration_worker::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    lock.unlock();
+    for (const auto& rule : rules_)
+      apply_rule(rule);
+    lock.lock();
+    cv_.wait_for(lock, interval_, [this] { return stopping_; });
+  }
+}
+
+void media_migration_worker::apply_rule(const Json::Value& rule) {
+  std::string cursor;
+  do {
+    std::vector<std::string> seqs;
+    try {
+      cursor = scan_(rule, cursor, batch_size_, seqs);
+    } catch (const std::exception& e) {
+      errors_++;
+      std::cerr << "media_migration_worker: Failed to read the series to "
+                   "migrate: "
+                << e.what() << std::endl;
+      return;
+    } catch (...) {
+      errors_++;
+      std::cerr << "media_migration_worker: Failed to read the series to "
+                   "migrate"
+                << std::endl;
+      return;
+    }
+
+    for (const auto& seq : seqs) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_)
+          return;
+      }
+      std::int64_t files = 0;
+      std::int64_t bytes = 0;
+      try {
+        switch (migrate_(rule, seq, files, bytes)) {
+          case result::migrated:
+            migrated_++;
+            break;
+          case result::skipped:
+            skipped_++;
+            break;
+          case result::failed:
+            failed_++;
+            break;
+        }
+      } catch (const std::exception& e) {
+        errors_++;
+        std::cerr << "media_migration_worker: Failed to migrate the series "
+                  << seq << ": " << e.what() << std::endl;
+      } catch (...) {
+        errors_++;
+        std::cerr << "media_migration_worker: Failed to migrate the series "
+                  << seq << std::endl;
+      }
+      files_ += files;
+      bytes_ += bytes;
+    }
+  } while (!cursor.empty());
+}
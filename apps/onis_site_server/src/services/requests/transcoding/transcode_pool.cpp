@@ -0,0 +1,167 @@
+#include "../../../../include/services/requests/transcoding/transcode_pool.hpp"
+#include <algorithm>
+#include <exception>
+#include "onis_kit/include/core/exception.hpp"
+#include "onis_kit/include/core/result.hpp"
+
+////////////////////////////////////////////////////////////////////////////////
+// transcode_pool class
+////////////////////////////////////////////////////////////////////////////////
+
+//------------------------------------------------------------------------------
+// static constructor
+//------------------------------------------------------------------------------
+
+transcode_pool_ptr transcode_pool::create(std::uint32_t workers,
+                                          std::size_t max_pending) {
+  return std::make_shared<transcode_pool>(workers, max_pending);
+}
+
+//------------------------------------------------------------------------------
+// constructor
+//------------------------------------------------------------------------------
+
+transcode_pool::transcode_pool(std::uint32_t workers, std::size_t max_pending)
+    : workers_count_(std::min<std::uint32_t>(workers, 256)),
+      max_pending_(std::max<std::size_t>(max_pending, 1)) {}
+
+//------------------------------------------------------------------------------
+// destructor
+//------------------------------------------------------------------------------
+
+transcode_pool::~transcode_pool() {
+  stop();
+}
+
+//------------------------------------------------------------------------------
+// lifecycle
+//------------------------------------------------------------------------------
+
+bool transcode_pool::is_enabled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !workers_.empty() && !stopping_;
+}
+
+void transcode_pool::start() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stopping_ = false;
+  for (std::uint32_t i = 0; i < workers_count_; i++)
+    workers_.emplace_back(&transcode_pool::worker, this);
+}
+
+void transcode_pool::stop() {
+  std::vector<std::thread> workers;
+  std::deque<std::shared_ptr<job>> pending;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    workers.swap(workers_);
+    pending.swap(pending_);
+  }
+  cv_.notify_all();
+  // the waiting requests fail, the running transcodings are completed:
+  for (auto& item : pending)
+    item->done.set_exception(std::make_exception_ptr(
+        onis::exception(EOS_NOT_AVAILABLE, "Service stopped")));
+  for (auto& th : workers) {
+    if (th.get_id() == std::this_thread::get_id())
+      th.detach();
+    else if (th.joinable())
+      th.join();
+  }
+}
+
+//------------------------------------------------------------------------------
+// execution
+//------------------------------------------------------------------------------
+
+std::chrono::microseconds transcode_pool::run(const task_fn& task) {
+  auto item = std::make_shared<job>();
+  item->task = task;
+  item->queued = std::chrono::steady_clock::now();
+  std::future<void> done = item->done.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (workers_.empty() || stopping_)
+      throw onis::exception(EOS_NOT_AVAILABLE, "Transcoding not available");
+    if (pending_.size() >= max_pending_) {
+      rejected_++;
+      throw onis::exception(EOS_BUSY, "Too many transcodings pending");
+    }
+    pending_.push_back(item);
+  }
+  cv_.notify_one();
+  done.get();
+  return item->duration;
+}
+
+//------------------------------------------------------------------------------
+// statistics
+//------------------------------------------------------------------------------
+
+void transcode_pool::get_statistics(Json::Value& output) const {
+  std::uint64_t completed = completed_;
+  std::uint64_t failed = failed_;
+  std::uint64_t count = completed + failed;
+  output["completed"] = static_cast<Json::UInt64>(completed);
+  output["failed"] = static_cast<Json::UInt64>(failed);
+  output["rejected"] = static_cast<Json::UInt64>(rejected_);
+  output["average_ms"] =
+      count > 0 ? static_cast<double>(total_us_) / count / 1000.0 : 0.0;
+  output["average_wait_ms"] =
+      count > 0 ? static_cast<double>(wait_us_) / count / 1000.0 : 0.0;
+  std::lock_guard<std::mutex> lock(mutex_);
+  output["workers"] = static_cast<Json::UInt>(workers_.size());
+  output["pending"] = static_cast<Json::UInt64>(pending_.size());
+  output["running"] = static_cast<Json::UInt64>(running_);
+  output["max_ms"] = static_cast<double>(max_us_) / 1000.0;
+}
+
+//------------------------------------------------------------------------------
+// workers
+//------------------------------------------------------------------------------
+
+void transcode_pool::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+    if (stopping_)
+      break;
+    std::shared_ptr<job> item = pending_.front();
+    pending_.pop_front();
+    running_++;
+    lock.unlock();
+
+    auto start = std::chrono::steady_clock::now();
+    std::exception_ptr error;
+    try {
+      item->task();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    auto end = std::chrono::steady_clock::now();
+    item->duration =
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    record(std::chrono::duration_cast<std::chrono::microseconds>(
+               start - item->queued),
+           item->duration);
+    if (error) {
+      failed_++;
+      item->done.set_exception(error);
+    } else {
+      completed_++;
+      item->done.set_value();
+    }
+
+    lock.lock();
+    running_--;
+  }
+}
+
+void transcode_pool::record(std::chrono::microseconds wait,
+                            std::chrono::microseconds duration) {
+  total_us_ += duration.count();
+  wait_us_ += wait.count();
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_us_ = std::max<std::int64_t>(max_us_, duration.count());
+}
@@ -85,7 +85,7 @@ bool site_api::initialize(const std::string& config_file_path) {
     }
 
     // Initialize request service
-    request_service_ = request_service::create();
+    request_service_ = request_service::create(config_service_);
     if (!request_service_) {
       std::cerr << "site_api: Failed to create request service" << std::endl;
       return false;
@@ -127,8 +127,9 @@ void site_api::shutdown() {
       http_server_.reset();
     }
 
-    // Shutdown request service
+    // Shutdown request service (the running imports are completed)
     if (request_service_) {
+      request_service_->stop();
       request_service_.reset();
     }
 
@@ -34,6 +34,7 @@ namespace onis {
 #define EOS_DB_TRANSACTION_ROLLBACK 57
 #define EOS_DB_CONSISTENCY 58
 #define EOS_DB_UPDATE 59
+#define EOS_DB_RETRY 60  // deadlock or serialization failure
 
 // others:
 #define EOS_UNKNOWN 100
@@ -2408,10 +2408,19 @@ public:
   dicom_file(dicom_file&&) = delete;
   dicom_file& operator=(dicom_file&&) = delete;
 
-  // loading:
+  // loading (retry_interval and limit are not used by the DCMTK
+  // implementation, the file is loaded once):
   virtual bool load_file(const std::string& path,
                          std::int32_t retry_interval = 0,
                          std::int32_t limit = 0) = 0;
+  // load_file already leaves the values longer than 4096 bytes (the pixel
+  // data) in the file, this lowers the threshold to max_read_length so
+  // that the medium values (LUT, overlay and icon data, long texts) are
+  // not read either. 256 bytes covers the attributes that are indexed, the
+  // longer ones are loaded from the file when they are accessed, which
+  // needs the file to stay at its path while the dataset is in use:
+  virtual bool load_file_metadata(const std::string& path,
+                                  std::uint32_t max_read_length = 256) = 0;
   virtual bool is_loaded() const = 0;
 
   // closing:
@@ -1,8 +1,11 @@
 
 #include "./bitmap_linux.hpp"
 #include <png.h>
+#include <csetjmp>
 #include <cstdio>
 #include <cstring>
+#include <vector>
+#include <jpeglib.h>
 #include "../../../include/utilities/filesystem.hpp"
 
 namespace onis::core {
@@ -178,8 +181,84 @@ bool bitmap_linux::save_file(const std::string& full_path, BitmapType type) {
       }
     }
     png_destroy_write_struct(&png_ptr, NULL);
+  } else if (type == BitmapType::Jpg) {
+    ret = save_jpeg_file(full_path);
   }
   return ret;
 }
 
+///////////////////////////////////////////////////////////////////////
+// jpeg
+///////////////////////////////////////////////////////////////////////
+
+// quality of the saved jpeg files:
+static const int kJpegQuality = 90;
+
+// libjpeg reports the errors through a callback that must not return:
+struct jpeg_error_handler {
+  jpeg_error_mgr manager;
+  std::jmp_buf jump;
+};
+
+static void on_jpeg_error(j_common_ptr cinfo) {
+  std::longjmp(reinterpret_cast<jpeg_error_handler*>(cinfo->err)->jump, 1);
+}
+
+bool bitmap_linux::save_jpeg_file(const std::string& full_path) {
+  std::size_t components = 0;
+  switch (_pixel_format) {
+    case PixelFormat::Rgb24:
+      components = 3;
+      break;
+    case PixelFormat::Argb32:
+    case PixelFormat::Rgba32:
+      components = 4;
+      break;
+    default:
+      return false;
+  };
+  if (_raw_data == nullptr || _width == 0 || _height == 0)
+    return false;
+
+  FILE* fp = fopen(full_path.data(), "wb");
+  if (fp == nullptr)
+    return false;
+
+  // the alpha channel is dropped (same memory order as for png):
+  std::vector<std::uint8_t> row(_width * 3);
+  jpeg_compress_struct cinfo;
+  jpeg_error_handler error;
+  cinfo.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = on_jpeg_error;
+  bool ret = false;
+  if (!setjmp(error.jump)) {
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, fp);
+    cinfo.image_width = static_cast<JDIMENSION>(_width);
+    cinfo.image_height = static_cast<JDIMENSION>(_height);
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, kJpegQuality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+      std::uint8_t* pix_ptr = _raw_data + cinfo.next_scanline * _stride;
+      if (components == 4) {
+        for (std::size_t x = 0; x < _width; x++)
+          memcpy(&row[x * 3], pix_ptr + x * 4, 3);
+        pix_ptr = row.data();
+      }
+      JSAMPROW row_ptr = pix_ptr;
+      jpeg_write_scanlines(&cinfo, &row_ptr, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    ret = true;
+  }
+  jpeg_destroy_compress(&cinfo);
+  fclose(fp);
+  if (!ret)
+    onis::util::filesystem::delete_file(full_path);
+  return ret;
+}
+
 }  // namespace onis::core
\ No newline at end of file
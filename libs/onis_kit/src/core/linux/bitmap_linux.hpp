@@ -47,6 +47,8 @@ public:
   bool _locked;
 
 private:
+  bool save_jpeg_file(const std::string& full_path);
+
   mutable std::recursive_mutex _mutex;
 };
 
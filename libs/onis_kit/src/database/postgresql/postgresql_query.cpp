@@ -9,6 +9,13 @@
 namespace onis_kit {
 namespace database {
 
+// deadlock or serialization failure: the transaction can be run again.
+static bool is_transient_failure(const PGresult* result) {
+  const char* state = PQresultErrorField(result, PG_DIAG_SQLSTATE);
+  return state != nullptr && (std::string(state) == "40P01" ||
+                              std::string(state) == "40001");
+}
+
 postgresql_query::postgresql_query(PGconn* connection)
     : connection_(connection), prepared_(false) {}
 
@@ -39,8 +46,10 @@ std::unique_ptr<database_result> postgresql_query::execute() {
         PQresultStatus(result) != PGRES_COMMAND_OK) {
       set_last_error("Query execution failed: " +
                      std::string(PQresultErrorMessage(result)));
+      bool transient = is_transient_failure(result);
       PQclear(result);
-      throw onis::exception(EOS_DB_QUERY, last_error_);
+      throw onis::exception(transient ? EOS_DB_RETRY : EOS_DB_QUERY,
+                            last_error_);
     }
 
     auto db_result = std::make_unique<postgresql_result>(result);
@@ -54,7 +63,10 @@ std::unique_ptr<database_result> postgresql_query::execute() {
       PQresultStatus(result) != PGRES_COMMAND_OK) {
     set_last_error("Query execution failed: " +
                    std::string(PQresultErrorMessage(result)));
+    bool transient = is_transient_failure(result);
     PQclear(result);
+    if (transient)
+      throw onis::exception(EOS_DB_RETRY, last_error_);
     throw std::runtime_error(last_error_);
   }
 
@@ -84,7 +96,10 @@ std::unique_ptr<database_result> postgresql_query::execute(
       PQresultStatus(result) != PGRES_COMMAND_OK) {
     set_last_error("Query execution failed: " +
                    std::string(PQresultErrorMessage(result)));
+    bool transient = is_transient_failure(result);
     PQclear(result);
+    if (transient)
+      throw onis::exception(EOS_DB_RETRY, last_error_);
     throw std::runtime_error(last_error_);
   }
 
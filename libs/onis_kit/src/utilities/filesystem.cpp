@@ -1,4 +1,6 @@
 #include "../../include/utilities/filesystem.hpp"
+#include <fcntl.h>
+#include <unistd.h>
 #include <algorithm>
 #include <filesystem>
 #include <fstream>
@@ -266,4 +268,27 @@ std::int64_t get_file_size(const std::string& file_path) {
   }
 }
 
+// Flush the content of a file to the disk:
+bool sync_file(const std::string& file_path) {
+  int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+
+// Flush the entries of a directory to the disk, so that the files created or
+// renamed in it survive a power loss:
+bool sync_directory(const std::string& dir) {
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = ::fsync(fd) == 0;
+  ::close(fd);
+  return synced;
+}
+
 }  // namespace onis::util::filesystem
\ No newline at end of file
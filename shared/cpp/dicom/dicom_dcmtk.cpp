@@ -1,11 +1,13 @@
 #include "./dicom_dcmtk.hpp"
 #include <png.h>
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <random>
 #include <sstream>
+#include <vector>
 #include "../../../libs/onis_kit/include/core/result.hpp"
 #include "../../../libs/onis_kit/include/utilities/dicom.hpp"
 #include "../../../libs/onis_kit/include/utilities/filesystem.hpp"
@@ -36,6 +38,50 @@ void dcmtk_png_write_data(png_structp png_ptr, png_bytep data,
 
 void dcmtk_png_flush(png_structp) {}
 
+// Fragment items of an encapsulated pixel data element. The positions are
+// relative to the header of the first fragment, "base" is its file position.
+struct dcmtk_fragment_layout {
+  std::uint64_t base{0};
+  std::vector<std::uint64_t> starts;
+  std::vector<std::uint64_t> lengths;
+};
+
+DcmPixelSequence* dcmtk_get_pixel_sequence(DcmPixelData* dpix) {
+  E_TransferSyntax xfer = EXS_Unknown;
+  const DcmRepresentationParameter* param = nullptr;
+  dpix->getOriginalRepresentationKey(xfer, param);
+  if (xfer == EXS_Unknown || !DcmXfer(xfer).isEncapsulated())
+    return nullptr;
+  DcmPixelSequence* pixSeq = nullptr;
+  if (dpix->getEncapsulatedRepresentation(xfer, param, pixSeq).bad())
+    return nullptr;
+  return pixSeq;
+}
+
+bool dcmtk_get_fragment_layout(DcmPixelSequence* pixSeq,
+                               dcmtk_fragment_layout& layout) {
+  std::uint64_t position = 0;
+  bool found_base = false;
+  for (unsigned long i = 1; i < pixSeq->card(); i++) {
+    DcmPixelItem* item = nullptr;
+    if (pixSeq->getItem(item, i).bad() || item == nullptr)
+      return false;
+    // small fragments are read in memory and have no file position, so the
+    // base is computed from the first fragment that was left on disk:
+    std::uint64_t value_offset = item->GetfLoadValueoffset();
+    if (!found_base && value_offset != 0) {
+      if (value_offset < position + 8)
+        return false;
+      layout.base = value_offset - 8 - position;
+      found_base = true;
+    }
+    layout.starts.push_back(position);
+    layout.lengths.push_back(item->getLength());
+    position += 8 + item->getLength();
+  }
+  return found_base;
+}
+
 }  // namespace
 
 void dcmtk_init() {
@@ -1860,6 +1906,18 @@ dicom_dcmtk_file::~dicom_dcmtk_file() {
 bool dicom_dcmtk_file::load_file(const std::string& path,
                                  std::int32_t retry_interval,
                                  std::int32_t limit) {
+  return load(path, DCM_MaxReadLength);
+}
+
+bool dicom_dcmtk_file::load_file_metadata(const std::string& path,
+                                          std::uint32_t max_read_length) {
+  // DCMTK skips the values longer than the maximum read length (4096 bytes
+  // for load_file) and keeps their position in the file:
+  return load(path, max_read_length);
+}
+
+bool dicom_dcmtk_file::load(const std::string& path,
+                            std::uint32_t max_read_length) {
   bool loaded = false;
 
   // prevent concurrency access:
@@ -1874,7 +1932,8 @@ bool dicom_dcmtk_file::load_file(const std::string& path,
   // try to load the dicom file:
   _file = new DcmFileFormat;
   is_mpeg_frame_ = false;
-  OFCondition status = _file->loadFile(file_path.data());
+  OFCondition status = _file->loadFile(file_path.data(), EXS_Unknown,
+                                       EGL_noChange, max_read_length);
   if (status.good()) {
     // file was loaded !
     //_path = utf8_path;
@@ -2713,234 +2772,162 @@ bool dicom_dcmtk_file::remove_private_tags_with_pixel_data() {
 //-----------------------------------------------------------------------
 bool dicom_dcmtk_file::get_pixel_data_positions(std::uint64_t* start,
                                                 std::uint64_t* end) {
-  bool res = false;
-  /*_mutex.lock();
-  if (_file != nullptr) {
-    if (_file->getDataset() && _file->getMetaInfo()) {
-      OFString current_transfer;
-      OFCondition status = _file->getMetaInfo()->findAndGetOFStringArray(
-          DCM_TransferSyntaxUID, current_transfer);
-      if (status == EC_Normal) {
-        DcmElement* delem = nullptr;
-        if (_file->getDataset()
-                ->findAndGetElement(DCM_PixelData, delem, OFFalse)
-                .good()) {
-          DcmPixelData* dpix = OFstatic_cast(DcmPixelData*, delem);
-          E_TransferSyntax xfer = EXS_Unknown;
-          const DcmRepresentationParameter* param = nullptr;
-          dpix->getOriginalRepresentationKey(xfer, param);
-          if ((xfer != EXS_Unknown) && DcmXfer(xfer).isEncapsulated()) {
-            DcmPixelSequence* pixSeq = nullptr;
-            if (dpix->getEncapsulatedRepresentation(xfer, param, pixSeq)
-                    .good() &&
-                (pixSeq != nullptr)) {
-              std::uint32_t seqlen = pixSeq->card();
-              bool get_start_pos = false;
-              if (end)
-                *end = 0;
-              for (std::uint32_t i = 0; i < seqlen; i++) {
-                DcmPixelItem* item;
-                if (pixSeq->getItem(item, i).good()) {
-                  unsigned long len = item->getLength();
-                  if (len > 0) {
-                    std::uint64_t fposstart = item->GetfLoadValueoffset();
-                    std::uint64_t fposend = fposstart + len;
-
-                    if (!get_start_pos) {
-                      if (start)
-                        *start = fposstart;
-                      if (end)
-                        *end = fposend;
-                      get_start_pos = true;
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (_file == nullptr || _file->getDataset() == nullptr)
+    return false;
 
-                    } else {
-                      if (end)
-                        *end += (8 + len);
-                    }
+  DcmElement* delem = nullptr;
+  if (_file->getDataset()
+          ->findAndGetElement(DCM_PixelData, delem, OFFalse)
+          .bad())
+    return false;
 
-                    res = true;
-                    // break;
-                  }
-                }
-              }
-            }
-          }
-        }
-      }
-    }
+  std::uint64_t first = 0;
+  std::uint64_t last = 0;
+  DcmPixelData* dpix = OFstatic_cast(DcmPixelData*, delem);
+  DcmPixelSequence* pixSeq = dcmtk_get_pixel_sequence(dpix);
+  if (pixSeq != nullptr) {
+    dcmtk_fragment_layout layout;
+    if (!dcmtk_get_fragment_layout(pixSeq, layout))
+      return false;
+    first = layout.base + layout.starts.front() + 8;
+    last = layout.base + layout.starts.back() + 8 + layout.lengths.back();
+
+  } else {
+    // the value was read in memory if it has no file position:
+    first = delem->GetfLoadValueoffset();
+    if (first == 0)
+      return false;
+    last = first + delem->getLength();
   }
-  _mutex.unlock();*/
-  return res;
+
+  if (start)
+    *start = first;
+  if (end)
+    *end = last;
+  return true;
 }
 
 onis::dicom_frame_offsets* dicom_dcmtk_file::get_pixel_data_positions(
     std::int32_t& count) {
   // init the output
-  onis::dicom_frame_offsets* offsets = nullptr;
   count = 0;
 
-  /*_mutex.lock();
-  if (_file != nullptr) {
-    if (_file->getDataset() && _file->getMetaInfo()) {
-      OFString current_transfer;
-      OFCondition status = _file->getMetaInfo()->findAndGetOFStringArray(
-          DCM_TransferSyntaxUID, current_transfer);
-      if (status == EC_Normal) {
-        DcmElement* delem = nullptr;
-        if (_file->getDataset()
-                ->findAndGetElement(DCM_PixelData, delem, OFFalse)
-                .good()) {
-          DcmPixelData* dpix = OFstatic_cast(DcmPixelData*, delem);
-          E_TransferSyntax xfer = EXS_Unknown;
-          const DcmRepresentationParameter* param = nullptr;
-          dpix->getOriginalRepresentationKey(xfer, param);
-          if ((xfer != EXS_Unknown) && DcmXfer(xfer).isEncapsulated()) {
-            DcmPixelSequence* pixSeq = nullptr;
-            if (dpix->getEncapsulatedRepresentation(xfer, param, pixSeq)
-                    .good() &&
-                (pixSeq != nullptr)) {
-              std::uint32_t seqlen = pixSeq->card();
-              if (seqlen >= 2) {
-                std::uint64_t goffset = 0;
-                DcmPixelItem* item1;
-                if (pixSeq->getItem(item1, 1).good())
-                  goffset = item1->GetfLoadValueoffset() - 8;
-
-                // get the basic offset table information:
-                DcmPixelItem* item;
-                if (pixSeq->getItem(item, 0).good()) {
-                  Uint8* table8 = nullptr;
-                  unsigned long len = item->getLength();
-                  bool valid = true;
-                  if (len == 0) {
-                    // there should be only one frame!
-                    std::int32_t fragment_count = seqlen - 1;
-                    if (fragment_count > 0) {
-                      count = 1;
-                      offsets = new onis::dicom_frame_offsets[count];
-                      offsets[0].count = fragment_count;
-                      offsets[0].offsets =
-                          new std::uint64_t[fragment_count * 2];
-
-                      // first fragment offsets:
-                      offsets[0].offsets[0] = 0;
-                      if (pixSeq->getItem(item, 1).good())
-                        offsets[0].offsets[1] =
-                            offsets[0].offsets[0] + 8 + item->getLength();
-                      else
-                        valid = false;
+  std::lock_guard<std::recursive_mutex> lock(_mutex);
+  if (_file == nullptr || _file->getDataset() == nullptr)
+    return nullptr;
+  DcmDataset* dataset = _file->getDataset();
 
-                      // additional fragment offsets:
-                      for (std::int32_t j = 2; j < seqlen; j++) {
-                        if (pixSeq->getItem(item, j).good()) {
-                          offsets[0].offsets[j * 2] =
-                              offsets[0].offsets[(j - 1) * 2 + 1];
-                          offsets[0].offsets[j * 2 + 1] =
-                              offsets[0].offsets[j * 2] + 8 +
-  item->getLength();
+  DcmElement* delem = nullptr;
+  if (dataset->findAndGetElement(DCM_PixelData, delem, OFFalse).bad())
+    return nullptr;
 
-                        } else {
-                          valid = false;
-                          break;
-                        }
-                      }
-                    }
+  long frame_count = 1;
+  dataset->findAndGetLongInt(DCM_NumberOfFrames, frame_count);
+  if (frame_count < 1)
+    frame_count = 1;
+
+  // value ranges (first byte, last byte) of the fragments of each frame:
+  std::vector<std::vector<std::uint64_t>> frames;
+  DcmPixelData* dpix = OFstatic_cast(DcmPixelData*, delem);
+  DcmPixelSequence* pixSeq = dcmtk_get_pixel_sequence(dpix);
+  if (pixSeq != nullptr) {
+    dcmtk_fragment_layout layout;
+    if (!dcmtk_get_fragment_layout(pixSeq, layout))
+      return nullptr;
+    std::size_t fragment_count = layout.starts.size();
 
-                  } else if (len != 0 && len % 4 == 0 &&
-                             item->loadAllDataIntoMemory().good() &&
-                             item->getUint8Array(table8).good()) {
-                    count = len / 4;
-                    Uint32* table = (Uint32*)table8;
-                    offsets = new onis::dicom_frame_offsets[count];
-                    std::int32_t index = 1;
-                    for (std::int32_t i = 0; i < count; i++) {
-                      // how many fragments make the frame?
-                      std::int32_t fragment_count = 0;
-                      if (i == count - 1) {
-                        // the last frame use all remaining fragments:
-                        fragment_count = seqlen - index;
-
-                      } else {
-                        // need to count until reaching the beginning of the
-                        // next frame:
-                        std::uint32_t next_frame_position = table[i + 1];
-                        std::uint32_t start_pos = table[i];
-                        std::uint32_t cur_pos = start_pos;
-                        for (std::int32_t j = index; j < seqlen; j++) {
-                          if (pixSeq->getItem(item, j).good()) {
-                            cur_pos += 8 + item->getLength();
-                            if (cur_pos >= next_frame_position) {
-                              if (cur_pos == next_frame_position)
-                                fragment_count++;
-                              break;
-
-                            } else
-                              fragment_count++;
-
-                          } else {
-                            // problem!
-                            fragment_count = 0;
-                            break;
-                          }
-                        }
-                      }
-                      if (fragment_count <= 0)
-                        valid = false;
-                      else {
-                        offsets[i].count = fragment_count;
-                        offsets[i].offsets =
-                            new std::uint64_t[fragment_count * 2];
-
-                        // first fragment offsets:
-                        offsets[i].offsets[0] = table[i];
-                        if (pixSeq->getItem(item, index).good())
-                          offsets[i].offsets[1] =
-                              offsets[i].offsets[0] + 8 + item->getLength();
-                        else
-                          valid = false;
-
-                        // additional fragment offsets:
-                        for (std::int32_t j = 1; j < fragment_count; j++) {
-                          if (pixSeq->getItem(item, index + j).good()) {
-                            offsets[i].offsets[j * 2] =
-                                offsets[i].offsets[(j - 1) * 2 + 1];
-                            offsets[i].offsets[j * 2 + 1] =
-                                offsets[i].offsets[j * 2] + 8 +
-                                item->getLength();
-
-                          } else
-                            valid = false;
-                        }
-                        index += fragment_count;
-                      }
-                      if (!valid)
-                        break;
-                    }
-                  }
+    // index of the first fragment of each frame:
+    std::vector<std::size_t> first_fragments;
+    DcmPixelItem* table_item = nullptr;
+    if (pixSeq->getItem(table_item, 0).bad() || table_item == nullptr)
+      return nullptr;
+    unsigned long table_length = table_item->getLength();
+    Uint8* table8 = nullptr;
+    if (table_length != 0 && table_length % 4 == 0 &&
+        table_item->loadAllDataIntoMemory().good() &&
+        table_item->getUint8Array(table8).good() && table8 != nullptr) {
+      // the basic offset table gives the position of each frame, relative to
+      // the first fragment (always little endian):
+      std::size_t fragment = 0;
+      for (unsigned long i = 0; i < table_length / 4; i++) {
+        const Uint8* entry = table8 + i * 4;
+        std::uint64_t position = static_cast<std::uint64_t>(entry[0]) |
+                                 (static_cast<std::uint64_t>(entry[1]) << 8) |
+                                 (static_cast<std::uint64_t>(entry[2]) << 16) |
+                                 (static_cast<std::uint64_t>(entry[3]) << 24);
+        while (fragment < fragment_count && layout.starts[fragment] < position)
+          fragment++;
+        if (fragment == fragment_count || layout.starts[fragment] != position)
+          return nullptr;
+        first_fragments.push_back(fragment);
+      }
 
-                  if (valid) {
-                    // correct the offsets:
-                    for (std::int32_t i = 0; i < count; i++) {
-                      for (std::int32_t j = 0; j < offsets[i].count; j++) {
-                        offsets[i].offsets[j * 2] += 8 + goffset;
-                        offsets[i].offsets[j * 2 + 1] += goffset - 1;
-                      }
-                    }
+    } else if (frame_count == 1) {
+      // single frame, all the fragments belong to it:
+      first_fragments.push_back(0);
 
-                  } else {
-                    delete[] offsets;
-                    count = 0;
-                    offsets = nullptr;
-                  }
-                }
-              }
-            }
-          }
-        }
+    } else if (static_cast<std::size_t>(frame_count) == fragment_count) {
+      // no offset table, but one fragment per frame:
+      for (std::size_t i = 0; i < fragment_count; i++)
+        first_fragments.push_back(i);
+
+    } else
+      return nullptr;
+
+    for (std::size_t i = 0; i < first_fragments.size(); i++) {
+      std::size_t next = i + 1 < first_fragments.size() ? first_fragments[i + 1]
+                                                        : fragment_count;
+      if (next <= first_fragments[i])
+        return nullptr;
+      std::vector<std::uint64_t>& ranges = frames.emplace_back();
+      for (std::size_t j = first_fragments[i]; j < next; j++) {
+        if (layout.lengths[j] == 0)
+          continue;
+        std::uint64_t value_start = layout.base + layout.starts[j] + 8;
+        ranges.push_back(value_start);
+        ranges.push_back(value_start + layout.lengths[j] - 1);
       }
+      if (ranges.empty())
+        return nullptr;
+    }
+
+  } else {
+    // native pixel data, the frames are contiguous and have the same size:
+    std::uint64_t value_start = delem->GetfLoadValueoffset();
+    if (value_start == 0)
+      return nullptr;
+    Uint16 rows = 0, columns = 0, samples = 1, bits = 0;
+    dataset->findAndGetUint16(DCM_Rows, rows);
+    dataset->findAndGetUint16(DCM_Columns, columns);
+    dataset->findAndGetUint16(DCM_SamplesPerPixel, samples);
+    dataset->findAndGetUint16(DCM_BitsAllocated, bits);
+    std::uint64_t frame_bits = static_cast<std::uint64_t>(rows) * columns *
+                               samples * bits;
+    // frames of single bit images may not start on a byte boundary:
+    if (frame_bits == 0 || frame_bits % 8 != 0)
+      return nullptr;
+    std::uint64_t frame_size = frame_bits / 8;
+    if (frame_size * static_cast<std::uint64_t>(frame_count) >
+        delem->getLength())
+      return nullptr;
+    for (long i = 0; i < frame_count; i++) {
+      std::vector<std::uint64_t>& ranges = frames.emplace_back();
+      ranges.push_back(value_start + i * frame_size);
+      ranges.push_back(value_start + (i + 1) * frame_size - 1);
     }
   }
-  _mutex.unlock();*/
+
+  if (frames.empty())
+    return nullptr;
+  onis::dicom_frame_offsets* offsets =
+      new onis::dicom_frame_offsets[frames.size()];
+  for (std::size_t i = 0; i < frames.size(); i++) {
+    offsets[i].count = static_cast<std::int32_t>(frames[i].size() / 2);
+    offsets[i].offsets = new std::uint64_t[frames[i].size()];
+    std::copy(frames[i].begin(), frames[i].end(), offsets[i].offsets);
+  }
+  count = static_cast<std::int32_t>(frames.size());
   return offsets;
 }
 
@@ -3749,7 +3736,7 @@ void dcmtk_dicom_frame::set_window_level(double center, double width) {
 
 bool dcmtk_dicom_frame::get_window_level(double* center, double* width) const {
   std::lock_guard<std::recursive_mutex> lock(_mutex);
-  if (_window_level_valid)
+  if (!_window_level_valid)
     return false;
   *center = _window_center;
   *width = _window_width;
@@ -204,6 +204,8 @@ public:
   // bool load_file(const std::string &utf8_path);
   bool load_file(const std::string& path, std::int32_t retry_interval,
                  std::int32_t limit);
+  bool load_file_metadata(const std::string& path,
+                          std::uint32_t max_read_length);
   bool is_loaded() const;
 
   // properties:
@@ -259,6 +261,8 @@ public:
   bool remove_private_tags_with_pixel_data();
 
 protected:
+  bool load(const std::string& path, std::uint32_t max_read_length);
+
   bool is_loaded_{false};
   bool is_temporary_file_{false};
   std::string path_{""};